@@ -0,0 +1,556 @@
+/*
+Measures how fast the stitching and conversion functions are, so tuning changes can be judged by numbers instead of guesses.
+
+Every function is run over a matrix of image sizes (VGA up to 12 MP), pixel formats, and camera counts.
+For each combination it reports the time per frame, the throughput (bytes read + bytes written per second), and the allocations per call.
+The results can also be written as .csv and/or .json, to compare them between commits.
+
+Usage: StitchBenchmark [--quick] [--csv results.csv] [--json results.json] [--filter name]
+  --quick   only VGA and 5 MP, and a shorter measuring time (eg: for a quick check before committing)
+  --filter  only run the benchmarks whose name contains this text
+
+Author: mbreit
+
+*/
+
+// Include files to use the PYLON API
+#include <pylon/PylonIncludes.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <StitchImage.h>
+#include <StitchKernels.h>
+
+// Namespace for using pylon objects.
+using namespace Pylon;
+
+// Namespace for using cout.
+using namespace std;
+
+#ifndef BENCHMARK_GIT_COMMIT
+#define BENCHMARK_GIT_COMMIT "unknown" // the Makefile passes in the current commit
+#endif
+
+// ******************************* Benchmark settings **********************************
+struct Resolution
+{
+	const char *name;
+	uint32_t width;
+	uint32_t height;
+};
+const Resolution c_resolutions[] = { { "VGA", 640, 480 }, { "1.3MP", 1280, 1024 }, { "2.3MP", 1920, 1200 }, { "5MP", 2448, 2048 }, { "12MP", 4096, 3000 } };
+const EPixelType c_pixelFormats[] = { PixelType_Mono8, PixelType_Mono12p, PixelType_Mono16 };
+const int c_cameraCounts[] = { 2, 4, 9 };
+const double c_minMeasuringTime = 0.5; // seconds per benchmark (at least c_minIterations)
+const double c_quickMeasuringTime = 0.1;
+const int c_minIterations = 5;
+const int c_warmupIterations = 2; // not measured: the first calls allocate the destination images
+const uint64_t c_maxImageBytes = 512ull * 1024 * 1024; // skip combinations that would need bigger images than this
+// *************************************************************************************
+
+// Every allocation through operator new is counted, to find per-call allocations in code that should reuse its buffers.
+static std::atomic<uint64_t> g_allocationCount(0);
+
+void *operator new(size_t size)
+{
+	g_allocationCount.fetch_add(1, std::memory_order_relaxed);
+	void *p = malloc(size > 0 ? size : 1);
+	if (p == NULL)
+		throw std::bad_alloc();
+	return p;
+}
+
+void *operator new[](size_t size)
+{
+	g_allocationCount.fetch_add(1, std::memory_order_relaxed);
+	void *p = malloc(size > 0 ? size : 1);
+	if (p == NULL)
+		throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void *p) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+	free(p);
+}
+
+struct BenchmarkResult
+{
+	std::string benchmark;
+	std::string resolution;
+	std::string pixelFormat;
+	int cameras = 0;
+	uint64_t iterations = 0;
+	double nsPerFrame = 0; // mean
+	double nsPerFrameMin = 0;
+	double gbPerSecond = 0; // (bytes read + bytes written) / mean time
+	double allocationsPerCall = 0;
+	double bufferReallocationsPerCall = 0; // the destination image got a different buffer (pylon may allocate image buffers without operator new)
+};
+
+struct Options
+{
+	bool quick = false;
+	std::string csvFileName;
+	std::string jsonFileName;
+	std::string filter;
+};
+
+const char *GetPixelFormatName(EPixelType pixelType)
+{
+	switch (pixelType)
+	{
+	case PixelType_Mono8:
+		return "Mono8";
+	case PixelType_Mono12p:
+		return "Mono12p";
+	case PixelType_Mono16:
+		return "Mono16";
+	default:
+		return "Other";
+	}
+}
+
+// Images with a recognizable pattern, as a camera would deliver them.
+void FillImage(CPylonImage &image, EPixelType pixelType, uint32_t width, uint32_t height, int seed)
+{
+	image.Reset(pixelType, width, height);
+	uint8_t *pBuffer = (uint8_t*)image.GetBuffer();
+	size_t size = image.GetImageSize();
+	for (size_t i = 0; i < size; i++)
+		pBuffer[i] = (uint8_t)(i * 7 + seed * 31);
+}
+
+// Runs work() until enough time has passed, and records the results.
+// bytesPerCall is what one call reads plus what it writes. pDestination (if not NULL) is watched for buffer reallocations.
+// errorMessage is where work() leaves its error. If work() fails, the benchmark is abandoned and the error reported, so a failing function is never timed.
+void Measure(const Options &options, std::vector<BenchmarkResult> &results, BenchmarkResult result, uint64_t bytesPerCall, CPylonImage *pDestination, const std::string &errorMessage, std::function<bool()> work)
+{
+	if (options.filter.empty() == false && result.benchmark.find(options.filter) == std::string::npos)
+		return;
+
+	for (int i = 0; i < c_warmupIterations; i++)
+	{
+		if (work() == false)
+		{
+			cout << "ERROR: " << result.benchmark << " failed, skipping it. " << errorMessage << endl;
+			return;
+		}
+	}
+
+	double measuringTime = options.quick ? c_quickMeasuringTime : c_minMeasuringTime;
+	uint64_t iterations = 0;
+	uint64_t bufferReallocations = 0;
+	double totalNs = 0;
+	double minNs = 1e300;
+	const void *pLastBuffer = (pDestination != NULL) ? pDestination->GetBuffer() : NULL;
+	uint64_t allocationsBefore = g_allocationCount.load();
+
+	while (iterations < (uint64_t)c_minIterations || totalNs < measuringTime * 1e9)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		bool succeeded = work();
+		std::chrono::steady_clock::time_point stop = std::chrono::steady_clock::now();
+
+		if (succeeded == false)
+		{
+			cout << "ERROR: " << result.benchmark << " failed after " << iterations << " iterations, skipping it. " << errorMessage << endl;
+			return;
+		}
+
+		double ns = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count();
+		totalNs += ns;
+		minNs = std::min(minNs, ns);
+		iterations++;
+
+		if (pDestination != NULL && pDestination->GetBuffer() != pLastBuffer)
+		{
+			bufferReallocations++;
+			pLastBuffer = pDestination->GetBuffer();
+		}
+	}
+
+	uint64_t allocations = g_allocationCount.load() - allocationsBefore;
+
+	result.iterations = iterations;
+	result.nsPerFrame = totalNs / iterations;
+	result.nsPerFrameMin = minNs;
+	result.gbPerSecond = (double)bytesPerCall / result.nsPerFrame; // bytes per ns = GB/s
+	result.allocationsPerCall = (double)allocations / iterations;
+	result.bufferReallocationsPerCall = (double)bufferReallocations / iterations;
+	results.push_back(result);
+
+	std::ios::fmtflags flags = cout.flags();
+	std::streamsize precision = cout.precision();
+	cout << std::left << std::setw(28) << result.benchmark << " " << std::setw(6) << result.resolution << " " << std::setw(8) << result.pixelFormat << " "
+		<< std::right << std::setw(3) << result.cameras << "  " << std::fixed << std::setprecision(0) << std::setw(12) << result.nsPerFrame << " ns/frame  "
+		<< std::setprecision(2) << std::setw(7) << result.gbPerSecond << " GB/s  " << std::setw(6) << result.allocationsPerCall << " allocs/call  "
+		<< std::setw(6) << result.bufferReallocationsPerCall << " reallocs/call" << endl;
+	cout.flags(flags);
+	cout.precision(precision);
+}
+
+void RunStitchBenchmarks(const Options &options, std::vector<BenchmarkResult> &results, const Resolution &resolution, EPixelType pixelType, int cameras)
+{
+	uint64_t imageBytes = StitchImage::GetRowBytes(pixelType, resolution.width) * resolution.height;
+	if (imageBytes * cameras * 2 > c_maxImageBytes)
+		return;
+
+	std::vector<CPylonImage> images(cameras);
+	for (int i = 0; i < cameras; i++)
+		FillImage(images[i], pixelType, resolution.width, resolution.height, i);
+
+	BenchmarkResult result;
+	result.resolution = resolution.name;
+	result.pixelFormat = GetPixelFormatName(pixelType);
+	result.cameras = cameras;
+
+	// A strip of all cameras side by side / on top of each other. The strips are reused from call to call, as the sample program does.
+	std::vector<CPylonImage> strips(cameras);
+	std::string errorMessage = "";
+
+	uint64_t stripBytes = 0; // each step reads the strip so far and one more image, and writes the longer strip
+	for (int i = 1; i < cameras; i++)
+		stripBytes += imageBytes * i + imageBytes + imageBytes * (i + 1);
+
+	result.benchmark = "StitchToRight";
+	Measure(options, results, result, stripBytes, &strips[cameras - 1], errorMessage, [&]() -> bool
+	{
+		CPylonImage *pLeft = &images[0];
+		for (int i = 1; i < cameras; i++)
+		{
+			if (StitchImage::StitchToRight(*pLeft, images[i], &strips[i], errorMessage) != 0)
+				return false;
+			pLeft = &strips[i];
+		}
+		return true;
+	});
+
+	result.benchmark = "StitchToBottom";
+	Measure(options, results, result, stripBytes, &strips[cameras - 1], errorMessage, [&]() -> bool
+	{
+		CPylonImage *pTop = &images[0];
+		for (int i = 1; i < cameras; i++)
+		{
+			if (StitchImage::StitchToBottom(*pTop, images[i], &strips[i], errorMessage) != 0)
+				return false;
+			pTop = &strips[i];
+		}
+		return true;
+	});
+
+	// A (nearly) square collage of all cameras, like a monitoring wall.
+	int collageWidth = 1;
+	while (collageWidth * collageWidth < cameras)
+		collageWidth++;
+	int collageHeight = (cameras + collageWidth - 1) / collageWidth;
+	int tiles = collageWidth * collageHeight;
+
+	for (int preallocated = 1; preallocated >= 0; preallocated--)
+	{
+		StitchImage::CollageMaker collageMaker;
+		collageMaker.SetWidth(collageWidth);
+		collageMaker.SetHeight(collageHeight);
+		collageMaker.SetPreallocatedCanvas(preallocated == 1);
+
+		result.benchmark = preallocated ? "StitchToCollage" : "StitchToCollage_Strips";
+		Measure(options, results, result, imageBytes * tiles * 2, NULL, errorMessage, [&]() -> bool
+		{
+			for (int i = 0; i < tiles; i++)
+			{
+				if (collageMaker.StitchToCollage(images[i % cameras], errorMessage) != 0)
+					return false;
+			}
+			return collageMaker.IsCollageComplete();
+		});
+	}
+
+	// All cameras in one go, the way the sample program stitches them (one row, or a grid).
+	std::vector<CPylonImage*> gridInputs(cameras);
+	for (int i = 0; i < cameras; i++)
+		gridInputs[i] = &images[i];
+	CPylonImage gridImage;
+
+	result.benchmark = "StitchToGrid_Row";
+	Measure(options, results, result, imageBytes * cameras * 2, &gridImage, errorMessage, [&]() -> bool
+	{
+		return StitchImage::StitchToGrid(gridInputs, cameras, &gridImage, errorMessage) == 0;
+	});
+
+	result.benchmark = "StitchToGrid";
+	Measure(options, results, result, imageBytes * cameras * 2, &gridImage, errorMessage, [&]() -> bool
+	{
+		return StitchImage::StitchToGrid(gridInputs, collageWidth, &gridImage, errorMessage) == 0;
+	});
+}
+
+void RunConversionBenchmarks(const Options &options, std::vector<BenchmarkResult> &results, const Resolution &resolution)
+{
+	// Stitching two Mono8 images and converting them to BGR for OpenCV, as the sample program does on Linux.
+	uint64_t imageBytes = (uint64_t)resolution.width * resolution.height;
+	CPylonImage leftImage;
+	CPylonImage rightImage;
+	FillImage(leftImage, PixelType_Mono8, resolution.width, resolution.height, 0);
+	FillImage(rightImage, PixelType_Mono8, resolution.width, resolution.height, 1);
+
+	BenchmarkResult result;
+	result.resolution = resolution.name;
+	result.pixelFormat = "Mono8";
+	result.cameras = 2;
+
+	CPylonImage stitchedImage;
+	CPylonImage convertedImage;
+	CImageFormatConverter converter;
+	converter.OutputPixelFormat = PixelType_BGR8packed;
+	std::string errorMessage = "";
+
+	result.benchmark = "StitchThenConvertToBGR8";
+	Measure(options, results, result, imageBytes * 2 + imageBytes * 2 + imageBytes * 2 + imageBytes * 6, &convertedImage, errorMessage, [&]() -> bool
+	{
+		if (StitchImage::StitchToRight(leftImage, rightImage, &stitchedImage, errorMessage) != 0)
+			return false;
+		converter.Convert(convertedImage, stitchedImage);
+		return true;
+	});
+
+	result.benchmark = "StitchToRightAsBGR8";
+	Measure(options, results, result, imageBytes * 2 + imageBytes * 6, &convertedImage, errorMessage, [&]() -> bool
+	{
+		return StitchImage::StitchToRightAsBGR8(leftImage, rightImage, &convertedImage, errorMessage) == 0;
+	});
+
+	// The kernels themselves, for each instruction set this CPU has.
+	std::vector<uint8_t> bgrRow((size_t)resolution.width * 3);
+	const uint8_t *pMono = (const uint8_t*)leftImage.GetBuffer();
+	StitchKernels::EInstructionSet instructionSet = StitchKernels::GetInstructionSet();
+
+	std::vector<std::pair<std::string, std::function<void(const uint8_t*, uint8_t*, int)>>> kernels;
+	kernels.push_back(std::make_pair(std::string("Mono8ToBGR8Row_Scalar"), StitchKernels::Mono8ToBGR8Row_Scalar));
+#ifdef STITCHKERNELS_X86
+	if (instructionSet >= StitchKernels::InstructionSet_SSSE3)
+		kernels.push_back(std::make_pair(std::string("Mono8ToBGR8Row_SSSE3"), StitchKernels::Mono8ToBGR8Row_SSSE3));
+	if (instructionSet >= StitchKernels::InstructionSet_AVX2)
+		kernels.push_back(std::make_pair(std::string("Mono8ToBGR8Row_AVX2"), StitchKernels::Mono8ToBGR8Row_AVX2));
+#endif
+
+	for (size_t k = 0; k < kernels.size(); k++)
+	{
+		result.benchmark = kernels[k].first;
+		result.cameras = 1;
+		std::function<void(const uint8_t*, uint8_t*, int)> &kernel = kernels[k].second;
+		Measure(options, results, result, imageBytes * 4, NULL, errorMessage, [&]() -> bool
+		{
+			for (uint32_t y = 0; y < resolution.height; y++)
+				kernel(&pMono[(size_t)y * resolution.width], bgrRow.data(), (int)resolution.width);
+			return true;
+		});
+	}
+
+	// Downscaling for the preview (2x2 and 4x4 box filter), of the stitched Mono8 image and of the BGR8 image converted for OpenCV, and while stitching.
+	CPylonImage downscaledImage;
+	if (StitchImage::StitchToRight(leftImage, rightImage, &stitchedImage, errorMessage) != 0 || StitchImage::StitchToRightAsBGR8(leftImage, rightImage, &convertedImage, errorMessage) != 0)
+	{
+		cout << errorMessage << endl;
+		return;
+	}
+	result.cameras = 2;
+	for (int factor = 2; factor <= 4; factor *= 2)
+	{
+		result.benchmark = "Downscale" + std::to_string(factor) + "x" + std::to_string(factor);
+		result.pixelFormat = "Mono8";
+		Measure(options, results, result, imageBytes * 2 + imageBytes * 2 / (factor * factor), &downscaledImage, errorMessage, [&]() -> bool
+		{
+			return StitchImage::Downscale(stitchedImage, factor, &downscaledImage, errorMessage) == 0;
+		});
+
+		result.pixelFormat = "BGR8";
+		Measure(options, results, result, imageBytes * 6 + imageBytes * 6 / (factor * factor), &downscaledImage, errorMessage, [&]() -> bool
+		{
+			return StitchImage::Downscale(convertedImage, factor, &downscaledImage, errorMessage) == 0;
+		});
+
+		// stitching and downscaling in one pass, instead of StitchToRight followed by Downscale
+		result.benchmark = "StitchToRightDecimated" + std::to_string(factor) + "x" + std::to_string(factor);
+		result.pixelFormat = "Mono8";
+		Measure(options, results, result, imageBytes * 2 + imageBytes * 2 / (factor * factor), &downscaledImage, errorMessage, [&]() -> bool
+		{
+			return StitchImage::StitchToRight(leftImage, StitchImage::Roi(), rightImage, StitchImage::Roi(), factor, &downscaledImage, errorMessage) == 0;
+		});
+	}
+	result.pixelFormat = "Mono8";
+	result.cameras = 1;
+
+	std::vector<uint8_t> downscaledRow((size_t)resolution.width / 2);
+	std::vector<std::pair<std::string, std::function<void(const uint8_t*, size_t, uint8_t*, int)>>> downscaleKernels;
+	downscaleKernels.push_back(std::make_pair(std::string("BoxDownscaleRow2x2_Scalar"), [](const uint8_t *pSource, size_t stride, uint8_t *pDestination, int width) { StitchKernels::BoxDownscaleRow_Scalar(pSource, stride, 1, 2, pDestination, width); }));
+#ifdef STITCHKERNELS_X86
+	if (instructionSet >= StitchKernels::InstructionSet_SSSE3)
+		downscaleKernels.push_back(std::make_pair(std::string("BoxDownscaleMono8Row2x2_SSSE3"), StitchKernels::BoxDownscaleMono8Row2x2_SSSE3));
+#endif
+
+	for (size_t k = 0; k < downscaleKernels.size(); k++)
+	{
+		result.benchmark = downscaleKernels[k].first;
+		std::function<void(const uint8_t*, size_t, uint8_t*, int)> &kernel = downscaleKernels[k].second;
+		Measure(options, results, result, imageBytes + imageBytes / 4, NULL, errorMessage, [&]() -> bool
+		{
+			for (uint32_t y = 0; y + 1 < resolution.height; y += 2)
+				kernel(&pMono[(size_t)y * resolution.width], resolution.width, downscaledRow.data(), (int)resolution.width / 2);
+			return true;
+		});
+	}
+
+	// Unpacking Mono12p, as StitchToRightUnpacked does.
+	CPylonImage packedImage;
+	FillImage(packedImage, PixelType_Mono12p, resolution.width, resolution.height, 2);
+	std::vector<uint16_t> unpackedRow(resolution.width);
+	size_t packedStride = StitchImage::GetStride(packedImage);
+	const uint8_t *pPacked = (const uint8_t*)packedImage.GetBuffer();
+
+	std::vector<std::pair<std::string, std::function<void(const uint8_t*, uint16_t*, int)>>> unpackKernels;
+	unpackKernels.push_back(std::make_pair(std::string("Unpack12pRow_Scalar"), StitchKernels::Unpack12pRow_Scalar));
+#ifdef STITCHKERNELS_X86
+	if (instructionSet >= StitchKernels::InstructionSet_SSSE3)
+		unpackKernels.push_back(std::make_pair(std::string("Unpack12pRow_SSSE3"), StitchKernels::Unpack12pRow_SSSE3));
+#endif
+
+	result.pixelFormat = "Mono12p";
+	for (size_t k = 0; k < unpackKernels.size(); k++)
+	{
+		result.benchmark = unpackKernels[k].first;
+		std::function<void(const uint8_t*, uint16_t*, int)> &kernel = unpackKernels[k].second;
+		Measure(options, results, result, packedStride * resolution.height + imageBytes * 2, NULL, errorMessage, [&]() -> bool
+		{
+			for (uint32_t y = 0; y < resolution.height; y++)
+				kernel(&pPacked[y * packedStride], unpackedRow.data(), (int)resolution.width);
+			return true;
+		});
+	}
+}
+
+void WriteCsv(const std::string &fileName, const std::vector<BenchmarkResult> &results)
+{
+	std::ofstream file(fileName.c_str());
+	file << "commit,instruction_set,benchmark,resolution,pixel_format,cameras,iterations,ns_per_frame,ns_per_frame_min,gb_per_s,allocs_per_call,buffer_reallocs_per_call\n";
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const BenchmarkResult &r = results[i];
+		file << BENCHMARK_GIT_COMMIT << "," << StitchKernels::GetInstructionSetName(StitchKernels::GetInstructionSet()) << ","
+			<< r.benchmark << "," << r.resolution << "," << r.pixelFormat << "," << r.cameras << "," << r.iterations << ","
+			<< r.nsPerFrame << "," << r.nsPerFrameMin << "," << r.gbPerSecond << "," << r.allocationsPerCall << "," << r.bufferReallocationsPerCall << "\n";
+	}
+}
+
+void WriteJson(const std::string &fileName, const std::vector<BenchmarkResult> &results)
+{
+	std::ofstream file(fileName.c_str());
+	file << "{\n";
+	file << "  \"commit\": \"" << BENCHMARK_GIT_COMMIT << "\",\n";
+	file << "  \"instruction_set\": \"" << StitchKernels::GetInstructionSetName(StitchKernels::GetInstructionSet()) << "\",\n";
+	file << "  \"results\": [\n";
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const BenchmarkResult &r = results[i];
+		file << "    { \"benchmark\": \"" << r.benchmark << "\", \"resolution\": \"" << r.resolution << "\", \"pixel_format\": \"" << r.pixelFormat
+			<< "\", \"cameras\": " << r.cameras << ", \"iterations\": " << r.iterations << ", \"ns_per_frame\": " << r.nsPerFrame
+			<< ", \"ns_per_frame_min\": " << r.nsPerFrameMin << ", \"gb_per_s\": " << r.gbPerSecond
+			<< ", \"allocs_per_call\": " << r.allocationsPerCall << ", \"buffer_reallocs_per_call\": " << r.bufferReallocationsPerCall << " }"
+			<< (i + 1 < results.size() ? "," : "") << "\n";
+	}
+	file << "  ]\n";
+	file << "}\n";
+}
+
+int main(int argc, char* argv[])
+{
+	// The exit code of the benchmark.
+	int exitCode = 0;
+
+	Options options;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string argument = argv[i];
+		if (argument == "--quick")
+			options.quick = true;
+		else if (argument == "--csv" && i + 1 < argc)
+			options.csvFileName = argv[++i];
+		else if (argument == "--json" && i + 1 < argc)
+			options.jsonFileName = argv[++i];
+		else if (argument == "--filter" && i + 1 < argc)
+			options.filter = argv[++i];
+		else
+		{
+			cerr << "Usage: " << argv[0] << " [--quick] [--csv results.csv] [--json results.json] [--filter name]" << endl;
+			return 1;
+		}
+	}
+
+	// Before using any pylon methods, the pylon runtime must be initialized.
+	PylonInitialize();
+
+	try
+	{
+		cout << "Commit: " << BENCHMARK_GIT_COMMIT << ". Kernels use: " << StitchKernels::GetInstructionSetName(StitchKernels::GetInstructionSet()) << endl;
+
+		std::vector<BenchmarkResult> results;
+		for (size_t r = 0; r < sizeof(c_resolutions) / sizeof(c_resolutions[0]); r++)
+		{
+			const Resolution &resolution = c_resolutions[r];
+			if (options.quick == true && resolution.width != 640 && resolution.width != 2448)
+				continue;
+
+			for (size_t p = 0; p < sizeof(c_pixelFormats) / sizeof(c_pixelFormats[0]); p++)
+			{
+				for (size_t c = 0; c < sizeof(c_cameraCounts) / sizeof(c_cameraCounts[0]); c++)
+					RunStitchBenchmarks(options, results, resolution, c_pixelFormats[p], c_cameraCounts[c]);
+			}
+
+			RunConversionBenchmarks(options, results, resolution);
+		}
+
+		if (options.csvFileName.empty() == false)
+		{
+			WriteCsv(options.csvFileName, results);
+			cout << "Results written to " << options.csvFileName << endl;
+		}
+		if (options.jsonFileName.empty() == false)
+		{
+			WriteJson(options.jsonFileName, results);
+			cout << "Results written to " << options.jsonFileName << endl;
+		}
+	}
+	catch (const GenericException &e)
+	{
+		// Error handling.
+		cerr << "An exception occurred." << endl
+			<< e.GetDescription() << endl;
+		exitCode = 1;
+	}
+	catch (std::exception &e)
+	{
+		// Error handling.
+		cerr << "An exception occurred." << endl
+			<< e.what() << endl;
+		exitCode = 1;
+	}
+
+	// Releases all pylon resources.
+	PylonTerminate();
+
+	return exitCode;
+}
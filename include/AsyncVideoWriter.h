@@ -0,0 +1,338 @@
+// AsyncVideoWriter.h
+// Writes frames to a video (or any other slow sink) on its own thread, behind a bounded queue with a choice of what to do when the queue is full.
+// Copyright (c) 2019 Matthew Breit - matt.breit@baslerweb.com or matt.breit@gmail.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ASYNCVIDEOWRITER_H
+#define ASYNCVIDEOWRITER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace AsyncVideoWriter
+{
+	// What Add() does when the queue is full because the encoder or the disk can't keep up.
+	enum EDropPolicy
+	{
+		DropPolicy_Block,      // wait for room (nothing is lost, but the caller is held up, and eventually the Grab Engines run out of buffers)
+		DropPolicy_DropOldest, // replace the oldest waiting frame (the video skips a frame, but stays as recent as possible)
+		DropPolicy_DropNewest  // discard the frame being added (the video skips a frame, and what is already queued is kept)
+	};
+
+	// Owns a bounded frame queue and a writer thread that calls write() for each frame, in order.
+	// Frames are moved into the queue, so for reference counted frames (eg: a CPylonImage) nothing is copied.
+	// Add() is meant to be called from one thread. The counters may be read from any thread.
+	template <typename T>
+	class FrameWriter
+	{
+	private:
+		std::function<void(T &frame)> m_write;
+		EDropPolicy m_dropPolicy;
+		std::vector<T> m_slots;
+		size_t m_head = 0; // oldest waiting frame
+		size_t m_count = 0;
+		std::mutex m_mutex;
+		std::condition_variable m_notEmpty;
+		std::condition_variable m_notFull;
+		std::thread m_thread;
+		bool m_running = false;
+		bool m_stopping = false;
+		bool m_failed = false;
+		std::string m_writeErrorMessage;
+		uint64_t m_framesWritten = 0;
+		uint64_t m_framesDropped = 0;
+		size_t m_highWaterMark = 0;
+
+		void WriteLoop();
+
+	public:
+		FrameWriter(size_t capacity, EDropPolicy dropPolicy, std::function<void(T &frame)> write);
+		~FrameWriter();
+
+		int Start(std::string &errorMessage);
+		bool Add(T &frame);
+		int Stop(std::string &errorMessage);
+		bool IsRunning();
+		EDropPolicy GetDropPolicy();
+		size_t GetCapacity();
+		size_t GetQueueSize();
+		size_t GetHighWaterMark();
+		uint64_t GetFramesWritten();
+		uint64_t GetFramesDropped();
+	};
+
+	const char *GetDropPolicyName(EDropPolicy dropPolicy);
+}
+
+// *********************************************************************************************************
+// DEFINITIONS
+template <typename T>
+AsyncVideoWriter::FrameWriter<T>::FrameWriter(size_t capacity, EDropPolicy dropPolicy, std::function<void(T &frame)> write)
+	: m_write(write), m_dropPolicy(dropPolicy), m_slots(capacity > 0 ? capacity : 1)
+{
+	// nothing
+}
+
+template <typename T>
+AsyncVideoWriter::FrameWriter<T>::~FrameWriter()
+{
+	// the writer thread must not outlive the frames and the write() function it uses
+	std::string errorMessage = "";
+	Stop(errorMessage);
+}
+
+template <typename T>
+int AsyncVideoWriter::FrameWriter<T>::Start(std::string &errorMessage)
+{
+	errorMessage = "ERROR: ";
+	errorMessage.append(__FUNCTION__);
+	errorMessage.append("(): ");
+
+	try
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_running == true)
+		{
+			errorMessage.append("Writer is already running");
+			return 1;
+		}
+
+		m_stopping = false;
+		m_failed = false;
+		m_running = true;
+		m_thread = std::thread(&FrameWriter<T>::WriteLoop, this);
+		return 0;
+	}
+	catch (std::exception &e)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append(e.what());
+		return 1;
+	}
+	catch (...)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append("UNKNOWN.");
+		return 1;
+	}
+}
+
+template <typename T>
+bool AsyncVideoWriter::FrameWriter<T>::Add(T &frame)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	if (m_running == false || m_stopping == true)
+	{
+		if (m_failed == true)
+			m_framesDropped++; // the frame would have been recorded if the writer hadn't failed
+		return false;
+	}
+
+	if (m_count == m_slots.size())
+	{
+		if (m_dropPolicy == DropPolicy_Block)
+		{
+			m_notFull.wait(lock, [&]() { return m_count < m_slots.size() || m_stopping == true; });
+			if (m_stopping == true)
+			{
+				m_framesDropped++; // the writer failed while we were waiting
+				return false;
+			}
+		}
+		else if (m_dropPolicy == DropPolicy_DropNewest)
+		{
+			m_framesDropped++;
+			return false;
+		}
+		else
+		{
+			// DropOldest: the new frame takes the place of the oldest one.
+			m_slots[m_head] = T();
+			m_head = (m_head + 1) % m_slots.size();
+			m_count--;
+			m_framesDropped++;
+		}
+	}
+
+	m_slots[(m_head + m_count) % m_slots.size()] = std::move(frame);
+	m_count++;
+	if (m_count > m_highWaterMark)
+		m_highWaterMark = m_count;
+
+	lock.unlock();
+	m_notEmpty.notify_one();
+	return true;
+}
+
+template <typename T>
+void AsyncVideoWriter::FrameWriter<T>::WriteLoop()
+{
+	while (true)
+	{
+		T frame;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_notEmpty.wait(lock, [&]() { return m_count > 0 || m_stopping == true; });
+
+			// When stopping, the frames still waiting are written first.
+			if (m_count == 0)
+				return;
+
+			frame = std::move(m_slots[m_head]);
+			m_slots[m_head] = T(); // don't keep a reference to the frame (eg: an image buffer) in the queue
+			m_head = (m_head + 1) % m_slots.size();
+			m_count--;
+		}
+		m_notFull.notify_one();
+
+		// The (slow) writing happens without holding the lock, so Add() is never held up by it.
+		try
+		{
+			m_write(frame);
+
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_framesWritten++;
+		}
+		catch (std::exception &e)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_writeErrorMessage = e.what();
+			m_failed = true;
+			m_stopping = true;
+		}
+		catch (...)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_writeErrorMessage = "UNKNOWN.";
+			m_failed = true;
+			m_stopping = true;
+		}
+
+		if (m_failed == true)
+		{
+			// Nothing more can be written, so let go of the waiting frames and anyone waiting for room.
+			std::lock_guard<std::mutex> lock(m_mutex);
+			for (size_t i = 0; i < m_slots.size(); i++)
+				m_slots[i] = T();
+			m_framesDropped += m_count;
+			m_count = 0;
+			m_notFull.notify_all();
+			return;
+		}
+	}
+}
+
+template <typename T>
+int AsyncVideoWriter::FrameWriter<T>::Stop(std::string &errorMessage)
+{
+	errorMessage = "ERROR: ";
+	errorMessage.append(__FUNCTION__);
+	errorMessage.append("(): ");
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_running == false)
+			return 0;
+		m_stopping = true;
+	}
+	m_notEmpty.notify_all();
+	m_notFull.notify_all();
+
+	if (m_thread.joinable())
+		m_thread.join();
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_running = false;
+	if (m_failed == true)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append(m_writeErrorMessage);
+		return 1;
+	}
+
+	return 0;
+}
+
+template <typename T>
+bool AsyncVideoWriter::FrameWriter<T>::IsRunning()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_running == true && m_stopping == false;
+}
+
+template <typename T>
+AsyncVideoWriter::EDropPolicy AsyncVideoWriter::FrameWriter<T>::GetDropPolicy()
+{
+	return m_dropPolicy;
+}
+
+template <typename T>
+size_t AsyncVideoWriter::FrameWriter<T>::GetCapacity()
+{
+	return m_slots.size();
+}
+
+template <typename T>
+size_t AsyncVideoWriter::FrameWriter<T>::GetQueueSize()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_count;
+}
+
+template <typename T>
+size_t AsyncVideoWriter::FrameWriter<T>::GetHighWaterMark()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_highWaterMark;
+}
+
+template <typename T>
+uint64_t AsyncVideoWriter::FrameWriter<T>::GetFramesWritten()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_framesWritten;
+}
+
+template <typename T>
+uint64_t AsyncVideoWriter::FrameWriter<T>::GetFramesDropped()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_framesDropped;
+}
+
+inline const char *AsyncVideoWriter::GetDropPolicyName(EDropPolicy dropPolicy)
+{
+	switch (dropPolicy)
+	{
+	case DropPolicy_Block:
+		return "Block";
+	case DropPolicy_DropOldest:
+		return "DropOldest";
+	case DropPolicy_DropNewest:
+		return "DropNewest";
+	default:
+		return "Unknown";
+	}
+}
+
+// *********************************************************************************************************
+
+#endif
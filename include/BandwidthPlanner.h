@@ -0,0 +1,269 @@
+// BandwidthPlanner.h
+// Computes the GigE transmission settings (packet size, interpacket delay, frame transmission delay) of a number of cameras from their image sizes, frame rates and links.
+// Copyright (c) 2019 Matthew Breit - matt.breit@baslerweb.com or matt.breit@gmail.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BANDWIDTHPLANNER_H
+#define BANDWIDTHPLANNER_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace BandwidthPlanner
+{
+	// Bytes around the image data of every packet. GevSCPSPacketSize includes the IP (20), UDP (8) and GVSP (8) headers...
+	const int c_packetHeaderBytes = 36;
+	// ...but not the Ethernet header (14), frame check sequence (4), preamble (8) and interframe gap (12), which take up the link as well.
+	const int c_ethernetOverheadBytes = 38;
+	// Every image is sent between a leader and a trailer packet (less than 64 bytes of data each).
+	const int c_leaderTrailerBytes = 2 * (c_ethernetOverheadBytes + c_packetHeaderBytes + 64);
+	// GevSCPSPacketSize must be a multiple of this, and no less than the minimum.
+	const int c_packetSizeIncrement = 4;
+	const int c_minPacketSize = 220;
+
+	// What one camera sends, and over which link.
+	struct CameraStream
+	{
+		std::string name;
+		int width = 0;
+		int height = 0;
+		double bitsPerPixel = 8; // eg: 12 for Mono12p, 16 for Mono16
+		int extraBytesPerFrame = 64; // sent along with every image (eg: chunk data)
+		double frameRate = 0; // fps
+		int64_t linkSpeed = 1000; // Mbit/s, eg: GevLinkSpeed
+		int link = 0; // Cameras with the same link number share a link (eg: the same NIC, or the same switch port to the host), and must split its bandwidth.
+		int maxPacketSize = 1500; // the largest packet the network takes (the MTU, or eg: 9000 with jumbo frames on every hop)
+		int64_t tickFrequency = 1000000000; // the unit of GevSCPD and GevSCFTD (GevTimestampTickFrequency, 1 GHz with PTP)
+	};
+
+	struct PlannerOptions
+	{
+		double targetUtilization = 0.9; // the fraction of each link the cameras may use, the rest is headroom (eg: for resends and other traffic)
+		bool synchronizedCameras = true; // The cameras expose on the same tick (eg: PTP synchronized free run), so their images are ready at the same time and have to take turns.
+		double guardTime = 0.00002; // s between the end of one camera's image and the start of the next one's on a shared link
+	};
+
+	// What to write to one camera
+	struct StreamSettings
+	{
+		int packetSize = 0; // GevSCPSPacketSize
+		int64_t interpacketDelay = 0; // GevSCPD (ticks)
+		int64_t frameTransmissionDelay = 0; // GevSCFTD (ticks)
+		int64_t wireBytesPerFrame = 0; // everything that goes over the link for one image
+		double bandwidth = 0; // bytes/s, averaged over the frame rate
+		double transmissionTime = 0; // s to send one image with the interpacket delay
+		double transmissionStart = 0; // s after the image is ready (the frame transmission delay)
+	};
+
+	// How much of one link the cameras on it use
+	struct LinkBudget
+	{
+		int link = 0;
+		int numCameras = 0;
+		double capacity = 0; // bytes/s
+		double bandwidth = 0; // bytes/s used by all of its cameras
+		double utilization = 0; // bandwidth / capacity
+		double framePeriod = 0; // s, of the fastest camera on the link
+		double busyTime = 0; // s per frame period the link is sending (including the guard times between synchronized cameras)
+		bool fits = false; // within the target utilization, and (with synchronized cameras) every image is sent before the next one is ready
+	};
+
+	struct BandwidthPlan
+	{
+		std::vector<CameraStream> streams;
+		std::vector<StreamSettings> settings; // one per stream
+		std::vector<LinkBudget> links;
+		double targetUtilization = 0;
+		bool fits = false; // every link fits
+	};
+
+	// Plans the transmission settings of the cameras. Only depends on its arguments, so a plan can be worked out (and checked) without cameras.
+	// On a link of its own, a camera sends at the full link speed. Cameras sharing a link are slowed down (interpacket delay) to the target utilization, and then
+	// either take turns (synchronized cameras: staggered frame transmission delays) or share the link at the same time (free-running cameras: each gets a share in proportion to its bandwidth).
+	// Returns 1 if the settings are invalid or a link is over budget. The plan is still filled in, so the budget can be printed.
+	int PlanBandwidth(const std::vector<CameraStream> &streams, const PlannerOptions &options, BandwidthPlan &plan, std::string &errorMessage);
+
+	// Prints the settings of each camera and the budget of each link.
+	void PrintBandwidthPlan(const BandwidthPlan &plan, std::ostream &stream);
+}
+
+// *********************************************************************************************************
+// DEFINITIONS
+inline int BandwidthPlanner::PlanBandwidth(const std::vector<CameraStream> &streams, const PlannerOptions &options, BandwidthPlan &plan, std::string &errorMessage)
+{
+	errorMessage = "ERROR: ";
+	errorMessage.append(__FUNCTION__);
+	errorMessage.append("(): ");
+
+	plan = BandwidthPlan();
+	plan.streams = streams;
+	plan.settings.resize(streams.size());
+	plan.targetUtilization = options.targetUtilization;
+
+	if (options.targetUtilization <= 0 || options.targetUtilization > 1)
+	{
+		errorMessage.append("The target utilization must be more than 0 and no more than 1.");
+		return 1;
+	}
+
+	// The packets and bytes of each image
+	for (size_t i = 0; i < streams.size(); i++)
+	{
+		const CameraStream &camera = streams[i];
+		StreamSettings &settings = plan.settings[i];
+		if (camera.width <= 0 || camera.height <= 0 || camera.bitsPerPixel <= 0 || camera.frameRate <= 0 || camera.linkSpeed <= 0 || camera.tickFrequency <= 0)
+		{
+			errorMessage.append(camera.name + ": The image size, pixel size, frame rate, link speed and tick frequency must be more than 0.");
+			return 1;
+		}
+
+		settings.packetSize = camera.maxPacketSize - (camera.maxPacketSize % c_packetSizeIncrement);
+		if (settings.packetSize < c_minPacketSize)
+		{
+			errorMessage.append(camera.name + ": The largest packet size must be at least " + std::to_string(c_minPacketSize) + " bytes.");
+			return 1;
+		}
+
+		int64_t imageBytes = (int64_t)std::ceil(camera.width * (double)camera.height * camera.bitsPerPixel / 8) + camera.extraBytesPerFrame;
+		int64_t bytesPerPacket = settings.packetSize - c_packetHeaderBytes;
+		int64_t numPackets = (imageBytes + bytesPerPacket - 1) / bytesPerPacket;
+		settings.wireBytesPerFrame = imageBytes + numPackets * (c_packetHeaderBytes + c_ethernetOverheadBytes) + c_leaderTrailerBytes;
+		settings.bandwidth = settings.wireBytesPerFrame * camera.frameRate;
+	}
+
+	// The links, in the order they first appear
+	std::vector<int> linkNumbers;
+	for (size_t i = 0; i < streams.size(); i++)
+	{
+		if (std::find(linkNumbers.begin(), linkNumbers.end(), streams[i].link) == linkNumbers.end())
+			linkNumbers.push_back(streams[i].link);
+	}
+
+	plan.fits = true;
+	for (size_t l = 0; l < linkNumbers.size(); l++)
+	{
+		LinkBudget budget;
+		budget.link = linkNumbers[l];
+
+		std::vector<size_t> members;
+		double maxFrameRate = 0;
+		int64_t minLinkSpeed = 0;
+		for (size_t i = 0; i < streams.size(); i++)
+		{
+			if (streams[i].link != budget.link)
+				continue;
+			members.push_back(i);
+			budget.bandwidth += plan.settings[i].bandwidth;
+			maxFrameRate = std::max(maxFrameRate, streams[i].frameRate);
+			if (minLinkSpeed == 0 || streams[i].linkSpeed < minLinkSpeed)
+				minLinkSpeed = streams[i].linkSpeed;
+		}
+		budget.numCameras = (int)members.size();
+		budget.capacity = minLinkSpeed * 1e6 / 8; // the slowest of the cameras' links limits the shared one
+		budget.utilization = budget.bandwidth / budget.capacity;
+		budget.framePeriod = 1.0 / maxFrameRate;
+
+		double targetRate = budget.capacity * options.targetUtilization;
+		double transmissionStart = 0;
+		for (size_t m = 0; m < members.size(); m++)
+		{
+			const CameraStream &camera = streams[members[m]];
+			StreamSettings &settings = plan.settings[members[m]];
+			double cameraRate = camera.linkSpeed * 1e6 / 8; // the camera sends its packets back to back at its own link speed
+
+			// Alone on its link, nothing collides with the camera's packets, so it may send at its full speed.
+			double sendRate = cameraRate;
+			if (members.size() > 1)
+				sendRate = (options.synchronizedCameras == true) ? targetRate : targetRate * settings.bandwidth / budget.bandwidth;
+			if (sendRate > cameraRate)
+				sendRate = cameraRate;
+
+			// The interpacket delay stretches every packet's time on the link from the camera's speed to the send rate (rounded up, so the rate is not exceeded).
+			double packetWireBytes = settings.packetSize + c_ethernetOverheadBytes;
+			double delay = packetWireBytes / sendRate - packetWireBytes / cameraRate;
+			settings.interpacketDelay = (int64_t)std::ceil(delay * camera.tickFrequency - 1e-6);
+			settings.transmissionTime = settings.wireBytesPerFrame / sendRate;
+
+			// Synchronized cameras on a shared link take turns, one image after the other.
+			if (members.size() > 1 && options.synchronizedCameras == true)
+			{
+				settings.transmissionStart = transmissionStart;
+				settings.frameTransmissionDelay = (int64_t)std::llround(transmissionStart * camera.tickFrequency);
+				transmissionStart += settings.transmissionTime + options.guardTime;
+				budget.busyTime = settings.transmissionStart + settings.transmissionTime;
+			}
+			else
+				budget.busyTime = std::max(budget.busyTime, settings.transmissionTime);
+		}
+
+		budget.fits = (budget.utilization <= options.targetUtilization && budget.busyTime <= budget.framePeriod);
+		if (budget.fits == false)
+			plan.fits = false;
+		plan.links.push_back(budget);
+	}
+
+	if (plan.fits == false)
+	{
+		std::ostringstream message;
+		message << "The cameras don't fit into the bandwidth of link(s):";
+		for (size_t l = 0; l < plan.links.size(); l++)
+		{
+			if (plan.links[l].fits == false)
+				message << " " << plan.links[l].link << " (" << std::fixed << std::setprecision(1) << plan.links[l].utilization * 100 << "% used, " << plan.links[l].busyTime * 1000 << " of " << plan.links[l].framePeriod * 1000 << " ms busy)";
+		}
+		message << ". Lower the frame rate, the image size or the bits per pixel, or put the cameras on separate links.";
+		errorMessage.append(message.str());
+		return 1;
+	}
+
+	return 0;
+}
+
+inline void BandwidthPlanner::PrintBandwidthPlan(const BandwidthPlan &plan, std::ostream &stream)
+{
+	std::ios::fmtflags flags = stream.flags();
+	std::streamsize precision = stream.precision();
+
+	stream << "GigE bandwidth plan (target link utilization " << plan.targetUtilization * 100 << "%):" << std::endl;
+	stream << std::left << std::setw(20) << "camera" << std::right << std::setw(6) << "link" << std::setw(12) << "packet size" << std::setw(10) << "GevSCPD" << std::setw(12) << "GevSCFTD"
+		<< std::setw(12) << "MB/s" << std::setw(14) << "send ms" << std::setw(14) << "start ms" << std::endl;
+	stream << std::fixed;
+	for (size_t i = 0; i < plan.settings.size(); i++)
+	{
+		const StreamSettings &settings = plan.settings[i];
+		stream << std::left << std::setw(20) << plan.streams[i].name << std::right << std::setw(6) << plan.streams[i].link << std::setw(12) << settings.packetSize
+			<< std::setw(10) << settings.interpacketDelay << std::setw(12) << settings.frameTransmissionDelay << std::setprecision(2) << std::setw(12) << settings.bandwidth / 1e6
+			<< std::setprecision(3) << std::setw(14) << settings.transmissionTime * 1000 << std::setw(14) << settings.transmissionStart * 1000 << std::endl;
+	}
+	for (size_t l = 0; l < plan.links.size(); l++)
+	{
+		const LinkBudget &budget = plan.links[l];
+		stream << "Link " << budget.link << ": " << budget.numCameras << " camera(s), " << std::setprecision(2) << budget.bandwidth / 1e6 << " of " << budget.capacity / 1e6 << " MB/s ("
+			<< std::setprecision(1) << budget.utilization * 100 << "%), busy " << std::setprecision(3) << budget.busyTime * 1000 << " of every " << budget.framePeriod * 1000 << " ms"
+			<< (budget.fits ? "" : " - OVER BUDGET") << std::endl;
+	}
+
+	stream.flags(flags);
+	stream.precision(precision);
+}
+
+// *********************************************************************************************************
+
+#endif
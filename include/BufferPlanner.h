@@ -0,0 +1,194 @@
+// BufferPlanner.h
+// Works out how many buffers the Grab Engines need from how long the processing takes per frame and a memory budget.
+// Copyright (c) 2019 Matthew Breit - matt.breit@baslerweb.com or matt.breit@gmail.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BUFFERPLANNER_H
+#define BUFFERPLANNER_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+#include <sstream>
+#include <string>
+
+namespace BufferPlanner
+{
+	// Mean, variance (Welford's online algorithm) and worst case of the time the processing takes per frame.
+	class ServiceTimeEstimator
+	{
+	private:
+		uint64_t m_count = 0;
+		double m_mean = 0;
+		double m_sumOfSquares = 0; // of the differences from the mean
+		double m_max = 0;
+
+	public:
+		void AddSample(double seconds);
+		uint64_t GetCount() const;
+		double GetMean() const; // s
+		double GetStdDev() const; // s
+		double GetMax() const; // s
+	};
+
+	struct BufferOptions
+	{
+		double frameRate = 0; // fps of each camera
+		int64_t bufferSize = 0; // bytes of one buffer (eg: PayloadSize)
+		int numCameras = 1;
+		uint64_t memoryBudget = 0; // bytes for the buffers of all of the cameras together
+		double targetStall = 0.5; // s the processing may fall behind (eg: an encoder or disk hiccup) without losing images
+		double sigmaMultiplier = 3; // a "normal" slow frame takes the mean + this many standard deviations
+		int heldBuffers = 0; // buffers of each camera held by the processing (eg: images waiting in the pipeline queues), which can't receive images
+		int minBuffers = 4;
+	};
+
+	struct BufferPlan
+	{
+		int maxNumBuffer = 0; // MaxNumBuffer of each camera
+		int maxNumQueuedBuffer = 0; // MaxNumQueuedBuffer of each camera
+		int requiredBuffers = 0; // what covering the stall would take
+		int budgetBuffers = 0; // the most the memory budget allows
+		int worstCaseBuffers = 0; // what covering the slowest frame of the warm-up would take
+		double stall = 0; // s the buffers were sized for
+		double coveredStall = 0; // s the chosen buffers actually cover
+		uint64_t memory = 0; // bytes of all of the chosen buffers
+		double framePeriod = 0; // s
+		double meanServiceTime = 0; // s
+		double stdDevServiceTime = 0; // s
+		double maxServiceTime = 0; // s
+		bool keepsUp = false; // the processing takes less than a frame period on average
+		bool budgetLimited = false; // fewer buffers than required, to stay within the memory budget
+		bool coversWorstCase = false; // enough buffers for the slowest frame of the warm-up
+	};
+
+	// A processing stall of d seconds lets d * frameRate images pile up in the Grab Engine, on top of the buffers the processing holds anyway.
+	// The stall covered is the largest of the target stall, the slowest frame of the warm-up, and the mean + sigmaMultiplier standard deviations.
+	// Only depends on its arguments, so a plan can be worked out (and checked) without cameras.
+	// Returns 1 if the options are invalid. A plan that doesn't keep up or doesn't cover the worst case is still valid: check keepsUp and coversWorstCase.
+	int PlanBuffers(const ServiceTimeEstimator &serviceTimes, const BufferOptions &options, BufferPlan &plan, std::string &errorMessage);
+
+	// Prints the chosen buffers, what they cover, and why.
+	void PrintBufferPlan(const BufferPlan &plan, std::ostream &stream);
+}
+
+// *********************************************************************************************************
+// DEFINITIONS
+inline void BufferPlanner::ServiceTimeEstimator::AddSample(double seconds)
+{
+	m_count++;
+	double delta = seconds - m_mean;
+	m_mean += delta / (double)m_count;
+	m_sumOfSquares += delta * (seconds - m_mean);
+	if (m_count == 1 || seconds > m_max)
+		m_max = seconds;
+}
+
+inline uint64_t BufferPlanner::ServiceTimeEstimator::GetCount() const
+{
+	return m_count;
+}
+
+inline double BufferPlanner::ServiceTimeEstimator::GetMean() const
+{
+	return m_mean;
+}
+
+inline double BufferPlanner::ServiceTimeEstimator::GetStdDev() const
+{
+	return (m_count > 1) ? std::sqrt(m_sumOfSquares / (double)(m_count - 1)) : 0.0;
+}
+
+inline double BufferPlanner::ServiceTimeEstimator::GetMax() const
+{
+	return m_max;
+}
+
+inline int BufferPlanner::PlanBuffers(const ServiceTimeEstimator &serviceTimes, const BufferOptions &options, BufferPlan &plan, std::string &errorMessage)
+{
+	errorMessage = "ERROR: ";
+	errorMessage.append(__FUNCTION__);
+	errorMessage.append("(): ");
+
+	plan = BufferPlan();
+
+	if (options.frameRate <= 0 || options.bufferSize <= 0 || options.numCameras <= 0)
+	{
+		errorMessage.append("The frame rate, buffer size and number of cameras must be more than 0.");
+		return 1;
+	}
+	if (options.targetStall < 0 || options.sigmaMultiplier < 0 || options.heldBuffers < 0 || options.minBuffers < 1)
+	{
+		errorMessage.append("The target stall, sigma multiplier and held buffers can't be negative, and at least 1 buffer is needed.");
+		return 1;
+	}
+	if (serviceTimes.GetCount() == 0)
+	{
+		errorMessage.append("There are no service times to plan with. Run the warm-up first.");
+		return 1;
+	}
+
+	plan.framePeriod = 1.0 / options.frameRate;
+	plan.meanServiceTime = serviceTimes.GetMean();
+	plan.stdDevServiceTime = serviceTimes.GetStdDev();
+	plan.maxServiceTime = serviceTimes.GetMax();
+	plan.keepsUp = (plan.meanServiceTime < plan.framePeriod);
+
+	// The buffers that cover a stall of so many seconds (the one being filled while the stall ends counts too)
+	auto BuffersFor = [&](double stall) -> int
+	{
+		return options.heldBuffers + (int)std::ceil(stall * options.frameRate) + 1;
+	};
+
+	plan.stall = std::max(options.targetStall, std::max(plan.maxServiceTime, plan.meanServiceTime + options.sigmaMultiplier * plan.stdDevServiceTime));
+	plan.requiredBuffers = std::max(options.minBuffers, BuffersFor(plan.stall));
+	plan.worstCaseBuffers = std::max(options.minBuffers, BuffersFor(plan.maxServiceTime));
+
+	uint64_t budgetBuffers = options.memoryBudget / ((uint64_t)options.bufferSize * (uint64_t)options.numCameras);
+	plan.budgetBuffers = (int)std::min<uint64_t>(budgetBuffers, 1000000);
+
+	plan.maxNumBuffer = plan.requiredBuffers;
+	if (plan.maxNumBuffer > plan.budgetBuffers)
+	{
+		plan.maxNumBuffer = std::max(options.minBuffers, plan.budgetBuffers);
+		plan.budgetLimited = true;
+	}
+	plan.maxNumQueuedBuffer = plan.maxNumBuffer; // queue up every buffer, so as many as possible are ready to receive images
+	plan.coversWorstCase = (plan.maxNumBuffer >= plan.worstCaseBuffers);
+	plan.coveredStall = std::max(0.0, (double)(plan.maxNumBuffer - options.heldBuffers - 1) / options.frameRate);
+	plan.memory = (uint64_t)plan.maxNumBuffer * (uint64_t)options.bufferSize * (uint64_t)options.numCameras;
+
+	return 0;
+}
+
+inline void BufferPlanner::PrintBufferPlan(const BufferPlan &plan, std::ostream &stream)
+{
+	std::ios::fmtflags flags = stream.flags();
+	std::streamsize precision = stream.precision();
+
+	stream << std::fixed << std::setprecision(3);
+	stream << "Grab Engine buffer plan: processing takes " << plan.meanServiceTime * 1000 << " ms per frame (std dev " << plan.stdDevServiceTime * 1000
+		<< " ms, slowest " << plan.maxServiceTime * 1000 << " ms) of every " << plan.framePeriod * 1000 << " ms." << std::endl;
+	stream << "MaxNumBuffer " << plan.maxNumBuffer << " per camera (" << std::setprecision(1) << plan.memory / (1024.0 * 1024.0) << " MB in total), covers a stall of "
+		<< std::setprecision(3) << plan.coveredStall * 1000 << " ms. Required " << plan.requiredBuffers << " for " << plan.stall * 1000 << " ms, the budget allows " << plan.budgetBuffers << "." << std::endl;
+
+	stream.flags(flags);
+	stream.precision(precision);
+}
+
+// *********************************************************************************************************
+
+#endif
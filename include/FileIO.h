@@ -0,0 +1,414 @@
+// FileIO.h
+// Thin wrappers around the operating system's file APIs: positioned writes, read-only and writable memory mappings.
+// Copyright (c) 2019 Matthew Breit - matt.breit@baslerweb.com or matt.breit@gmail.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FILEIO_H
+#define FILEIO_H
+
+#include <cstdint>
+#include <string>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace FileIO
+{
+	class OutputFile
+	{
+	private:
+#ifdef _WIN32
+		HANDLE m_handle = INVALID_HANDLE_VALUE;
+#else
+		int m_fd = -1;
+#endif
+
+	public:
+		OutputFile();
+		~OutputFile();
+
+		bool Create(const std::string &fileName);
+		bool WriteAt(uint64_t offset, const void *pData, uint64_t size);
+		bool Resize(uint64_t size); // reserves the space on disk, so appending doesn't have to grow the file
+		void Close();
+		bool IsOpen();
+	};
+
+	class MappedFile
+	{
+	private:
+		const uint8_t *m_pData = NULL;
+		uint64_t m_size = 0;
+#ifdef _WIN32
+		HANDLE m_handle = INVALID_HANDLE_VALUE;
+		HANDLE m_mapping = NULL;
+#else
+		int m_fd = -1;
+#endif
+
+	public:
+		MappedFile();
+		~MappedFile();
+
+		bool Open(const std::string &fileName);
+		void Close();
+		const uint8_t *GetData();
+		uint64_t GetSize();
+	};
+
+	// A file that is written through a writable memory mapping (eg: small fixed size records, without a system call per record).
+	// Resize() maps the file again, so pointers from GetData() are only valid until then.
+	class MappedOutputFile
+	{
+	private:
+		uint8_t *m_pData = NULL;
+		uint64_t m_size = 0;
+#ifdef _WIN32
+		HANDLE m_handle = INVALID_HANDLE_VALUE;
+		HANDLE m_mapping = NULL;
+#else
+		int m_fd = -1;
+#endif
+
+		bool Map();
+		void Unmap();
+
+	public:
+		MappedOutputFile();
+		~MappedOutputFile();
+
+		bool Create(const std::string &fileName, uint64_t size);
+		bool Resize(uint64_t size);
+		void Close();
+		bool IsOpen();
+		uint8_t *GetData();
+		uint64_t GetSize();
+	};
+}
+
+// *********************************************************************************************************
+// DEFINITIONS
+inline FileIO::OutputFile::OutputFile()
+{
+	// nothing
+}
+
+inline FileIO::OutputFile::~OutputFile()
+{
+	Close();
+}
+
+inline bool FileIO::OutputFile::Create(const std::string &fileName)
+{
+	Close();
+#ifdef _WIN32
+	m_handle = CreateFileA(fileName.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	return m_handle != INVALID_HANDLE_VALUE;
+#else
+	m_fd = open(fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	return m_fd >= 0;
+#endif
+}
+
+inline bool FileIO::OutputFile::WriteAt(uint64_t offset, const void *pData, uint64_t size)
+{
+	const uint8_t *pBytes = (const uint8_t*)pData;
+	while (size > 0)
+	{
+		// write in pieces, as a single call can't write more than 2 GB (and may write less than asked for)
+		uint32_t chunk = (uint32_t)std::min<uint64_t>(size, 1u << 30);
+#ifdef _WIN32
+		OVERLAPPED overlapped = {};
+		overlapped.Offset = (DWORD)(offset & 0xFFFFFFFF);
+		overlapped.OffsetHigh = (DWORD)(offset >> 32);
+		DWORD written = 0;
+		if (WriteFile(m_handle, pBytes, chunk, &written, &overlapped) == FALSE || written == 0)
+			return false;
+#else
+		ssize_t written = pwrite(m_fd, pBytes, chunk, (off_t)offset);
+		if (written <= 0)
+			return false;
+#endif
+		pBytes += written;
+		offset += written;
+		size -= written;
+	}
+	return true;
+}
+
+inline bool FileIO::OutputFile::Resize(uint64_t size)
+{
+#ifdef _WIN32
+	LARGE_INTEGER position;
+	position.QuadPart = (LONGLONG)size;
+	return SetFilePointerEx(m_handle, position, NULL, FILE_BEGIN) != FALSE && SetEndOfFile(m_handle) != FALSE;
+#else
+	if (ftruncate(m_fd, (off_t)size) != 0)
+		return false;
+#ifdef __linux__
+	// ftruncate only makes a sparse file. Actually allocating the blocks now keeps the file system's work out of the recording.
+	struct stat status;
+	if (fstat(m_fd, &status) == 0 && (uint64_t)status.st_size == size && size > 0)
+		posix_fallocate(m_fd, 0, (off_t)size); // not supported by every file system, in which case the file stays sparse
+#endif
+	return true;
+#endif
+}
+
+inline void FileIO::OutputFile::Close()
+{
+#ifdef _WIN32
+	if (m_handle != INVALID_HANDLE_VALUE)
+		CloseHandle(m_handle);
+	m_handle = INVALID_HANDLE_VALUE;
+#else
+	if (m_fd >= 0)
+		close(m_fd);
+	m_fd = -1;
+#endif
+}
+
+inline bool FileIO::OutputFile::IsOpen()
+{
+#ifdef _WIN32
+	return m_handle != INVALID_HANDLE_VALUE;
+#else
+	return m_fd >= 0;
+#endif
+}
+
+inline FileIO::MappedFile::MappedFile()
+{
+	// nothing
+}
+
+inline FileIO::MappedFile::~MappedFile()
+{
+	Close();
+}
+
+inline bool FileIO::MappedFile::Open(const std::string &fileName)
+{
+	Close();
+#ifdef _WIN32
+	m_handle = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (m_handle == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if (GetFileSizeEx(m_handle, &size) == FALSE || size.QuadPart == 0)
+	{
+		Close();
+		return false;
+	}
+	m_size = (uint64_t)size.QuadPart;
+
+	m_mapping = CreateFileMappingA(m_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (m_mapping == NULL)
+	{
+		Close();
+		return false;
+	}
+
+	m_pData = (const uint8_t*)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+	if (m_pData == NULL)
+	{
+		Close();
+		return false;
+	}
+#else
+	m_fd = open(fileName.c_str(), O_RDONLY);
+	if (m_fd < 0)
+		return false;
+
+	struct stat status;
+	if (fstat(m_fd, &status) != 0 || status.st_size == 0)
+	{
+		Close();
+		return false;
+	}
+	m_size = (uint64_t)status.st_size;
+
+	void *pData = mmap(NULL, (size_t)m_size, PROT_READ, MAP_SHARED, m_fd, 0);
+	if (pData == MAP_FAILED)
+	{
+		Close();
+		return false;
+	}
+	m_pData = (const uint8_t*)pData;
+#endif
+	return true;
+}
+
+inline void FileIO::MappedFile::Close()
+{
+#ifdef _WIN32
+	if (m_pData != NULL)
+		UnmapViewOfFile(m_pData);
+	if (m_mapping != NULL)
+		CloseHandle(m_mapping);
+	if (m_handle != INVALID_HANDLE_VALUE)
+		CloseHandle(m_handle);
+	m_mapping = NULL;
+	m_handle = INVALID_HANDLE_VALUE;
+#else
+	if (m_pData != NULL)
+		munmap((void*)m_pData, (size_t)m_size);
+	if (m_fd >= 0)
+		close(m_fd);
+	m_fd = -1;
+#endif
+	m_pData = NULL;
+	m_size = 0;
+}
+
+inline const uint8_t *FileIO::MappedFile::GetData()
+{
+	return m_pData;
+}
+
+inline uint64_t FileIO::MappedFile::GetSize()
+{
+	return m_size;
+}
+
+inline FileIO::MappedOutputFile::MappedOutputFile()
+{
+	// nothing
+}
+
+inline FileIO::MappedOutputFile::~MappedOutputFile()
+{
+	Close();
+}
+
+inline bool FileIO::MappedOutputFile::Map()
+{
+#ifdef _WIN32
+	m_mapping = CreateFileMappingA(m_handle, NULL, PAGE_READWRITE, (DWORD)(m_size >> 32), (DWORD)(m_size & 0xFFFFFFFF), NULL);
+	if (m_mapping == NULL)
+		return false;
+
+	m_pData = (uint8_t*)MapViewOfFile(m_mapping, FILE_MAP_WRITE, 0, 0, 0);
+	return m_pData != NULL;
+#else
+	void *pData = mmap(NULL, (size_t)m_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+	if (pData == MAP_FAILED)
+		return false;
+	m_pData = (uint8_t*)pData;
+	return true;
+#endif
+}
+
+inline void FileIO::MappedOutputFile::Unmap()
+{
+#ifdef _WIN32
+	if (m_pData != NULL)
+		UnmapViewOfFile(m_pData);
+	if (m_mapping != NULL)
+		CloseHandle(m_mapping);
+	m_mapping = NULL;
+#else
+	if (m_pData != NULL)
+		munmap(m_pData, (size_t)m_size);
+#endif
+	m_pData = NULL;
+}
+
+inline bool FileIO::MappedOutputFile::Create(const std::string &fileName, uint64_t size)
+{
+	Close();
+#ifdef _WIN32
+	m_handle = CreateFileA(fileName.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (m_handle == INVALID_HANDLE_VALUE)
+		return false;
+#else
+	m_fd = open(fileName.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (m_fd < 0)
+		return false;
+#endif
+	if (Resize(size) == false)
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+inline bool FileIO::MappedOutputFile::Resize(uint64_t size)
+{
+	if (size == 0)
+		return false; // an empty file can't be mapped
+
+	Unmap();
+#ifdef _WIN32
+	LARGE_INTEGER position;
+	position.QuadPart = (LONGLONG)size;
+	if (SetFilePointerEx(m_handle, position, NULL, FILE_BEGIN) == FALSE || SetEndOfFile(m_handle) == FALSE)
+		return false;
+#else
+	if (ftruncate(m_fd, (off_t)size) != 0)
+		return false;
+#ifdef __linux__
+	// allocate the blocks now, so a page fault while writing a record doesn't have to (and a full disk shows up here rather than as a SIGBUS)
+	if (size > m_size)
+		posix_fallocate(m_fd, 0, (off_t)size);
+#endif
+#endif
+	m_size = size;
+	return Map();
+}
+
+inline void FileIO::MappedOutputFile::Close()
+{
+	Unmap();
+#ifdef _WIN32
+	if (m_handle != INVALID_HANDLE_VALUE)
+		CloseHandle(m_handle);
+	m_handle = INVALID_HANDLE_VALUE;
+#else
+	if (m_fd >= 0)
+		close(m_fd);
+	m_fd = -1;
+#endif
+	m_size = 0;
+}
+
+inline bool FileIO::MappedOutputFile::IsOpen()
+{
+	return m_pData != NULL;
+}
+
+inline uint8_t *FileIO::MappedOutputFile::GetData()
+{
+	return m_pData;
+}
+
+inline uint64_t FileIO::MappedOutputFile::GetSize()
+{
+	return m_size;
+}
+
+// *********************************************************************************************************
+
+#endif
@@ -0,0 +1,256 @@
+// FrameMatcher.h
+// Groups the images of several cameras by their timestamps (or frame counters) instead of by the order in which they were retrieved.
+// Copyright (c) 2019 Matthew Breit - matt.breit@baslerweb.com or matt.breit@gmail.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FRAMEMATCHER_H
+#define FRAMEMATCHER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+namespace FrameMatcher
+{
+	enum EMatchMode
+	{
+		MatchMode_Timestamp,   // frames belong together if their (PTP synchronized) timestamps are within the tolerance
+		MatchMode_FrameCounter // frames belong together if their frame counters are equal (for when the camera clocks are not synchronized)
+	};
+
+	// A frame waiting for its partners, and the metadata used to find them.
+	template <typename T>
+	struct MatchedFrame
+	{
+		T payload; // eg: the grab result
+		int64_t timestamp = 0;
+		int64_t frameCounter = 0;
+	};
+
+	// Buffers the frames of a number of cameras (index 0 to numCameras - 1) and hands them out in sets of one frame per camera.
+	// A frame whose partners never all arrive (dropped or incomplete on another camera) is discarded and counted as an orphan,
+	// so one lost frame doesn't shift all of the following sets.
+	// Timestamps and frame counters of each camera must increase from frame to frame, as the camera's chunk data does.
+	// Finding a set takes one pass over the oldest frame of each camera, so the cost per set grows linearly with the number of cameras.
+	// Not thread safe: Push() and TryGetSet() must be called from the same thread.
+	template <typename T>
+	class SetMatcher
+	{
+	private:
+		std::vector<std::deque<MatchedFrame<T>>> m_pending;
+		EMatchMode m_matchMode = MatchMode_Timestamp;
+		int64_t m_tolerance = 0;
+		size_t m_maxPending = 8;
+		uint64_t m_setCount = 0;
+		std::vector<uint64_t> m_orphanCount;
+
+		int64_t GetKey(const MatchedFrame<T> &frame);
+		void DiscardOrphan(int cameraIndex);
+
+	public:
+		SetMatcher(int numCameras);
+		~SetMatcher();
+
+		bool Push(int cameraIndex, const T &payload, int64_t timestamp, int64_t frameCounter);
+		bool TryGetSet(std::vector<MatchedFrame<T>> &frames); // frames[i] is the frame of camera i
+		void Reset();
+		int GetNumCameras();
+		void SetMatchMode(EMatchMode matchMode);
+		EMatchMode GetMatchMode();
+		void SetTolerance(int64_t tolerance);
+		int64_t GetTolerance();
+		void SetMaxPending(size_t numFrames);
+		size_t GetMaxPending();
+		size_t GetPendingCount(int cameraIndex);
+		uint64_t GetSetCount();
+		uint64_t GetOrphanCount(int cameraIndex);
+		uint64_t GetTotalOrphanCount();
+	};
+}
+
+// *********************************************************************************************************
+// DEFINITIONS
+template <typename T>
+FrameMatcher::SetMatcher<T>::SetMatcher(int numCameras)
+	: m_pending(numCameras > 0 ? numCameras : 1), m_orphanCount(numCameras > 0 ? numCameras : 1, 0)
+{
+	// nothing
+}
+
+template <typename T>
+FrameMatcher::SetMatcher<T>::~SetMatcher()
+{
+	// nothing
+}
+
+template <typename T>
+int64_t FrameMatcher::SetMatcher<T>::GetKey(const MatchedFrame<T> &frame)
+{
+	return (m_matchMode == MatchMode_Timestamp) ? frame.timestamp : frame.frameCounter;
+}
+
+template <typename T>
+void FrameMatcher::SetMatcher<T>::DiscardOrphan(int cameraIndex)
+{
+	m_pending[cameraIndex].pop_front();
+	m_orphanCount[cameraIndex]++;
+}
+
+template <typename T>
+bool FrameMatcher::SetMatcher<T>::Push(int cameraIndex, const T &payload, int64_t timestamp, int64_t frameCounter)
+{
+	if (cameraIndex < 0 || cameraIndex >= (int)m_pending.size())
+		return false;
+
+	MatchedFrame<T> frame;
+	frame.payload = payload;
+	frame.timestamp = timestamp;
+	frame.frameCounter = frameCounter;
+	m_pending[cameraIndex].push_back(frame);
+
+	// If another camera has stopped delivering, don't hold on to (and keep the grab buffers of) an unlimited number of frames.
+	if (m_pending[cameraIndex].size() > m_maxPending)
+		DiscardOrphan(cameraIndex);
+
+	return true;
+}
+
+template <typename T>
+bool FrameMatcher::SetMatcher<T>::TryGetSet(std::vector<MatchedFrame<T>> &frames)
+{
+	const int numCameras = (int)m_pending.size();
+
+	while (true)
+	{
+		// The newest of the oldest frames sets the pace: nothing older than it can still get a partner from its camera.
+		int64_t newestKey = 0;
+		for (int i = 0; i < numCameras; i++)
+		{
+			if (m_pending[i].empty() == true)
+				return false;
+
+			int64_t key = GetKey(m_pending[i].front());
+			if (i == 0 || key > newestKey)
+				newestKey = key;
+		}
+
+		bool discarded = false;
+		for (int i = 0; i < numCameras; i++)
+		{
+			if (GetKey(m_pending[i].front()) < newestKey - m_tolerance)
+			{
+				DiscardOrphan(i);
+				discarded = true;
+			}
+		}
+
+		if (discarded == true)
+			continue;
+
+		// The oldest frame of every camera is within the tolerance of the others, so they belong together.
+		frames.resize(numCameras);
+		for (int i = 0; i < numCameras; i++)
+		{
+			frames[i] = m_pending[i].front();
+			m_pending[i].pop_front();
+		}
+		m_setCount++;
+		return true;
+	}
+}
+
+template <typename T>
+void FrameMatcher::SetMatcher<T>::Reset()
+{
+	for (size_t i = 0; i < m_pending.size(); i++)
+	{
+		m_pending[i].clear();
+		m_orphanCount[i] = 0;
+	}
+	m_setCount = 0;
+}
+
+template <typename T>
+int FrameMatcher::SetMatcher<T>::GetNumCameras()
+{
+	return (int)m_pending.size();
+}
+
+template <typename T>
+void FrameMatcher::SetMatcher<T>::SetMatchMode(EMatchMode matchMode)
+{
+	m_matchMode = matchMode;
+}
+
+template <typename T>
+FrameMatcher::EMatchMode FrameMatcher::SetMatcher<T>::GetMatchMode()
+{
+	return m_matchMode;
+}
+
+template <typename T>
+void FrameMatcher::SetMatcher<T>::SetTolerance(int64_t tolerance)
+{
+	m_tolerance = tolerance;
+}
+
+template <typename T>
+int64_t FrameMatcher::SetMatcher<T>::GetTolerance()
+{
+	return m_tolerance;
+}
+
+template <typename T>
+void FrameMatcher::SetMatcher<T>::SetMaxPending(size_t numFrames)
+{
+	m_maxPending = numFrames;
+}
+
+template <typename T>
+size_t FrameMatcher::SetMatcher<T>::GetMaxPending()
+{
+	return m_maxPending;
+}
+
+template <typename T>
+size_t FrameMatcher::SetMatcher<T>::GetPendingCount(int cameraIndex)
+{
+	return m_pending[cameraIndex].size();
+}
+
+template <typename T>
+uint64_t FrameMatcher::SetMatcher<T>::GetSetCount()
+{
+	return m_setCount;
+}
+
+template <typename T>
+uint64_t FrameMatcher::SetMatcher<T>::GetOrphanCount(int cameraIndex)
+{
+	return m_orphanCount[cameraIndex];
+}
+
+template <typename T>
+uint64_t FrameMatcher::SetMatcher<T>::GetTotalOrphanCount()
+{
+	uint64_t total = 0;
+	for (size_t i = 0; i < m_orphanCount.size(); i++)
+		total += m_orphanCount[i];
+	return total;
+}
+
+// *********************************************************************************************************
+
+#endif
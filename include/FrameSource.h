@@ -0,0 +1,570 @@
+// FrameSource.h
+// Where the images come from: a camera, a synthetic image generator, or a raw recording. The rest of the program doesn't need to know which.
+// Copyright (c) 2019 Matthew Breit - matt.breit@baslerweb.com or matt.breit@gmail.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FRAMESOURCE_H
+#define FRAMESOURCE_H
+
+// Include Pylon libraries (if needed)
+#include <pylon/PylonIncludes.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include "StitchImage.h" // for ImagePool
+#include "RawStereoFile.h"
+
+namespace FrameSource
+{
+	enum ESourceType
+	{
+		SourceType_Pylon,     // a camera, through the pylon Grab Engine
+		SourceType_Synthetic, // generated images with camera-like timestamps (no camera needed, eg: to profile the processing)
+		SourceType_Replay     // one side of a raw stereo recording (see RawStereoFile.h)
+	};
+
+	// One image and the chunk data that came with it.
+	// The image shares its buffer with the source (eg: the Grab Engine's buffer), which is given back once every copy of the image is released.
+	struct SourceFrame
+	{
+		Pylon::CPylonImage image;
+		int64_t timestamp = 0;
+		int64_t frameCounter = 0;
+		uint32_t errorCode = 0; // why the image isn't usable, if RetrieveFrame() returned 1 (eg: the Grab Result's GetErrorCode(), 0 if the source has no error codes)
+	};
+
+	class IFrameSource
+	{
+	public:
+		virtual ~IFrameSource() {}
+
+		virtual int Start(size_t numFrames, std::string &errorMessage) = 0;
+		virtual void Stop() = 0;
+		virtual bool IsGrabbing() = 0;
+		// Waits for the next image. Returns 1 (and errorMessage) if there is an image but it is not usable (eg: incompletely grabbed).
+		// Like RetrieveResult(), throws if no image arrives within timeoutMs.
+		virtual int RetrieveFrame(unsigned int timeoutMs, SourceFrame &frame, std::string &errorMessage) = 0;
+		// The geometry of the images, eg: to set up the video writers before the first image arrives.
+		virtual uint32_t GetWidth() = 0;
+		virtual uint32_t GetHeight() = 0;
+		virtual Pylon::EPixelType GetPixelType() = 0;
+		virtual std::string GetName() = 0;
+	};
+
+	// A pylon Instant Camera. The camera must already be open and configured (and have chunk timestamps and framecounters enabled).
+	template <typename Camera_t, typename GrabResultPtr_t>
+	class PylonSource : public IFrameSource
+	{
+	private:
+		Camera_t &m_camera;
+		std::string m_name;
+
+	public:
+		PylonSource(Camera_t &camera, const std::string &name);
+		~PylonSource();
+
+		int Start(size_t numFrames, std::string &errorMessage);
+		void Stop();
+		bool IsGrabbing();
+		int RetrieveFrame(unsigned int timeoutMs, SourceFrame &frame, std::string &errorMessage);
+		uint32_t GetWidth();
+		uint32_t GetHeight();
+		Pylon::EPixelType GetPixelType();
+		std::string GetName();
+	};
+
+	// Generates images at a given frame rate, with timestamps in ns like a PTP synchronized camera's.
+	// Timestamp jitter, a fixed offset (eg: the skew between two cameras), and dropped frames can be added to exercise the pairing of stereo frames.
+	class SyntheticSource : public IFrameSource
+	{
+	private:
+		std::string m_name;
+		Pylon::EPixelType m_pixelType;
+		uint32_t m_width;
+		uint32_t m_height;
+		double m_frameRate;
+		int64_t m_jitter = 0;
+		int64_t m_offset = 0;
+		double m_dropRate = 0;
+		bool m_realTime = true;
+		std::mt19937 m_random;
+		StitchImage::ImagePool m_imagePool;
+		size_t m_numFrames = 0;
+		size_t m_frameNumber = 0; // including dropped frames
+		bool m_grabbing = false;
+		std::chrono::steady_clock::time_point m_startTime;
+
+	public:
+		// numBuffers works like the Grab Engine's MaxNumBuffer: how many images can be in use at the same time before they have to be reallocated.
+		SyntheticSource(const std::string &name, Pylon::EPixelType pixelType, uint32_t width, uint32_t height, double frameRate, size_t numBuffers, unsigned int seed = 0);
+		~SyntheticSource();
+
+		void SetJitter(int64_t jitter); // timestamps vary by up to +/- this many ns
+		void SetOffset(int64_t offset); // added to every timestamp
+		void SetDropRate(double dropRate); // fraction of the frames (0..1) that are reported as failed grabs instead, like incompletely grabbed images.
+		void SetRealTime(bool realTime); // deliver the images at the frame rate, or as fast as they are asked for
+
+		int Start(size_t numFrames, std::string &errorMessage);
+		void Stop();
+		bool IsGrabbing();
+		int RetrieveFrame(unsigned int timeoutMs, SourceFrame &frame, std::string &errorMessage);
+		uint32_t GetWidth();
+		uint32_t GetHeight();
+		Pylon::EPixelType GetPixelType();
+		std::string GetName();
+	};
+
+	// Replays the left (cameraIndex 0) or right (cameraIndex 1) images of a raw stereo recording.
+	// The images point straight into the memory mapped file, so nothing is copied. They must not be written to.
+	class ReplaySource : public IFrameSource
+	{
+	private:
+		std::string m_name;
+		std::string m_fileName;
+		int m_cameraIndex;
+		bool m_realTime = true;
+		RawStereoFile::Reader m_reader;
+		uint64_t m_frameNumber = 0;
+		uint64_t m_lastFrameNumber = 0;
+		bool m_grabbing = false;
+		std::chrono::steady_clock::time_point m_startTime;
+		int64_t m_firstTimestamp = 0; // of the first image, the real-time replay keeps the spacing of the images from it
+
+		bool GetInfo(uint64_t frameNumber, RawStereoFile::FrameInfo &info, const uint8_t *&pPayload);
+
+	public:
+		ReplaySource(const std::string &name, const std::string &fileName, int cameraIndex);
+		~ReplaySource();
+
+		int Open(std::string &errorMessage);
+		void SetRealTime(bool realTime); // deliver the images at the recorded timestamps, or as fast as they are asked for
+
+		int Start(size_t numFrames, std::string &errorMessage);
+		void Stop();
+		bool IsGrabbing();
+		int RetrieveFrame(unsigned int timeoutMs, SourceFrame &frame, std::string &errorMessage);
+		uint32_t GetWidth();
+		uint32_t GetHeight();
+		Pylon::EPixelType GetPixelType();
+		std::string GetName();
+	};
+
+	const char *GetSourceTypeName(ESourceType sourceType);
+}
+
+// *********************************************************************************************************
+// DEFINITIONS
+template <typename Camera_t, typename GrabResultPtr_t>
+FrameSource::PylonSource<Camera_t, GrabResultPtr_t>::PylonSource(Camera_t &camera, const std::string &name)
+	: m_camera(camera), m_name(name)
+{
+	// nothing
+}
+
+template <typename Camera_t, typename GrabResultPtr_t>
+FrameSource::PylonSource<Camera_t, GrabResultPtr_t>::~PylonSource()
+{
+	// nothing
+}
+
+template <typename Camera_t, typename GrabResultPtr_t>
+int FrameSource::PylonSource<Camera_t, GrabResultPtr_t>::Start(size_t numFrames, std::string &errorMessage)
+{
+	errorMessage = "ERROR: ";
+	errorMessage.append(__FUNCTION__);
+	errorMessage.append("(): ");
+
+	try
+	{
+		m_camera.StartGrabbing(numFrames);
+		return 0;
+	}
+	catch (GenICam::GenericException &e)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append(e.GetDescription());
+		return 1;
+	}
+	catch (std::exception &e)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append(e.what());
+		return 1;
+	}
+	catch (...)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append("UNKNOWN.");
+		return 1;
+	}
+}
+
+template <typename Camera_t, typename GrabResultPtr_t>
+void FrameSource::PylonSource<Camera_t, GrabResultPtr_t>::Stop()
+{
+	m_camera.StopGrabbing();
+}
+
+template <typename Camera_t, typename GrabResultPtr_t>
+bool FrameSource::PylonSource<Camera_t, GrabResultPtr_t>::IsGrabbing()
+{
+	return m_camera.IsGrabbing();
+}
+
+template <typename Camera_t, typename GrabResultPtr_t>
+int FrameSource::PylonSource<Camera_t, GrabResultPtr_t>::RetrieveFrame(unsigned int timeoutMs, SourceFrame &frame, std::string &errorMessage)
+{
+	// RetrieveResult calls the image event handler's OnImageGrabbed method.
+	GrabResultPtr_t ptrGrabResult;
+	m_camera.RetrieveResult(timeoutMs, ptrGrabResult, Pylon::TimeoutHandling_ThrowException);
+
+	if (ptrGrabResult->GrabSucceeded() == false)
+	{
+		frame.errorCode = (uint32_t)ptrGrabResult->GetErrorCode();
+		errorMessage = "Grab Failed: " + m_name + ": (" + std::to_string(ptrGrabResult->GetErrorCode()) + ") " + std::string(ptrGrabResult->GetErrorDescription().c_str());
+		return 1;
+	}
+
+	// The image keeps the Grab Result (and so the Grab Engine's buffer) for as long as it is used.
+	frame.image.AttachGrabResultBuffer(ptrGrabResult);
+	frame.timestamp = ptrGrabResult->ChunkTimestamp.GetValue();
+	frame.frameCounter = ptrGrabResult->ChunkFramecounter.GetValue();
+	return 0;
+}
+
+template <typename Camera_t, typename GrabResultPtr_t>
+uint32_t FrameSource::PylonSource<Camera_t, GrabResultPtr_t>::GetWidth()
+{
+	return (uint32_t)m_camera.Width.GetValue();
+}
+
+template <typename Camera_t, typename GrabResultPtr_t>
+uint32_t FrameSource::PylonSource<Camera_t, GrabResultPtr_t>::GetHeight()
+{
+	return (uint32_t)m_camera.Height.GetValue();
+}
+
+template <typename Camera_t, typename GrabResultPtr_t>
+Pylon::EPixelType FrameSource::PylonSource<Camera_t, GrabResultPtr_t>::GetPixelType()
+{
+	Pylon::CEnumParameter pixelFormat(m_camera.GetNodeMap(), "PixelFormat");
+	Pylon::CPixelTypeMapper pixelTypeMapper(&pixelFormat);
+	return pixelTypeMapper.GetPylonPixelTypeFromNodeValue(pixelFormat.GetIntValue());
+}
+
+template <typename Camera_t, typename GrabResultPtr_t>
+std::string FrameSource::PylonSource<Camera_t, GrabResultPtr_t>::GetName()
+{
+	return m_name;
+}
+
+inline FrameSource::SyntheticSource::SyntheticSource(const std::string &name, Pylon::EPixelType pixelType, uint32_t width, uint32_t height, double frameRate, size_t numBuffers, unsigned int seed)
+	: m_name(name), m_pixelType(pixelType), m_width(width), m_height(height), m_frameRate(frameRate > 0 ? frameRate : 1), m_random(seed), m_imagePool(numBuffers)
+{
+	// nothing
+}
+
+inline FrameSource::SyntheticSource::~SyntheticSource()
+{
+	// nothing
+}
+
+inline void FrameSource::SyntheticSource::SetJitter(int64_t jitter)
+{
+	m_jitter = jitter;
+}
+
+inline void FrameSource::SyntheticSource::SetOffset(int64_t offset)
+{
+	m_offset = offset;
+}
+
+inline void FrameSource::SyntheticSource::SetDropRate(double dropRate)
+{
+	m_dropRate = dropRate;
+}
+
+inline void FrameSource::SyntheticSource::SetRealTime(bool realTime)
+{
+	m_realTime = realTime;
+}
+
+inline int FrameSource::SyntheticSource::Start(size_t numFrames, std::string &errorMessage)
+{
+	errorMessage = "ERROR: ";
+	errorMessage.append(__FUNCTION__);
+	errorMessage.append("(): ");
+
+	if (m_pixelType == Pylon::EPixelType::PixelType_Undefined || m_width == 0 || m_height == 0)
+	{
+		errorMessage.append("Pixel type, width, and height must be set");
+		return 1;
+	}
+
+	m_numFrames = numFrames;
+	m_frameNumber = 0;
+	m_grabbing = (numFrames > 0);
+	m_startTime = std::chrono::steady_clock::now();
+	return 0;
+}
+
+inline void FrameSource::SyntheticSource::Stop()
+{
+	m_grabbing = false;
+}
+
+inline bool FrameSource::SyntheticSource::IsGrabbing()
+{
+	return m_grabbing;
+}
+
+inline int FrameSource::SyntheticSource::RetrieveFrame(unsigned int timeoutMs, SourceFrame &frame, std::string &errorMessage)
+{
+	if (m_grabbing == false)
+		throw std::runtime_error(m_name + ": Not grabbing");
+
+	int64_t period = (int64_t)(1e9 / m_frameRate);
+	if (m_realTime == true)
+	{
+		std::chrono::steady_clock::time_point due = m_startTime + std::chrono::nanoseconds(period * (int64_t)m_frameNumber);
+		if (due - std::chrono::steady_clock::now() > std::chrono::milliseconds(timeoutMs))
+			throw std::runtime_error(m_name + ": Timeout waiting for the next image");
+		std::this_thread::sleep_until(due);
+	}
+
+	m_frameNumber++;
+	if (m_frameNumber >= m_numFrames)
+		m_grabbing = false;
+
+	// A dropped image is reported like an incompletely grabbed one: it still uses up its slot in time and its framecounter.
+	std::uniform_real_distribution<double> dropDistribution(0.0, 1.0);
+	if (m_dropRate > 0 && dropDistribution(m_random) < m_dropRate)
+	{
+		errorMessage = "Grab Failed: " + m_name + ": Image " + std::to_string(m_frameNumber - 1) + " dropped (synthetic)";
+		return 1;
+	}
+
+	// Reuse the images once the rest of the program is done with them, like the Grab Engine reuses its buffers.
+	Pylon::CPylonImage &image = m_imagePool.GetImage();
+	if (StitchImage::IsReusable(image, m_pixelType, m_width, m_height) == false)
+	{
+		image.Reset(m_pixelType, m_width, m_height);
+
+		// A diagonal gradient, so stitching mistakes are easy to spot.
+		uint8_t *pBuffer = (uint8_t*)image.GetBuffer();
+		size_t stride = StitchImage::GetStride(image);
+		for (uint32_t y = 0; y < m_height; y++)
+		{
+			for (size_t x = 0; x < stride; x++)
+				pBuffer[y * stride + x] = (uint8_t)(x + y);
+		}
+	}
+
+	// Mark the image with its framecounter, so it can be told apart from the others.
+	size_t markSize = std::min<size_t>(sizeof(uint64_t), image.GetImageSize());
+	uint64_t frameCounter = m_frameNumber - 1;
+	memcpy(image.GetBuffer(), &frameCounter, markSize);
+
+	int64_t jitter = 0;
+	if (m_jitter > 0)
+		jitter = std::uniform_int_distribution<int64_t>(-m_jitter, m_jitter)(m_random);
+
+	frame.image = image;
+	frame.timestamp = period * (int64_t)frameCounter + m_offset + jitter;
+	frame.frameCounter = (int64_t)frameCounter;
+	return 0;
+}
+
+inline uint32_t FrameSource::SyntheticSource::GetWidth()
+{
+	return m_width;
+}
+
+inline uint32_t FrameSource::SyntheticSource::GetHeight()
+{
+	return m_height;
+}
+
+inline Pylon::EPixelType FrameSource::SyntheticSource::GetPixelType()
+{
+	return m_pixelType;
+}
+
+inline std::string FrameSource::SyntheticSource::GetName()
+{
+	return m_name;
+}
+
+inline FrameSource::ReplaySource::ReplaySource(const std::string &name, const std::string &fileName, int cameraIndex)
+	: m_name(name), m_fileName(fileName), m_cameraIndex(cameraIndex)
+{
+	// nothing
+}
+
+inline FrameSource::ReplaySource::~ReplaySource()
+{
+	// nothing
+}
+
+inline int FrameSource::ReplaySource::Open(std::string &errorMessage)
+{
+	if (m_reader.Open(m_fileName, errorMessage) != 0)
+		return 1;
+
+	if (m_reader.GetFrameCount() == 0)
+	{
+		errorMessage.append(m_fileName + " has no frames");
+		return 1;
+	}
+
+	RawStereoFile::FrameInfo firstInfo;
+	const uint8_t *pFirstPayload = NULL;
+	if (GetInfo(0, firstInfo, pFirstPayload) == false)
+	{
+		errorMessage.append("Frame 0 of " + m_fileName + " is damaged");
+		return 1;
+	}
+	m_firstTimestamp = firstInfo.timestamp;
+
+	return 0;
+}
+
+inline void FrameSource::ReplaySource::SetRealTime(bool realTime)
+{
+	m_realTime = realTime;
+}
+
+inline bool FrameSource::ReplaySource::GetInfo(uint64_t frameNumber, RawStereoFile::FrameInfo &info, const uint8_t *&pPayload)
+{
+	RawStereoFile::Frame frame;
+	if (m_reader.GetFrame(frameNumber, frame) == false)
+		return false;
+
+	info = (m_cameraIndex == 0) ? frame.left : frame.right;
+	pPayload = (m_cameraIndex == 0) ? frame.pLeft : frame.pRight;
+	return true;
+}
+
+inline int FrameSource::ReplaySource::Start(size_t numFrames, std::string &errorMessage)
+{
+	errorMessage = "ERROR: ";
+	errorMessage.append(__FUNCTION__);
+	errorMessage.append("(): ");
+
+	if (m_reader.GetFrameCount() == 0)
+	{
+		errorMessage.append("Not open");
+		return 1;
+	}
+
+	m_frameNumber = 0;
+	m_lastFrameNumber = std::min<uint64_t>(numFrames, m_reader.GetFrameCount());
+	m_grabbing = (m_lastFrameNumber > 0);
+	m_startTime = std::chrono::steady_clock::now();
+	return 0;
+}
+
+inline void FrameSource::ReplaySource::Stop()
+{
+	m_grabbing = false;
+}
+
+inline bool FrameSource::ReplaySource::IsGrabbing()
+{
+	return m_grabbing;
+}
+
+inline int FrameSource::ReplaySource::RetrieveFrame(unsigned int timeoutMs, SourceFrame &frame, std::string &errorMessage)
+{
+	if (m_grabbing == false)
+		throw std::runtime_error(m_name + ": Not grabbing");
+
+	RawStereoFile::FrameInfo info;
+	const uint8_t *pPayload = NULL;
+	uint64_t frameNumber = m_frameNumber++;
+	if (m_frameNumber >= m_lastFrameNumber)
+		m_grabbing = false;
+
+	if (GetInfo(frameNumber, info, pPayload) == false)
+	{
+		errorMessage = m_name + ": Frame " + std::to_string(frameNumber) + " of " + m_fileName + " is damaged";
+		return 1;
+	}
+
+	if (m_realTime == true)
+	{
+		// keep the recorded spacing between the images
+		std::chrono::steady_clock::time_point due = m_startTime + std::chrono::nanoseconds(info.timestamp - m_firstTimestamp);
+		if (due - std::chrono::steady_clock::now() > std::chrono::milliseconds(timeoutMs))
+			throw std::runtime_error(m_name + ": Timeout waiting for the next image");
+		std::this_thread::sleep_until(due);
+	}
+
+	frame.image.AttachUserBuffer((void*)pPayload, (size_t)info.size, (Pylon::EPixelType)info.pixelType, info.width, info.height, info.paddingX);
+	frame.timestamp = info.timestamp;
+	frame.frameCounter = info.frameCounter;
+	return 0;
+}
+
+inline uint32_t FrameSource::ReplaySource::GetWidth()
+{
+	RawStereoFile::FrameInfo info;
+	const uint8_t *pPayload = NULL;
+	return GetInfo(0, info, pPayload) ? info.width : 0;
+}
+
+inline uint32_t FrameSource::ReplaySource::GetHeight()
+{
+	RawStereoFile::FrameInfo info;
+	const uint8_t *pPayload = NULL;
+	return GetInfo(0, info, pPayload) ? info.height : 0;
+}
+
+inline Pylon::EPixelType FrameSource::ReplaySource::GetPixelType()
+{
+	RawStereoFile::FrameInfo info;
+	const uint8_t *pPayload = NULL;
+	return GetInfo(0, info, pPayload) ? (Pylon::EPixelType)info.pixelType : Pylon::EPixelType::PixelType_Undefined;
+}
+
+inline std::string FrameSource::ReplaySource::GetName()
+{
+	return m_name;
+}
+
+inline const char *FrameSource::GetSourceTypeName(ESourceType sourceType)
+{
+	switch (sourceType)
+	{
+	case SourceType_Pylon:
+		return "Pylon";
+	case SourceType_Synthetic:
+		return "Synthetic";
+	case SourceType_Replay:
+		return "Replay";
+	default:
+		return "Unknown";
+	}
+}
+
+// *********************************************************************************************************
+
+#endif
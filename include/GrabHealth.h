@@ -0,0 +1,446 @@
+// GrabHealth.h
+// Watches the Grab Engines from a thread of its own: samples their buffer queues and stream grabber statistics every now and then, keeps rolling counters, and raises alerts.
+// Doesn't need pylon: the statistics of the cameras are read by GrabHealthCamera.h.
+// Copyright (c) 2019 Matthew Breit - matt.breit@baslerweb.com or matt.breit@gmail.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef GRABHEALTH_H
+#define GRABHEALTH_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace GrabHealth
+{
+	// The state of one camera's Grab Engine and stream grabber at one moment. Counters that can't be read are -1.
+	// The Statistic_ counters count up from when grabbing started.
+	struct StreamSample
+	{
+		int64_t queuedBuffers = -1; // NumQueuedBuffers: waiting to be filled
+		int64_t readyBuffers = -1; // NumReadyBuffers: filled, waiting to be retrieved
+		int64_t totalBuffers = -1; // Statistic_Total_Buffer_Count
+		int64_t failedBuffers = -1; // Statistic_Failed_Buffer_Count (eg: incompletely grabbed)
+		int64_t bufferUnderruns = -1; // Statistic_Buffer_Underrun_Count: an image arrived and there was no buffer for it
+		int64_t failedPackets = -1; // Statistic_Failed_Packet_Count
+		int64_t resendRequests = -1; // Statistic_Resend_Request_Count
+		int64_t resendPackets = -1; // Statistic_Resend_Packet_Count
+	};
+
+	// Where the samples come from. CameraStatisticsSource (GrabHealthCamera.h) reads them from the cameras. Anything else (eg: a simulated series)
+	// can be used to try out the monitor without cameras.
+	class IStatisticsSource
+	{
+	public:
+		virtual ~IStatisticsSource() {}
+
+		virtual int GetNumStreams() = 0;
+		virtual std::string GetName(int streamIndex) = 0;
+		virtual int ReadSamples(std::vector<StreamSample> &samples, std::string &errorMessage) = 0;
+	};
+
+	enum EAlertType
+	{
+		Alert_BufferUnderrun, // images were lost for lack of buffers (or all buffers are filled and waiting to be retrieved)
+		Alert_FailedBuffers,  // images were grabbed incompletely
+		Alert_PacketErrors,   // packets were lost
+		Alert_Resends,        // packets had to be sent again (the network or the host is close to its limit)
+		Alert_ReadError       // the statistics could not be read
+	};
+
+	struct Alert
+	{
+		EAlertType type = Alert_ReadError;
+		int streamIndex = -1; // -1 = not about a single stream
+		int64_t count = 0; // how many happened since the previous sample
+		std::string message;
+	};
+
+	// The counters of one stream, over the whole run and over the last few samples.
+	struct StreamHealth
+	{
+		std::string name;
+		StreamSample lastSample;
+		// since the monitor was started
+		int64_t failedBuffers = 0;
+		int64_t bufferUnderruns = 0;
+		int64_t failedPackets = 0;
+		int64_t resendRequests = 0;
+		int64_t resendPackets = 0;
+		int64_t underrunSamples = 0; // samples where the input queue was empty while images were waiting in the output queue
+		int64_t minQueuedBuffers = -1;
+		int64_t maxReadyBuffers = -1;
+		// over the rolling window
+		int64_t windowFailedBuffers = 0;
+		int64_t windowBufferUnderruns = 0;
+		int64_t windowFailedPackets = 0;
+		int64_t windowResendPackets = 0;
+		int numAlerts = 0;
+	};
+
+	// Samples a statistics source every poll interval on its own thread, so whoever retrieves the images never has to touch a camera parameter.
+	class HealthMonitor
+	{
+	private:
+		double m_pollInterval = 1.0;
+		size_t m_windowSize = 10;
+		std::function<void(const Alert &alert)> m_onAlert;
+		IStatisticsSource *m_pSource = NULL;
+		std::vector<StreamHealth> m_health;
+		std::vector<StreamSample> m_previousSamples;
+		std::vector<StreamSample> m_firstSamples;
+		std::deque<std::vector<StreamSample>> m_window; // the deltas of the last m_windowSize samples, per stream
+		int m_numSamples = 0;
+		int m_numReadErrors = 0;
+		std::mutex m_mutex; // guards the health counters
+		std::mutex m_wakeMutex;
+		std::condition_variable m_wake;
+		std::thread m_thread;
+		bool m_running = false;
+		bool m_stopping = false;
+
+		void MonitorLoop();
+		void TakeSample();
+
+	public:
+		HealthMonitor();
+		~HealthMonitor();
+
+		void SetPollInterval(double seconds);
+		double GetPollInterval();
+		void SetWindowSize(size_t numSamples); // how many samples the rolling counters cover
+		size_t GetWindowSize();
+		// Called on the monitor's thread for every alert. Must not block for long.
+		void SetAlertCallback(std::function<void(const Alert &alert)> onAlert);
+
+		int Start(IStatisticsSource &source, std::string &errorMessage);
+		// Takes one last sample, so the totals include the end of the run.
+		int Stop(std::string &errorMessage);
+		bool IsRunning();
+		int GetNumSamples();
+		std::vector<StreamHealth> GetHealth();
+		void PrintSummary(std::ostream &stream);
+	};
+
+	const char *GetAlertTypeName(EAlertType type);
+}
+
+// *********************************************************************************************************
+// DEFINITIONS
+inline GrabHealth::HealthMonitor::HealthMonitor()
+{
+	// nothing
+}
+
+inline GrabHealth::HealthMonitor::~HealthMonitor()
+{
+	// the monitor's thread must not outlive the source and the alert callback it uses
+	std::string errorMessage = "";
+	Stop(errorMessage);
+}
+
+inline void GrabHealth::HealthMonitor::SetPollInterval(double seconds)
+{
+	m_pollInterval = seconds;
+}
+
+inline double GrabHealth::HealthMonitor::GetPollInterval()
+{
+	return m_pollInterval;
+}
+
+inline void GrabHealth::HealthMonitor::SetWindowSize(size_t numSamples)
+{
+	m_windowSize = (numSamples > 0) ? numSamples : 1;
+}
+
+inline size_t GrabHealth::HealthMonitor::GetWindowSize()
+{
+	return m_windowSize;
+}
+
+inline void GrabHealth::HealthMonitor::SetAlertCallback(std::function<void(const Alert &alert)> onAlert)
+{
+	m_onAlert = onAlert;
+}
+
+inline void GrabHealth::HealthMonitor::TakeSample()
+{
+	std::vector<StreamSample> samples;
+	std::string errorMessage = "";
+	std::vector<Alert> alerts;
+
+	if (m_pSource->ReadSamples(samples, errorMessage) != 0 || samples.size() != m_health.size())
+	{
+		Alert alert;
+		alert.type = Alert_ReadError;
+		alert.message = "Could not read the Grab Engine statistics: " + errorMessage;
+		alerts.push_back(alert);
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_numReadErrors++;
+	}
+	else
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_firstSamples.empty() == true)
+		{
+			// The counters may not start at 0 (eg: grabbing had started before the monitor), so everything is counted from the first sample.
+			m_firstSamples = samples;
+			m_previousSamples = samples;
+		}
+
+		// a counter that can't be read (-1) doesn't count
+		auto Delta = [](int64_t current, int64_t previous) -> int64_t
+		{
+			return (current >= 0 && previous >= 0 && current > previous) ? current - previous : 0;
+		};
+
+		std::vector<StreamSample> deltas(samples.size());
+		for (size_t i = 0; i < samples.size(); i++)
+		{
+			const StreamSample &sample = samples[i];
+			const StreamSample &previous = m_previousSamples[i];
+			StreamSample &delta = deltas[i];
+			StreamHealth &health = m_health[i];
+
+			delta.failedBuffers = Delta(sample.failedBuffers, previous.failedBuffers);
+			delta.bufferUnderruns = Delta(sample.bufferUnderruns, previous.bufferUnderruns);
+			delta.failedPackets = Delta(sample.failedPackets, previous.failedPackets);
+			delta.resendRequests = Delta(sample.resendRequests, previous.resendRequests);
+			delta.resendPackets = Delta(sample.resendPackets, previous.resendPackets);
+
+			health.lastSample = sample;
+			health.failedBuffers += delta.failedBuffers;
+			health.bufferUnderruns += delta.bufferUnderruns;
+			health.failedPackets += delta.failedPackets;
+			health.resendRequests += delta.resendRequests;
+			health.resendPackets += delta.resendPackets;
+			if (sample.queuedBuffers >= 0 && (health.minQueuedBuffers < 0 || sample.queuedBuffers < health.minQueuedBuffers))
+				health.minQueuedBuffers = sample.queuedBuffers;
+			if (sample.readyBuffers > health.maxReadyBuffers)
+				health.maxReadyBuffers = sample.readyBuffers;
+
+			// The input queue is empty while images wait to be retrieved: the Grab Engine can't receive the next image.
+			bool starved = (sample.queuedBuffers == 0 && sample.readyBuffers > 0);
+			if (starved == true)
+				health.underrunSamples++;
+
+			auto Raise = [&](EAlertType type, int64_t count, const std::string &what)
+			{
+				Alert alert;
+				alert.type = type;
+				alert.streamIndex = (int)i;
+				alert.count = count;
+				alert.message = health.name + ": " + what;
+				alerts.push_back(alert);
+				health.numAlerts++;
+			};
+
+			if (delta.bufferUnderruns > 0 || starved == true)
+				Raise(Alert_BufferUnderrun, delta.bufferUnderruns, "Buffer underrun (" + std::to_string(delta.bufferUnderruns) + " images lost, " + std::to_string(sample.readyBuffers) + " waiting to be retrieved). Increase MaxNumBuffer or make the image processing run faster.");
+			if (delta.failedBuffers > 0)
+				Raise(Alert_FailedBuffers, delta.failedBuffers, std::to_string(delta.failedBuffers) + " incompletely grabbed image(s).");
+			if (delta.failedPackets > 0)
+				Raise(Alert_PacketErrors, delta.failedPackets, std::to_string(delta.failedPackets) + " lost packet(s).");
+			if (delta.resendPackets > 0)
+				Raise(Alert_Resends, delta.resendPackets, std::to_string(delta.resendPackets) + " packet(s) resent (" + std::to_string(delta.resendRequests) + " requests).");
+		}
+
+		// roll the window
+		m_window.push_back(deltas);
+		while (m_window.size() > m_windowSize)
+			m_window.pop_front();
+		for (size_t i = 0; i < m_health.size(); i++)
+		{
+			StreamHealth &health = m_health[i];
+			health.windowFailedBuffers = 0;
+			health.windowBufferUnderruns = 0;
+			health.windowFailedPackets = 0;
+			health.windowResendPackets = 0;
+			for (size_t w = 0; w < m_window.size(); w++)
+			{
+				health.windowFailedBuffers += m_window[w][i].failedBuffers;
+				health.windowBufferUnderruns += m_window[w][i].bufferUnderruns;
+				health.windowFailedPackets += m_window[w][i].failedPackets;
+				health.windowResendPackets += m_window[w][i].resendPackets;
+			}
+		}
+
+		m_previousSamples = samples;
+		m_numSamples++;
+	}
+
+	// outside the lock, so the callback may call GetHealth()
+	if (m_onAlert)
+	{
+		for (size_t i = 0; i < alerts.size(); i++)
+			m_onAlert(alerts[i]);
+	}
+}
+
+inline void GrabHealth::HealthMonitor::MonitorLoop()
+{
+	std::chrono::steady_clock::time_point nextSampleTime = std::chrono::steady_clock::now();
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_wakeMutex);
+			if (m_wake.wait_until(lock, nextSampleTime, [&]() { return m_stopping == true; }) == true)
+				return;
+		}
+
+		TakeSample();
+		nextSampleTime += std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(m_pollInterval));
+	}
+}
+
+inline int GrabHealth::HealthMonitor::Start(IStatisticsSource &source, std::string &errorMessage)
+{
+	errorMessage = "ERROR: ";
+	errorMessage.append(__FUNCTION__);
+	errorMessage.append("(): ");
+
+	try
+	{
+		std::lock_guard<std::mutex> wakeLock(m_wakeMutex);
+		if (m_running == true)
+		{
+			errorMessage.append("Monitor is already running");
+			return 1;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_pSource = &source;
+			m_health.assign(source.GetNumStreams(), StreamHealth());
+			for (int i = 0; i < source.GetNumStreams(); i++)
+				m_health[i].name = source.GetName(i);
+			m_previousSamples.clear();
+			m_firstSamples.clear();
+			m_window.clear();
+			m_numSamples = 0;
+			m_numReadErrors = 0;
+		}
+
+		m_stopping = false;
+		m_running = true;
+		m_thread = std::thread(&HealthMonitor::MonitorLoop, this);
+		return 0;
+	}
+	catch (std::exception &e)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append(e.what());
+		return 1;
+	}
+	catch (...)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append("UNKNOWN.");
+		return 1;
+	}
+}
+
+inline int GrabHealth::HealthMonitor::Stop(std::string &errorMessage)
+{
+	errorMessage = "ERROR: ";
+	errorMessage.append(__FUNCTION__);
+	errorMessage.append("(): ");
+
+	{
+		std::lock_guard<std::mutex> wakeLock(m_wakeMutex);
+		if (m_running == false)
+			return 0;
+		m_stopping = true;
+	}
+	m_wake.notify_all();
+
+	if (m_thread.joinable())
+		m_thread.join();
+
+	TakeSample();
+
+	std::lock_guard<std::mutex> wakeLock(m_wakeMutex);
+	m_running = false;
+	return 0;
+}
+
+inline bool GrabHealth::HealthMonitor::IsRunning()
+{
+	std::lock_guard<std::mutex> wakeLock(m_wakeMutex);
+	return m_running == true && m_stopping == false;
+}
+
+inline int GrabHealth::HealthMonitor::GetNumSamples()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_numSamples;
+}
+
+inline std::vector<GrabHealth::StreamHealth> GrabHealth::HealthMonitor::GetHealth()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_health;
+}
+
+inline void GrabHealth::HealthMonitor::PrintSummary(std::ostream &stream)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	const std::vector<StreamHealth> &health = m_health;
+	for (size_t i = 0; i < health.size(); i++)
+	{
+		const StreamHealth &h = health[i];
+		stream << h.name << " : images " << (h.lastSample.totalBuffers >= 0 && m_firstSamples.empty() == false ? h.lastSample.totalBuffers - m_firstSamples[i].totalBuffers : -1)
+			<< ", incomplete " << h.failedBuffers
+			<< ", lost for lack of buffers " << h.bufferUnderruns
+			<< ", lost packets " << h.failedPackets
+			<< ", resent packets " << h.resendPackets << " (" << h.resendRequests << " requests)"
+			<< ". Fewest queued buffers " << h.minQueuedBuffers << ", most ready buffers " << h.maxReadyBuffers
+			<< ". Alerts: " << h.numAlerts << std::endl;
+	}
+	if (m_numReadErrors > 0)
+		stream << "The statistics could not be read " << m_numReadErrors << " time(s)." << std::endl;
+}
+
+inline const char *GrabHealth::GetAlertTypeName(EAlertType type)
+{
+	switch (type)
+	{
+	case Alert_BufferUnderrun:
+		return "BufferUnderrun";
+	case Alert_FailedBuffers:
+		return "FailedBuffers";
+	case Alert_PacketErrors:
+		return "PacketErrors";
+	case Alert_Resends:
+		return "Resends";
+	case Alert_ReadError:
+		return "ReadError";
+	default:
+		return "Unknown";
+	}
+}
+
+// *********************************************************************************************************
+
+#endif
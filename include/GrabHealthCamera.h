@@ -0,0 +1,138 @@
+// GrabHealthCamera.h
+// Reads the buffer queues and stream grabber statistics of the cameras for GrabHealth.h.
+// Copyright (c) 2019 Matthew Breit - matt.breit@baslerweb.com or matt.breit@gmail.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef GRABHEALTHCAMERA_H
+#define GRABHEALTHCAMERA_H
+
+// Include Pylon libraries (if needed)
+#include <pylon/PylonIncludes.h>
+
+#include <cstdint>
+#include <exception>
+#include <string>
+#include <vector>
+
+#include "GrabHealth.h"
+
+namespace GrabHealth
+{
+	// Reads the buffer queues of the Instant Cameras and their stream grabbers' Statistic_ counters (GigE).
+	template <typename Camera_t>
+	class CameraStatisticsSource : public IStatisticsSource
+	{
+	private:
+		std::vector<Camera_t*> m_cameras;
+		std::vector<std::string> m_names;
+
+	public:
+		CameraStatisticsSource();
+		~CameraStatisticsSource();
+
+		void AddCamera(Camera_t &camera, const std::string &name);
+
+		int GetNumStreams();
+		std::string GetName(int streamIndex);
+		int ReadSamples(std::vector<StreamSample> &samples, std::string &errorMessage);
+	};
+}
+
+// *********************************************************************************************************
+// DEFINITIONS
+template <typename Camera_t>
+GrabHealth::CameraStatisticsSource<Camera_t>::CameraStatisticsSource()
+{
+	// nothing
+}
+
+template <typename Camera_t>
+GrabHealth::CameraStatisticsSource<Camera_t>::~CameraStatisticsSource()
+{
+	// nothing
+}
+
+template <typename Camera_t>
+void GrabHealth::CameraStatisticsSource<Camera_t>::AddCamera(Camera_t &camera, const std::string &name)
+{
+	m_cameras.push_back(&camera);
+	m_names.push_back(name);
+}
+
+template <typename Camera_t>
+int GrabHealth::CameraStatisticsSource<Camera_t>::GetNumStreams()
+{
+	return (int)m_cameras.size();
+}
+
+template <typename Camera_t>
+std::string GrabHealth::CameraStatisticsSource<Camera_t>::GetName(int streamIndex)
+{
+	return m_names[streamIndex];
+}
+
+template <typename Camera_t>
+int GrabHealth::CameraStatisticsSource<Camera_t>::ReadSamples(std::vector<StreamSample> &samples, std::string &errorMessage)
+{
+	errorMessage = "ERROR: ";
+	errorMessage.append(__FUNCTION__);
+	errorMessage.append("(): ");
+
+	try
+	{
+		// not every transport layer (or pylon version) has every counter
+		auto ReadCounter = [](GenApi::IInteger &parameter) -> int64_t
+		{
+			return GenApi::IsReadable(&parameter) ? parameter.GetValue() : -1;
+		};
+
+		samples.resize(m_cameras.size());
+		for (size_t i = 0; i < m_cameras.size(); i++)
+		{
+			Camera_t &camera = *m_cameras[i];
+			samples[i].queuedBuffers = ReadCounter(camera.NumQueuedBuffers);
+			samples[i].readyBuffers = ReadCounter(camera.NumReadyBuffers);
+			samples[i].totalBuffers = ReadCounter(camera.GetStreamGrabberParams().Statistic_Total_Buffer_Count);
+			samples[i].failedBuffers = ReadCounter(camera.GetStreamGrabberParams().Statistic_Failed_Buffer_Count);
+			samples[i].bufferUnderruns = ReadCounter(camera.GetStreamGrabberParams().Statistic_Buffer_Underrun_Count);
+			samples[i].failedPackets = ReadCounter(camera.GetStreamGrabberParams().Statistic_Failed_Packet_Count);
+			samples[i].resendRequests = ReadCounter(camera.GetStreamGrabberParams().Statistic_Resend_Request_Count);
+			samples[i].resendPackets = ReadCounter(camera.GetStreamGrabberParams().Statistic_Resend_Packet_Count);
+		}
+
+		return 0;
+	}
+	catch (GenICam::GenericException &e)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append(e.GetDescription());
+		return 1;
+	}
+	catch (std::exception &e)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append(e.what());
+		return 1;
+	}
+	catch (...)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append("UNKNOWN.");
+		return 1;
+	}
+}
+
+// *********************************************************************************************************
+
+#endif
@@ -0,0 +1,538 @@
+// MetadataJournal.h
+// Records the metadata of every image (camera, framecounter, timestamp, when it arrived, and whether it was grabbed) to a binary file, without slowing down the Grab Loop.
+// Copyright (c) 2019 Matthew Breit - matt.breit@baslerweb.com or matt.breit@gmail.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef METADATAJOURNAL_H
+#define METADATAJOURNAL_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <FileIO.h> // for MappedOutputFile and MappedFile
+
+// File layout:
+//   JournalHeader, then one Record per image, in the order they were added.
+// The file is written through a memory mapping and grown in steps. The header's record count is updated after every batch of records,
+// so a journal that wasn't closed properly (eg: the program crashed) can still be read up to the last batch.
+namespace MetadataJournal
+{
+	const uint32_t c_magic = 0x4C4E524A; // "JRNL"
+	const uint32_t c_version = 1;
+
+	enum EGrabStatus
+	{
+		GrabStatus_Grabbed = 0, // the image arrived and can be used
+		GrabStatus_Failed = 1   // the image arrived but isn't usable (eg: incompletely grabbed). errorCode says why (eg: the Grab Result's GetErrorCode()).
+	};
+
+	struct JournalHeader
+	{
+		uint32_t magic = 0;
+		uint32_t version = 0;
+		uint32_t headerSize = 0;
+		uint32_t recordSize = 0;
+		uint64_t recordCount = 0;
+		int64_t hostTimeAtOpen = 0; // the host clock (see Record::hostTime)...
+		int64_t systemTimeAtOpen = 0; // ...and the wall clock (ns since 1970) at the same moment, to turn host times into dates
+		uint64_t reserved[3] = { 0, 0, 0 };
+	};
+
+	// One image of one camera. Fixed size, so record n is at a known place in the file.
+	struct Record
+	{
+		int64_t frameCounter = 0; // ChunkFramecounter
+		int64_t timestamp = 0; // ChunkTimestamp (ns when using PTP)
+		int64_t hostTime = 0; // when the host retrieved the image (ns, steady clock, eg: Telemetry::GetHostTime())
+		uint32_t cameraIndex = 0;
+		uint32_t status = GrabStatus_Grabbed; // EGrabStatus
+		uint32_t errorCode = 0;
+		uint32_t reserved = 0;
+	};
+
+	// A bounded queue of records that any number of threads can add to, and one thread takes from, without locking.
+	// Each slot has a sequence number that says whether it is free for the producer of that round, or filled for the consumer.
+	class RecordQueue
+	{
+	private:
+		struct Slot
+		{
+			std::atomic<uint64_t> sequence;
+			Record record;
+		};
+
+		std::unique_ptr<Slot[]> m_slots;
+		uint64_t m_mask = 0; // the capacity is a power of two
+		char m_padding0[64];
+		std::atomic<uint64_t> m_tail; // next slot to fill. Shared by the producers.
+		char m_padding1[64];
+		uint64_t m_head = 0; // next slot to take. Only used by the consumer.
+
+	public:
+		RecordQueue(size_t capacity);
+		~RecordQueue();
+
+		// Never waits. Returns false if the queue is full.
+		bool TryPush(const Record &record);
+		bool TryPop(Record &record);
+		size_t GetCapacity();
+	};
+
+	// Owns the journal file, the record queue, and the thread that moves the records from the queue to the file.
+	// Add() may be called from any thread. It copies the record into the queue and returns; the file is only touched by the journal's thread.
+	class Writer
+	{
+	private:
+		RecordQueue m_queue;
+		FileIO::MappedOutputFile m_file;
+		uint64_t m_preallocationRecords = 0;
+		uint64_t m_recordCount = 0; // only used by the journal's thread while it runs
+		std::thread m_thread;
+		std::atomic<bool> m_running;
+		std::atomic<bool> m_stopping;
+		std::atomic<bool> m_failed;
+		std::atomic<uint64_t> m_recordsWritten;
+		std::atomic<uint64_t> m_recordsDropped;
+
+		void WriteLoop();
+		bool WriteRecord(const Record &record);
+		JournalHeader *GetHeader();
+
+	public:
+		// queueCapacity records can wait to be written. If the journal's thread falls that far behind, Add() drops records (and counts them).
+		Writer(size_t queueCapacity);
+		~Writer();
+
+		// The file grows in steps of preallocationRecords records.
+		int Open(const std::string &fileName, uint64_t preallocationRecords, std::string &errorMessage);
+		bool Add(const Record &record);
+		// Writes the records still in the queue and trims the file to them.
+		int Close(std::string &errorMessage);
+		bool IsOpen();
+		uint64_t GetRecordsWritten();
+		uint64_t GetRecordsDropped();
+	};
+
+	// Reads a journal through a memory mapping, eg: to convert it to .csv.
+	class Reader
+	{
+	private:
+		FileIO::MappedFile m_file;
+		JournalHeader m_header;
+		const Record *m_pRecords = NULL;
+		uint64_t m_recordCount = 0;
+
+	public:
+		Reader();
+		~Reader();
+
+		int Open(const std::string &fileName, std::string &errorMessage);
+		void Close();
+		uint64_t GetRecordCount();
+		bool GetRecord(uint64_t recordNumber, Record &record);
+		const JournalHeader &GetHeader();
+	};
+
+	const char *GetGrabStatusName(uint32_t status);
+	// Writes every record of the journal as a line of .csv (with a header line).
+	int WriteCsv(Reader &reader, std::ostream &csv, std::string &errorMessage);
+}
+
+// *********************************************************************************************************
+// DEFINITIONS
+inline MetadataJournal::RecordQueue::RecordQueue(size_t capacity)
+	: m_tail(0)
+{
+	size_t roundedCapacity = 2;
+	while (roundedCapacity < capacity)
+		roundedCapacity *= 2;
+
+	m_slots.reset(new Slot[roundedCapacity]);
+	m_mask = roundedCapacity - 1;
+	for (size_t i = 0; i < roundedCapacity; i++)
+		m_slots[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+inline MetadataJournal::RecordQueue::~RecordQueue()
+{
+	// nothing
+}
+
+inline bool MetadataJournal::RecordQueue::TryPush(const Record &record)
+{
+	uint64_t position = m_tail.load(std::memory_order_relaxed);
+	while (true)
+	{
+		Slot &slot = m_slots[position & m_mask];
+		uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+		int64_t difference = (int64_t)(sequence - position);
+
+		if (difference == 0)
+		{
+			// The slot is free for this round. Claim it, unless another producer got there first.
+			if (m_tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+			{
+				slot.record = record;
+				slot.sequence.store(position + 1, std::memory_order_release); // now the consumer may take it
+				return true;
+			}
+		}
+		else if (difference < 0)
+			return false; // full: the slot still holds a record from the previous round
+		else
+			position = m_tail.load(std::memory_order_relaxed); // another producer filled it, try the next one
+	}
+}
+
+inline bool MetadataJournal::RecordQueue::TryPop(Record &record)
+{
+	Slot &slot = m_slots[m_head & m_mask];
+	uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+	if (sequence != m_head + 1)
+		return false; // empty (or the producer that claimed it hasn't finished writing it yet)
+
+	record = slot.record;
+	slot.sequence.store(m_head + m_mask + 1, std::memory_order_release); // free for the producers of the next round
+	m_head++;
+	return true;
+}
+
+inline size_t MetadataJournal::RecordQueue::GetCapacity()
+{
+	return (size_t)(m_mask + 1);
+}
+
+inline MetadataJournal::Writer::Writer(size_t queueCapacity)
+	: m_queue(queueCapacity), m_running(false), m_stopping(false), m_failed(false), m_recordsWritten(0), m_recordsDropped(0)
+{
+	// nothing
+}
+
+inline MetadataJournal::Writer::~Writer()
+{
+	// the journal's thread must not outlive the file it writes to
+	std::string errorMessage = "";
+	Close(errorMessage);
+}
+
+inline MetadataJournal::JournalHeader *MetadataJournal::Writer::GetHeader()
+{
+	return (JournalHeader*)m_file.GetData();
+}
+
+inline int MetadataJournal::Writer::Open(const std::string &fileName, uint64_t preallocationRecords, std::string &errorMessage)
+{
+	errorMessage = "ERROR: ";
+	errorMessage.append(__FUNCTION__);
+	errorMessage.append("(): ");
+
+	try
+	{
+		if (m_running.load() == true)
+		{
+			errorMessage.append("Already open");
+			return 1;
+		}
+
+		m_preallocationRecords = (preallocationRecords > 0) ? preallocationRecords : 1;
+		if (m_file.Create(fileName, sizeof(JournalHeader) + m_preallocationRecords * sizeof(Record)) == false)
+		{
+			errorMessage.append("Could not create " + fileName);
+			return 1;
+		}
+
+		JournalHeader header;
+		header.magic = c_magic;
+		header.version = c_version;
+		header.headerSize = sizeof(JournalHeader);
+		header.recordSize = sizeof(Record);
+		header.recordCount = 0;
+		header.hostTimeAtOpen = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+		header.systemTimeAtOpen = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+		memcpy(GetHeader(), &header, sizeof(header));
+
+		m_recordCount = 0;
+		m_recordsWritten.store(0);
+		m_recordsDropped.store(0);
+		m_failed.store(false);
+		m_stopping.store(false);
+		m_running.store(true);
+		m_thread = std::thread(&Writer::WriteLoop, this);
+		return 0;
+	}
+	catch (std::exception &e)
+	{
+		m_running.store(false);
+		m_file.Close();
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append(e.what());
+		return 1;
+	}
+	catch (...)
+	{
+		m_running.store(false);
+		m_file.Close();
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append("UNKNOWN.");
+		return 1;
+	}
+}
+
+inline bool MetadataJournal::Writer::Add(const Record &record)
+{
+	if (m_running.load(std::memory_order_relaxed) == false || m_stopping.load(std::memory_order_relaxed) == true || m_failed.load(std::memory_order_relaxed) == true || m_queue.TryPush(record) == false)
+	{
+		m_recordsDropped.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+	return true;
+}
+
+inline bool MetadataJournal::Writer::WriteRecord(const Record &record)
+{
+	uint64_t end = sizeof(JournalHeader) + (m_recordCount + 1) * sizeof(Record);
+	if (end > m_file.GetSize())
+	{
+		// grow by whole preallocation steps, so this happens rarely
+		if (m_file.Resize(m_file.GetSize() + m_preallocationRecords * sizeof(Record)) == false)
+			return false;
+	}
+
+	memcpy(m_file.GetData() + sizeof(JournalHeader) + m_recordCount * sizeof(Record), &record, sizeof(Record));
+	m_recordCount++;
+	return true;
+}
+
+inline void MetadataJournal::Writer::WriteLoop()
+{
+	while (true)
+	{
+		// Check before draining, so the records added before Close() was called are all written.
+		bool stopping = m_stopping.load(std::memory_order_acquire);
+
+		uint64_t batch = 0;
+		Record record;
+		while (m_queue.TryPop(record) == true)
+		{
+			if (WriteRecord(record) == false)
+			{
+				m_failed.store(true);
+				m_recordsDropped.fetch_add(1, std::memory_order_relaxed);
+				while (m_queue.TryPop(record) == true)
+					m_recordsDropped.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+			batch++;
+		}
+
+		if (batch > 0)
+		{
+			GetHeader()->recordCount = m_recordCount; // the records before it are complete
+			m_recordsWritten.fetch_add(batch, std::memory_order_relaxed);
+		}
+
+		if (stopping == true)
+			return;
+
+		// A few images per frame period doesn't need more than this to keep up.
+		if (batch == 0)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+}
+
+inline int MetadataJournal::Writer::Close(std::string &errorMessage)
+{
+	errorMessage = "ERROR: ";
+	errorMessage.append(__FUNCTION__);
+	errorMessage.append("(): ");
+
+	if (m_running.load() == false)
+		return 0;
+
+	m_stopping.store(true, std::memory_order_release);
+	if (m_thread.joinable())
+		m_thread.join();
+	m_running.store(false);
+
+	// give back the preallocated space that wasn't used
+	bool trimmed = m_file.Resize(sizeof(JournalHeader) + m_recordCount * sizeof(Record));
+	if (trimmed == true)
+		GetHeader()->recordCount = m_recordCount;
+	m_file.Close();
+
+	if (m_failed.load() == true)
+	{
+		errorMessage.append("Could not grow the journal (disk full?). Records after the first " + std::to_string(m_recordCount) + " were lost.");
+		return 1;
+	}
+	if (trimmed == false)
+	{
+		errorMessage.append("Could not trim the journal");
+		return 1;
+	}
+
+	return 0;
+}
+
+inline bool MetadataJournal::Writer::IsOpen()
+{
+	return m_running.load() == true && m_failed.load() == false;
+}
+
+inline uint64_t MetadataJournal::Writer::GetRecordsWritten()
+{
+	return m_recordsWritten.load();
+}
+
+inline uint64_t MetadataJournal::Writer::GetRecordsDropped()
+{
+	return m_recordsDropped.load();
+}
+
+inline MetadataJournal::Reader::Reader()
+{
+	// nothing
+}
+
+inline MetadataJournal::Reader::~Reader()
+{
+	Close();
+}
+
+inline int MetadataJournal::Reader::Open(const std::string &fileName, std::string &errorMessage)
+{
+	errorMessage = "ERROR: ";
+	errorMessage.append(__FUNCTION__);
+	errorMessage.append("(): ");
+
+	try
+	{
+		Close();
+
+		if (m_file.Open(fileName) == false)
+		{
+			errorMessage.append("Could not open " + fileName);
+			return 1;
+		}
+
+		if (m_file.GetSize() < sizeof(JournalHeader))
+		{
+			Close();
+			errorMessage.append("File is too short");
+			return 1;
+		}
+		memcpy(&m_header, m_file.GetData(), sizeof(m_header));
+
+		if (m_header.magic != c_magic || m_header.version != c_version || m_header.headerSize != sizeof(JournalHeader) || m_header.recordSize != sizeof(Record))
+		{
+			Close();
+			errorMessage.append("Not a metadata journal, or written by a different version");
+			return 1;
+		}
+
+		// The rest of the file may be preallocated space (if the journal wasn't closed properly), so the header's count is used, as long as the file is big enough for it.
+		m_pRecords = (const Record*)(m_file.GetData() + sizeof(JournalHeader));
+		m_recordCount = std::min<uint64_t>(m_header.recordCount, (m_file.GetSize() - sizeof(JournalHeader)) / sizeof(Record));
+		return 0;
+	}
+	catch (std::exception &e)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append(e.what());
+		return 1;
+	}
+	catch (...)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append("UNKNOWN.");
+		return 1;
+	}
+}
+
+inline void MetadataJournal::Reader::Close()
+{
+	m_file.Close();
+	m_header = JournalHeader();
+	m_pRecords = NULL;
+	m_recordCount = 0;
+}
+
+inline uint64_t MetadataJournal::Reader::GetRecordCount()
+{
+	return m_recordCount;
+}
+
+inline bool MetadataJournal::Reader::GetRecord(uint64_t recordNumber, Record &record)
+{
+	if (recordNumber >= m_recordCount)
+		return false;
+
+	memcpy(&record, &m_pRecords[recordNumber], sizeof(Record));
+	return true;
+}
+
+inline const MetadataJournal::JournalHeader &MetadataJournal::Reader::GetHeader()
+{
+	return m_header;
+}
+
+inline const char *MetadataJournal::GetGrabStatusName(uint32_t status)
+{
+	switch (status)
+	{
+	case GrabStatus_Grabbed:
+		return "Grabbed";
+	case GrabStatus_Failed:
+		return "Failed";
+	default:
+		return "Unknown";
+	}
+}
+
+inline int MetadataJournal::WriteCsv(Reader &reader, std::ostream &csv, std::string &errorMessage)
+{
+	errorMessage = "ERROR: ";
+	errorMessage.append(__FUNCTION__);
+	errorMessage.append("(): ");
+
+	// the host times as dates (ns since 1970), using the clocks noted when the journal was opened
+	int64_t hostToSystemTime = reader.GetHeader().systemTimeAtOpen - reader.GetHeader().hostTimeAtOpen;
+
+	csv << "Record,Camera,FrameCounter,Timestamp,HostTime,HostTimeUnixNs,Status,ErrorCode\n";
+	Record record;
+	for (uint64_t i = 0; i < reader.GetRecordCount(); i++)
+	{
+		reader.GetRecord(i, record);
+		csv << i << "," << record.cameraIndex << "," << record.frameCounter << "," << record.timestamp << "," << record.hostTime << "," << record.hostTime + hostToSystemTime << ","
+			<< GetGrabStatusName(record.status) << ",0x" << std::hex << record.errorCode << std::dec << "\n";
+	}
+
+	if (csv.good() == false)
+	{
+		errorMessage.append("Could not write the .csv");
+		return 1;
+	}
+	return 0;
+}
+
+// *********************************************************************************************************
+
+#endif
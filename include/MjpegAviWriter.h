@@ -0,0 +1,717 @@
+// MjpegAviWriter.h
+// Records a Motion JPEG (or PNG) .avi video, encoding the frames on a pool of threads (one per core) and writing them in order.
+// Copyright (c) 2019 Matthew Breit - matt.breit@baslerweb.com or matt.breit@gmail.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MJPEGAVIWRITER_H
+#define MJPEGAVIWRITER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <FileIO.h> // for OutputFile
+
+// File layout (AVI 1.0, RIFF chunk sizes are 32 bit, so a file holds up to 4 GB):
+//   RIFF 'AVI '
+//     LIST 'hdrl'   avih (main header), LIST 'strl' (strh: one video stream, strf: BITMAPINFOHEADER with MJPG or MPNG compression)
+//     LIST 'movi'   one '00dc' chunk per frame, holding the JPEG (or PNG)
+//     idx1          one entry per frame: where its '00dc' chunk is, relative to the 'movi' fourcc
+// The headers are written with zero frames when the file is opened, and rewritten with the final counts when it is closed.
+namespace MjpegAviWriter
+{
+	const uint32_t c_headerSize = 224; // up to and including the 'movi' fourcc
+	const uint32_t c_moviListOffset = 212;
+	const uint32_t c_moviFourccOffset = 220; // idx1 offsets are relative to this
+	const uint32_t c_avifHasIndex = 0x10;
+	const uint32_t c_aviifKeyFrame = 0x10;
+	const uint32_t c_frameRateScale = 1000; // so fractional frame rates can be stored as dwRate / dwScale
+
+	// Little endian, as RIFF is.
+	void AppendFourcc(std::vector<uint8_t> &buffer, const char *fourcc);
+	void AppendUint32(std::vector<uint8_t> &buffer, uint32_t value);
+	void AppendUint16(std::vector<uint8_t> &buffer, uint16_t value);
+
+	// What the frames of a video are
+	struct FrameFormat
+	{
+		uint32_t width = 0;
+		uint32_t height = 0;
+		uint16_t bitsPerPixel = 24; // once decoded: 24 for BGR, 8 for 8 bit gray, 16 for 16 bit gray
+		const char *codec = "MJPG"; // the fourcc of the frames: "MJPG" (JPEG: 8 bit gray or color) or "MPNG" (PNG: also 16 bit gray, lossless)
+		double frameRate = 0;
+	};
+
+	// Writes frames that were encoded elsewhere into an .avi file. Not thread safe.
+	class AviFile
+	{
+	private:
+		FileIO::OutputFile m_file;
+		FrameFormat m_format;
+		uint64_t m_position = 0; // where the next chunk goes
+		uint32_t m_maxFrameSize = 0;
+		std::vector<uint32_t> m_index; // offset and size of each frame
+
+		std::vector<uint8_t> BuildHeaders();
+
+	public:
+		AviFile();
+		~AviFile();
+
+		int Open(const std::string &fileName, const FrameFormat &format, std::string &errorMessage);
+		int AddFrame(const uint8_t *pJpeg, size_t size, std::string &errorMessage);
+		// Writes the index and the final headers. The video can't be played without them.
+		int Close(std::string &errorMessage);
+		bool IsOpen();
+		uint64_t GetFrameCount();
+		uint64_t GetFileSize();
+	};
+
+	// Owns the encoding threads and the thread that writes the encoded frames to an AviFile.
+	// The frames are encoded in whatever order the threads finish them, and held in a reorder buffer until all of the frames before them are written.
+	// encode() must turn a frame into a JPEG or PNG, as the format says (eg: cv::imencode()), and may be called from several threads at once. It throws to report an error.
+	// Add() is meant to be called from one thread. The counters may be read from any thread.
+	template <typename T>
+	class ParallelWriter
+	{
+	private:
+		std::function<void(T &frame, std::vector<uint8_t> &jpeg)> m_encode;
+		AviFile m_file;
+		size_t m_capacity = 0;
+		std::mutex m_mutex;
+		std::condition_variable m_workAvailable;
+		std::condition_variable m_encoded;
+		std::condition_variable m_notFull;
+		std::deque<std::pair<uint64_t, T>> m_waiting; // frames waiting for a free thread, with their sequence numbers
+		std::map<uint64_t, std::vector<uint8_t>> m_reorderBuffer; // encoded frames waiting for the frames before them
+		uint64_t m_nextSequence = 0; // of the next frame added
+		uint64_t m_nextToWrite = 0;
+		size_t m_inFlight = 0; // added, but not written yet
+		size_t m_reorderHighWaterMark = 0;
+		std::vector<std::thread> m_workers;
+		std::thread m_muxer;
+		std::vector<int64_t> m_workerBusyTime; // ns spent in encode(), per thread
+		std::chrono::steady_clock::time_point m_startTime;
+		double m_elapsedTime = 0; // s from Open() to Close(), once closed
+		bool m_running = false;
+		bool m_stopping = false;
+		bool m_failed = false;
+		std::string m_failureMessage;
+		uint64_t m_framesWritten = 0;
+
+		void EncodeLoop(size_t workerIndex);
+		void MuxLoop();
+		void Fail(const std::string &message);
+
+	public:
+		ParallelWriter(std::function<void(T &frame, std::vector<uint8_t> &jpeg)> encode);
+		~ParallelWriter();
+
+		// numWorkers = 0 starts one encoding thread per core. capacity is how many frames may be encoding or waiting to be written before Add() waits.
+		int Open(const std::string &fileName, const FrameFormat &format, size_t numWorkers, size_t capacity, std::string &errorMessage);
+		// Takes the frame (it is moved, so a reference counted frame is not copied). Waits while the writer is at capacity. Returns false if the writer has failed or is not open.
+		bool Add(T &frame);
+		// Waits for the frames still being encoded, then finishes the file.
+		int Close(std::string &errorMessage);
+		bool IsOpen();
+		size_t GetNumWorkers();
+		size_t GetCapacity();
+		size_t GetReorderHighWaterMark();
+		uint64_t GetFramesWritten();
+		double GetEncodedFrameRate(); // frames written per second since Open()
+		std::vector<double> GetWorkerUtilization(); // the fraction of the time since Open() each thread spent encoding
+	};
+}
+
+// *********************************************************************************************************
+// DEFINITIONS
+inline void MjpegAviWriter::AppendFourcc(std::vector<uint8_t> &buffer, const char *fourcc)
+{
+	buffer.insert(buffer.end(), fourcc, fourcc + 4);
+}
+
+inline void MjpegAviWriter::AppendUint32(std::vector<uint8_t> &buffer, uint32_t value)
+{
+	for (int i = 0; i < 4; i++)
+		buffer.push_back((uint8_t)(value >> (8 * i)));
+}
+
+inline void MjpegAviWriter::AppendUint16(std::vector<uint8_t> &buffer, uint16_t value)
+{
+	buffer.push_back((uint8_t)value);
+	buffer.push_back((uint8_t)(value >> 8));
+}
+
+inline MjpegAviWriter::AviFile::AviFile()
+{
+	// nothing
+}
+
+inline MjpegAviWriter::AviFile::~AviFile()
+{
+	std::string errorMessage = "";
+	Close(errorMessage);
+}
+
+inline std::vector<uint8_t> MjpegAviWriter::AviFile::BuildHeaders()
+{
+	uint32_t numFrames = (uint32_t)(m_index.size() / 2);
+	uint32_t moviSize = (uint32_t)(m_position - c_moviListOffset - 8);
+	uint32_t riffSize = (uint32_t)(m_position + 8 + m_index.size() * 8 - 8); // everything after the RIFF size, including idx1
+	uint32_t microSecondsPerFrame = (uint32_t)(1000000.0 / m_format.frameRate + 0.5);
+	uint32_t maxBytesPerSecond = (uint32_t)(m_maxFrameSize * m_format.frameRate);
+
+	std::vector<uint8_t> headers;
+	headers.reserve(c_headerSize);
+	AppendFourcc(headers, "RIFF");
+	AppendUint32(headers, riffSize);
+	AppendFourcc(headers, "AVI ");
+
+	AppendFourcc(headers, "LIST");
+	AppendUint32(headers, 192); // hdrl
+	AppendFourcc(headers, "hdrl");
+
+	AppendFourcc(headers, "avih");
+	AppendUint32(headers, 56);
+	AppendUint32(headers, microSecondsPerFrame);
+	AppendUint32(headers, maxBytesPerSecond);
+	AppendUint32(headers, 0); // padding granularity
+	AppendUint32(headers, c_avifHasIndex);
+	AppendUint32(headers, numFrames);
+	AppendUint32(headers, 0); // initial frames
+	AppendUint32(headers, 1); // streams
+	AppendUint32(headers, m_maxFrameSize); // suggested buffer size
+	AppendUint32(headers, m_format.width);
+	AppendUint32(headers, m_format.height);
+	for (int i = 0; i < 4; i++)
+		AppendUint32(headers, 0); // reserved
+
+	AppendFourcc(headers, "LIST");
+	AppendUint32(headers, 116); // strl
+	AppendFourcc(headers, "strl");
+
+	AppendFourcc(headers, "strh");
+	AppendUint32(headers, 56);
+	AppendFourcc(headers, "vids");
+	AppendFourcc(headers, m_format.codec);
+	AppendUint32(headers, 0); // flags
+	AppendUint16(headers, 0); // priority
+	AppendUint16(headers, 0); // language
+	AppendUint32(headers, 0); // initial frames
+	AppendUint32(headers, c_frameRateScale);
+	AppendUint32(headers, (uint32_t)(m_format.frameRate * c_frameRateScale + 0.5));
+	AppendUint32(headers, 0); // start
+	AppendUint32(headers, numFrames); // length
+	AppendUint32(headers, m_maxFrameSize); // suggested buffer size
+	AppendUint32(headers, 0xFFFFFFFF); // quality (default)
+	AppendUint32(headers, 0); // sample size (varies)
+	AppendUint16(headers, 0); // frame rectangle
+	AppendUint16(headers, 0);
+	AppendUint16(headers, (uint16_t)m_format.width);
+	AppendUint16(headers, (uint16_t)m_format.height);
+
+	AppendFourcc(headers, "strf");
+	AppendUint32(headers, 40);
+	AppendUint32(headers, 40); // BITMAPINFOHEADER size
+	AppendUint32(headers, m_format.width);
+	AppendUint32(headers, m_format.height);
+	AppendUint16(headers, 1); // planes
+	AppendUint16(headers, m_format.bitsPerPixel);
+	AppendFourcc(headers, m_format.codec);
+	AppendUint32(headers, m_format.width * m_format.height * (m_format.bitsPerPixel / 8));
+	AppendUint32(headers, 0); // pixels per meter
+	AppendUint32(headers, 0);
+	AppendUint32(headers, 0); // colors used
+	AppendUint32(headers, 0); // colors important
+
+	AppendFourcc(headers, "LIST");
+	AppendUint32(headers, moviSize);
+	AppendFourcc(headers, "movi");
+	return headers;
+}
+
+inline int MjpegAviWriter::AviFile::Open(const std::string &fileName, const FrameFormat &format, std::string &errorMessage)
+{
+	errorMessage = "ERROR: ";
+	errorMessage.append(__FUNCTION__);
+	errorMessage.append("(): ");
+
+	try
+	{
+		if (m_file.IsOpen() == true)
+		{
+			errorMessage.append("The file is already open.");
+			return 1;
+		}
+		if (format.width == 0 || format.height == 0 || format.width > 0xFFFF || format.height > 0xFFFF || format.frameRate <= 0)
+		{
+			errorMessage.append("Invalid image size or frame rate.");
+			return 1;
+		}
+		if (format.codec == NULL || std::strlen(format.codec) != 4)
+		{
+			errorMessage.append("The codec must be a fourcc, eg: MJPG.");
+			return 1;
+		}
+
+		m_format = format;
+		m_position = c_headerSize;
+		m_maxFrameSize = 0;
+		m_index.clear();
+
+		if (m_file.Create(fileName) == false)
+		{
+			errorMessage.append("Could not create " + fileName);
+			return 1;
+		}
+
+		std::vector<uint8_t> headers = BuildHeaders();
+		if (m_file.WriteAt(0, headers.data(), headers.size()) == false)
+		{
+			m_file.Close();
+			errorMessage.append("Could not write the headers of " + fileName);
+			return 1;
+		}
+		return 0;
+	}
+	catch (std::exception &e)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append(e.what());
+		return 1;
+	}
+	catch (...)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append("UNKNOWN.");
+		return 1;
+	}
+}
+
+inline int MjpegAviWriter::AviFile::AddFrame(const uint8_t *pJpeg, size_t size, std::string &errorMessage)
+{
+	errorMessage = "ERROR: ";
+	errorMessage.append(__FUNCTION__);
+	errorMessage.append("(): ");
+
+	if (m_file.IsOpen() == false)
+	{
+		errorMessage.append("The file is not open.");
+		return 1;
+	}
+
+	// chunks start on even offsets
+	uint64_t paddedSize = size + (size & 1);
+	uint64_t indexSize = 8 + (m_index.size() / 2 + 1) * 16;
+	if (m_position + 8 + paddedSize + indexSize > 0xFFFFFFFFull)
+	{
+		errorMessage.append("The file has reached the 4 GB limit of an AVI 1.0 file.");
+		return 1;
+	}
+
+	std::vector<uint8_t> chunkHeader;
+	AppendFourcc(chunkHeader, "00dc");
+	AppendUint32(chunkHeader, (uint32_t)size);
+	const uint8_t padding = 0;
+	if (m_file.WriteAt(m_position, chunkHeader.data(), chunkHeader.size()) == false || m_file.WriteAt(m_position + 8, pJpeg, size) == false
+		|| (paddedSize != size && m_file.WriteAt(m_position + 8 + size, &padding, 1) == false))
+	{
+		errorMessage.append("Could not write the frame.");
+		return 1;
+	}
+
+	m_index.push_back((uint32_t)(m_position - c_moviFourccOffset));
+	m_index.push_back((uint32_t)size);
+	m_position += 8 + paddedSize;
+	if (size > m_maxFrameSize)
+		m_maxFrameSize = (uint32_t)size;
+	return 0;
+}
+
+inline int MjpegAviWriter::AviFile::Close(std::string &errorMessage)
+{
+	errorMessage = "ERROR: ";
+	errorMessage.append(__FUNCTION__);
+	errorMessage.append("(): ");
+
+	if (m_file.IsOpen() == false)
+		return 0;
+
+	try
+	{
+		std::vector<uint8_t> index;
+		index.reserve(8 + m_index.size() * 8);
+		AppendFourcc(index, "idx1");
+		AppendUint32(index, (uint32_t)(m_index.size() * 8));
+		for (size_t i = 0; i < m_index.size(); i += 2)
+		{
+			AppendFourcc(index, "00dc");
+			AppendUint32(index, c_aviifKeyFrame); // every JPEG is a key frame
+			AppendUint32(index, m_index[i]);
+			AppendUint32(index, m_index[i + 1]);
+		}
+
+		std::vector<uint8_t> headers = BuildHeaders();
+		bool written = m_file.WriteAt(m_position, index.data(), index.size()) && m_file.WriteAt(0, headers.data(), headers.size());
+		m_file.Close();
+		if (written == false)
+		{
+			errorMessage.append("Could not write the index and headers.");
+			return 1;
+		}
+		return 0;
+	}
+	catch (std::exception &e)
+	{
+		m_file.Close();
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append(e.what());
+		return 1;
+	}
+	catch (...)
+	{
+		m_file.Close();
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append("UNKNOWN.");
+		return 1;
+	}
+}
+
+inline bool MjpegAviWriter::AviFile::IsOpen()
+{
+	return m_file.IsOpen();
+}
+
+inline uint64_t MjpegAviWriter::AviFile::GetFrameCount()
+{
+	return m_index.size() / 2;
+}
+
+inline uint64_t MjpegAviWriter::AviFile::GetFileSize()
+{
+	return m_position + 8 + m_index.size() * 8;
+}
+
+template <typename T>
+MjpegAviWriter::ParallelWriter<T>::ParallelWriter(std::function<void(T &frame, std::vector<uint8_t> &jpeg)> encode)
+	: m_encode(encode)
+{
+	// nothing
+}
+
+template <typename T>
+MjpegAviWriter::ParallelWriter<T>::~ParallelWriter()
+{
+	// the threads must not outlive the frames and the encode() function they use
+	std::string errorMessage = "";
+	Close(errorMessage);
+}
+
+template <typename T>
+void MjpegAviWriter::ParallelWriter<T>::Fail(const std::string &message)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_failed == false)
+			m_failureMessage = message;
+		m_failed = true;
+		m_waiting.clear();
+		m_reorderBuffer.clear();
+	}
+	m_workAvailable.notify_all();
+	m_encoded.notify_all();
+	m_notFull.notify_all();
+}
+
+template <typename T>
+int MjpegAviWriter::ParallelWriter<T>::Open(const std::string &fileName, const FrameFormat &format, size_t numWorkers, size_t capacity, std::string &errorMessage)
+{
+	if (m_running == true)
+	{
+		errorMessage = "ERROR: ";
+		errorMessage.append(__FUNCTION__);
+		errorMessage.append("(): Writer is already open");
+		return 1;
+	}
+
+	if (m_file.Open(fileName, format, errorMessage) != 0)
+		return 1;
+
+	errorMessage = "ERROR: ";
+	errorMessage.append(__FUNCTION__);
+	errorMessage.append("(): ");
+
+	try
+	{
+		if (numWorkers == 0)
+			numWorkers = std::thread::hardware_concurrency();
+		if (numWorkers == 0)
+			numWorkers = 1;
+		m_capacity = (capacity > numWorkers) ? capacity : numWorkers; // at least one frame per thread, or some would sit idle
+
+		m_waiting.clear();
+		m_reorderBuffer.clear();
+		m_nextSequence = 0;
+		m_nextToWrite = 0;
+		m_inFlight = 0;
+		m_reorderHighWaterMark = 0;
+		m_workerBusyTime.assign(numWorkers, 0);
+		m_elapsedTime = 0;
+		m_stopping = false;
+		m_failed = false;
+		m_failureMessage = "";
+		m_framesWritten = 0;
+		m_startTime = std::chrono::steady_clock::now();
+		m_running = true;
+
+		m_muxer = std::thread(&ParallelWriter<T>::MuxLoop, this);
+		for (size_t i = 0; i < numWorkers; i++)
+			m_workers.push_back(std::thread(&ParallelWriter<T>::EncodeLoop, this, i));
+		return 0;
+	}
+	catch (std::exception &e)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append(e.what());
+	}
+	catch (...)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append("UNKNOWN.");
+	}
+
+	// a thread could not be started, so stop the ones that were
+	std::string closeErrorMessage = "";
+	Close(closeErrorMessage);
+	m_file.Close(closeErrorMessage);
+	return 1;
+}
+
+template <typename T>
+bool MjpegAviWriter::ParallelWriter<T>::Add(T &frame)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_notFull.wait(lock, [&]() { return m_inFlight < m_capacity || m_running == false || m_stopping == true || m_failed == true; });
+	if (m_running == false || m_stopping == true || m_failed == true)
+		return false;
+
+	m_waiting.push_back(std::make_pair(m_nextSequence, std::move(frame)));
+	m_nextSequence++;
+	m_inFlight++;
+
+	lock.unlock();
+	m_workAvailable.notify_one();
+	return true;
+}
+
+template <typename T>
+void MjpegAviWriter::ParallelWriter<T>::EncodeLoop(size_t workerIndex)
+{
+	while (true)
+	{
+		std::pair<uint64_t, T> work;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_workAvailable.wait(lock, [&]() { return m_waiting.empty() == false || m_stopping == true || m_failed == true; });
+
+			// When stopping, the frames still waiting are encoded first.
+			if (m_failed == true || m_waiting.empty() == true)
+				return;
+
+			work = std::move(m_waiting.front());
+			m_waiting.pop_front();
+		}
+
+		// The (slow) encoding happens without holding the lock, so the other threads and Add() are never held up by it.
+		std::vector<uint8_t> jpeg;
+		std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+		try
+		{
+			m_encode(work.second, jpeg);
+		}
+		catch (std::exception &e)
+		{
+			Fail(std::string("Encoding failed: ") + e.what());
+			return;
+		}
+		catch (...)
+		{
+			Fail("Encoding failed: UNKNOWN.");
+			return;
+		}
+		work.second = T(); // done with the frame (eg: an image buffer)
+		int64_t busyTime = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count();
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_workerBusyTime[workerIndex] += busyTime;
+			if (m_failed == true)
+				return;
+			m_reorderBuffer[work.first] = std::move(jpeg);
+			if (m_reorderBuffer.size() > m_reorderHighWaterMark)
+				m_reorderHighWaterMark = m_reorderBuffer.size();
+		}
+		m_encoded.notify_one();
+	}
+}
+
+template <typename T>
+void MjpegAviWriter::ParallelWriter<T>::MuxLoop()
+{
+	while (true)
+	{
+		std::vector<uint8_t> jpeg;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_encoded.wait(lock, [&]() { return m_failed == true || m_reorderBuffer.count(m_nextToWrite) > 0 || (m_stopping == true && m_inFlight == 0); });
+			if (m_failed == true || m_reorderBuffer.count(m_nextToWrite) == 0)
+				return;
+
+			std::map<uint64_t, std::vector<uint8_t>>::iterator next = m_reorderBuffer.find(m_nextToWrite);
+			jpeg = std::move(next->second);
+			m_reorderBuffer.erase(next);
+		}
+
+		// Only this thread touches the file.
+		std::string errorMessage = "";
+		if (m_file.AddFrame(jpeg.data(), jpeg.size(), errorMessage) != 0)
+		{
+			Fail(errorMessage);
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_nextToWrite++;
+			m_inFlight--;
+			m_framesWritten++;
+		}
+		m_notFull.notify_one();
+		m_encoded.notify_one(); // in case this was the last frame Close() is waiting for
+	}
+}
+
+template <typename T>
+int MjpegAviWriter::ParallelWriter<T>::Close(std::string &errorMessage)
+{
+	errorMessage = "ERROR: ";
+	errorMessage.append(__FUNCTION__);
+	errorMessage.append("(): ");
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_running == false)
+			return 0;
+		m_stopping = true;
+	}
+	m_workAvailable.notify_all();
+	m_notFull.notify_all();
+
+	for (size_t i = 0; i < m_workers.size(); i++)
+	{
+		if (m_workers[i].joinable())
+			m_workers[i].join();
+	}
+	m_workers.clear();
+	m_encoded.notify_all();
+	if (m_muxer.joinable())
+		m_muxer.join();
+
+	// The frames written so far make a playable video, even if writing failed part way.
+	std::string fileErrorMessage = "";
+	int fileResult = m_file.Close(fileErrorMessage);
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_elapsedTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_startTime).count();
+	m_running = false;
+	if (m_failed == true)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append(m_failureMessage);
+		return 1;
+	}
+	if (fileResult != 0)
+	{
+		errorMessage = fileErrorMessage;
+		return 1;
+	}
+
+	return 0;
+}
+
+template <typename T>
+bool MjpegAviWriter::ParallelWriter<T>::IsOpen()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_running == true && m_stopping == false && m_failed == false;
+}
+
+template <typename T>
+size_t MjpegAviWriter::ParallelWriter<T>::GetNumWorkers()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_workerBusyTime.size();
+}
+
+template <typename T>
+size_t MjpegAviWriter::ParallelWriter<T>::GetCapacity()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_capacity;
+}
+
+template <typename T>
+size_t MjpegAviWriter::ParallelWriter<T>::GetReorderHighWaterMark()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_reorderHighWaterMark;
+}
+
+template <typename T>
+uint64_t MjpegAviWriter::ParallelWriter<T>::GetFramesWritten()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_framesWritten;
+}
+
+template <typename T>
+double MjpegAviWriter::ParallelWriter<T>::GetEncodedFrameRate()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	double elapsedTime = (m_running == true) ? std::chrono::duration<double>(std::chrono::steady_clock::now() - m_startTime).count() : m_elapsedTime;
+	return (elapsedTime > 0) ? m_framesWritten / elapsedTime : 0.0;
+}
+
+template <typename T>
+std::vector<double> MjpegAviWriter::ParallelWriter<T>::GetWorkerUtilization()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	double elapsedTime = (m_running == true) ? std::chrono::duration<double>(std::chrono::steady_clock::now() - m_startTime).count() : m_elapsedTime;
+	std::vector<double> utilization(m_workerBusyTime.size(), 0.0);
+	for (size_t i = 0; i < m_workerBusyTime.size() && elapsedTime > 0; i++)
+		utilization[i] = m_workerBusyTime[i] / 1e9 / elapsedTime;
+	return utilization;
+}
+
+// *********************************************************************************************************
+
+#endif
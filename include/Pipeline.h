@@ -0,0 +1,243 @@
+// Pipeline.h
+// Bounded lock-free single-producer/single-consumer (SPSC) queues and a helper to run processing stages on their own threads.
+// Copyright (c) 2019 Matthew Breit - matt.breit@baslerweb.com or matt.breit@gmail.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Pipeline
+{
+	// A bounded queue that passes items from exactly one producer thread to exactly one consumer thread without locking.
+	// Either side may Close() the queue: the producer to signal the end of the stream, the consumer to signal that it has stopped.
+	template <typename T>
+	class SpscQueue
+	{
+	private:
+		std::vector<T> m_slots; // one more slot than the capacity, so that a full queue can be told apart from an empty one
+		char m_padding0[64];
+		std::atomic<size_t> m_head; // next slot to pop. Written only by the consumer.
+		char m_padding1[64];
+		std::atomic<size_t> m_tail; // next slot to push. Written only by the producer.
+		char m_padding2[64];
+		std::atomic<size_t> m_highWaterMark;
+		std::atomic<bool> m_closed;
+
+	public:
+		SpscQueue(size_t capacity);
+		~SpscQueue();
+
+		bool TryPush(T &item);
+		bool TryPop(T &item);
+		bool Push(T &item);
+		bool Pop(T &item);
+		void Close();
+		bool IsClosed();
+		size_t GetSize();
+		size_t GetCapacity();
+		size_t GetHighWaterMark();
+	};
+
+	// Waits a little longer each time it is called. Used while a queue is empty (consumer) or full (producer).
+	void Backoff(int &attempt);
+
+	// Runs one pipeline stage on the calling thread: pops items from inQueue, processes them, and pushes them to outQueue (if not NULL).
+	// process() returns false to drop an item instead of passing it on.
+	// Returns when inQueue is closed and drained (0), or when an exception occurs or outQueue is closed by its consumer (1).
+	// In both cases both queues are closed on return, so neighbouring stages also wind down.
+	template <typename T>
+	int RunStage(const std::string &stageName, SpscQueue<T> &inQueue, SpscQueue<T> *outQueue, std::function<bool(T &item)> process, std::string &errorMessage);
+}
+
+// *********************************************************************************************************
+// DEFINITIONS
+template <typename T>
+Pipeline::SpscQueue<T>::SpscQueue(size_t capacity)
+	: m_slots(capacity + 1), m_head(0), m_tail(0), m_highWaterMark(0), m_closed(false)
+{
+	// nothing
+}
+
+template <typename T>
+Pipeline::SpscQueue<T>::~SpscQueue()
+{
+	// nothing
+}
+
+template <typename T>
+bool Pipeline::SpscQueue<T>::TryPush(T &item)
+{
+	size_t tail = m_tail.load(std::memory_order_relaxed);
+	size_t nextTail = (tail + 1) % m_slots.size();
+
+	if (nextTail == m_head.load(std::memory_order_acquire))
+		return false; // full
+
+	m_slots[tail] = std::move(item);
+	m_tail.store(nextTail, std::memory_order_release);
+
+	size_t size = GetSize();
+	size_t highWaterMark = m_highWaterMark.load(std::memory_order_relaxed);
+	if (size > highWaterMark)
+		m_highWaterMark.store(size, std::memory_order_relaxed); // only the producer writes this
+
+	return true;
+}
+
+template <typename T>
+bool Pipeline::SpscQueue<T>::TryPop(T &item)
+{
+	size_t head = m_head.load(std::memory_order_relaxed);
+
+	if (head == m_tail.load(std::memory_order_acquire))
+		return false; // empty
+
+	item = std::move(m_slots[head]);
+	m_slots[head] = T(); // don't keep a reference to the item (eg: a grab result) in the queue
+	m_head.store((head + 1) % m_slots.size(), std::memory_order_release);
+
+	return true;
+}
+
+template <typename T>
+bool Pipeline::SpscQueue<T>::Push(T &item)
+{
+	int attempt = 0;
+	while (IsClosed() == false)
+	{
+		if (TryPush(item) == true)
+			return true;
+		Backoff(attempt);
+	}
+	return false;
+}
+
+template <typename T>
+bool Pipeline::SpscQueue<T>::Pop(T &item)
+{
+	int attempt = 0;
+	while (true)
+	{
+		if (TryPop(item) == true)
+			return true;
+
+		// The producer may have pushed its last item just before closing, so look once more after seeing the queue closed.
+		if (IsClosed() == true)
+			return TryPop(item);
+
+		Backoff(attempt);
+	}
+}
+
+template <typename T>
+void Pipeline::SpscQueue<T>::Close()
+{
+	m_closed.store(true, std::memory_order_release);
+}
+
+template <typename T>
+bool Pipeline::SpscQueue<T>::IsClosed()
+{
+	return m_closed.load(std::memory_order_acquire);
+}
+
+template <typename T>
+size_t Pipeline::SpscQueue<T>::GetSize()
+{
+	size_t head = m_head.load(std::memory_order_acquire);
+	size_t tail = m_tail.load(std::memory_order_acquire);
+	return (tail + m_slots.size() - head) % m_slots.size();
+}
+
+template <typename T>
+size_t Pipeline::SpscQueue<T>::GetCapacity()
+{
+	return m_slots.size() - 1;
+}
+
+template <typename T>
+size_t Pipeline::SpscQueue<T>::GetHighWaterMark()
+{
+	return m_highWaterMark.load(std::memory_order_relaxed);
+}
+
+inline void Pipeline::Backoff(int &attempt)
+{
+	// spin briefly first (the other side is usually only a moment away), then give up the core.
+	if (attempt < 16)
+		std::this_thread::yield();
+	else
+		std::this_thread::sleep_for(std::chrono::microseconds(attempt < 64 ? 50 : 500));
+
+	attempt++;
+}
+
+template <typename T>
+int Pipeline::RunStage(const std::string &stageName, SpscQueue<T> &inQueue, SpscQueue<T> *outQueue, std::function<bool(T &item)> process, std::string &errorMessage)
+{
+	errorMessage = "ERROR: ";
+	errorMessage.append(__FUNCTION__);
+	errorMessage.append("(" + stageName + "): ");
+
+	int result = 0;
+
+	try
+	{
+		T item;
+		while (inQueue.Pop(item) == true)
+		{
+			bool passOn = process(item);
+			if (passOn == true && outQueue != NULL && outQueue->Push(item) == false)
+			{
+				errorMessage.append("Next stage has stopped");
+				result = 1;
+				break;
+			}
+
+			// let go of this stage's copy right away, so its buffers (eg: grab results, pooled images) aren't held until the next item arrives
+			item = T();
+		}
+	}
+	catch (std::exception &e)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append(e.what());
+		result = 1;
+	}
+	catch (...)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append("UNKNOWN.");
+		result = 1;
+	}
+
+	// let the previous stage know we've stopped, and the next stage know there is nothing more coming.
+	inQueue.Close();
+	if (outQueue != NULL)
+		outQueue->Close();
+
+	return result;
+}
+
+// *********************************************************************************************************
+
+#endif
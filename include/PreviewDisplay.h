@@ -0,0 +1,275 @@
+// PreviewDisplay.h
+// Shows the latest frame on its own thread at a capped rate, so a slow display (or a GUI event loop) never holds up the caller.
+// Copyright (c) 2019 Matthew Breit - matt.breit@baslerweb.com or matt.breit@gmail.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PREVIEWDISPLAY_H
+#define PREVIEWDISPLAY_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace PreviewDisplay
+{
+	// Owns a single frame slot (a mailbox) and a display thread that calls show() for the frame in it, at most maxFrameRate times per second.
+	// Offer() never waits: it replaces whatever frame hasn't been shown yet, so the preview is always the latest frame and frames in between are skipped.
+	// Frames are moved into the slot, so for reference counted frames (eg: a CPylonImage) nothing is copied.
+	// show() runs on the display thread only (eg: everything that touches an OpenCV window). It throws to report an error, which stops the preview.
+	// Offer() is meant to be called from one thread. The counters may be read from any thread.
+	template <typename T>
+	class PreviewThread
+	{
+	private:
+		std::function<void(T &frame)> m_show;
+		std::chrono::steady_clock::duration m_minInterval;
+		T m_latest;
+		bool m_hasFrame = false;
+		std::mutex m_mutex;
+		std::condition_variable m_wake;
+		std::thread m_thread;
+		bool m_running = false;
+		bool m_stopping = false;
+		bool m_failed = false;
+		std::string m_showErrorMessage;
+		uint64_t m_framesOffered = 0;
+		uint64_t m_framesShown = 0;
+		uint64_t m_framesSkipped = 0;
+
+		void ShowLoop();
+
+	public:
+		PreviewThread(double maxFrameRate, std::function<void(T &frame)> show);
+		~PreviewThread();
+
+		int Start(std::string &errorMessage);
+		// Returns false if the preview isn't running (eg: show() has failed).
+		bool Offer(T &frame);
+		int Stop(std::string &errorMessage);
+		bool IsRunning();
+		double GetMaxFrameRate();
+		uint64_t GetFramesOffered();
+		uint64_t GetFramesShown();
+		uint64_t GetFramesSkipped();
+	};
+}
+
+// *********************************************************************************************************
+// DEFINITIONS
+template <typename T>
+PreviewDisplay::PreviewThread<T>::PreviewThread(double maxFrameRate, std::function<void(T &frame)> show)
+	: m_show(show), m_minInterval(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(maxFrameRate > 0 ? 1.0 / maxFrameRate : 0.0)))
+{
+	// nothing
+}
+
+template <typename T>
+PreviewDisplay::PreviewThread<T>::~PreviewThread()
+{
+	// the display thread must not outlive the frame and the show() function it uses
+	std::string errorMessage = "";
+	Stop(errorMessage);
+}
+
+template <typename T>
+int PreviewDisplay::PreviewThread<T>::Start(std::string &errorMessage)
+{
+	errorMessage = "ERROR: ";
+	errorMessage.append(__FUNCTION__);
+	errorMessage.append("(): ");
+
+	try
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_running == true)
+		{
+			errorMessage.append("Preview is already running");
+			return 1;
+		}
+
+		m_stopping = false;
+		m_failed = false;
+		m_running = true;
+		m_thread = std::thread(&PreviewThread<T>::ShowLoop, this);
+		return 0;
+	}
+	catch (std::exception &e)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append(e.what());
+		return 1;
+	}
+	catch (...)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append("UNKNOWN.");
+		return 1;
+	}
+}
+
+template <typename T>
+bool PreviewDisplay::PreviewThread<T>::Offer(T &frame)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_running == false || m_stopping == true)
+			return false;
+
+		m_framesOffered++;
+		if (m_hasFrame == true)
+			m_framesSkipped++; // replaced before it was shown
+
+		m_latest = std::move(frame);
+		m_hasFrame = true;
+	}
+	m_wake.notify_one();
+	return true;
+}
+
+template <typename T>
+void PreviewDisplay::PreviewThread<T>::ShowLoop()
+{
+	while (true)
+	{
+		T frame;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wake.wait(lock, [&]() { return m_hasFrame == true || m_stopping == true; });
+
+			// When stopping, a frame that hasn't been shown yet is not worth waiting for.
+			if (m_stopping == true)
+			{
+				if (m_hasFrame == true)
+					m_framesSkipped++;
+				m_latest = T();
+				m_hasFrame = false;
+				return;
+			}
+
+			frame = std::move(m_latest);
+			m_latest = T(); // don't keep a reference to the frame (eg: an image buffer) in the slot
+			m_hasFrame = false;
+		}
+
+		std::chrono::steady_clock::time_point nextShowTime = std::chrono::steady_clock::now() + m_minInterval;
+
+		// The (slow) showing happens without holding the lock, so Offer() is never held up by it.
+		try
+		{
+			m_show(frame);
+			frame = T();
+
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_framesShown++;
+		}
+		catch (std::exception &e)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_showErrorMessage = e.what();
+			m_failed = true;
+			m_stopping = true;
+			m_latest = T();
+			m_hasFrame = false;
+			return;
+		}
+		catch (...)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_showErrorMessage = "UNKNOWN.";
+			m_failed = true;
+			m_stopping = true;
+			m_latest = T();
+			m_hasFrame = false;
+			return;
+		}
+
+		// Cap the rate: frames offered until then replace each other in the slot, and only the last one is shown.
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_wake.wait_until(lock, nextShowTime, [&]() { return m_stopping == true; });
+	}
+}
+
+template <typename T>
+int PreviewDisplay::PreviewThread<T>::Stop(std::string &errorMessage)
+{
+	errorMessage = "ERROR: ";
+	errorMessage.append(__FUNCTION__);
+	errorMessage.append("(): ");
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_running == false)
+			return 0;
+		m_stopping = true;
+	}
+	m_wake.notify_all();
+
+	if (m_thread.joinable())
+		m_thread.join();
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_running = false;
+	if (m_failed == true)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append(m_showErrorMessage);
+		return 1;
+	}
+
+	return 0;
+}
+
+template <typename T>
+bool PreviewDisplay::PreviewThread<T>::IsRunning()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_running == true && m_stopping == false;
+}
+
+template <typename T>
+double PreviewDisplay::PreviewThread<T>::GetMaxFrameRate()
+{
+	double minInterval = std::chrono::duration<double>(m_minInterval).count();
+	return (minInterval > 0) ? 1.0 / minInterval : 0.0;
+}
+
+template <typename T>
+uint64_t PreviewDisplay::PreviewThread<T>::GetFramesOffered()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_framesOffered;
+}
+
+template <typename T>
+uint64_t PreviewDisplay::PreviewThread<T>::GetFramesShown()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_framesShown;
+}
+
+template <typename T>
+uint64_t PreviewDisplay::PreviewThread<T>::GetFramesSkipped()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_framesSkipped;
+}
+
+// *********************************************************************************************************
+
+#endif
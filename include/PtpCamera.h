@@ -0,0 +1,218 @@
+// PtpCamera.h
+// Reads the IEEE1588 (PTP) clocks of the cameras for PtpMonitor.h, and schedules a common start time on them.
+// Copyright (c) 2019 Matthew Breit - matt.breit@baslerweb.com or matt.breit@gmail.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PTPCAMERA_H
+#define PTPCAMERA_H
+
+// Include Pylon libraries (if needed)
+#include <pylon/PylonIncludes.h>
+
+#include <cstdint>
+#include <exception>
+#include <string>
+#include <vector>
+
+#include "PtpMonitor.h"
+
+namespace PtpMonitor
+{
+	// Reads GevIEEE1588Status and GevIEEE1588OffsetFromMaster of a number of open cameras, after latching all of their data sets (GevIEEE1588DataSetLatch).
+	template <typename Camera_t>
+	class CameraClockSource : public IClockSource
+	{
+	private:
+		std::vector<Camera_t*> m_cameras;
+		std::vector<std::string> m_names;
+
+	public:
+		CameraClockSource();
+		~CameraClockSource();
+
+		void AddCamera(Camera_t &camera, const std::string &name);
+
+		int GetNumClocks();
+		std::string GetName(int clockIndex);
+		int ReadSamples(std::vector<ClockSample> &samples, std::string &errorMessage);
+	};
+
+	// Reads the current time of the camera's clock (the PTP time, once the clocks are synchronized), in ns.
+	template <typename Camera_t>
+	int ReadClockTime(Camera_t &camera, int64_t &time, std::string &errorMessage);
+
+	// Programs the synchronous free run timer of every camera to start at the same instant (in the time of the synchronized clocks, ns).
+	// The cameras then begin exposing on the same tick once they are acquiring, no matter in which order or how quickly acquisition was started,
+	// as long as all of them were started before that instant.
+	template <typename Camera_t>
+	int ScheduleFreeRunStart(const std::vector<Camera_t*> &cameras, int64_t startTime, std::string &errorMessage);
+}
+
+// *********************************************************************************************************
+// DEFINITIONS
+template <typename Camera_t>
+PtpMonitor::CameraClockSource<Camera_t>::CameraClockSource()
+{
+	// nothing
+}
+
+template <typename Camera_t>
+PtpMonitor::CameraClockSource<Camera_t>::~CameraClockSource()
+{
+	// nothing
+}
+
+template <typename Camera_t>
+void PtpMonitor::CameraClockSource<Camera_t>::AddCamera(Camera_t &camera, const std::string &name)
+{
+	m_cameras.push_back(&camera);
+	m_names.push_back(name);
+}
+
+template <typename Camera_t>
+int PtpMonitor::CameraClockSource<Camera_t>::GetNumClocks()
+{
+	return (int)m_cameras.size();
+}
+
+template <typename Camera_t>
+std::string PtpMonitor::CameraClockSource<Camera_t>::GetName(int clockIndex)
+{
+	return m_names[clockIndex];
+}
+
+template <typename Camera_t>
+int PtpMonitor::CameraClockSource<Camera_t>::ReadSamples(std::vector<ClockSample> &samples, std::string &errorMessage)
+{
+	errorMessage = "ERROR: ";
+	errorMessage.append(__FUNCTION__);
+	errorMessage.append("(): ");
+
+	try
+	{
+		// latch all of the cameras first, so the samples are taken as close together as possible
+		for (size_t i = 0; i < m_cameras.size(); i++)
+			m_cameras[i]->GevIEEE1588DataSetLatch.Execute();
+
+		samples.resize(m_cameras.size());
+		for (size_t i = 0; i < m_cameras.size(); i++)
+		{
+			Camera_t &camera = *m_cameras[i];
+			samples[i].status = camera.GevIEEE1588Status.ToString().c_str();
+			samples[i].synchronized = (samples[i].status == "Slave" || samples[i].status == "Master");
+			samples[i].offsetFromMaster = camera.GevIEEE1588OffsetFromMaster.GetValue();
+		}
+
+		return 0;
+	}
+	catch (GenICam::GenericException &e)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append(e.GetDescription());
+		return 1;
+	}
+	catch (std::exception &e)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append(e.what());
+		return 1;
+	}
+	catch (...)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append("UNKNOWN.");
+		return 1;
+	}
+}
+
+template <typename Camera_t>
+int PtpMonitor::ReadClockTime(Camera_t &camera, int64_t &time, std::string &errorMessage)
+{
+	errorMessage = "ERROR: ";
+	errorMessage.append(__FUNCTION__);
+	errorMessage.append("(): ");
+
+	try
+	{
+		camera.GevTimestampControlLatch.Execute();
+		time = camera.GevTimestampValue.GetValue();
+		return 0;
+	}
+	catch (GenICam::GenericException &e)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append(e.GetDescription());
+		return 1;
+	}
+	catch (std::exception &e)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append(e.what());
+		return 1;
+	}
+	catch (...)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append("UNKNOWN.");
+		return 1;
+	}
+}
+
+template <typename Camera_t>
+int PtpMonitor::ScheduleFreeRunStart(const std::vector<Camera_t*> &cameras, int64_t startTime, std::string &errorMessage)
+{
+	errorMessage = "ERROR: ";
+	errorMessage.append(__FUNCTION__);
+	errorMessage.append("(): ");
+
+	try
+	{
+		if (startTime < 0)
+		{
+			errorMessage.append("The start time must not be negative.");
+			return 1;
+		}
+
+		// the start time is split into two 32 bit registers, which only take effect together on SyncFreeRunTimerUpdate
+		for (size_t i = 0; i < cameras.size(); i++)
+		{
+			cameras[i]->SyncFreeRunTimerStartTimeHigh.SetValue((startTime >> 32) & 0xFFFFFFFF);
+			cameras[i]->SyncFreeRunTimerStartTimeLow.SetValue(startTime & 0xFFFFFFFF);
+			cameras[i]->SyncFreeRunTimerUpdate.Execute();
+		}
+		return 0;
+	}
+	catch (GenICam::GenericException &e)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append(e.GetDescription());
+		return 1;
+	}
+	catch (std::exception &e)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append(e.what());
+		return 1;
+	}
+	catch (...)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append("UNKNOWN.");
+		return 1;
+	}
+}
+
+// *********************************************************************************************************
+
+#endif
@@ -0,0 +1,193 @@
+// PtpMonitor.h
+// Waits until the IEEE1588 (PTP) clocks of the cameras have converged, instead of waiting for a fixed time.
+// Doesn't need pylon: the clocks of the cameras are read (and the common start time scheduled) by PtpCamera.h.
+// Copyright (c) 2019 Matthew Breit - matt.breit@baslerweb.com or matt.breit@gmail.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PTPMONITOR_H
+#define PTPMONITOR_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace PtpMonitor
+{
+	// The PTP state of one camera's clock at one moment.
+	struct ClockSample
+	{
+		std::string status; // eg: "Slave", "Master", "Listening"
+		bool synchronized = false; // the clock is Master or Slave
+		int64_t offsetFromMaster = 0; // ns
+	};
+
+	// Where the samples come from. CameraClockSource (PtpCamera.h) reads them from the cameras. Anything else (eg: a recorded or simulated series)
+	// can be used to try out the convergence logic without cameras.
+	class IClockSource
+	{
+	public:
+		virtual ~IClockSource() {}
+
+		virtual int GetNumClocks() = 0;
+		virtual std::string GetName(int clockIndex) = 0;
+		// Takes one sample of every clock, as close together in time as possible.
+		virtual int ReadSamples(std::vector<ClockSample> &samples, std::string &errorMessage) = 0;
+	};
+
+	// How a wait for convergence ended.
+	struct ConvergenceResult
+	{
+		bool converged = false; // false = timed out
+		double seconds = 0.0; // until the clocks had converged, or until the timeout
+		int numSamples = 0;
+		int64_t maxOffset = 0; // the largest |offset from master| of the last sample, ns
+		std::vector<ClockSample> lastSamples;
+	};
+
+	// Polls the clocks until every one of them is Master or Slave, and its |offset from master| is no more than the threshold,
+	// for a number of samples in a row. Gives up at the timeout.
+	class ConvergenceMonitor
+	{
+	private:
+		int64_t m_offsetThreshold = 1000;
+		int m_requiredSamples = 5;
+		double m_pollInterval = 1.0;
+		double m_timeout = 60.0;
+		std::function<void(int sampleIndex, const std::vector<ClockSample> &samples)> m_onSample;
+
+	public:
+		ConvergenceMonitor();
+		~ConvergenceMonitor();
+
+		void SetOffsetThreshold(int64_t offsetThreshold); // ns
+		int64_t GetOffsetThreshold();
+		void SetRequiredSamples(int numSamples);
+		int GetRequiredSamples();
+		void SetPollInterval(double seconds);
+		double GetPollInterval();
+		void SetTimeout(double seconds);
+		double GetTimeout();
+		// Called after every sample (eg: to print the status of each clock)
+		void SetSampleCallback(std::function<void(int sampleIndex, const std::vector<ClockSample> &samples)> onSample);
+
+		// Returns 0 both when the clocks have converged and when the timeout was reached (see result.converged). 1 if the clocks could not be read.
+		int WaitForConvergence(IClockSource &clockSource, ConvergenceResult &result, std::string &errorMessage);
+	};
+}
+
+// *********************************************************************************************************
+// DEFINITIONS
+inline PtpMonitor::ConvergenceMonitor::ConvergenceMonitor()
+{
+	// nothing
+}
+
+inline PtpMonitor::ConvergenceMonitor::~ConvergenceMonitor()
+{
+	// nothing
+}
+
+inline void PtpMonitor::ConvergenceMonitor::SetOffsetThreshold(int64_t offsetThreshold)
+{
+	m_offsetThreshold = offsetThreshold;
+}
+
+inline int64_t PtpMonitor::ConvergenceMonitor::GetOffsetThreshold()
+{
+	return m_offsetThreshold;
+}
+
+inline void PtpMonitor::ConvergenceMonitor::SetRequiredSamples(int numSamples)
+{
+	m_requiredSamples = (numSamples > 0) ? numSamples : 1;
+}
+
+inline int PtpMonitor::ConvergenceMonitor::GetRequiredSamples()
+{
+	return m_requiredSamples;
+}
+
+inline void PtpMonitor::ConvergenceMonitor::SetPollInterval(double seconds)
+{
+	m_pollInterval = (seconds > 0) ? seconds : 0;
+}
+
+inline double PtpMonitor::ConvergenceMonitor::GetPollInterval()
+{
+	return m_pollInterval;
+}
+
+inline void PtpMonitor::ConvergenceMonitor::SetTimeout(double seconds)
+{
+	m_timeout = seconds;
+}
+
+inline double PtpMonitor::ConvergenceMonitor::GetTimeout()
+{
+	return m_timeout;
+}
+
+inline void PtpMonitor::ConvergenceMonitor::SetSampleCallback(std::function<void(int sampleIndex, const std::vector<ClockSample> &samples)> onSample)
+{
+	m_onSample = onSample;
+}
+
+inline int PtpMonitor::ConvergenceMonitor::WaitForConvergence(IClockSource &clockSource, ConvergenceResult &result, std::string &errorMessage)
+{
+	result = ConvergenceResult();
+	std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+	int samplesInRange = 0;
+
+	while (true)
+	{
+		if (clockSource.ReadSamples(result.lastSamples, errorMessage) != 0)
+			return 1;
+		result.numSamples++;
+
+		// Every clock must be locked (a camera that is still Listening has an offset of 0, which means nothing) and close enough to the master.
+		bool allInRange = (result.lastSamples.empty() == false);
+		result.maxOffset = 0;
+		for (size_t i = 0; i < result.lastSamples.size(); i++)
+		{
+			const ClockSample &sample = result.lastSamples[i];
+			int64_t offset = (sample.offsetFromMaster < 0) ? -sample.offsetFromMaster : sample.offsetFromMaster;
+			if (offset > result.maxOffset)
+				result.maxOffset = offset;
+			if (sample.synchronized == false || offset > m_offsetThreshold)
+				allInRange = false;
+		}
+		samplesInRange = (allInRange == true) ? samplesInRange + 1 : 0;
+
+		if (m_onSample)
+			m_onSample(result.numSamples - 1, result.lastSamples);
+
+		result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+		if (samplesInRange >= m_requiredSamples)
+		{
+			result.converged = true;
+			return 0;
+		}
+		if (result.seconds >= m_timeout)
+			return 0;
+
+		std::this_thread::sleep_for(std::chrono::duration<double>(m_pollInterval));
+	}
+}
+
+// *********************************************************************************************************
+
+#endif
@@ -0,0 +1,441 @@
+// RawStereoFile.h
+// Records the unprocessed images of both cameras (plus their chunk data) to an append-only file with a fixed-size record index, and replays them memory-mapped.
+// Copyright (c) 2019 Matthew Breit - matt.breit@baslerweb.com or matt.breit@gmail.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RAWSTEREOFILE_H
+#define RAWSTEREOFILE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <string>
+#include <FileIO.h> // for OutputFile and MappedFile
+
+// File layout:
+//   <name>      FileHeader, then the image payloads (left, right, left, right, ...), each starting on a c_payloadAlignment boundary.
+//   <name>.idx  FileHeader, then one IndexRecord per stereo frame. Record n describes frame n, so finding a frame by number is a single lookup.
+// Payloads are written before their index record, so after a crash the index only refers to complete frames.
+// The index is appended with one positioned write (pwrite) per frame rather than through a memory mapping: its size then always tells
+// how many frames are complete, without preallocating or remapping it, and one small write per frame is negligible next to the payloads.
+// The Reader maps both files.
+namespace RawStereoFile
+{
+	const uint32_t c_dataMagic = 0x57415253; // "SRAW"
+	const uint32_t c_indexMagic = 0x58445253; // "SRDX"
+	const uint32_t c_version = 1;
+	const uint64_t c_payloadAlignment = 64; // so replayed images can be processed with aligned SIMD loads
+
+	struct FileHeader
+	{
+		uint32_t magic = 0;
+		uint32_t version = 0;
+		uint32_t headerSize = 0;
+		uint32_t recordSize = 0;
+		uint64_t reserved[6] = { 0, 0, 0, 0, 0, 0 };
+	};
+
+	// One camera's image: where its payload is in the data file, and the chunk data that came with it.
+	struct FrameInfo
+	{
+		uint64_t offset = 0; // filled in by Writer::Add()
+		uint64_t size = 0;
+		int64_t timestamp = 0;
+		int64_t frameCounter = 0;
+		uint32_t pixelType = 0; // Pylon::EPixelType
+		uint32_t width = 0;
+		uint32_t height = 0;
+		uint32_t paddingX = 0;
+	};
+
+	struct IndexRecord
+	{
+		FrameInfo left;
+		FrameInfo right;
+	};
+
+	// A replayed stereo frame. The pointers point straight into the mapped file.
+	struct Frame
+	{
+		const uint8_t *pLeft = NULL;
+		const uint8_t *pRight = NULL;
+		FrameInfo left;
+		FrameInfo right;
+	};
+
+	class Writer
+	{
+	private:
+		FileIO::OutputFile m_dataFile;
+		FileIO::OutputFile m_indexFile;
+		uint64_t m_preallocationSize = 0;
+		uint64_t m_allocatedSize = 0;
+		uint64_t m_dataSize = 0;
+		uint64_t m_frameCount = 0;
+
+		bool AppendPayload(const void *pPayload, FrameInfo &info);
+
+	public:
+		Writer();
+		~Writer();
+
+		// The data file is preallocated in steps of preallocationSize bytes, and trimmed to what was used by Close().
+		int Open(const std::string &fileName, uint64_t preallocationSize, std::string &errorMessage);
+		// left.size and right.size bytes are written from pLeft and pRight. The offsets are filled in.
+		int Add(const void *pLeft, FrameInfo left, const void *pRight, FrameInfo right, std::string &errorMessage);
+		int Close(std::string &errorMessage);
+		bool IsOpen();
+		uint64_t GetFrameCount();
+		uint64_t GetDataSize();
+	};
+
+	class Reader
+	{
+	private:
+		FileIO::MappedFile m_dataFile;
+		FileIO::MappedFile m_indexFile;
+		const IndexRecord *m_pRecords = NULL;
+		uint64_t m_frameCount = 0;
+
+	public:
+		Reader();
+		~Reader();
+
+		int Open(const std::string &fileName, std::string &errorMessage);
+		void Close();
+		uint64_t GetFrameCount();
+		bool GetFrame(uint64_t frameNumber, Frame &frame);
+		// Finds the frame whose left timestamp is closest to timestamp.
+		bool FindFrame(int64_t timestamp, uint64_t &frameNumber);
+	};
+
+	std::string GetIndexFileName(const std::string &fileName);
+}
+
+// *********************************************************************************************************
+// DEFINITIONS
+inline std::string RawStereoFile::GetIndexFileName(const std::string &fileName)
+{
+	return fileName + ".idx";
+}
+
+inline RawStereoFile::Writer::Writer()
+{
+	// nothing
+}
+
+inline RawStereoFile::Writer::~Writer()
+{
+	std::string errorMessage = "";
+	Close(errorMessage);
+}
+
+inline int RawStereoFile::Writer::Open(const std::string &fileName, uint64_t preallocationSize, std::string &errorMessage)
+{
+	errorMessage = "ERROR: ";
+	errorMessage.append(__FUNCTION__);
+	errorMessage.append("(): ");
+
+	try
+	{
+		if (IsOpen() == true)
+		{
+			errorMessage.append("Already open");
+			return 1;
+		}
+
+		if (m_dataFile.Create(fileName) == false || m_indexFile.Create(GetIndexFileName(fileName)) == false)
+		{
+			m_dataFile.Close();
+			m_indexFile.Close();
+			errorMessage.append("Could not create " + fileName + " or its index file");
+			return 1;
+		}
+
+		FileHeader header;
+		header.magic = c_dataMagic;
+		header.version = c_version;
+		header.headerSize = sizeof(FileHeader);
+		header.recordSize = 0;
+
+		FileHeader indexHeader = header;
+		indexHeader.magic = c_indexMagic;
+		indexHeader.recordSize = sizeof(IndexRecord);
+
+		m_preallocationSize = preallocationSize;
+		m_allocatedSize = std::max<uint64_t>(preallocationSize, sizeof(FileHeader));
+		m_dataSize = sizeof(FileHeader);
+		m_frameCount = 0;
+
+		if (m_dataFile.Resize(m_allocatedSize) == false || m_dataFile.WriteAt(0, &header, sizeof(header)) == false || m_indexFile.WriteAt(0, &indexHeader, sizeof(indexHeader)) == false)
+		{
+			m_dataFile.Close();
+			m_indexFile.Close();
+			errorMessage.append("Could not write to " + fileName + " or its index file");
+			return 1;
+		}
+
+		return 0;
+	}
+	catch (std::exception &e)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append(e.what());
+		return 1;
+	}
+	catch (...)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append("UNKNOWN.");
+		return 1;
+	}
+}
+
+inline bool RawStereoFile::Writer::AppendPayload(const void *pPayload, FrameInfo &info)
+{
+	info.offset = (m_dataSize + c_payloadAlignment - 1) / c_payloadAlignment * c_payloadAlignment;
+
+	uint64_t end = info.offset + info.size;
+	if (end > m_allocatedSize)
+	{
+		// grow by whole preallocation steps, so this happens rarely
+		uint64_t step = std::max<uint64_t>(m_preallocationSize, end - m_allocatedSize);
+		if (m_dataFile.Resize(m_allocatedSize + step) == false)
+			return false;
+		m_allocatedSize += step;
+	}
+
+	if (m_dataFile.WriteAt(info.offset, pPayload, info.size) == false)
+		return false;
+
+	m_dataSize = end;
+	return true;
+}
+
+inline int RawStereoFile::Writer::Add(const void *pLeft, FrameInfo left, const void *pRight, FrameInfo right, std::string &errorMessage)
+{
+	errorMessage = "ERROR: ";
+	errorMessage.append(__FUNCTION__);
+	errorMessage.append("(): ");
+
+	if (IsOpen() == false)
+	{
+		errorMessage.append("Not open");
+		return 1;
+	}
+
+	IndexRecord record;
+	record.left = left;
+	record.right = right;
+
+	if (AppendPayload(pLeft, record.left) == false || AppendPayload(pRight, record.right) == false)
+	{
+		errorMessage.append("Could not write the images (disk full?)");
+		return 1;
+	}
+
+	if (m_indexFile.WriteAt(sizeof(FileHeader) + m_frameCount * sizeof(IndexRecord), &record, sizeof(record)) == false)
+	{
+		errorMessage.append("Could not write the index");
+		return 1;
+	}
+
+	m_frameCount++;
+	return 0;
+}
+
+inline int RawStereoFile::Writer::Close(std::string &errorMessage)
+{
+	errorMessage = "ERROR: ";
+	errorMessage.append(__FUNCTION__);
+	errorMessage.append("(): ");
+
+	if (IsOpen() == false)
+		return 0;
+
+	// give back the preallocated space that wasn't used
+	bool trimmed = m_dataFile.Resize(m_dataSize);
+	m_dataFile.Close();
+	m_indexFile.Close();
+
+	if (trimmed == false)
+	{
+		errorMessage.append("Could not trim the data file");
+		return 1;
+	}
+
+	return 0;
+}
+
+inline bool RawStereoFile::Writer::IsOpen()
+{
+	return m_dataFile.IsOpen() && m_indexFile.IsOpen();
+}
+
+inline uint64_t RawStereoFile::Writer::GetFrameCount()
+{
+	return m_frameCount;
+}
+
+inline uint64_t RawStereoFile::Writer::GetDataSize()
+{
+	return m_dataSize;
+}
+
+inline RawStereoFile::Reader::Reader()
+{
+	// nothing
+}
+
+inline RawStereoFile::Reader::~Reader()
+{
+	Close();
+}
+
+inline int RawStereoFile::Reader::Open(const std::string &fileName, std::string &errorMessage)
+{
+	errorMessage = "ERROR: ";
+	errorMessage.append(__FUNCTION__);
+	errorMessage.append("(): ");
+
+	try
+	{
+		Close();
+
+		if (m_dataFile.Open(fileName) == false || m_indexFile.Open(GetIndexFileName(fileName)) == false)
+		{
+			Close();
+			errorMessage.append("Could not open " + fileName + " or its index file");
+			return 1;
+		}
+
+		FileHeader header;
+		FileHeader indexHeader;
+		if (m_dataFile.GetSize() < sizeof(FileHeader) || m_indexFile.GetSize() < sizeof(FileHeader))
+		{
+			Close();
+			errorMessage.append("File is too short");
+			return 1;
+		}
+		memcpy(&header, m_dataFile.GetData(), sizeof(header));
+		memcpy(&indexHeader, m_indexFile.GetData(), sizeof(indexHeader));
+
+		if (header.magic != c_dataMagic || indexHeader.magic != c_indexMagic || header.version != c_version || indexHeader.version != c_version || indexHeader.recordSize != sizeof(IndexRecord) || indexHeader.headerSize != sizeof(FileHeader))
+		{
+			Close();
+			errorMessage.append("Not a raw stereo recording, or written by a different version");
+			return 1;
+		}
+
+		// The number of frames follows from the size of the index, so a recording that wasn't closed properly can still be read.
+		m_pRecords = (const IndexRecord*)(m_indexFile.GetData() + sizeof(FileHeader));
+		m_frameCount = (m_indexFile.GetSize() - sizeof(FileHeader)) / sizeof(IndexRecord);
+		return 0;
+	}
+	catch (std::exception &e)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append(e.what());
+		return 1;
+	}
+	catch (...)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append("UNKNOWN.");
+		return 1;
+	}
+}
+
+inline void RawStereoFile::Reader::Close()
+{
+	m_dataFile.Close();
+	m_indexFile.Close();
+	m_pRecords = NULL;
+	m_frameCount = 0;
+}
+
+inline uint64_t RawStereoFile::Reader::GetFrameCount()
+{
+	return m_frameCount;
+}
+
+inline bool RawStereoFile::Reader::GetFrame(uint64_t frameNumber, Frame &frame)
+{
+	if (frameNumber >= m_frameCount)
+		return false;
+
+	const IndexRecord &record = m_pRecords[frameNumber];
+	uint64_t dataSize = m_dataFile.GetSize();
+	if (record.left.offset > dataSize || record.left.size > dataSize - record.left.offset || record.right.offset > dataSize || record.right.size > dataSize - record.right.offset)
+		return false; // damaged index
+
+	frame.pLeft = m_dataFile.GetData() + record.left.offset;
+	frame.pRight = m_dataFile.GetData() + record.right.offset;
+	frame.left = record.left;
+	frame.right = record.right;
+	return true;
+}
+
+inline bool RawStereoFile::Reader::FindFrame(int64_t timestamp, uint64_t &frameNumber)
+{
+	if (m_frameCount == 0)
+		return false;
+
+	int64_t firstTimestamp = m_pRecords[0].left.timestamp;
+	int64_t lastTimestamp = m_pRecords[m_frameCount - 1].left.timestamp;
+	if (timestamp <= firstTimestamp || m_frameCount == 1)
+	{
+		frameNumber = 0;
+		return true;
+	}
+	if (timestamp >= lastTimestamp)
+	{
+		frameNumber = m_frameCount - 1;
+		return true;
+	}
+
+	// The frame rate is (nearly) constant, so interpolating gets to within a frame or two of the right one.
+	uint64_t candidate = (uint64_t)((double)(timestamp - firstTimestamp) / (double)(lastTimestamp - firstTimestamp) * (double)(m_frameCount - 1));
+	candidate = std::min<uint64_t>(candidate, m_frameCount - 2);
+
+	// Find the last frame at or before timestamp. Step from the guess, or search if it was far off (eg: a gap in the recording).
+	int steps = 0;
+	while (steps < 8 && candidate > 0 && m_pRecords[candidate].left.timestamp > timestamp)
+	{
+		candidate--;
+		steps++;
+	}
+	while (steps < 8 && candidate + 1 < m_frameCount - 1 && m_pRecords[candidate + 1].left.timestamp <= timestamp)
+	{
+		candidate++;
+		steps++;
+	}
+	if (m_pRecords[candidate].left.timestamp > timestamp || m_pRecords[candidate + 1].left.timestamp <= timestamp)
+	{
+		const IndexRecord *pAfter = std::upper_bound(m_pRecords, m_pRecords + m_frameCount, timestamp, [](int64_t value, const IndexRecord &record) { return value < record.left.timestamp; });
+		candidate = (uint64_t)(pAfter - m_pRecords) - 1;
+	}
+
+	// candidate is at or before timestamp, and the next one is after it. Pick the closer one.
+	if (timestamp - m_pRecords[candidate].left.timestamp > m_pRecords[candidate + 1].left.timestamp - timestamp)
+		candidate++;
+
+	frameNumber = candidate;
+	return true;
+}
+
+// *********************************************************************************************************
+
+#endif
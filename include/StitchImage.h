@@ -29,11 +29,98 @@
 // Include Pylon libraries (if needed)
 #include <pylon/PylonIncludes.h>
 
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+// SIMD kernels for the stitch functions that also convert
+#include "StitchKernels.h"
+
 namespace StitchImage
 {
+	// stitchedImage is only reallocated when its geometry changes, so reusing the same stitchedImage from call to call doesn't allocate.
+	// stitchedImage may also be one of the input images (eg: to keep adding images to a strip), which needs a temporary image.
 	int StitchToBottom(Pylon::CPylonImage &topImage, Pylon::CPylonImage &bottomImage, Pylon::CPylonImage *stitchedImage, std::string &errorMessage);
 	int StitchToRight(Pylon::CPylonImage &leftImage, Pylon::CPylonImage &rightImage, Pylon::CPylonImage *stitchedImage, std::string &errorMessage);
 
+	// These write the stitched image into a buffer provided by the caller (eg: a video writer's input frame). Never allocates.
+	// stitchedStride is the number of bytes from the start of one row to the start of the next (0 = rows are not padded).
+	int StitchToBottom(Pylon::CPylonImage &topImage, Pylon::CPylonImage &bottomImage, uint8_t *pStitchedBuffer, size_t stitchedBufferSize, size_t stitchedStride, std::string &errorMessage);
+	int StitchToRight(Pylon::CPylonImage &leftImage, Pylon::CPylonImage &rightImage, uint8_t *pStitchedBuffer, size_t stitchedBufferSize, size_t stitchedStride, std::string &errorMessage);
+
+	// These stitch two Mono8 images side by side and expand them to BGR8 (eg: for OpenCV) in one pass, without an intermediate Mono8 stitched image.
+	int StitchToRightAsBGR8(Pylon::CPylonImage &leftImage, Pylon::CPylonImage &rightImage, Pylon::CPylonImage *stitchedImage, std::string &errorMessage);
+	int StitchToRightAsBGR8(Pylon::CPylonImage &leftImage, Pylon::CPylonImage &rightImage, uint8_t *pStitchedBuffer, size_t stitchedBufferSize, size_t stitchedStride, std::string &errorMessage);
+
+	// This stitches images of a packed pixel format (eg: Mono12p) side by side and unpacks them to one 16 bit value per pixel in one pass.
+	// The values are not shifted, so the result has the matching unpacked pixel type (eg: Mono12p -> Mono12, BayerRG12p -> BayerRG12).
+	int StitchToRightUnpacked(Pylon::CPylonImage &leftImage, Pylon::CPylonImage &rightImage, Pylon::CPylonImage *stitchedImage, std::string &errorMessage);
+
+	// These stitch any number of images (eg: one per camera) into a grid that is columns images wide, filled row by row (columns = images.size() for a single row).
+	// The images must all have the same size and pixel type. Each one is copied once, straight into its place, so the cost grows linearly with the number of images.
+	// Cells without an image (when the last row isn't full) are black.
+	int StitchToGrid(const std::vector<Pylon::CPylonImage*> &images, int columns, Pylon::CPylonImage *stitchedImage, std::string &errorMessage);
+	int StitchToGridAsBGR8(const std::vector<Pylon::CPylonImage*> &images, int columns, Pylon::CPylonImage *stitchedImage, std::string &errorMessage);
+
+	// This averages blocks of factor x factor pixels (eg: 2 for half the width and height) of a Mono8 or BGR8 image into a smaller image, eg: for a preview.
+	// downscaledImage is only reallocated when its geometry changes. Pixels beyond the last whole block (when the size isn't a multiple of factor) are left out.
+	int Downscale(Pylon::CPylonImage &sourceImage, int factor, Pylon::CPylonImage *downscaledImage, std::string &errorMessage);
+
+	// The part of an image to use: the rectangle starting at (x, y), in pixels. A width or height of 0 means up to the right or bottom edge.
+	struct Roi
+	{
+		int x = 0;
+		int y = 0;
+		int width = 0;
+		int height = 0;
+	};
+
+	// These stitch a region of each of two Mono8 or BGR8 images side by side (or one above the other), and average blocks of factor x factor pixels
+	// (eg: 2 or 4 for a half or quarter size preview or proxy video) on the way, in one pass. Only the regions are read, and no full size stitched image is made.
+	// After decimation, the regions must have the same height (StitchToRight) or width (StitchToBottom). Pixels beyond the last whole block of a region are left out.
+	// stitchedImage is only reallocated when its geometry changes, and can't be one of the input images.
+	int StitchToBottom(Pylon::CPylonImage &topImage, const Roi &topRoi, Pylon::CPylonImage &bottomImage, const Roi &bottomRoi, int factor, Pylon::CPylonImage *stitchedImage, std::string &errorMessage);
+	int StitchToRight(Pylon::CPylonImage &leftImage, const Roi &leftRoi, Pylon::CPylonImage &rightImage, const Roi &rightRoi, int factor, Pylon::CPylonImage *stitchedImage, std::string &errorMessage);
+
+	// Helpers used by the functions above
+	int GetStitchToBottomGeometry(Pylon::CPylonImage &topImage, Pylon::CPylonImage &bottomImage, Pylon::EPixelType &pixelType, int &width, int &height, std::string &errorMessage);
+	int GetStitchToRightGeometry(Pylon::CPylonImage &leftImage, Pylon::CPylonImage &rightImage, Pylon::EPixelType &pixelType, int &width, int &height, std::string &errorMessage);
+	int GetStitchToGridGeometry(const std::vector<Pylon::CPylonImage*> &images, int columns, Pylon::EPixelType &pixelType, int &width, int &height, std::string &errorMessage);
+	int GetDecimatedGeometry(Pylon::CPylonImage &image, const Roi &roi, int factor, Roi &resolvedRoi, int &channels, int &width, int &height, std::string &errorMessage);
+	void DecimateRowsAt(Pylon::CPylonImage &sourceImage, const Roi &roi, int factor, int channels, uint8_t *pDestination, size_t destinationStride, int width, int height);
+	size_t GetRowBytes(Pylon::EPixelType pixelType, int width);
+	size_t GetStride(Pylon::CPylonImage &image);
+	void CopyRows(Pylon::CPylonImage &sourceImage, uint8_t *pDestination, size_t destinationStride);
+	void CopyRowsAt(Pylon::CPylonImage &sourceImage, uint8_t *pDestination, size_t destinationStride, size_t destinationBitOffset);
+	void CopyRowsRightOf(Pylon::CPylonImage &leftImage, Pylon::CPylonImage &rightImage, uint8_t *pDestination, size_t destinationStride);
+	StitchKernels::EPacking GetPacking(Pylon::EPixelType pixelType);
+	Pylon::EPixelType GetUnpackedPixelType(Pylon::EPixelType pixelType);
+	bool IsReusable(Pylon::CPylonImage &image, Pylon::EPixelType pixelType, int width, int height);
+
+	// A few reusable images, for when stitched images are handed on to other threads (eg: a pipeline) before the next one is stitched.
+	// GetImage() returns an image that isn't referenced anywhere else anymore, so stitching into it doesn't allocate.
+	// Only as many images as are actually in use at the same time ever get allocated.
+	// When all of them are still in use, GetImage() waits up to timeoutMs for one to be let go of, and then throws a std::runtime_error.
+	// Not thread safe: only one thread may call GetImage() (the other threads may hold and let go of the images it returned).
+	class ImagePool
+	{
+	private:
+		std::vector<Pylon::CPylonImage> m_images;
+		unsigned int m_timeoutMs;
+
+	public:
+		ImagePool(size_t numImages, unsigned int timeoutMs = 1000);
+		~ImagePool();
+
+		Pylon::CPylonImage &GetImage();
+		size_t GetSize();
+	};
+
+	// By default, the whole collage (canvas) is allocated once from SetWidth()/SetHeight() and the size of the first image,
+	// and each image is copied straight into its place. Two canvases take turns, so the latest collage can be handed out without a copy
+	// while the next one is being filled. All images of a collage must then have the same size and pixel type.
+	// SetPreallocatedCanvas(false) selects the original behaviour of stitching strips together (slower, but allows mixed image sizes).
 	class CollageMaker
 	{
 	private:
@@ -41,30 +128,880 @@ namespace StitchImage
 		Pylon::CPylonImage m_tempImage;
 		Pylon::CPylonImage m_collageRow;
 		std::vector<Pylon::CPylonImage> m_collageRows;
+		Pylon::CPylonImage m_canvas[2];
+		int m_fillingCanvas = 0;
+		int m_latestCanvas = -1;
+		Pylon::EPixelType m_tilePixelType = Pylon::EPixelType::PixelType_Undefined;
+		int m_tileWidth = 0;
+		int m_tileHeight = 0;
 		int m_collageWidth = 0;
 		int m_collageHeight = 0;
 		int m_collageImagesCounter = 0;
 		bool m_collageComplete = false;
+		bool m_usingPreallocatedCanvas = true;
+
+		int StitchToCanvas(Pylon::CPylonImage &image, std::string &errorMessage);
+		int StitchToStrips(Pylon::CPylonImage &image, std::string &errorMessage);
 
 	public:
 		CollageMaker();
 		~CollageMaker();
 
-		int StitchToCollage(Pylon::CPylonImage &image, std::string &errorMessage);
-		int GetLatestCollage(Pylon::CPylonImage *collageImage, std::string &errorMessage);
-		int ResetCollage(std::string &errorMessage);
-		int GetWidth();
-		int GetHeight();
-		void SetWidth(int numImages);
-		void SetHeight(int numImages);
-		bool IsCollageComplete();
-	};
+		int StitchToCollage(Pylon::CPylonImage &image, std::string &errorMessage);
+		// collageImage shares the buffer of the latest collage. If it is still held when that canvas is due to be filled again, the canvas gets a new buffer instead.
+		int GetLatestCollage(Pylon::CPylonImage *collageImage, std::string &errorMessage);
+		// No copy and no reference counting. Returns NULL if there is no collage yet. Only valid until the next collage is complete.
+		const Pylon::CPylonImage *GetLatestCollage();
+		int ResetCollage(std::string &errorMessage);
+		int GetWidth();
+		int GetHeight();
+		void SetWidth(int numImages);
+		void SetHeight(int numImages);
+		bool IsCollageComplete();
+		void SetPreallocatedCanvas(bool enable);
+		bool IsUsingPreallocatedCanvas();
+	};
+
+}
+
+// *********************************************************************************************************
+// DEFINITIONS
+int StitchImage::GetStitchToBottomGeometry(Pylon::CPylonImage &topImage, Pylon::CPylonImage &bottomImage, Pylon::EPixelType &pixelType, int &width, int &height, std::string &errorMessage)
+{
+	if (topImage.GetPixelType() == Pylon::EPixelType::PixelType_Undefined)
+	{
+		if (bottomImage.GetPixelType() == Pylon::EPixelType::PixelType_Undefined)
+		{
+			errorMessage.append("Both images have undefined pixel types!");
+			return 1;
+		}
+		else
+			pixelType = bottomImage.GetPixelType();
+	}
+	else
+	{
+		if (topImage.GetPixelType() != bottomImage.GetPixelType())
+		{
+			errorMessage.append("Images must be same PixelType");
+			return 1;
+		}
+		else
+			pixelType = topImage.GetPixelType();
+	}
+
+
+	if (topImage.GetWidth() == 0)
+	{
+		if (bottomImage.GetWidth() == 0)
+		{
+			errorMessage.append("Both Images have Width = 0!");
+			return 1;
+		}
+		else
+			width = bottomImage.GetWidth();
+	}
+	else
+	{
+		if (topImage.GetWidth() != bottomImage.GetWidth())
+		{
+			errorMessage.append("Images must be same Width!");
+			return 1;
+		}
+		else
+			width = topImage.GetWidth();
+	}
+
+	height = topImage.GetHeight() + bottomImage.GetHeight();
+
+	return 0;
+}
+
+int StitchImage::GetStitchToRightGeometry(Pylon::CPylonImage &leftImage, Pylon::CPylonImage &rightImage, Pylon::EPixelType &pixelType, int &width, int &height, std::string &errorMessage)
+{
+	if (leftImage.GetPixelType() == Pylon::EPixelType::PixelType_Undefined)
+	{
+		if (rightImage.GetPixelType() == Pylon::EPixelType::PixelType_Undefined)
+		{
+			errorMessage.append("Both images have undefined pixel types!");
+			return 1;
+		}
+		else
+			pixelType = rightImage.GetPixelType();
+	}
+	else
+	{
+		if (leftImage.GetPixelType() != rightImage.GetPixelType())
+		{
+			errorMessage.append("Images must be same PixelType");
+			return 1;
+		}
+		else
+			pixelType = leftImage.GetPixelType();
+	}
+
+
+	if (leftImage.GetHeight() == 0)
+	{
+		if (rightImage.GetHeight() == 0)
+		{
+			errorMessage.append("Both Images have Height = 0!");
+			return 1;
+		}
+		else
+			height = rightImage.GetHeight();
+	}
+	else
+	{
+		if (leftImage.GetHeight() != rightImage.GetHeight())
+		{
+			errorMessage.append("Images must be same Height!");
+			return 1;
+		}
+		else
+			height = leftImage.GetHeight();
+	}
+
+	// Rows of packed pixels can be joined at any bit, but pixel pairs of the GigE packed formats can't be split.
+	if (Pylon::IsPacked(pixelType) == true)
+	{
+		StitchKernels::EPacking packing = GetPacking(pixelType);
+		if (packing == StitchKernels::Packing_None)
+		{
+			errorMessage.append("This packed pixel format is not supported");
+			return 1;
+		}
+		if ((packing == StitchKernels::Packing_10Packed || packing == StitchKernels::Packing_12Packed) && leftImage.GetWidth() % 2 != 0)
+		{
+			errorMessage.append("Left image must have an even Width for this packed pixel format!");
+			return 1;
+		}
+	}
+
+	width = leftImage.GetWidth() + rightImage.GetWidth();
+
+	return 0;
+}
+
+int StitchImage::GetStitchToGridGeometry(const std::vector<Pylon::CPylonImage*> &images, int columns, Pylon::EPixelType &pixelType, int &width, int &height, std::string &errorMessage)
+{
+	if (images.empty() == true || columns <= 0)
+	{
+		errorMessage.append("Need at least one image and one column!");
+		return 1;
+	}
+
+	Pylon::CPylonImage &firstImage = *images[0];
+	pixelType = firstImage.GetPixelType();
+	int tileWidth = firstImage.GetWidth();
+	int tileHeight = firstImage.GetHeight();
+	if (pixelType == Pylon::EPixelType::PixelType_Undefined || tileWidth == 0 || tileHeight == 0)
+	{
+		errorMessage.append("Image is empty");
+		return 1;
+	}
+
+	for (size_t i = 1; i < images.size(); i++)
+	{
+		if (images[i]->GetPixelType() != pixelType || (int)images[i]->GetWidth() != tileWidth || (int)images[i]->GetHeight() != tileHeight)
+		{
+			errorMessage.append("All images must have the same size and PixelType");
+			return 1;
+		}
+	}
+
+	// GigE packed formats store two pixels in three bytes, so an image can't start on an odd pixel.
+	StitchKernels::EPacking packing = GetPacking(pixelType);
+	if ((packing == StitchKernels::Packing_10Packed || packing == StitchKernels::Packing_12Packed) && tileWidth % 2 != 0 && columns > 1)
+	{
+		errorMessage.append("Image width must be even for this packed pixel format");
+		return 1;
+	}
+
+	int numImages = (int)images.size();
+	int rows = (numImages + columns - 1) / columns;
+	width = tileWidth * ((numImages < columns) ? numImages : columns);
+	height = tileHeight * rows;
+
+	return 0;
+}
+
+int StitchImage::GetDecimatedGeometry(Pylon::CPylonImage &image, const Roi &roi, int factor, Roi &resolvedRoi, int &channels, int &width, int &height, std::string &errorMessage)
+{
+	Pylon::EPixelType pixelType = image.GetPixelType();
+	if (pixelType == Pylon::EPixelType::PixelType_Mono8)
+		channels = 1;
+	else if (pixelType == Pylon::EPixelType::PixelType_BGR8packed || pixelType == Pylon::EPixelType::PixelType_RGB8packed)
+		channels = 3;
+	else
+	{
+		errorMessage.append("Images must be Mono8 or BGR8");
+		return 1;
+	}
+
+	if (factor < 1)
+	{
+		errorMessage.append("Factor must be at least 1");
+		return 1;
+	}
+
+	int imageWidth = (int)image.GetWidth();
+	int imageHeight = (int)image.GetHeight();
+	resolvedRoi = roi;
+	if (resolvedRoi.width == 0)
+		resolvedRoi.width = imageWidth - roi.x;
+	if (resolvedRoi.height == 0)
+		resolvedRoi.height = imageHeight - roi.y;
+
+	if (roi.x < 0 || roi.y < 0 || resolvedRoi.width <= 0 || resolvedRoi.height <= 0 || roi.x + resolvedRoi.width > imageWidth || roi.y + resolvedRoi.height > imageHeight)
+	{
+		errorMessage.append("ROI must be inside the image");
+		return 1;
+	}
+
+	width = resolvedRoi.width / factor;
+	height = resolvedRoi.height / factor;
+	if (width == 0 || height == 0)
+	{
+		errorMessage.append("ROI is smaller than the factor");
+		return 1;
+	}
+
+	return 0;
+}
+
+void StitchImage::DecimateRowsAt(Pylon::CPylonImage &sourceImage, const Roi &roi, int factor, int channels, uint8_t *pDestination, size_t destinationStride, int width, int height)
+{
+	const uint8_t *pSource = (const uint8_t*)sourceImage.GetBuffer();
+	size_t sourceStride = GetStride(sourceImage);
+	const uint8_t *pRoi = &pSource[(size_t)roi.y * sourceStride + (size_t)roi.x * channels];
+
+	for (int y = 0; y < height; y++)
+		StitchKernels::BoxDownscaleRow(&pRoi[(size_t)y * factor * sourceStride], sourceStride, channels, factor, &pDestination[y * destinationStride], width);
+}
+
+size_t StitchImage::GetRowBytes(Pylon::EPixelType pixelType, int width)
+{
+	return ((size_t)width * Pylon::BitPerPixel(pixelType) + 7) / 8;
+}
+
+size_t StitchImage::GetStride(Pylon::CPylonImage &image)
+{
+	size_t stride = 0;
+	if (image.GetStride(stride) == false)
+		stride = GetRowBytes(image.GetPixelType(), image.GetWidth()) + image.GetPaddingX();
+	return stride;
+}
+
+void StitchImage::CopyRows(Pylon::CPylonImage &sourceImage, uint8_t *pDestination, size_t destinationStride)
+{
+	if (sourceImage.GetWidth() == 0 || sourceImage.GetHeight() == 0)
+		return; // nothing to copy (eg: the first image of a strip)
+
+	const uint8_t *pSource = (const uint8_t*)sourceImage.GetBuffer();
+	size_t sourceStride = GetStride(sourceImage);
+	size_t rowBytes = GetRowBytes(sourceImage.GetPixelType(), sourceImage.GetWidth());
+	int height = sourceImage.GetHeight();
+
+	if (sourceStride == rowBytes && destinationStride == rowBytes)
+	{
+		memcpy(pDestination, pSource, rowBytes * height);
+		return;
+	}
+
+	for (int i = 0; i < height; i++)
+		memcpy(&pDestination[i * destinationStride], &pSource[i * sourceStride], rowBytes);
+}
+
+void StitchImage::CopyRowsAt(Pylon::CPylonImage &sourceImage, uint8_t *pDestination, size_t destinationStride, size_t destinationBitOffset)
+{
+	// With packed pixel formats, the destination rows can start in the middle of a byte.
+	if (destinationBitOffset % 8 == 0)
+	{
+		CopyRows(sourceImage, &pDestination[destinationBitOffset / 8], destinationStride);
+		return;
+	}
+
+	const uint8_t *pSource = (const uint8_t*)sourceImage.GetBuffer();
+	size_t sourceStride = GetStride(sourceImage);
+	size_t sourceImageBits = (size_t)sourceImage.GetWidth() * Pylon::BitPerPixel(sourceImage.GetPixelType());
+	int height = sourceImage.GetHeight();
+
+	for (int i = 0; i < height; i++)
+		StitchKernels::CopyBitsLsbFirst(&pSource[i * sourceStride], &pDestination[i * destinationStride + destinationBitOffset / 8], destinationBitOffset % 8, sourceImageBits);
+}
+
+void StitchImage::CopyRowsRightOf(Pylon::CPylonImage &leftImage, Pylon::CPylonImage &rightImage, uint8_t *pDestination, size_t destinationStride)
+{
+	// The right image starts where the rows of the left image end.
+	CopyRowsAt(rightImage, pDestination, destinationStride, (size_t)leftImage.GetWidth() * Pylon::BitPerPixel(rightImage.GetPixelType()));
+}
+
+StitchKernels::EPacking StitchImage::GetPacking(Pylon::EPixelType pixelType)
+{
+	switch (pixelType)
+	{
+	case Pylon::EPixelType::PixelType_Mono10p:
+	case Pylon::EPixelType::PixelType_BayerGR10p:
+	case Pylon::EPixelType::PixelType_BayerRG10p:
+	case Pylon::EPixelType::PixelType_BayerGB10p:
+	case Pylon::EPixelType::PixelType_BayerBG10p:
+		return StitchKernels::Packing_10p;
+	case Pylon::EPixelType::PixelType_Mono12p:
+	case Pylon::EPixelType::PixelType_BayerGR12p:
+	case Pylon::EPixelType::PixelType_BayerRG12p:
+	case Pylon::EPixelType::PixelType_BayerGB12p:
+	case Pylon::EPixelType::PixelType_BayerBG12p:
+		return StitchKernels::Packing_12p;
+	case Pylon::EPixelType::PixelType_Mono10packed:
+		return StitchKernels::Packing_10Packed;
+	case Pylon::EPixelType::PixelType_Mono12packed:
+	case Pylon::EPixelType::PixelType_BayerGR12Packed:
+	case Pylon::EPixelType::PixelType_BayerRG12Packed:
+	case Pylon::EPixelType::PixelType_BayerGB12Packed:
+	case Pylon::EPixelType::PixelType_BayerBG12Packed:
+		return StitchKernels::Packing_12Packed;
+	default:
+		return StitchKernels::Packing_None;
+	}
+}
+
+Pylon::EPixelType StitchImage::GetUnpackedPixelType(Pylon::EPixelType pixelType)
+{
+	switch (pixelType)
+	{
+	case Pylon::EPixelType::PixelType_Mono10p:
+	case Pylon::EPixelType::PixelType_Mono10packed:
+		return Pylon::EPixelType::PixelType_Mono10;
+	case Pylon::EPixelType::PixelType_Mono12p:
+	case Pylon::EPixelType::PixelType_Mono12packed:
+		return Pylon::EPixelType::PixelType_Mono12;
+	case Pylon::EPixelType::PixelType_BayerGR10p:
+		return Pylon::EPixelType::PixelType_BayerGR10;
+	case Pylon::EPixelType::PixelType_BayerRG10p:
+		return Pylon::EPixelType::PixelType_BayerRG10;
+	case Pylon::EPixelType::PixelType_BayerGB10p:
+		return Pylon::EPixelType::PixelType_BayerGB10;
+	case Pylon::EPixelType::PixelType_BayerBG10p:
+		return Pylon::EPixelType::PixelType_BayerBG10;
+	case Pylon::EPixelType::PixelType_BayerGR12p:
+	case Pylon::EPixelType::PixelType_BayerGR12Packed:
+		return Pylon::EPixelType::PixelType_BayerGR12;
+	case Pylon::EPixelType::PixelType_BayerRG12p:
+	case Pylon::EPixelType::PixelType_BayerRG12Packed:
+		return Pylon::EPixelType::PixelType_BayerRG12;
+	case Pylon::EPixelType::PixelType_BayerGB12p:
+	case Pylon::EPixelType::PixelType_BayerGB12Packed:
+		return Pylon::EPixelType::PixelType_BayerGB12;
+	case Pylon::EPixelType::PixelType_BayerBG12p:
+	case Pylon::EPixelType::PixelType_BayerBG12Packed:
+		return Pylon::EPixelType::PixelType_BayerBG12;
+	default:
+		return Pylon::EPixelType::PixelType_Undefined;
+	}
+}
+
+bool StitchImage::IsReusable(Pylon::CPylonImage &image, Pylon::EPixelType pixelType, int width, int height)
+{
+	// A buffer that is shared with another image can't be written to without changing that image too.
+	return image.IsValid() == true
+		&& image.IsUnique() == true
+		&& image.GetPixelType() == pixelType
+		&& (int)image.GetWidth() == width
+		&& (int)image.GetHeight() == height
+		&& image.GetPaddingX() == 0;
+}
+
+int StitchImage::StitchToBottom(Pylon::CPylonImage &topImage, Pylon::CPylonImage &bottomImage, Pylon::CPylonImage *stitchedImage, std::string &errorMessage)
+{
+	errorMessage = "ERROR: ";
+	errorMessage.append(__FUNCTION__);
+	errorMessage.append("(): ");
+
+	try
+	{
+		Pylon::EPixelType tempPixelType;
+		int tempWidth;
+		int tempHeight;
+
+		if (GetStitchToBottomGeometry(topImage, bottomImage, tempPixelType, tempWidth, tempHeight, errorMessage) != 0)
+			return 1;
+
+		size_t tempStride = GetRowBytes(tempPixelType, tempWidth);
+
+		// If the stitched image is also one of the input images, we have to stitch into a temporary image first.
+		if (stitchedImage == &topImage || stitchedImage == &bottomImage)
+		{
+			Pylon::CPylonImage tempImage;
+			tempImage.Reset(tempPixelType, tempWidth, tempHeight);
+
+			uint8_t *pTempImage = (uint8_t*)tempImage.GetBuffer();
+			CopyRows(topImage, &pTempImage[0], tempStride);
+			CopyRows(bottomImage, &pTempImage[topImage.GetHeight() * tempStride], tempStride);
+
+			// hand the temporary buffer over instead of copying it
+			*stitchedImage = tempImage;
+
+			return 0;
+		}
+
+		if (IsReusable(*stitchedImage, tempPixelType, tempWidth, tempHeight) == false)
+			stitchedImage->Reset(tempPixelType, tempWidth, tempHeight);
+
+		uint8_t *pStitchedImage = (uint8_t*)stitchedImage->GetBuffer();
+		CopyRows(topImage, &pStitchedImage[0], tempStride);
+		CopyRows(bottomImage, &pStitchedImage[topImage.GetHeight() * tempStride], tempStride);
+
+		return 0;
+
+	}
+	catch (GenICam::GenericException &e)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append(e.GetDescription());
+		return 1;
+	}
+	catch (std::exception &e)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append(e.what());
+		return 1;
+	}
+	catch (...)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append("UNKNOWN.");
+		return 1;
+	}
+}
+
+int StitchImage::StitchToBottom(Pylon::CPylonImage &topImage, Pylon::CPylonImage &bottomImage, uint8_t *pStitchedBuffer, size_t stitchedBufferSize, size_t stitchedStride, std::string &errorMessage)
+{
+	errorMessage = "ERROR: ";
+	errorMessage.append(__FUNCTION__);
+	errorMessage.append("(): ");
+
+	try
+	{
+		Pylon::EPixelType tempPixelType;
+		int tempWidth;
+		int tempHeight;
+
+		if (GetStitchToBottomGeometry(topImage, bottomImage, tempPixelType, tempWidth, tempHeight, errorMessage) != 0)
+			return 1;
+
+		size_t rowBytes = GetRowBytes(tempPixelType, tempWidth);
+		if (stitchedStride == 0)
+			stitchedStride = rowBytes;
+
+		if (stitchedStride < rowBytes || stitchedBufferSize < stitchedStride * (tempHeight - 1) + rowBytes)
+		{
+			errorMessage.append("Stitched buffer is too small!");
+			return 1;
+		}
+
+		CopyRows(topImage, &pStitchedBuffer[0], stitchedStride);
+		CopyRows(bottomImage, &pStitchedBuffer[topImage.GetHeight() * stitchedStride], stitchedStride);
+
+		return 0;
+	}
+	catch (GenICam::GenericException &e)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append(e.GetDescription());
+		return 1;
+	}
+	catch (std::exception &e)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append(e.what());
+		return 1;
+	}
+	catch (...)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append("UNKNOWN.");
+		return 1;
+	}
+}
+
+int StitchImage::StitchToRight(Pylon::CPylonImage &leftImage, Pylon::CPylonImage &rightImage, Pylon::CPylonImage *stitchedImage, std::string &errorMessage)
+{
+	errorMessage = "ERROR: ";
+	errorMessage.append(__FUNCTION__);
+	errorMessage.append("(): ");
+
+	try
+	{
+		Pylon::EPixelType tempPixelType;
+		int tempWidth;
+		int tempHeight;
+
+		if (GetStitchToRightGeometry(leftImage, rightImage, tempPixelType, tempWidth, tempHeight, errorMessage) != 0)
+			return 1;
+
+		size_t tempStride = GetRowBytes(tempPixelType, tempWidth);
+
+		// If the stitched image is also one of the input images, we have to stitch into a temporary image first.
+		if (stitchedImage == &leftImage || stitchedImage == &rightImage)
+		{
+			Pylon::CPylonImage tempImage;
+			tempImage.Reset(tempPixelType, tempWidth, tempHeight);
+
+			uint8_t *pTempImage = (uint8_t*)tempImage.GetBuffer();
+			CopyRows(leftImage, &pTempImage[0], tempStride);
+			CopyRowsRightOf(leftImage, rightImage, &pTempImage[0], tempStride);
+
+			// hand the temporary buffer over instead of copying it
+			*stitchedImage = tempImage;
+
+			return 0;
+		}
+
+		if (IsReusable(*stitchedImage, tempPixelType, tempWidth, tempHeight) == false)
+			stitchedImage->Reset(tempPixelType, tempWidth, tempHeight);
+
+		uint8_t *pStitchedImage = (uint8_t*)stitchedImage->GetBuffer();
+		CopyRows(leftImage, &pStitchedImage[0], tempStride);
+		CopyRowsRightOf(leftImage, rightImage, &pStitchedImage[0], tempStride);
+
+		return 0;
+
+	}
+	catch (GenICam::GenericException &e)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append(e.GetDescription());
+		return 1;
+	}
+	catch (std::exception &e)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append(e.what());
+		return 1;
+	}
+	catch (...)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append("UNKNOWN.");
+		return 1;
+	}
+}
+
+int StitchImage::StitchToRight(Pylon::CPylonImage &leftImage, Pylon::CPylonImage &rightImage, uint8_t *pStitchedBuffer, size_t stitchedBufferSize, size_t stitchedStride, std::string &errorMessage)
+{
+	errorMessage = "ERROR: ";
+	errorMessage.append(__FUNCTION__);
+	errorMessage.append("(): ");
+
+	try
+	{
+		Pylon::EPixelType tempPixelType;
+		int tempWidth;
+		int tempHeight;
+
+		if (GetStitchToRightGeometry(leftImage, rightImage, tempPixelType, tempWidth, tempHeight, errorMessage) != 0)
+			return 1;
+
+		size_t rowBytes = GetRowBytes(tempPixelType, tempWidth);
+		if (stitchedStride == 0)
+			stitchedStride = rowBytes;
+
+		if (stitchedStride < rowBytes || stitchedBufferSize < stitchedStride * (tempHeight - 1) + rowBytes)
+		{
+			errorMessage.append("Stitched buffer is too small!");
+			return 1;
+		}
+
+		CopyRows(leftImage, &pStitchedBuffer[0], stitchedStride);
+		CopyRowsRightOf(leftImage, rightImage, &pStitchedBuffer[0], stitchedStride);
+
+		return 0;
+	}
+	catch (GenICam::GenericException &e)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append(e.GetDescription());
+		return 1;
+	}
+	catch (std::exception &e)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append(e.what());
+		return 1;
+	}
+	catch (...)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append("UNKNOWN.");
+		return 1;
+	}
+}
+
+int StitchImage::StitchToRightAsBGR8(Pylon::CPylonImage &leftImage, Pylon::CPylonImage &rightImage, Pylon::CPylonImage *stitchedImage, std::string &errorMessage)
+{
+	errorMessage = "ERROR: ";
+	errorMessage.append(__FUNCTION__);
+	errorMessage.append("(): ");
+
+	try
+	{
+		Pylon::EPixelType tempPixelType;
+		int tempWidth;
+		int tempHeight;
+
+		if (GetStitchToRightGeometry(leftImage, rightImage, tempPixelType, tempWidth, tempHeight, errorMessage) != 0)
+			return 1;
+
+		if (tempPixelType != Pylon::EPixelType::PixelType_Mono8)
+		{
+			errorMessage.append("Images must be Mono8");
+			return 1;
+		}
+
+		if (stitchedImage == &leftImage || stitchedImage == &rightImage)
+		{
+			errorMessage.append("Stitched image can't be one of the input images");
+			return 1;
+		}
+
+		if (IsReusable(*stitchedImage, Pylon::EPixelType::PixelType_BGR8packed, tempWidth, tempHeight) == false)
+			stitchedImage->Reset(Pylon::EPixelType::PixelType_BGR8packed, tempWidth, tempHeight);
+
+		StitchKernels::StitchToRightMono8ToBGR8(
+			(const uint8_t*)leftImage.GetBuffer(), GetStride(leftImage), leftImage.GetWidth(),
+			(const uint8_t*)rightImage.GetBuffer(), GetStride(rightImage), rightImage.GetWidth(),
+			tempHeight, (uint8_t*)stitchedImage->GetBuffer(), 3 * (size_t)tempWidth);
+
+		return 0;
+	}
+	catch (GenICam::GenericException &e)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append(e.GetDescription());
+		return 1;
+	}
+	catch (std::exception &e)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append(e.what());
+		return 1;
+	}
+	catch (...)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append("UNKNOWN.");
+		return 1;
+	}
+}
+
+int StitchImage::StitchToRightAsBGR8(Pylon::CPylonImage &leftImage, Pylon::CPylonImage &rightImage, uint8_t *pStitchedBuffer, size_t stitchedBufferSize, size_t stitchedStride, std::string &errorMessage)
+{
+	errorMessage = "ERROR: ";
+	errorMessage.append(__FUNCTION__);
+	errorMessage.append("(): ");
+
+	try
+	{
+		Pylon::EPixelType tempPixelType;
+		int tempWidth;
+		int tempHeight;
+
+		if (GetStitchToRightGeometry(leftImage, rightImage, tempPixelType, tempWidth, tempHeight, errorMessage) != 0)
+			return 1;
+
+		if (tempPixelType != Pylon::EPixelType::PixelType_Mono8)
+		{
+			errorMessage.append("Images must be Mono8");
+			return 1;
+		}
+
+		size_t rowBytes = 3 * (size_t)tempWidth;
+		if (stitchedStride == 0)
+			stitchedStride = rowBytes;
+
+		if (stitchedStride < rowBytes || stitchedBufferSize < stitchedStride * (tempHeight - 1) + rowBytes)
+		{
+			errorMessage.append("Stitched buffer is too small!");
+			return 1;
+		}
+
+		StitchKernels::StitchToRightMono8ToBGR8(
+			(const uint8_t*)leftImage.GetBuffer(), GetStride(leftImage), leftImage.GetWidth(),
+			(const uint8_t*)rightImage.GetBuffer(), GetStride(rightImage), rightImage.GetWidth(),
+			tempHeight, pStitchedBuffer, stitchedStride);
+
+		return 0;
+	}
+	catch (GenICam::GenericException &e)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append(e.GetDescription());
+		return 1;
+	}
+	catch (std::exception &e)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append(e.what());
+		return 1;
+	}
+	catch (...)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append("UNKNOWN.");
+		return 1;
+	}
+}
+
+int StitchImage::StitchToRightUnpacked(Pylon::CPylonImage &leftImage, Pylon::CPylonImage &rightImage, Pylon::CPylonImage *stitchedImage, std::string &errorMessage)
+{
+	errorMessage = "ERROR: ";
+	errorMessage.append(__FUNCTION__);
+	errorMessage.append("(): ");
+
+	try
+	{
+		Pylon::EPixelType tempPixelType;
+		int tempWidth;
+		int tempHeight;
+
+		if (GetStitchToRightGeometry(leftImage, rightImage, tempPixelType, tempWidth, tempHeight, errorMessage) != 0)
+			return 1;
+
+		StitchKernels::EPacking packing = GetPacking(tempPixelType);
+		if (packing == StitchKernels::Packing_None)
+		{
+			errorMessage.append("Images must have a packed pixel format");
+			return 1;
+		}
+
+		if (stitchedImage == &leftImage || stitchedImage == &rightImage)
+		{
+			errorMessage.append("Stitched image can't be one of the input images");
+			return 1;
+		}
+
+		Pylon::EPixelType unpackedPixelType = GetUnpackedPixelType(tempPixelType);
+		if (IsReusable(*stitchedImage, unpackedPixelType, tempWidth, tempHeight) == false)
+			stitchedImage->Reset(unpackedPixelType, tempWidth, tempHeight);
+
+		const uint8_t *pLeftImage = (const uint8_t*)leftImage.GetBuffer();
+		const uint8_t *pRightImage = (const uint8_t*)rightImage.GetBuffer();
+		uint16_t *pStitchedImage = (uint16_t*)stitchedImage->GetBuffer();
+		size_t leftImageStride = GetStride(leftImage);
+		size_t rightImageStride = GetStride(rightImage);
+		int leftImageWidth = leftImage.GetWidth();
+		int rightImageWidth = rightImage.GetWidth();
+
+		for (int i = 0; i < tempHeight; i++)
+		{
+			uint16_t *pStitchedRow = &pStitchedImage[(size_t)i * tempWidth];
+			if (leftImageWidth > 0)
+				StitchKernels::UnpackRow(packing, &pLeftImage[i * leftImageStride], &pStitchedRow[0], leftImageWidth);
+			if (rightImageWidth > 0)
+				StitchKernels::UnpackRow(packing, &pRightImage[i * rightImageStride], &pStitchedRow[leftImageWidth], rightImageWidth);
+		}
+
+		return 0;
+	}
+	catch (GenICam::GenericException &e)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append(e.GetDescription());
+		return 1;
+	}
+	catch (std::exception &e)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append(e.what());
+		return 1;
+	}
+	catch (...)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append("UNKNOWN.");
+		return 1;
+	}
+}
+
+int StitchImage::StitchToGrid(const std::vector<Pylon::CPylonImage*> &images, int columns, Pylon::CPylonImage *stitchedImage, std::string &errorMessage)
+{
+	errorMessage = "ERROR: ";
+	errorMessage.append(__FUNCTION__);
+	errorMessage.append("(): ");
+
+	try
+	{
+		Pylon::EPixelType tempPixelType;
+		int tempWidth;
+		int tempHeight;
+
+		if (GetStitchToGridGeometry(images, columns, tempPixelType, tempWidth, tempHeight, errorMessage) != 0)
+			return 1;
+
+		for (size_t i = 0; i < images.size(); i++)
+		{
+			if (images[i] == stitchedImage)
+			{
+				errorMessage.append("Stitched image can't be one of the input images");
+				return 1;
+			}
+		}
+
+		if (IsReusable(*stitchedImage, tempPixelType, tempWidth, tempHeight) == false)
+		{
+			// only the cells without an image need it, but they never get written to after this
+			stitchedImage->Reset(tempPixelType, tempWidth, tempHeight);
+			memset(stitchedImage->GetBuffer(), 0, stitchedImage->GetImageSize());
+		}
+
+		uint8_t *pStitchedImage = (uint8_t*)stitchedImage->GetBuffer();
+		size_t stitchedStride = GetStride(*stitchedImage);
+		int tileWidth = images[0]->GetWidth();
+		int tileHeight = images[0]->GetHeight();
+
+		for (size_t i = 0; i < images.size(); i++)
+		{
+			int column = (int)i % columns;
+			int row = (int)i / columns;
+			uint8_t *pTileRow = &pStitchedImage[(size_t)row * tileHeight * stitchedStride];
+			CopyRowsAt(*images[i], pTileRow, stitchedStride, (size_t)column * tileWidth * Pylon::BitPerPixel(tempPixelType));
+		}
 
+		// With packed pixel formats, an image's rows can end in the middle of a byte, and the unused bits of that byte are copied along.
+		// The next image overwrites them, but the first empty cell (if there is one) has to get them cleared.
+		int lastColumn = (int)(images.size() - 1) % columns;
+		size_t endBit = (size_t)(lastColumn + 1) * tileWidth * Pylon::BitPerPixel(tempPixelType);
+		if (lastColumn < columns - 1 && endBit % 8 != 0)
+		{
+			int lastRow = (int)(images.size() - 1) / columns;
+			uint8_t keepMask = (uint8_t)((1 << (endBit % 8)) - 1);
+			for (int y = 0; y < tileHeight; y++)
+				pStitchedImage[((size_t)lastRow * tileHeight + y) * stitchedStride + endBit / 8] &= keepMask;
+		}
+
+		return 0;
+	}
+	catch (GenICam::GenericException &e)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append(e.GetDescription());
+		return 1;
+	}
+	catch (std::exception &e)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append(e.what());
+		return 1;
+	}
+	catch (...)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append("UNKNOWN.");
+		return 1;
+	}
 }
 
-// *********************************************************************************************************
-// DEFINITIONS
-int StitchImage::StitchToBottom(Pylon::CPylonImage &topImage, Pylon::CPylonImage &bottomImage, Pylon::CPylonImage *stitchedImage, std::string &errorMessage)
+int StitchImage::StitchToGridAsBGR8(const std::vector<Pylon::CPylonImage*> &images, int columns, Pylon::CPylonImage *stitchedImage, std::string &errorMessage)
 {
 	errorMessage = "ERROR: ";
 	errorMessage.append(__FUNCTION__);
@@ -72,72 +1009,125 @@ int StitchImage::StitchToBottom(Pylon::CPylonImage &topImage, Pylon::CPylonImage
 
 	try
 	{
-		Pylon::CPylonImage tempImage;
 		Pylon::EPixelType tempPixelType;
 		int tempWidth;
+		int tempHeight;
+
+		if (GetStitchToGridGeometry(images, columns, tempPixelType, tempWidth, tempHeight, errorMessage) != 0)
+			return 1;
 
-		if (topImage.GetPixelType() == Pylon::EPixelType::PixelType_Undefined)
+		if (tempPixelType != Pylon::EPixelType::PixelType_Mono8)
 		{
-			if (bottomImage.GetPixelType() == Pylon::EPixelType::PixelType_Undefined)
-			{
-				errorMessage.append("Both images have undefined pixel types!");
-				return 1;
-			}
-			else
-				tempPixelType = bottomImage.GetPixelType();
+			errorMessage.append("Images must be Mono8");
+			return 1;
 		}
-		else
+
+		for (size_t i = 0; i < images.size(); i++)
 		{
-			if (topImage.GetPixelType() != bottomImage.GetPixelType())
+			if (images[i] == stitchedImage)
 			{
-				errorMessage.append("Images must be same PixelType");
+				errorMessage.append("Stitched image can't be one of the input images");
 				return 1;
 			}
-			else
-				tempPixelType = topImage.GetPixelType();
 		}
 
+		if (IsReusable(*stitchedImage, Pylon::EPixelType::PixelType_BGR8packed, tempWidth, tempHeight) == false)
+		{
+			stitchedImage->Reset(Pylon::EPixelType::PixelType_BGR8packed, tempWidth, tempHeight);
+			memset(stitchedImage->GetBuffer(), 0, stitchedImage->GetImageSize());
+		}
+
+		uint8_t *pStitchedImage = (uint8_t*)stitchedImage->GetBuffer();
+		size_t stitchedStride = 3 * (size_t)tempWidth;
+		int tileWidth = images[0]->GetWidth();
+		int tileHeight = images[0]->GetHeight();
 
-		if (topImage.GetWidth() == 0)
+		for (size_t i = 0; i < images.size(); i++)
 		{
-			if (bottomImage.GetWidth() == 0)
-			{
-				errorMessage.append("Both Images have Width = 0!");
-				return 1;
-			}
-			else
-				tempWidth = bottomImage.GetWidth();
+			int column = (int)i % columns;
+			int row = (int)i / columns;
+			const uint8_t *pImage = (const uint8_t*)images[i]->GetBuffer();
+			size_t imageStride = GetStride(*images[i]);
+			uint8_t *pTile = &pStitchedImage[(size_t)row * tileHeight * stitchedStride + 3 * (size_t)column * tileWidth];
+
+			for (int y = 0; y < tileHeight; y++)
+				StitchKernels::Mono8ToBGR8Row(&pImage[y * imageStride], &pTile[y * stitchedStride], tileWidth);
 		}
+
+		return 0;
+	}
+	catch (GenICam::GenericException &e)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append(e.GetDescription());
+		return 1;
+	}
+	catch (std::exception &e)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append(e.what());
+		return 1;
+	}
+	catch (...)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append("UNKNOWN.");
+		return 1;
+	}
+}
+
+int StitchImage::Downscale(Pylon::CPylonImage &sourceImage, int factor, Pylon::CPylonImage *downscaledImage, std::string &errorMessage)
+{
+	errorMessage = "ERROR: ";
+	errorMessage.append(__FUNCTION__);
+	errorMessage.append("(): ");
+
+	try
+	{
+		Pylon::EPixelType pixelType = sourceImage.GetPixelType();
+		int channels = 0;
+		if (pixelType == Pylon::EPixelType::PixelType_Mono8)
+			channels = 1;
+		else if (pixelType == Pylon::EPixelType::PixelType_BGR8packed || pixelType == Pylon::EPixelType::PixelType_RGB8packed)
+			channels = 3;
 		else
 		{
-			if (topImage.GetWidth() != bottomImage.GetWidth())
-			{
-				errorMessage.append("Images must be same Width!");
-				return 1;
-			}
-			else
-				tempWidth = topImage.GetWidth();
+			errorMessage.append("Image must be Mono8 or BGR8");
+			return 1;
+		}
+
+		if (factor < 1)
+		{
+			errorMessage.append("Factor must be at least 1");
+			return 1;
 		}
 
-		int topImageHeight = topImage.GetHeight();
-		int bottomImageHeight = bottomImage.GetHeight();
-		size_t topImageSize = topImage.GetImageSize();
-		size_t bottomImageSize = bottomImage.GetImageSize();
-		int tempHeight = topImageHeight + bottomImageHeight;
+		if (downscaledImage == &sourceImage)
+		{
+			errorMessage.append("Downscaled image can't be the source image");
+			return 1;
+		}
 
-		tempImage.Reset(tempPixelType, tempWidth, tempHeight);
+		int tempWidth = (int)sourceImage.GetWidth() / factor;
+		int tempHeight = (int)sourceImage.GetHeight() / factor;
+		if (tempWidth == 0 || tempHeight == 0)
+		{
+			errorMessage.append("Image is smaller than the factor");
+			return 1;
+		}
 
-		uint8_t *pTopImage = (uint8_t*)topImage.GetBuffer();
-		uint8_t *pBottomImage = (uint8_t*)bottomImage.GetBuffer();
-		uint8_t *pTempImage = (uint8_t*)tempImage.GetBuffer();
+		if (IsReusable(*downscaledImage, pixelType, tempWidth, tempHeight) == false)
+			downscaledImage->Reset(pixelType, tempWidth, tempHeight);
 
-		memcpy(&pTempImage[0], &pTopImage[0], topImageSize);
-		memcpy(&pTempImage[0 + topImageSize], &pBottomImage[0], bottomImageSize);
+		const uint8_t *pSource = (const uint8_t*)sourceImage.GetBuffer();
+		size_t sourceStride = GetStride(sourceImage);
+		uint8_t *pDownscaled = (uint8_t*)downscaledImage->GetBuffer();
+		size_t downscaledStride = (size_t)tempWidth * channels;
 
-		stitchedImage->CopyImage(tempImage);
+		for (int y = 0; y < tempHeight; y++)
+			StitchKernels::BoxDownscaleRow(&pSource[(size_t)y * factor * sourceStride], sourceStride, channels, factor, &pDownscaled[y * downscaledStride], tempWidth);
 
 		return 0;
-
 	}
 	catch (GenICam::GenericException &e)
 	{
@@ -159,7 +1149,7 @@ int StitchImage::StitchToBottom(Pylon::CPylonImage &topImage, Pylon::CPylonImage
 	}
 }
 
-int StitchImage::StitchToRight(Pylon::CPylonImage &leftImage, Pylon::CPylonImage &rightImage, Pylon::CPylonImage *stitchedImage, std::string &errorMessage)
+int StitchImage::StitchToBottom(Pylon::CPylonImage &topImage, const Roi &topRoi, Pylon::CPylonImage &bottomImage, const Roi &bottomRoi, int factor, Pylon::CPylonImage *stitchedImage, std::string &errorMessage)
 {
 	errorMessage = "ERROR: ";
 	errorMessage.append(__FUNCTION__);
@@ -167,81 +1157,112 @@ int StitchImage::StitchToRight(Pylon::CPylonImage &leftImage, Pylon::CPylonImage
 
 	try
 	{
-		Pylon::CPylonImage tempImage;
-		Pylon::EPixelType tempPixelType;
-		int tempHeight;
+		Roi top;
+		Roi bottom;
+		int topChannels, bottomChannels;
+		int topWidth, topHeight, bottomWidth, bottomHeight;
+
+		if (GetDecimatedGeometry(topImage, topRoi, factor, top, topChannels, topWidth, topHeight, errorMessage) != 0)
+			return 1;
+		if (GetDecimatedGeometry(bottomImage, bottomRoi, factor, bottom, bottomChannels, bottomWidth, bottomHeight, errorMessage) != 0)
+			return 1;
 
-		if (Pylon::IsPacked(leftImage.GetPixelType()) == true || Pylon::IsPacked(rightImage.GetPixelType()) == true)
+		if (topImage.GetPixelType() != bottomImage.GetPixelType())
 		{
-			errorMessage.append("Packed pixel formats are not supported yet");
+			errorMessage.append("Images must be same PixelType");
 			return 1;
 		}
-
-		if (leftImage.GetPixelType() == Pylon::EPixelType::PixelType_Undefined)
+		if (topWidth != bottomWidth)
 		{
-			if (rightImage.GetPixelType() == Pylon::EPixelType::PixelType_Undefined)
-			{
-				errorMessage.append("Both images have undefined pixel types!");
-				return 1;
-			}
-			else
-				tempPixelType = rightImage.GetPixelType();
+			errorMessage.append("ROIs must be same Width after decimation!");
+			return 1;
 		}
-		else
+		if (stitchedImage == &topImage || stitchedImage == &bottomImage)
 		{
-			if (leftImage.GetPixelType() != rightImage.GetPixelType())
-			{
-				errorMessage.append("Images must be same PixelType");
-				return 1;
-			}
-			else
-				tempPixelType = leftImage.GetPixelType();
+			errorMessage.append("Stitched image can't be one of the input images");
+			return 1;
 		}
 
+		Pylon::EPixelType tempPixelType = topImage.GetPixelType();
+		int tempWidth = topWidth;
+		int tempHeight = topHeight + bottomHeight;
+		if (IsReusable(*stitchedImage, tempPixelType, tempWidth, tempHeight) == false)
+			stitchedImage->Reset(tempPixelType, tempWidth, tempHeight);
 
-		if (leftImage.GetHeight() == 0)
-		{
-			if (rightImage.GetHeight() == 0)
-			{
-				errorMessage.append("Both Images have Height = 0!");
-				return 1;
-			}
-			else
-				tempHeight = rightImage.GetHeight();
-		}
-		else
-		{
-			if (leftImage.GetHeight() != rightImage.GetHeight())
-			{
-				errorMessage.append("Images must be same Height!");
-				return 1;
-			}
-			else
-				tempHeight = leftImage.GetHeight();
-		}
+		uint8_t *pStitchedImage = (uint8_t*)stitchedImage->GetBuffer();
+		size_t tempStride = (size_t)tempWidth * topChannels;
+		DecimateRowsAt(topImage, top, factor, topChannels, &pStitchedImage[0], tempStride, topWidth, topHeight);
+		DecimateRowsAt(bottomImage, bottom, factor, bottomChannels, &pStitchedImage[(size_t)topHeight * tempStride], tempStride, bottomWidth, bottomHeight);
 
+		return 0;
+	}
+	catch (GenICam::GenericException &e)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append(e.GetDescription());
+		return 1;
+	}
+	catch (std::exception &e)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append(e.what());
+		return 1;
+	}
+	catch (...)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append("UNKNOWN.");
+		return 1;
+	}
+}
 
-		int BytesPerPixel = Pylon::BitPerPixel(tempPixelType) / 8;
-		int LeftImageWidth = leftImage.GetWidth();
-		int RightImageWidth = rightImage.GetWidth();
-		int tempWidth = LeftImageWidth + RightImageWidth;
+int StitchImage::StitchToRight(Pylon::CPylonImage &leftImage, const Roi &leftRoi, Pylon::CPylonImage &rightImage, const Roi &rightRoi, int factor, Pylon::CPylonImage *stitchedImage, std::string &errorMessage)
+{
+	errorMessage = "ERROR: ";
+	errorMessage.append(__FUNCTION__);
+	errorMessage.append("(): ");
 
-		tempImage.Reset(tempPixelType, tempWidth, tempHeight);
+	try
+	{
+		Roi left;
+		Roi right;
+		int leftChannels, rightChannels;
+		int leftWidth, leftHeight, rightWidth, rightHeight;
 
-		uint8_t *pLeftImage = (uint8_t*)leftImage.GetBuffer();
-		uint8_t *pRightImage = (uint8_t*)rightImage.GetBuffer();
-		uint8_t *pTempImage = (uint8_t*)tempImage.GetBuffer();
+		if (GetDecimatedGeometry(leftImage, leftRoi, factor, left, leftChannels, leftWidth, leftHeight, errorMessage) != 0)
+			return 1;
+		if (GetDecimatedGeometry(rightImage, rightRoi, factor, right, rightChannels, rightWidth, rightHeight, errorMessage) != 0)
+			return 1;
 
-		for (int i = 0; i < tempHeight; i++)
+		if (leftImage.GetPixelType() != rightImage.GetPixelType())
+		{
+			errorMessage.append("Images must be same PixelType");
+			return 1;
+		}
+		if (leftHeight != rightHeight)
+		{
+			errorMessage.append("ROIs must be same Height after decimation!");
+			return 1;
+		}
+		if (stitchedImage == &leftImage || stitchedImage == &rightImage)
 		{
-			memcpy(&pTempImage[(tempWidth * i * BytesPerPixel)], &pLeftImage[LeftImageWidth * i * BytesPerPixel], LeftImageWidth * BytesPerPixel);
-			memcpy(&pTempImage[(tempWidth * i * BytesPerPixel) + (LeftImageWidth * BytesPerPixel)], &pRightImage[RightImageWidth * i * BytesPerPixel], RightImageWidth * BytesPerPixel);
+			errorMessage.append("Stitched image can't be one of the input images");
+			return 1;
 		}
 
-		stitchedImage->CopyImage(tempImage);
+		Pylon::EPixelType tempPixelType = leftImage.GetPixelType();
+		int tempWidth = leftWidth + rightWidth;
+		int tempHeight = leftHeight;
+		if (IsReusable(*stitchedImage, tempPixelType, tempWidth, tempHeight) == false)
+			stitchedImage->Reset(tempPixelType, tempWidth, tempHeight);
 
-		return 0;
+		// Each row of the stitched image is the decimated row of the left ROI followed by the decimated row of the right ROI.
+		uint8_t *pStitchedImage = (uint8_t*)stitchedImage->GetBuffer();
+		size_t tempStride = (size_t)tempWidth * leftChannels;
+		DecimateRowsAt(leftImage, left, factor, leftChannels, &pStitchedImage[0], tempStride, leftWidth, leftHeight);
+		DecimateRowsAt(rightImage, right, factor, rightChannels, &pStitchedImage[(size_t)leftWidth * leftChannels], tempStride, rightWidth, rightHeight);
 
+		return 0;
 	}
 	catch (GenICam::GenericException &e)
 	{
@@ -263,6 +1284,41 @@ int StitchImage::StitchToRight(Pylon::CPylonImage &leftImage, Pylon::CPylonImage
 	}
 }
 
+StitchImage::ImagePool::ImagePool(size_t numImages, unsigned int timeoutMs)
+	: m_images(numImages > 0 ? numImages : 1), m_timeoutMs(timeoutMs)
+{
+	// nothing
+}
+
+StitchImage::ImagePool::~ImagePool()
+{
+	// nothing
+}
+
+Pylon::CPylonImage &StitchImage::ImagePool::GetImage()
+{
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(m_timeoutMs);
+	while (true)
+	{
+		// Always search from the start, so only as many images as are needed at the same time get used (and allocated).
+		for (size_t i = 0; i < m_images.size(); i++)
+		{
+			if (m_images[i].IsValid() == false || m_images[i].IsUnique() == true)
+				return m_images[i];
+		}
+
+		// All images are still in use elsewhere (eg: waiting in a queue). Wait for one of them to be let go of, instead of taking it away from its users.
+		if (std::chrono::steady_clock::now() >= deadline)
+			throw std::runtime_error("ImagePool::GetImage(): All " + std::to_string(m_images.size()) + " images are still in use");
+		std::this_thread::sleep_for(std::chrono::microseconds(100));
+	}
+}
+
+size_t StitchImage::ImagePool::GetSize()
+{
+	return m_images.size();
+}
+
 StitchImage::CollageMaker::CollageMaker()
 {
 	// nothing
@@ -281,36 +1337,16 @@ int StitchImage::CollageMaker::StitchToCollage(Pylon::CPylonImage &image, std::s
 
 	try
 	{
-		if (StitchImage::StitchToRight(m_collageRow, image, &m_collageRow, errorMessage) != 0)
-			return 1;
-		
-		m_collageComplete = false;
-
-		m_collageImagesCounter++;
-
-		if (m_collageImagesCounter % m_collageWidth == 0 && m_collageImagesCounter > 0)
-		{
-			m_collageRows.push_back(m_collageRow);
-			m_collageRow.Release();
-		}
-
-		if (m_collageImagesCounter % (m_collageWidth * m_collageHeight) == 0 && m_collageImagesCounter > 0)
+		if (m_collageWidth <= 0 || m_collageHeight <= 0)
 		{
-			for (size_t i = 0; i < m_collageRows.size(); i++)
-			{
-				std::string errorMessage = "";
-				if (StitchImage::StitchToBottom(m_tempImage, m_collageRows[i], &m_tempImage, errorMessage) != 0)
-					return 1;
-			}
-			m_collageImage.CopyImage(m_tempImage);
-			m_tempImage.Release();
-			m_collageRow.Release();
-			m_collageRows.clear();
-			m_collageImagesCounter = 0;
-			m_collageComplete = true;
+			errorMessage.append("Collage Width and Height must be set first");
+			return 1;
 		}
 
-		return 0;
+		if (m_usingPreallocatedCanvas == true)
+			return StitchToCanvas(image, errorMessage);
+		else
+			return StitchToStrips(image, errorMessage);
 	}
 	catch (GenICam::GenericException &e)
 	{
@@ -332,6 +1368,98 @@ int StitchImage::CollageMaker::StitchToCollage(Pylon::CPylonImage &image, std::s
 	}
 }
 
+int StitchImage::CollageMaker::StitchToCanvas(Pylon::CPylonImage &image, std::string &errorMessage)
+{
+	if (m_collageImagesCounter == 0)
+	{
+		// The first image of a collage decides the size of the tiles.
+		m_tilePixelType = image.GetPixelType();
+		m_tileWidth = image.GetWidth();
+		m_tileHeight = image.GetHeight();
+
+		if (m_tilePixelType == Pylon::EPixelType::PixelType_Undefined || m_tileWidth == 0 || m_tileHeight == 0)
+		{
+			errorMessage.append("Image is empty");
+			return 1;
+		}
+
+		// GigE packed formats store two pixels in three bytes, so a tile can't start on an odd pixel.
+		StitchKernels::EPacking packing = GetPacking(m_tilePixelType);
+		if ((packing == StitchKernels::Packing_10Packed || packing == StitchKernels::Packing_12Packed) && m_tileWidth % 2 != 0 && m_collageWidth > 1)
+		{
+			errorMessage.append("Image width must be even for this packed pixel format");
+			return 1;
+		}
+
+		Pylon::CPylonImage &canvas = m_canvas[m_fillingCanvas];
+		int canvasWidth = m_tileWidth * m_collageWidth;
+		int canvasHeight = m_tileHeight * m_collageHeight;
+		if (IsReusable(canvas, m_tilePixelType, canvasWidth, canvasHeight) == false)
+			canvas.Reset(m_tilePixelType, canvasWidth, canvasHeight);
+	}
+	else if (image.GetPixelType() != m_tilePixelType || (int)image.GetWidth() != m_tileWidth || (int)image.GetHeight() != m_tileHeight)
+	{
+		errorMessage.append("All images of a collage must have the same size and PixelType");
+		return 1;
+	}
+
+	m_collageComplete = false;
+
+	Pylon::CPylonImage &canvas = m_canvas[m_fillingCanvas];
+	size_t canvasStride = GetStride(canvas);
+	int column = m_collageImagesCounter % m_collageWidth;
+	int row = m_collageImagesCounter / m_collageWidth;
+
+	uint8_t *pTileRow = (uint8_t*)canvas.GetBuffer() + (size_t)row * m_tileHeight * canvasStride;
+	CopyRowsAt(image, pTileRow, canvasStride, (size_t)column * m_tileWidth * Pylon::BitPerPixel(m_tilePixelType));
+
+	m_collageImagesCounter++;
+
+	if (m_collageImagesCounter == m_collageWidth * m_collageHeight)
+	{
+		m_latestCanvas = m_fillingCanvas;
+		m_fillingCanvas = 1 - m_fillingCanvas;
+		m_collageImagesCounter = 0;
+		m_collageComplete = true;
+	}
+
+	return 0;
+}
+
+int StitchImage::CollageMaker::StitchToStrips(Pylon::CPylonImage &image, std::string &errorMessage)
+{
+	if (StitchImage::StitchToRight(m_collageRow, image, &m_collageRow, errorMessage) != 0)
+		return 1;
+
+	m_collageComplete = false;
+
+	m_collageImagesCounter++;
+
+	if (m_collageImagesCounter % m_collageWidth == 0 && m_collageImagesCounter > 0)
+	{
+		m_collageRows.push_back(m_collageRow);
+		m_collageRow.Release();
+	}
+
+	if (m_collageImagesCounter % (m_collageWidth * m_collageHeight) == 0 && m_collageImagesCounter > 0)
+	{
+		for (size_t i = 0; i < m_collageRows.size(); i++)
+		{
+			std::string errorMessage = "";
+			if (StitchImage::StitchToBottom(m_tempImage, m_collageRows[i], &m_tempImage, errorMessage) != 0)
+				return 1;
+		}
+		m_collageImage.CopyImage(m_tempImage);
+		m_tempImage.Release();
+		m_collageRow.Release();
+		m_collageRows.clear();
+		m_collageImagesCounter = 0;
+		m_collageComplete = true;
+	}
+
+	return 0;
+}
+
 int StitchImage::CollageMaker::GetLatestCollage(Pylon::CPylonImage *collageImage, std::string &errorMessage)
 {
 	errorMessage = "ERROR: ";
@@ -340,11 +1468,17 @@ int StitchImage::CollageMaker::GetLatestCollage(Pylon::CPylonImage *collageImage
 
 	try
 	{
-		if (m_collageImage.GetImageSize() == 0)
+		const Pylon::CPylonImage *pLatestCollage = GetLatestCollage();
+		if (pLatestCollage == NULL)
 		{
 			errorMessage.append("No Collage available yet");
 			return 1;
 		}
+		else if (m_usingPreallocatedCanvas == true)
+		{
+			*collageImage = *pLatestCollage;
+			return 0;
+		}
 		else
 		{
 			collageImage->CopyImage(m_collageImage);
@@ -371,6 +1505,14 @@ int StitchImage::CollageMaker::GetLatestCollage(Pylon::CPylonImage *collageImage
 	}
 }
 
+const Pylon::CPylonImage *StitchImage::CollageMaker::GetLatestCollage()
+{
+	if (m_usingPreallocatedCanvas == true)
+		return (m_latestCanvas < 0) ? NULL : &m_canvas[m_latestCanvas];
+	else
+		return (m_collageImage.GetImageSize() == 0) ? NULL : &m_collageImage;
+}
+
 int StitchImage::CollageMaker::ResetCollage(std::string &errorMessage)
 {
 	errorMessage = "ERROR: ";
@@ -383,6 +1525,10 @@ int StitchImage::CollageMaker::ResetCollage(std::string &errorMessage)
 		m_collageImage.Release();
 		m_collageRow.Release();
 		m_collageRows.clear();
+		m_canvas[0].Release();
+		m_canvas[1].Release();
+		m_fillingCanvas = 0;
+		m_latestCanvas = -1;
 		m_collageImagesCounter = 0;
 		m_collageComplete = false;
 		return 0;
@@ -432,6 +1578,22 @@ bool StitchImage::CollageMaker::IsCollageComplete()
 	return m_collageComplete;
 }
 
+void StitchImage::CollageMaker::SetPreallocatedCanvas(bool enable)
+{
+	// Switching in the middle of a collage would mix up the two ways of keeping track of it, so start over.
+	if (enable != m_usingPreallocatedCanvas)
+	{
+		std::string errorMessage = "";
+		ResetCollage(errorMessage);
+	}
+	m_usingPreallocatedCanvas = enable;
+}
+
+bool StitchImage::CollageMaker::IsUsingPreallocatedCanvas()
+{
+	return m_usingPreallocatedCanvas;
+}
+
 // *********************************************************************************************************
 
 #endif
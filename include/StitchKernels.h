@@ -0,0 +1,530 @@
+// StitchKernels.h
+// Low level (raw buffer) kernels used by StitchImage, with SIMD versions for x86 processors that are chosen at runtime.
+// Copyright (c) 2019 Matthew Breit - matt.breit@baslerweb.com or matt.breit@gmail.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STITCHKERNELS_H
+#define STITCHKERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define STITCHKERNELS_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// GCC and Clang only emit SIMD instructions beyond the compiler flags for functions marked with a target. MSVC always allows them.
+#if defined(__GNUC__) || defined(__clang__)
+#define STITCHKERNELS_TARGET(instructionSet) __attribute__((target(instructionSet)))
+#else
+#define STITCHKERNELS_TARGET(instructionSet)
+#endif
+
+namespace StitchKernels
+{
+	enum EInstructionSet
+	{
+		InstructionSet_Scalar,
+		InstructionSet_SSSE3,
+		InstructionSet_AVX2
+	};
+
+	// The best instruction set supported by this processor (detected once).
+	EInstructionSet GetInstructionSet();
+	const char *GetInstructionSetName(EInstructionSet instructionSet);
+
+	// Expands one row of Mono8 pixels to BGR8 (B = G = R = gray).
+	void Mono8ToBGR8Row(const uint8_t *pSource, uint8_t *pDestination, int width);
+	void Mono8ToBGR8Row_Scalar(const uint8_t *pSource, uint8_t *pDestination, int width);
+#ifdef STITCHKERNELS_X86
+	void Mono8ToBGR8Row_SSSE3(const uint8_t *pSource, uint8_t *pDestination, int width);
+	void Mono8ToBGR8Row_AVX2(const uint8_t *pSource, uint8_t *pDestination, int width);
+#endif
+
+	// How the pixels of packed pixel formats are laid out in memory
+	enum EPacking
+	{
+		Packing_None,
+		Packing_10p,       // 4 pixels in 5 bytes, least significant bits first (eg: Mono10p, BayerRG10p)
+		Packing_12p,       // 2 pixels in 3 bytes, least significant bits first (eg: Mono12p, BayerRG12p)
+		Packing_10Packed,  // 2 pixels in 3 bytes, the upper 8 bits of each pixel in its own byte and the lower 2 bits in the middle byte (GigE Mono10Packed)
+		Packing_12Packed   // 2 pixels in 3 bytes, the upper 8 bits of each pixel in its own byte and the lower 4 bits in the middle byte (GigE Mono12Packed, BayerRG12Packed)
+	};
+
+	// Unpacks one row of packed pixels to one 16 bit value per pixel (the values are not shifted, eg: 0-4095 for 12 bit).
+	void UnpackRow(EPacking packing, const uint8_t *pSource, uint16_t *pDestination, int width);
+	void Unpack10pRow_Scalar(const uint8_t *pSource, uint16_t *pDestination, int width);
+	void Unpack12pRow_Scalar(const uint8_t *pSource, uint16_t *pDestination, int width);
+	void Unpack10PackedRow_Scalar(const uint8_t *pSource, uint16_t *pDestination, int width);
+	void Unpack12PackedRow_Scalar(const uint8_t *pSource, uint16_t *pDestination, int width);
+#ifdef STITCHKERNELS_X86
+	void Unpack10pRow_SSSE3(const uint8_t *pSource, uint16_t *pDestination, int width);
+	void Unpack12pRow_SSSE3(const uint8_t *pSource, uint16_t *pDestination, int width);
+#endif
+
+	// Copies numBits bits from pSource to pDestination, starting at bit destinationBitOffset (0-7) of the first destination byte.
+	// Bits are counted least significant first, as in the 10p/12p formats. The bits of the first destination byte below the offset are kept.
+	void CopyBitsLsbFirst(const uint8_t *pSource, uint8_t *pDestination, int destinationBitOffset, size_t numBits);
+
+	// Averages blocks of factor x factor pixels (a box filter) into one row of a smaller image. Works on 8 bit channels, channels is the number of bytes per pixel (1 for Mono8, 3 for BGR8).
+	// pSource is the first of the factor source rows, which must each hold factor * destinationWidth pixels.
+	void BoxDownscaleRow(const uint8_t *pSource, size_t sourceStride, int channels, int factor, uint8_t *pDestination, int destinationWidth);
+	void BoxDownscaleRow_Scalar(const uint8_t *pSource, size_t sourceStride, int channels, int factor, uint8_t *pDestination, int destinationWidth);
+#ifdef STITCHKERNELS_X86
+	void BoxDownscaleMono8Row2x2_SSSE3(const uint8_t *pSource, size_t sourceStride, uint8_t *pDestination, int destinationWidth);
+	void BoxDownscaleMono8Row4x4_SSSE3(const uint8_t *pSource, size_t sourceStride, uint8_t *pDestination, int destinationWidth);
+	void BoxDownscaleBGR8Row2x2_SSSE3(const uint8_t *pSource, size_t sourceStride, uint8_t *pDestination, int destinationWidth);
+#endif
+
+	// Reads a left and a right Mono8 image and writes them side by side as one BGR8 image, in a single pass.
+	// Strides are the number of bytes from the start of one row to the start of the next.
+	void StitchToRightMono8ToBGR8(const uint8_t *pLeft, size_t leftStride, int leftWidth, const uint8_t *pRight, size_t rightStride, int rightWidth, int height, uint8_t *pDestination, size_t destinationStride);
+}
+
+// *********************************************************************************************************
+// DEFINITIONS
+StitchKernels::EInstructionSet StitchKernels::GetInstructionSet()
+{
+	static const EInstructionSet instructionSet = []() -> EInstructionSet
+	{
+#if defined(STITCHKERNELS_X86) && (defined(__GNUC__) || defined(__clang__))
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2"))
+			return InstructionSet_AVX2;
+		if (__builtin_cpu_supports("ssse3"))
+			return InstructionSet_SSSE3;
+#elif defined(STITCHKERNELS_X86) && defined(_MSC_VER)
+		int cpuInfo[4];
+		__cpuid(cpuInfo, 0);
+		int maxLeaf = cpuInfo[0];
+		__cpuid(cpuInfo, 1);
+		bool hasSSSE3 = (cpuInfo[2] & (1 << 9)) != 0;
+		bool osSavesYmm = (cpuInfo[2] & (1 << 27)) != 0 && (_xgetbv(0) & 0x6) == 0x6;
+		if (maxLeaf >= 7 && osSavesYmm)
+		{
+			__cpuidex(cpuInfo, 7, 0);
+			if ((cpuInfo[1] & (1 << 5)) != 0)
+				return InstructionSet_AVX2;
+		}
+		if (hasSSSE3)
+			return InstructionSet_SSSE3;
+#endif
+		return InstructionSet_Scalar;
+	}();
+
+	return instructionSet;
+}
+
+const char *StitchKernels::GetInstructionSetName(EInstructionSet instructionSet)
+{
+	switch (instructionSet)
+	{
+	case InstructionSet_AVX2:
+		return "AVX2";
+	case InstructionSet_SSSE3:
+		return "SSSE3";
+	default:
+		return "Scalar";
+	}
+}
+
+void StitchKernels::Mono8ToBGR8Row_Scalar(const uint8_t *pSource, uint8_t *pDestination, int width)
+{
+	for (int x = 0; x < width; x++)
+	{
+		uint8_t gray = pSource[x];
+		pDestination[3 * x + 0] = gray;
+		pDestination[3 * x + 1] = gray;
+		pDestination[3 * x + 2] = gray;
+	}
+}
+
+#ifdef STITCHKERNELS_X86
+STITCHKERNELS_TARGET("ssse3")
+void StitchKernels::Mono8ToBGR8Row_SSSE3(const uint8_t *pSource, uint8_t *pDestination, int width)
+{
+	// each group of 16 gray pixels becomes 48 bytes: three 16 byte blocks, each picking its pixels out of the group
+	const __m128i shuffle0 = _mm_setr_epi8(0, 0, 0, 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, 4, 4, 5);
+	const __m128i shuffle1 = _mm_setr_epi8(5, 5, 6, 6, 6, 7, 7, 7, 8, 8, 8, 9, 9, 9, 10, 10);
+	const __m128i shuffle2 = _mm_setr_epi8(10, 11, 11, 11, 12, 12, 12, 13, 13, 13, 14, 14, 14, 15, 15, 15);
+
+	int x = 0;
+	for (; x + 16 <= width; x += 16)
+	{
+		__m128i gray = _mm_loadu_si128((const __m128i*)&pSource[x]);
+		_mm_storeu_si128((__m128i*)&pDestination[3 * x + 0], _mm_shuffle_epi8(gray, shuffle0));
+		_mm_storeu_si128((__m128i*)&pDestination[3 * x + 16], _mm_shuffle_epi8(gray, shuffle1));
+		_mm_storeu_si128((__m128i*)&pDestination[3 * x + 32], _mm_shuffle_epi8(gray, shuffle2));
+	}
+
+	Mono8ToBGR8Row_Scalar(&pSource[x], &pDestination[3 * x], width - x);
+}
+
+STITCHKERNELS_TARGET("avx2")
+void StitchKernels::Mono8ToBGR8Row_AVX2(const uint8_t *pSource, uint8_t *pDestination, int width)
+{
+	// Same as SSSE3, but for two groups of 16 pixels at a time (AVX2 shuffles work within each 128 bit lane).
+	const __m256i shuffle0 = _mm256_setr_epi8(0, 0, 0, 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, 4, 4, 5, 0, 0, 0, 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, 4, 4, 5);
+	const __m256i shuffle1 = _mm256_setr_epi8(5, 5, 6, 6, 6, 7, 7, 7, 8, 8, 8, 9, 9, 9, 10, 10, 5, 5, 6, 6, 6, 7, 7, 7, 8, 8, 8, 9, 9, 9, 10, 10);
+	const __m256i shuffle2 = _mm256_setr_epi8(10, 11, 11, 11, 12, 12, 12, 13, 13, 13, 14, 14, 14, 15, 15, 15, 10, 11, 11, 11, 12, 12, 12, 13, 13, 13, 14, 14, 14, 15, 15, 15);
+
+	int x = 0;
+	for (; x + 32 <= width; x += 32)
+	{
+		__m256i gray = _mm256_loadu_si256((const __m256i*)&pSource[x]);
+		__m256i block0 = _mm256_shuffle_epi8(gray, shuffle0); // output bytes 0-15 (low lane) and 48-63 (high lane)
+		__m256i block1 = _mm256_shuffle_epi8(gray, shuffle1); // output bytes 16-31 and 64-79
+		__m256i block2 = _mm256_shuffle_epi8(gray, shuffle2); // output bytes 32-47 and 80-95
+		_mm256_storeu_si256((__m256i*)&pDestination[3 * x + 0], _mm256_permute2x128_si256(block0, block1, 0x20));
+		_mm256_storeu_si256((__m256i*)&pDestination[3 * x + 32], _mm256_permute2x128_si256(block2, block0, 0x30));
+		_mm256_storeu_si256((__m256i*)&pDestination[3 * x + 64], _mm256_permute2x128_si256(block1, block2, 0x31));
+	}
+
+	Mono8ToBGR8Row_SSSE3(&pSource[x], &pDestination[3 * x], width - x);
+}
+#endif
+
+void StitchKernels::Mono8ToBGR8Row(const uint8_t *pSource, uint8_t *pDestination, int width)
+{
+#ifdef STITCHKERNELS_X86
+	switch (GetInstructionSet())
+	{
+	case InstructionSet_AVX2:
+		Mono8ToBGR8Row_AVX2(pSource, pDestination, width);
+		return;
+	case InstructionSet_SSSE3:
+		Mono8ToBGR8Row_SSSE3(pSource, pDestination, width);
+		return;
+	default:
+		break;
+	}
+#endif
+	Mono8ToBGR8Row_Scalar(pSource, pDestination, width);
+}
+
+void StitchKernels::Unpack10pRow_Scalar(const uint8_t *pSource, uint16_t *pDestination, int width)
+{
+	// pixel x starts at bit 10 * x, so it always lies within two neighbouring bytes
+	for (int x = 0; x < width; x++)
+	{
+		size_t bit = 10 * (size_t)x;
+		uint16_t twoBytes = (uint16_t)(pSource[bit / 8] | (pSource[bit / 8 + 1] << 8));
+		pDestination[x] = (uint16_t)((twoBytes >> (bit % 8)) & 0x3FF);
+	}
+}
+
+void StitchKernels::Unpack12pRow_Scalar(const uint8_t *pSource, uint16_t *pDestination, int width)
+{
+	int x = 0;
+	for (; x + 2 <= width; x += 2)
+	{
+		const uint8_t *pGroup = &pSource[3 * (x / 2)];
+		pDestination[x + 0] = (uint16_t)(pGroup[0] | ((pGroup[1] & 0x0F) << 8));
+		pDestination[x + 1] = (uint16_t)((pGroup[1] >> 4) | (pGroup[2] << 4));
+	}
+	if (x < width)
+	{
+		const uint8_t *pGroup = &pSource[3 * (x / 2)];
+		pDestination[x] = (uint16_t)(pGroup[0] | ((pGroup[1] & 0x0F) << 8));
+	}
+}
+
+void StitchKernels::Unpack10PackedRow_Scalar(const uint8_t *pSource, uint16_t *pDestination, int width)
+{
+	int x = 0;
+	for (; x + 2 <= width; x += 2)
+	{
+		const uint8_t *pGroup = &pSource[3 * (x / 2)];
+		pDestination[x + 0] = (uint16_t)((pGroup[0] << 2) | (pGroup[1] & 0x03));
+		pDestination[x + 1] = (uint16_t)((pGroup[2] << 2) | ((pGroup[1] >> 4) & 0x03));
+	}
+	if (x < width)
+	{
+		const uint8_t *pGroup = &pSource[3 * (x / 2)];
+		pDestination[x] = (uint16_t)((pGroup[0] << 2) | (pGroup[1] & 0x03));
+	}
+}
+
+void StitchKernels::Unpack12PackedRow_Scalar(const uint8_t *pSource, uint16_t *pDestination, int width)
+{
+	int x = 0;
+	for (; x + 2 <= width; x += 2)
+	{
+		const uint8_t *pGroup = &pSource[3 * (x / 2)];
+		pDestination[x + 0] = (uint16_t)((pGroup[0] << 4) | (pGroup[1] & 0x0F));
+		pDestination[x + 1] = (uint16_t)((pGroup[2] << 4) | (pGroup[1] >> 4));
+	}
+	if (x < width)
+	{
+		const uint8_t *pGroup = &pSource[3 * (x / 2)];
+		pDestination[x] = (uint16_t)((pGroup[0] << 4) | (pGroup[1] & 0x0F));
+	}
+}
+
+#ifdef STITCHKERNELS_X86
+STITCHKERNELS_TARGET("ssse3")
+void StitchKernels::Unpack10pRow_SSSE3(const uint8_t *pSource, uint16_t *pDestination, int width)
+{
+	// 8 pixels from 10 bytes: gather the two bytes holding each pixel into a 16 bit lane,
+	// then move the pixel to the top of the lane (dropping the bits above it) and back down to the bottom (dropping the bits below it).
+	const __m128i gather = _mm_setr_epi8(0, 1, 1, 2, 2, 3, 3, 4, 5, 6, 6, 7, 7, 8, 8, 9);
+	const __m128i shiftUp = _mm_setr_epi16(1 << 6, 1 << 4, 1 << 2, 1 << 0, 1 << 6, 1 << 4, 1 << 2, 1 << 0);
+	size_t rowBytes = (10 * (size_t)width + 7) / 8;
+
+	int x = 0;
+	for (; x + 8 <= width && (10 * (size_t)x) / 8 + 16 <= rowBytes; x += 8) // don't read past the end of the row
+	{
+		__m128i packed = _mm_loadu_si128((const __m128i*)&pSource[(10 * (size_t)x) / 8]);
+		__m128i pairs = _mm_shuffle_epi8(packed, gather);
+		__m128i pixels = _mm_srli_epi16(_mm_mullo_epi16(pairs, shiftUp), 6);
+		_mm_storeu_si128((__m128i*)&pDestination[x], pixels);
+	}
+
+	Unpack10pRow_Scalar(&pSource[(10 * (size_t)x) / 8], &pDestination[x], width - x);
+}
+
+STITCHKERNELS_TARGET("ssse3")
+void StitchKernels::Unpack12pRow_SSSE3(const uint8_t *pSource, uint16_t *pDestination, int width)
+{
+	// 8 pixels from 12 bytes, the same way as Unpack10pRow_SSSE3
+	const __m128i gather = _mm_setr_epi8(0, 1, 1, 2, 3, 4, 4, 5, 6, 7, 7, 8, 9, 10, 10, 11);
+	const __m128i shiftUp = _mm_setr_epi16(1 << 4, 1 << 0, 1 << 4, 1 << 0, 1 << 4, 1 << 0, 1 << 4, 1 << 0);
+	size_t rowBytes = (12 * (size_t)width + 7) / 8;
+
+	int x = 0;
+	for (; x + 8 <= width && 3 * (size_t)x / 2 + 16 <= rowBytes; x += 8) // don't read past the end of the row
+	{
+		__m128i packed = _mm_loadu_si128((const __m128i*)&pSource[3 * (size_t)x / 2]);
+		__m128i pairs = _mm_shuffle_epi8(packed, gather);
+		__m128i pixels = _mm_srli_epi16(_mm_mullo_epi16(pairs, shiftUp), 4);
+		_mm_storeu_si128((__m128i*)&pDestination[x], pixels);
+	}
+
+	Unpack12pRow_Scalar(&pSource[3 * (size_t)x / 2], &pDestination[x], width - x);
+}
+#endif
+
+void StitchKernels::UnpackRow(EPacking packing, const uint8_t *pSource, uint16_t *pDestination, int width)
+{
+	bool useSSSE3 = false;
+#ifdef STITCHKERNELS_X86
+	useSSSE3 = (GetInstructionSet() != InstructionSet_Scalar);
+#endif
+
+	switch (packing)
+	{
+	case Packing_10p:
+#ifdef STITCHKERNELS_X86
+		if (useSSSE3 == true)
+		{
+			Unpack10pRow_SSSE3(pSource, pDestination, width);
+			return;
+		}
+#endif
+		Unpack10pRow_Scalar(pSource, pDestination, width);
+		return;
+	case Packing_12p:
+#ifdef STITCHKERNELS_X86
+		if (useSSSE3 == true)
+		{
+			Unpack12pRow_SSSE3(pSource, pDestination, width);
+			return;
+		}
+#endif
+		Unpack12pRow_Scalar(pSource, pDestination, width);
+		return;
+	case Packing_10Packed:
+		Unpack10PackedRow_Scalar(pSource, pDestination, width);
+		return;
+	case Packing_12Packed:
+		Unpack12PackedRow_Scalar(pSource, pDestination, width);
+		return;
+	default:
+		(void)useSSSE3;
+		return;
+	}
+}
+
+void StitchKernels::CopyBitsLsbFirst(const uint8_t *pSource, uint8_t *pDestination, int destinationBitOffset, size_t numBits)
+{
+	if (numBits == 0)
+		return;
+
+	if (destinationBitOffset == 0)
+	{
+		memcpy(pDestination, pSource, (numBits + 7) / 8);
+		return;
+	}
+
+	// every destination byte gets the top bits of the previous source byte and the bottom bits of the current one
+	size_t numDestinationBytes = (destinationBitOffset + numBits + 7) / 8;
+	size_t numSourceBytes = (numBits + 7) / 8;
+	uint8_t keepMask = (uint8_t)((1 << destinationBitOffset) - 1);
+
+	pDestination[0] = (uint8_t)((pDestination[0] & keepMask) | (pSource[0] << destinationBitOffset));
+	for (size_t i = 1; i < numDestinationBytes; i++)
+	{
+		uint8_t current = (i < numSourceBytes) ? pSource[i] : 0;
+		pDestination[i] = (uint8_t)((current << destinationBitOffset) | (pSource[i - 1] >> (8 - destinationBitOffset)));
+	}
+}
+
+void StitchKernels::BoxDownscaleRow_Scalar(const uint8_t *pSource, size_t sourceStride, int channels, int factor, uint8_t *pDestination, int destinationWidth)
+{
+	unsigned int blockSize = (unsigned int)(factor * factor);
+	for (int x = 0; x < destinationWidth; x++)
+	{
+		for (int c = 0; c < channels; c++)
+		{
+			unsigned int sum = 0;
+			for (int dy = 0; dy < factor; dy++)
+			{
+				const uint8_t *pRow = &pSource[dy * sourceStride + (size_t)x * factor * channels + c];
+				for (int dx = 0; dx < factor; dx++)
+					sum += pRow[dx * channels];
+			}
+			pDestination[x * channels + c] = (uint8_t)((sum + blockSize / 2) / blockSize);
+		}
+	}
+}
+
+#ifdef STITCHKERNELS_X86
+STITCHKERNELS_TARGET("ssse3")
+void StitchKernels::BoxDownscaleMono8Row2x2_SSSE3(const uint8_t *pSource, size_t sourceStride, uint8_t *pDestination, int destinationWidth)
+{
+	// 16 output pixels from 32 pixels of two rows: add up neighbouring pixels in 16 bit lanes (maddubs with 1s), then the two rows, then round and divide by 4.
+	const __m128i ones = _mm_set1_epi8(1);
+	const __m128i rounding = _mm_set1_epi16(2);
+	const uint8_t *pSource0 = pSource;
+	const uint8_t *pSource1 = &pSource[sourceStride];
+
+	int x = 0;
+	for (; x + 16 <= destinationWidth; x += 16)
+	{
+		__m128i low = _mm_add_epi16(_mm_maddubs_epi16(_mm_loadu_si128((const __m128i*)&pSource0[2 * x]), ones), _mm_maddubs_epi16(_mm_loadu_si128((const __m128i*)&pSource1[2 * x]), ones));
+		__m128i high = _mm_add_epi16(_mm_maddubs_epi16(_mm_loadu_si128((const __m128i*)&pSource0[2 * x + 16]), ones), _mm_maddubs_epi16(_mm_loadu_si128((const __m128i*)&pSource1[2 * x + 16]), ones));
+		low = _mm_srli_epi16(_mm_add_epi16(low, rounding), 2);
+		high = _mm_srli_epi16(_mm_add_epi16(high, rounding), 2);
+		_mm_storeu_si128((__m128i*)&pDestination[x], _mm_packus_epi16(low, high));
+	}
+
+	BoxDownscaleRow_Scalar(&pSource[2 * x], sourceStride, 1, 2, &pDestination[x], destinationWidth - x);
+}
+
+STITCHKERNELS_TARGET("ssse3")
+void StitchKernels::BoxDownscaleMono8Row4x4_SSSE3(const uint8_t *pSource, size_t sourceStride, uint8_t *pDestination, int destinationWidth)
+{
+	// 8 output pixels from 32 pixels of four rows: pairs are added up as in the 2x2 version, then the four rows, then neighbouring pairs (madd with 1s, to 32 bit lanes).
+	const __m128i ones = _mm_set1_epi8(1);
+	const __m128i ones16 = _mm_set1_epi16(1);
+	const __m128i rounding = _mm_set1_epi16(8);
+
+	int x = 0;
+	for (; x + 8 <= destinationWidth; x += 8)
+	{
+		__m128i low = _mm_setzero_si128();
+		__m128i high = _mm_setzero_si128();
+		for (int y = 0; y < 4; y++)
+		{
+			const uint8_t *pRow = &pSource[y * sourceStride + 4 * (size_t)x];
+			low = _mm_add_epi16(low, _mm_maddubs_epi16(_mm_loadu_si128((const __m128i*)&pRow[0]), ones));
+			high = _mm_add_epi16(high, _mm_maddubs_epi16(_mm_loadu_si128((const __m128i*)&pRow[16]), ones));
+		}
+		__m128i sums = _mm_packs_epi32(_mm_madd_epi16(low, ones16), _mm_madd_epi16(high, ones16)); // at most 16 * 255, so they fit
+		sums = _mm_srli_epi16(_mm_add_epi16(sums, rounding), 4);
+		_mm_storel_epi64((__m128i*)&pDestination[x], _mm_packus_epi16(sums, sums));
+	}
+
+	BoxDownscaleRow_Scalar(&pSource[4 * x], sourceStride, 1, 4, &pDestination[x], destinationWidth - x);
+}
+
+STITCHKERNELS_TARGET("ssse3")
+void StitchKernels::BoxDownscaleBGR8Row2x2_SSSE3(const uint8_t *pSource, size_t sourceStride, uint8_t *pDestination, int destinationWidth)
+{
+	// 4 output pixels from 8 pixels (24 bytes) of two rows: the same channel of neighbouring pixels is shuffled next to each other, then added up as in the Mono8 version.
+	const __m128i gather = _mm_setr_epi8(0, 3, 1, 4, 2, 5, 6, 9, 7, 10, 8, 11, -1, -1, -1, -1); // 4 pixels -> BB GG RR BB GG RR
+	const __m128i compact = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 8, 9, 10, 11, 12, 13, -1, -1, -1, -1);
+	const __m128i ones = _mm_set1_epi8(1);
+	const __m128i rounding = _mm_set1_epi16(2);
+	const uint8_t *pSource0 = pSource;
+	const uint8_t *pSource1 = &pSource[sourceStride];
+
+	int x = 0;
+	for (; x + 6 <= destinationWidth; x += 4) // the loads and the store reach past the 4 pixels, so leave room at the end of the rows
+	{
+		size_t offset = 6 * (size_t)x;
+		__m128i first = _mm_add_epi16(
+			_mm_maddubs_epi16(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)&pSource0[offset]), gather), ones),
+			_mm_maddubs_epi16(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)&pSource1[offset]), gather), ones));
+		__m128i second = _mm_add_epi16(
+			_mm_maddubs_epi16(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)&pSource0[offset + 12]), gather), ones),
+			_mm_maddubs_epi16(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)&pSource1[offset + 12]), gather), ones));
+		first = _mm_srli_epi16(_mm_add_epi16(first, rounding), 2);
+		second = _mm_srli_epi16(_mm_add_epi16(second, rounding), 2);
+		_mm_storeu_si128((__m128i*)&pDestination[3 * x], _mm_shuffle_epi8(_mm_packus_epi16(first, second), compact)); // 12 bytes, the last 4 are overwritten by the next pixels
+	}
+
+	BoxDownscaleRow_Scalar(&pSource[6 * x], sourceStride, 3, 2, &pDestination[3 * x], destinationWidth - x);
+}
+#endif
+
+void StitchKernels::BoxDownscaleRow(const uint8_t *pSource, size_t sourceStride, int channels, int factor, uint8_t *pDestination, int destinationWidth)
+{
+	if (factor == 1)
+	{
+		memcpy(pDestination, pSource, (size_t)destinationWidth * channels);
+		return;
+	}
+
+#ifdef STITCHKERNELS_X86
+	if (GetInstructionSet() != InstructionSet_Scalar)
+	{
+		if (channels == 1 && factor == 2)
+		{
+			BoxDownscaleMono8Row2x2_SSSE3(pSource, sourceStride, pDestination, destinationWidth);
+			return;
+		}
+		if (channels == 1 && factor == 4)
+		{
+			BoxDownscaleMono8Row4x4_SSSE3(pSource, sourceStride, pDestination, destinationWidth);
+			return;
+		}
+		if (channels == 3 && factor == 2)
+		{
+			BoxDownscaleBGR8Row2x2_SSSE3(pSource, sourceStride, pDestination, destinationWidth);
+			return;
+		}
+	}
+#endif
+	BoxDownscaleRow_Scalar(pSource, sourceStride, channels, factor, pDestination, destinationWidth);
+}
+
+void StitchKernels::StitchToRightMono8ToBGR8(const uint8_t *pLeft, size_t leftStride, int leftWidth, const uint8_t *pRight, size_t rightStride, int rightWidth, int height, uint8_t *pDestination, size_t destinationStride)
+{
+	for (int y = 0; y < height; y++)
+	{
+		uint8_t *pDestinationRow = &pDestination[y * destinationStride];
+		Mono8ToBGR8Row(&pLeft[y * leftStride], &pDestinationRow[0], leftWidth);
+		Mono8ToBGR8Row(&pRight[y * rightStride], &pDestinationRow[3 * leftWidth], rightWidth);
+	}
+}
+
+// *********************************************************************************************************
+
+#endif
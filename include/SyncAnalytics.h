@@ -0,0 +1,539 @@
+// SyncAnalytics.h
+// Checks, image set by image set, that the cameras stay synchronized: the skew between their timestamps, how it drifts, steps in it, and the frame period.
+// Copyright (c) 2019 Matthew Breit - matt.breit@baslerweb.com or matt.breit@gmail.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SYNCANALYTICS_H
+#define SYNCANALYTICS_H
+
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <Telemetry.h>
+
+namespace SyncAnalytics
+{
+	// Mean and variance (Welford's online algorithm) and the largest absolute value.
+	class RunningStatistics
+	{
+	private:
+		uint64_t m_count = 0;
+		double m_mean = 0;
+		double m_sumOfSquares = 0; // of the differences from the mean
+		double m_maxAbs = 0;
+
+	public:
+		void Add(double value);
+		void Reset();
+		uint64_t GetCount() const;
+		double GetMean() const;
+		double GetStdDev() const;
+		double GetMaxAbs() const;
+	};
+
+	// Least squares line through (x, y) points, one point at a time. x and y are taken relative to the first point, so the sums stay small.
+	class LinearRegression
+	{
+	private:
+		uint64_t m_count = 0;
+		double m_x0 = 0;
+		double m_y0 = 0;
+		double m_sumX = 0;
+		double m_sumY = 0;
+		double m_sumXX = 0;
+		double m_sumXY = 0;
+
+	public:
+		void Add(double x, double y);
+		void Reset();
+		uint64_t GetCount() const;
+		double GetSlope() const; // 0 until there are two different x values
+	};
+
+	enum EAlarmType
+	{
+		Alarm_Skew,       // the images of a set were taken further apart than the skew threshold
+		Alarm_Drift,      // the skew changes faster than the drift threshold
+		Alarm_Step,       // the skew jumped and stayed there (eg: the PTP master changed)
+		Alarm_FramePeriod // the measured frame period is off from the expected one by more than the tolerance
+	};
+
+	struct Alarm
+	{
+		EAlarmType type = Alarm_Skew;
+		int cameraIndex = 0; // the camera compared with camera 0 (skew, drift, step), or whose frame period is off
+		double value = 0; // ns (skew, step), ns/s (drift), or the fraction the frame period is off
+		double threshold = 0;
+		std::string message;
+	};
+
+	// The skew of each camera's timestamp from camera 0's (camera 0's own entry stays empty), and the frame period of each camera.
+	// Every set costs a constant amount of work per camera: the statistics are updated online and nothing is kept per frame.
+	// With synchronized clocks (PTP), the skew is the difference of the timestamps. Without, the clocks have different zeros, so the skew is measured
+	// from the first set's (and so only shows how the clocks drift apart).
+	// Skew and frame period alarms are raised at most once per report interval per camera. Drift and period alarms are checked by Report().
+	// Not thread safe: all methods must be called from the same thread (eg: the Grab Loop).
+	class SyncMonitor
+	{
+	private:
+		struct CameraStatistics
+		{
+			std::string name;
+			// skew from camera 0 (ns)
+			RunningStatistics skew;
+			RunningStatistics intervalSkew;
+			LinearRegression drift; // skew over camera 0's time (s), since the last step
+			int64_t skewOffset = 0; // subtracted from the raw skew (the first one, without synchronized clocks)
+			bool haveSkewOffset = false;
+			double level = 0; // smoothed skew, to tell steps from jitter
+			int stepCandidates = 0; // sets in a row that were off the level by more than the step threshold
+			int numSteps = 0;
+			double lastStep = 0; // ns
+			uint64_t skewAlarms = 0; // sets over the skew threshold
+			bool skewAlarmRaised = false; // in this report interval
+			// frame period (ns)
+			int64_t lastTimestamp = 0;
+			int64_t lastFrameCounter = 0;
+			bool haveLast = false;
+			RunningStatistics period;
+			RunningStatistics intervalPeriod;
+			uint64_t numAlarms = 0;
+		};
+
+		std::vector<CameraStatistics> m_cameras;
+		std::vector<Telemetry::LatencyHistogram> m_skewHistograms; // |skew| (ns), for the telemetry
+		std::vector<Telemetry::LatencyHistogram> m_periodHistograms; // frame period (ns), for the telemetry
+		bool m_synchronizedClocks = true;
+		double m_ticksPerSecond = 1e9;
+		double m_expectedFramePeriod = 0; // ns, 0 = don't check
+		double m_skewThreshold = 0; // ns, 0 = no alarm
+		double m_driftThreshold = 0; // ns/s, 0 = no alarm
+		double m_stepThreshold = 0; // ns, 0 = no step detection
+		double m_periodTolerance = 0; // fraction, 0 = no alarm
+		int m_stepConfirmation = 3; // sets in a row
+		std::function<void(const Alarm &alarm)> m_onAlarm;
+		double m_firstTime = 0; // s, camera 0's first timestamp
+		bool m_haveFirstTime = false;
+		uint64_t m_numSets = 0;
+
+		void Raise(EAlarmType type, int cameraIndex, double value, double threshold, const std::string &message);
+
+	public:
+		SyncMonitor(const std::vector<std::string> &cameraNames);
+		~SyncMonitor();
+
+		void SetSynchronizedClocks(bool synchronized);
+		void SetTickFrequency(int64_t ticksPerSecond); // 1 GHz with PTP, otherwise eg: GevTimestampTickFrequency
+		void SetExpectedFrameRate(double frameRate);
+		void SetSkewThreshold(double nanoseconds);
+		void SetDriftThreshold(double nanosecondsPerSecond);
+		void SetStepThreshold(double nanoseconds);
+		void SetPeriodTolerance(double fraction);
+		void SetAlarmCallback(std::function<void(const Alarm &alarm)> onAlarm);
+
+		// The timestamps and frame counters of one set, in camera order.
+		void AddSet(const std::vector<int64_t> &timestamps, const std::vector<int64_t> &frameCounters);
+		// Prints the skew, jitter, drift and frame period since the previous report, checks the drift and frame period, and starts a new interval.
+		void Report(std::ostream &stream);
+		void PrintSummary(std::ostream &stream);
+
+		// For Telemetry::Reporter::Add()
+		Telemetry::LatencyHistogram &GetSkewHistogram(int cameraIndex);
+		Telemetry::LatencyHistogram &GetPeriodHistogram(int cameraIndex);
+
+		uint64_t GetSetCount();
+		double GetMeanSkew(int cameraIndex); // ns
+		double GetSkewJitter(int cameraIndex); // ns (standard deviation)
+		double GetMaxSkew(int cameraIndex); // ns (absolute)
+		double GetDrift(int cameraIndex); // ns/s, since the last step
+		int GetStepCount(int cameraIndex);
+		double GetMeanFramePeriod(int cameraIndex); // ns
+		uint64_t GetAlarmCount(int cameraIndex);
+	};
+
+	const char *GetAlarmTypeName(EAlarmType type);
+}
+
+// *********************************************************************************************************
+// DEFINITIONS
+inline void SyncAnalytics::RunningStatistics::Add(double value)
+{
+	m_count++;
+	double delta = value - m_mean;
+	m_mean += delta / (double)m_count;
+	m_sumOfSquares += delta * (value - m_mean);
+	if (std::fabs(value) > m_maxAbs)
+		m_maxAbs = std::fabs(value);
+}
+
+inline void SyncAnalytics::RunningStatistics::Reset()
+{
+	*this = RunningStatistics();
+}
+
+inline uint64_t SyncAnalytics::RunningStatistics::GetCount() const
+{
+	return m_count;
+}
+
+inline double SyncAnalytics::RunningStatistics::GetMean() const
+{
+	return m_mean;
+}
+
+inline double SyncAnalytics::RunningStatistics::GetStdDev() const
+{
+	return (m_count > 1) ? std::sqrt(m_sumOfSquares / (double)(m_count - 1)) : 0.0;
+}
+
+inline double SyncAnalytics::RunningStatistics::GetMaxAbs() const
+{
+	return m_maxAbs;
+}
+
+inline void SyncAnalytics::LinearRegression::Add(double x, double y)
+{
+	if (m_count == 0)
+	{
+		m_x0 = x;
+		m_y0 = y;
+	}
+	x -= m_x0;
+	y -= m_y0;
+
+	m_count++;
+	m_sumX += x;
+	m_sumY += y;
+	m_sumXX += x * x;
+	m_sumXY += x * y;
+}
+
+inline void SyncAnalytics::LinearRegression::Reset()
+{
+	*this = LinearRegression();
+}
+
+inline uint64_t SyncAnalytics::LinearRegression::GetCount() const
+{
+	return m_count;
+}
+
+inline double SyncAnalytics::LinearRegression::GetSlope() const
+{
+	double n = (double)m_count;
+	double denominator = n * m_sumXX - m_sumX * m_sumX;
+	if (m_count < 2 || denominator <= 0)
+		return 0.0;
+	return (n * m_sumXY - m_sumX * m_sumY) / denominator;
+}
+
+inline SyncAnalytics::SyncMonitor::SyncMonitor(const std::vector<std::string> &cameraNames)
+	: m_cameras(cameraNames.size()), m_skewHistograms(cameraNames.size()), m_periodHistograms(cameraNames.size())
+{
+	for (size_t i = 0; i < cameraNames.size(); i++)
+		m_cameras[i].name = cameraNames[i];
+}
+
+inline SyncAnalytics::SyncMonitor::~SyncMonitor()
+{
+	// nothing
+}
+
+inline void SyncAnalytics::SyncMonitor::SetSynchronizedClocks(bool synchronized)
+{
+	m_synchronizedClocks = synchronized;
+}
+
+inline void SyncAnalytics::SyncMonitor::SetTickFrequency(int64_t ticksPerSecond)
+{
+	m_ticksPerSecond = (ticksPerSecond > 0) ? (double)ticksPerSecond : 1e9;
+}
+
+inline void SyncAnalytics::SyncMonitor::SetExpectedFrameRate(double frameRate)
+{
+	m_expectedFramePeriod = (frameRate > 0) ? 1e9 / frameRate : 0.0;
+}
+
+inline void SyncAnalytics::SyncMonitor::SetSkewThreshold(double nanoseconds)
+{
+	m_skewThreshold = nanoseconds;
+}
+
+inline void SyncAnalytics::SyncMonitor::SetDriftThreshold(double nanosecondsPerSecond)
+{
+	m_driftThreshold = nanosecondsPerSecond;
+}
+
+inline void SyncAnalytics::SyncMonitor::SetStepThreshold(double nanoseconds)
+{
+	m_stepThreshold = nanoseconds;
+}
+
+inline void SyncAnalytics::SyncMonitor::SetPeriodTolerance(double fraction)
+{
+	m_periodTolerance = fraction;
+}
+
+inline void SyncAnalytics::SyncMonitor::SetAlarmCallback(std::function<void(const Alarm &alarm)> onAlarm)
+{
+	m_onAlarm = onAlarm;
+}
+
+inline void SyncAnalytics::SyncMonitor::Raise(EAlarmType type, int cameraIndex, double value, double threshold, const std::string &message)
+{
+	m_cameras[cameraIndex].numAlarms++;
+	if (!m_onAlarm)
+		return;
+
+	Alarm alarm;
+	alarm.type = type;
+	alarm.cameraIndex = cameraIndex;
+	alarm.value = value;
+	alarm.threshold = threshold;
+	alarm.message = m_cameras[cameraIndex].name + ": " + message;
+	m_onAlarm(alarm);
+}
+
+inline void SyncAnalytics::SyncMonitor::AddSet(const std::vector<int64_t> &timestamps, const std::vector<int64_t> &frameCounters)
+{
+	if (timestamps.size() != m_cameras.size() || frameCounters.size() != m_cameras.size() || m_cameras.empty() == true)
+		return;
+
+	m_numSets++;
+	const double nanosecondsPerTick = 1e9 / m_ticksPerSecond;
+	if (m_haveFirstTime == false)
+	{
+		m_firstTime = (double)timestamps[0] / m_ticksPerSecond;
+		m_haveFirstTime = true;
+	}
+	const double time = (double)timestamps[0] / m_ticksPerSecond - m_firstTime; // s, on camera 0's clock
+
+	for (size_t i = 0; i < m_cameras.size(); i++)
+	{
+		CameraStatistics &camera = m_cameras[i];
+
+		// frame period (the frame counters tell how many frames the timestamps are apart, so a dropped frame doesn't count as a long period)
+		if (camera.haveLast == true && frameCounters[i] > camera.lastFrameCounter && timestamps[i] > camera.lastTimestamp)
+		{
+			double period = (double)(timestamps[i] - camera.lastTimestamp) * nanosecondsPerTick / (double)(frameCounters[i] - camera.lastFrameCounter);
+			camera.period.Add(period);
+			camera.intervalPeriod.Add(period);
+			m_periodHistograms[i].Record((int64_t)period);
+		}
+		camera.lastTimestamp = timestamps[i];
+		camera.lastFrameCounter = frameCounters[i];
+		camera.haveLast = true;
+
+		if (i == 0)
+			continue;
+
+		// skew from camera 0
+		int64_t rawSkew = timestamps[i] - timestamps[0];
+		if (camera.haveSkewOffset == false)
+		{
+			camera.skewOffset = m_synchronizedClocks ? 0 : rawSkew;
+			camera.haveSkewOffset = true;
+		}
+		double skew = (double)(rawSkew - camera.skewOffset) * nanosecondsPerTick;
+
+		// A step: the skew is off its (smoothed) level by more than the threshold for several sets in a row. A single outlier is only jitter.
+		if (m_stepThreshold > 0 && camera.drift.GetCount() > 0 && std::fabs(skew - camera.level) > m_stepThreshold)
+		{
+			camera.stepCandidates++;
+			if (camera.stepCandidates >= m_stepConfirmation)
+			{
+				camera.numSteps++;
+				camera.lastStep = skew - camera.level;
+				std::ostringstream message;
+				message << "The skew stepped by " << std::fixed << std::setprecision(1) << camera.lastStep / 1000.0 << " us (to " << skew / 1000.0 << " us) at " << time << " s. Has the PTP master changed?";
+				Raise(Alarm_Step, (int)i, camera.lastStep, m_stepThreshold, message.str());
+
+				// the drift is measured from the new level on
+				camera.drift.Reset();
+				camera.level = skew;
+				camera.stepCandidates = 0;
+			}
+		}
+		else
+		{
+			camera.stepCandidates = 0;
+			camera.level = (camera.drift.GetCount() == 0) ? skew : camera.level + (skew - camera.level) / 16.0;
+		}
+
+		camera.skew.Add(skew);
+		camera.intervalSkew.Add(skew);
+		camera.drift.Add(time, skew);
+		m_skewHistograms[i].Record((int64_t)std::fabs(skew));
+
+		if (m_skewThreshold > 0 && std::fabs(skew) > m_skewThreshold)
+		{
+			camera.skewAlarms++;
+			if (camera.skewAlarmRaised == false)
+			{
+				camera.skewAlarmRaised = true;
+				std::ostringstream message;
+				message << "The skew from " << m_cameras[0].name << " is " << std::fixed << std::setprecision(1) << skew / 1000.0 << " us, more than " << m_skewThreshold / 1000.0 << " us.";
+				Raise(Alarm_Skew, (int)i, skew, m_skewThreshold, message.str());
+			}
+		}
+	}
+}
+
+inline void SyncAnalytics::SyncMonitor::Report(std::ostream &stream)
+{
+	std::ios::fmtflags flags = stream.flags();
+	std::streamsize precision = stream.precision();
+	stream << std::fixed;
+
+	for (size_t i = 0; i < m_cameras.size(); i++)
+	{
+		CameraStatistics &camera = m_cameras[i];
+		if (i > 0 && camera.intervalSkew.GetCount() > 0)
+		{
+			double drift = camera.drift.GetSlope();
+			stream << "Sync " << camera.name << "-" << m_cameras[0].name << ": skew " << std::setprecision(2) << camera.intervalSkew.GetMean() / 1000.0
+				<< " us, jitter " << camera.intervalSkew.GetStdDev() / 1000.0 << " us, max " << camera.intervalSkew.GetMaxAbs() / 1000.0
+				<< " us, drift " << std::setprecision(1) << drift << " ns/s, steps " << camera.numSteps << std::endl;
+
+			if (m_driftThreshold > 0 && camera.drift.GetCount() >= 2 && std::fabs(drift) > m_driftThreshold)
+			{
+				std::ostringstream message;
+				message << "The skew from " << m_cameras[0].name << " drifts by " << std::fixed << std::setprecision(1) << drift << " ns/s, more than " << m_driftThreshold << " ns/s. Are the clocks still synchronized?";
+				Raise(Alarm_Drift, (int)i, drift, m_driftThreshold, message.str());
+			}
+		}
+
+		if (m_expectedFramePeriod > 0 && m_periodTolerance > 0 && camera.intervalPeriod.GetCount() > 0)
+		{
+			double error = (camera.intervalPeriod.GetMean() - m_expectedFramePeriod) / m_expectedFramePeriod;
+			if (std::fabs(error) > m_periodTolerance)
+			{
+				std::ostringstream message;
+				message << "The frame period is " << std::fixed << std::setprecision(3) << camera.intervalPeriod.GetMean() / 1e6 << " ms instead of " << m_expectedFramePeriod / 1e6
+					<< " ms (" << std::setprecision(2) << error * 100 << "%).";
+				Raise(Alarm_FramePeriod, (int)i, error, m_periodTolerance, message.str());
+			}
+		}
+
+		camera.intervalSkew.Reset();
+		camera.intervalPeriod.Reset();
+		camera.skewAlarmRaised = false;
+	}
+
+	stream.flags(flags);
+	stream.precision(precision);
+}
+
+inline void SyncAnalytics::SyncMonitor::PrintSummary(std::ostream &stream)
+{
+	std::ios::fmtflags flags = stream.flags();
+	std::streamsize precision = stream.precision();
+	stream << std::fixed;
+
+	stream << "Synchronization over " << m_numSets << " image sets" << (m_synchronizedClocks ? "" : " (clocks not synchronized, skew measured from the first set)") << ":" << std::endl;
+	for (size_t i = 0; i < m_cameras.size(); i++)
+	{
+		CameraStatistics &camera = m_cameras[i];
+		stream << camera.name << ":";
+		if (i > 0)
+		{
+			stream << " skew from " << m_cameras[0].name << " " << std::setprecision(2) << camera.skew.GetMean() / 1000.0 << " us, jitter " << camera.skew.GetStdDev() / 1000.0
+				<< " us, max " << camera.skew.GetMaxAbs() / 1000.0 << " us (" << camera.skewAlarms << " sets over the threshold), drift " << std::setprecision(1) << camera.drift.GetSlope()
+				<< " ns/s, steps " << camera.numSteps << ".";
+		}
+		stream << " Frame period " << std::setprecision(3) << camera.period.GetMean() / 1e6 << " ms";
+		if (m_expectedFramePeriod > 0 && camera.period.GetCount() > 0)
+			stream << " (" << std::showpos << std::setprecision(1) << (camera.period.GetMean() - m_expectedFramePeriod) / m_expectedFramePeriod * 1e6 << std::noshowpos << " ppm)";
+		stream << ". Alarms: " << camera.numAlarms << std::endl;
+	}
+
+	stream.flags(flags);
+	stream.precision(precision);
+}
+
+inline Telemetry::LatencyHistogram &SyncAnalytics::SyncMonitor::GetSkewHistogram(int cameraIndex)
+{
+	return m_skewHistograms[cameraIndex];
+}
+
+inline Telemetry::LatencyHistogram &SyncAnalytics::SyncMonitor::GetPeriodHistogram(int cameraIndex)
+{
+	return m_periodHistograms[cameraIndex];
+}
+
+inline uint64_t SyncAnalytics::SyncMonitor::GetSetCount()
+{
+	return m_numSets;
+}
+
+inline double SyncAnalytics::SyncMonitor::GetMeanSkew(int cameraIndex)
+{
+	return m_cameras[cameraIndex].skew.GetMean();
+}
+
+inline double SyncAnalytics::SyncMonitor::GetSkewJitter(int cameraIndex)
+{
+	return m_cameras[cameraIndex].skew.GetStdDev();
+}
+
+inline double SyncAnalytics::SyncMonitor::GetMaxSkew(int cameraIndex)
+{
+	return m_cameras[cameraIndex].skew.GetMaxAbs();
+}
+
+inline double SyncAnalytics::SyncMonitor::GetDrift(int cameraIndex)
+{
+	return m_cameras[cameraIndex].drift.GetSlope();
+}
+
+inline int SyncAnalytics::SyncMonitor::GetStepCount(int cameraIndex)
+{
+	return m_cameras[cameraIndex].numSteps;
+}
+
+inline double SyncAnalytics::SyncMonitor::GetMeanFramePeriod(int cameraIndex)
+{
+	return m_cameras[cameraIndex].period.GetMean();
+}
+
+inline uint64_t SyncAnalytics::SyncMonitor::GetAlarmCount(int cameraIndex)
+{
+	return m_cameras[cameraIndex].numAlarms;
+}
+
+inline const char *SyncAnalytics::GetAlarmTypeName(EAlarmType type)
+{
+	switch (type)
+	{
+	case Alarm_Skew:
+		return "Skew";
+	case Alarm_Drift:
+		return "Drift";
+	case Alarm_Step:
+		return "Step";
+	case Alarm_FramePeriod:
+		return "FramePeriod";
+	default:
+		return "Unknown";
+	}
+}
+
+// *********************************************************************************************************
+
+#endif
@@ -0,0 +1,497 @@
+// Telemetry.h
+// Low-overhead latency histograms for timing each stage of the Grab Loop, and a reporter that writes their percentiles to a .csv file.
+// Copyright (c) 2019 Matthew Breit - matt.breit@baslerweb.com or matt.breit@gmail.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace Telemetry
+{
+	// The host's monotonic clock, in ns. Used for all of the durations.
+	int64_t GetHostTime();
+
+	// The counts of a LatencyHistogram at one moment.
+	// Subtracting an earlier snapshot of the same histogram leaves the counts of the time in between (eg: one report interval).
+	struct HistogramSnapshot
+	{
+		std::vector<uint64_t> counts;
+		uint64_t count = 0;
+		int64_t sum = 0;
+		int64_t max = 0; // exact in a snapshot. After Subtract(), the upper end of the highest bucket still in use.
+
+		void Subtract(const HistogramSnapshot &earlier);
+		int64_t GetPercentile(double percentile) const; // eg: 99.9. Returns the upper end of the bucket the percentile falls into.
+		double GetMean() const;
+	};
+
+	// Counts values (durations in ns) in log-linear buckets, like an HDR histogram: every power of two is split into 64 buckets,
+	// so any value is known to within 1.6%, from 1 ns up to over 4 minutes, in a fixed 17 KB. Recording a value never allocates or locks.
+	// Record() must only be called from one thread (eg: the thread running the stage being timed). The rest may be called from any thread.
+	class LatencyHistogram
+	{
+	public:
+		static const int c_subBucketBits = 7; // values below 2^7 get one bucket each, above that every power of two gets 2^6 buckets
+		static const int c_subBucketHalfCount = 1 << (c_subBucketBits - 1);
+		static const int c_highestTrackableBits = 38; // larger values are counted as the largest trackable value (2^38 ns = 275 s)
+		static const int c_bucketCount = (c_highestTrackableBits - c_subBucketBits + 2) * c_subBucketHalfCount;
+
+	private:
+		std::atomic<uint64_t> m_counts[c_bucketCount];
+		std::atomic<uint64_t> m_count;
+		std::atomic<int64_t> m_sum;
+		std::atomic<int64_t> m_max;
+
+	public:
+		LatencyHistogram();
+
+		void Record(int64_t value);
+		void GetSnapshot(HistogramSnapshot &snapshot) const;
+		uint64_t GetCount() const;
+
+		static int GetBucketIndex(int64_t value);
+		static int64_t GetBucketLowestValue(int index);
+		static int64_t GetBucketHighestValue(int index);
+	};
+
+	// Camera-to-host latency: how long after its ChunkTimestamp an image was retrieved by the host.
+	// The camera's clock (PTP or free-running) and the host's clock don't share a zero, so the offset between them is estimated as
+	// the smallest (host time - camera time) seen, ie: the fastest frame is taken as zero latency, and what is recorded is the latency on top of that.
+	// This is the part that grows when the network, the driver, or the Grab Engine's output queue hold frames up.
+	// The clocks drift apart slowly (a few ppm), so Rebase() lets the offset follow: afterwards, it is the smallest one seen since the previous Rebase().
+	// Record() and Rebase() must be called from the same thread.
+	class CameraLatency
+	{
+	private:
+		int64_t m_ticksPerSecond = 1000000000; // 1 tick = 1 ns when using PTP
+		int64_t m_offset = 0;
+		bool m_haveOffset = false;
+		int64_t m_intervalOffset = 0;
+		bool m_haveIntervalOffset = false;
+		LatencyHistogram m_histogram;
+
+	public:
+		void SetTickFrequency(int64_t ticksPerSecond); // eg: GevTimestampTickFrequency when not using PTP
+		void Record(int64_t hostTime, int64_t cameraTimestamp);
+		void Rebase();
+		LatencyHistogram &GetHistogram();
+	};
+
+	// Every interval, appends one line per histogram to a .csv file with what was recorded since the previous line:
+	// the count, the rate (fps), and the mean, p50, p99, p99.9, and max in us. PrintSummary() prints the same over the whole run.
+	// The histograms are owned by the caller and must outlive the reporter. All methods must be called from the same thread.
+	class Reporter
+	{
+	private:
+		struct Entry
+		{
+			std::string name;
+			LatencyHistogram *pHistogram;
+			CameraLatency *pLatency;
+			HistogramSnapshot lastSnapshot;
+		};
+
+		std::vector<Entry> m_entries;
+		std::ofstream m_file;
+		int64_t m_startTime;
+		int64_t m_lastReportTime;
+		int64_t m_interval = 0;
+
+		static void WriteStatistics(std::ostream &out, const HistogramSnapshot &snapshot, double seconds);
+
+	public:
+		Reporter();
+
+		void Add(const std::string &name, LatencyHistogram &histogram);
+		void Add(const std::string &name, CameraLatency &latency);
+		int Open(const char *fileName, double intervalSeconds, std::string &errorMessage);
+		bool IsOpen();
+		bool IsReportDue();
+		int Report(std::string &errorMessage);
+		int Close(std::string &errorMessage);
+		void PrintSummary(std::ostream &out);
+	};
+}
+
+// *********************************************************************************************************
+// DEFINITIONS
+inline int64_t Telemetry::GetHostTime()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline void Telemetry::HistogramSnapshot::Subtract(const HistogramSnapshot &earlier)
+{
+	max = 0;
+	for (size_t i = 0; i < counts.size(); i++)
+	{
+		if (i < earlier.counts.size())
+			counts[i] -= earlier.counts[i];
+		if (counts[i] != 0)
+			max = LatencyHistogram::GetBucketHighestValue((int)i);
+	}
+	count -= earlier.count;
+	sum -= earlier.sum;
+}
+
+inline int64_t Telemetry::HistogramSnapshot::GetPercentile(double percentile) const
+{
+	if (count == 0)
+		return 0;
+
+	uint64_t target = (uint64_t)std::ceil(percentile / 100.0 * (double)count);
+	if (target < 1)
+		target = 1;
+	if (target > count)
+		target = count;
+
+	uint64_t counted = 0;
+	for (size_t i = 0; i < counts.size(); i++)
+	{
+		counted += counts[i];
+		if (counted >= target)
+		{
+			int64_t value = LatencyHistogram::GetBucketHighestValue((int)i);
+			return (value < max) ? value : max;
+		}
+	}
+
+	return max;
+}
+
+inline double Telemetry::HistogramSnapshot::GetMean() const
+{
+	return (count == 0) ? 0.0 : (double)sum / (double)count;
+}
+
+inline Telemetry::LatencyHistogram::LatencyHistogram()
+	: m_count(0), m_sum(0), m_max(0)
+{
+	for (int i = 0; i < c_bucketCount; i++)
+		m_counts[i].store(0, std::memory_order_relaxed);
+}
+
+inline void Telemetry::LatencyHistogram::Record(int64_t value)
+{
+	if (value < 0)
+		value = 0; // eg: a camera timestamp that is ahead of the estimated clock offset
+	const int64_t highestTrackableValue = ((int64_t)1 << c_highestTrackableBits) - 1;
+	if (value > highestTrackableValue)
+		value = highestTrackableValue;
+
+	// There is only one writer, so a plain load and store is enough (no locked read-modify-write).
+	// The atomics only make sure a reader on another thread never sees a torn value.
+	std::atomic<uint64_t> &bucket = m_counts[GetBucketIndex(value)];
+	bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	m_sum.store(m_sum.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+	if (value > m_max.load(std::memory_order_relaxed))
+		m_max.store(value, std::memory_order_relaxed);
+	m_count.store(m_count.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+inline void Telemetry::LatencyHistogram::GetSnapshot(HistogramSnapshot &snapshot) const
+{
+	snapshot.count = m_count.load(std::memory_order_acquire);
+	snapshot.sum = m_sum.load(std::memory_order_relaxed);
+	snapshot.max = m_max.load(std::memory_order_relaxed);
+	snapshot.counts.resize(c_bucketCount);
+	for (int i = 0; i < c_bucketCount; i++)
+		snapshot.counts[i] = m_counts[i].load(std::memory_order_relaxed);
+}
+
+inline uint64_t Telemetry::LatencyHistogram::GetCount() const
+{
+	return m_count.load(std::memory_order_relaxed);
+}
+
+inline int Telemetry::LatencyHistogram::GetBucketIndex(int64_t value)
+{
+	if (value < (1 << c_subBucketBits))
+		return (int)value;
+
+	// The highest set bit tells which power of two the value is in, and the next 6 bits which of its buckets.
+#ifdef _MSC_VER
+	unsigned long highestBit = 0;
+	_BitScanReverse64(&highestBit, (unsigned __int64)value);
+#else
+	int highestBit = 63 - __builtin_clzll((unsigned long long)value);
+#endif
+	int shift = (int)highestBit - (c_subBucketBits - 1);
+	return (shift + 1) * c_subBucketHalfCount + (int)(value >> shift) - c_subBucketHalfCount;
+}
+
+inline int64_t Telemetry::LatencyHistogram::GetBucketLowestValue(int index)
+{
+	if (index < (1 << c_subBucketBits))
+		return index;
+
+	int shift = index / c_subBucketHalfCount - 1;
+	int64_t subBucket = index % c_subBucketHalfCount + c_subBucketHalfCount;
+	return subBucket << shift;
+}
+
+inline int64_t Telemetry::LatencyHistogram::GetBucketHighestValue(int index)
+{
+	if (index < (1 << c_subBucketBits))
+		return index;
+
+	int shift = index / c_subBucketHalfCount - 1;
+	return GetBucketLowestValue(index) + ((int64_t)1 << shift) - 1;
+}
+
+inline void Telemetry::CameraLatency::SetTickFrequency(int64_t ticksPerSecond)
+{
+	if (ticksPerSecond > 0)
+		m_ticksPerSecond = ticksPerSecond;
+}
+
+inline void Telemetry::CameraLatency::Record(int64_t hostTime, int64_t cameraTimestamp)
+{
+	// ticks to ns, without overflowing for PTP timestamps (which count from 1970)
+	int64_t cameraTime = (cameraTimestamp / m_ticksPerSecond) * 1000000000 + (cameraTimestamp % m_ticksPerSecond) * 1000000000 / m_ticksPerSecond;
+	int64_t offset = hostTime - cameraTime;
+
+	if (m_haveOffset == false || offset < m_offset)
+	{
+		m_offset = offset;
+		m_haveOffset = true;
+	}
+	if (m_haveIntervalOffset == false || offset < m_intervalOffset)
+	{
+		m_intervalOffset = offset;
+		m_haveIntervalOffset = true;
+	}
+
+	m_histogram.Record(offset - m_offset);
+}
+
+inline void Telemetry::CameraLatency::Rebase()
+{
+	if (m_haveIntervalOffset == true)
+		m_offset = m_intervalOffset;
+	m_haveIntervalOffset = false;
+}
+
+inline Telemetry::LatencyHistogram &Telemetry::CameraLatency::GetHistogram()
+{
+	return m_histogram;
+}
+
+inline Telemetry::Reporter::Reporter()
+{
+	m_startTime = GetHostTime();
+	m_lastReportTime = m_startTime;
+}
+
+inline void Telemetry::Reporter::Add(const std::string &name, LatencyHistogram &histogram)
+{
+	Entry entry;
+	entry.name = name;
+	entry.pHistogram = &histogram;
+	entry.pLatency = NULL;
+	histogram.GetSnapshot(entry.lastSnapshot);
+	m_entries.push_back(entry);
+}
+
+inline void Telemetry::Reporter::Add(const std::string &name, CameraLatency &latency)
+{
+	Add(name, latency.GetHistogram());
+	m_entries.back().pLatency = &latency;
+}
+
+inline int Telemetry::Reporter::Open(const char *fileName, double intervalSeconds, std::string &errorMessage)
+{
+	errorMessage = "ERROR: ";
+	errorMessage.append(__FUNCTION__);
+	errorMessage.append("(): ");
+
+	try
+	{
+		if (m_file.is_open() == true)
+		{
+			errorMessage.append("Reporter is already open");
+			return 1;
+		}
+		if (intervalSeconds <= 0)
+		{
+			errorMessage.append("The report interval must be greater than 0");
+			return 1;
+		}
+
+		m_file.open(fileName, std::ios::out | std::ios::trunc);
+		if (m_file.is_open() == false)
+		{
+			errorMessage.append("Could not create ");
+			errorMessage.append(fileName);
+			return 1;
+		}
+
+		m_file << "time_s,stage,count,fps,mean_us,p50_us,p99_us,p99.9_us,max_us" << std::endl;
+		m_interval = (int64_t)(intervalSeconds * 1e9);
+		m_lastReportTime = GetHostTime();
+		return 0;
+	}
+	catch (std::exception &e)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append(e.what());
+		return 1;
+	}
+	catch (...)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append("UNKNOWN.");
+		return 1;
+	}
+}
+
+inline bool Telemetry::Reporter::IsOpen()
+{
+	return m_file.is_open();
+}
+
+inline bool Telemetry::Reporter::IsReportDue()
+{
+	return m_file.is_open() == true && GetHostTime() - m_lastReportTime >= m_interval;
+}
+
+inline void Telemetry::Reporter::WriteStatistics(std::ostream &out, const HistogramSnapshot &snapshot, double seconds)
+{
+	out << std::fixed << std::setprecision(1)
+		<< snapshot.count << ","
+		<< ((seconds > 0) ? (double)snapshot.count / seconds : 0.0) << ","
+		<< snapshot.GetMean() / 1000.0 << ","
+		<< snapshot.GetPercentile(50) / 1000.0 << ","
+		<< snapshot.GetPercentile(99) / 1000.0 << ","
+		<< snapshot.GetPercentile(99.9) / 1000.0 << ","
+		<< snapshot.max / 1000.0;
+	out.unsetf(std::ios::floatfield);
+}
+
+inline int Telemetry::Reporter::Report(std::string &errorMessage)
+{
+	errorMessage = "ERROR: ";
+	errorMessage.append(__FUNCTION__);
+	errorMessage.append("(): ");
+
+	try
+	{
+		if (m_file.is_open() == false)
+		{
+			errorMessage.append("Reporter is not open");
+			return 1;
+		}
+
+		int64_t now = GetHostTime();
+		double seconds = (now - m_lastReportTime) / 1e9;
+		double elapsed = (now - m_startTime) / 1e9;
+		m_lastReportTime = now;
+
+		// The whole report is built first and written at once, so a reader tailing the file never sees half of one.
+		std::ostringstream lines;
+		HistogramSnapshot snapshot;
+		for (size_t i = 0; i < m_entries.size(); i++)
+		{
+			Entry &entry = m_entries[i];
+			entry.pHistogram->GetSnapshot(snapshot);
+			HistogramSnapshot interval = snapshot;
+			interval.Subtract(entry.lastSnapshot);
+			entry.lastSnapshot.counts.swap(snapshot.counts);
+			entry.lastSnapshot.count = snapshot.count;
+			entry.lastSnapshot.sum = snapshot.sum;
+			entry.lastSnapshot.max = snapshot.max;
+
+			if (entry.pLatency != NULL)
+				entry.pLatency->Rebase();
+
+			lines << std::fixed << std::setprecision(3) << elapsed << "," << entry.name << ",";
+			WriteStatistics(lines, interval, seconds);
+			lines << "\n";
+		}
+
+		m_file << lines.str();
+		m_file.flush();
+		if (m_file.good() == false)
+		{
+			errorMessage.append("Could not write to the telemetry file");
+			return 1;
+		}
+
+		return 0;
+	}
+	catch (std::exception &e)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append(e.what());
+		return 1;
+	}
+	catch (...)
+	{
+		errorMessage.append("EXCEPTION: ");
+		errorMessage.append("UNKNOWN.");
+		return 1;
+	}
+}
+
+inline int Telemetry::Reporter::Close(std::string &errorMessage)
+{
+	if (m_file.is_open() == false)
+		return 0;
+
+	// report whatever was recorded since the last interval
+	int result = Report(errorMessage);
+	m_file.close();
+	return result;
+}
+
+inline void Telemetry::Reporter::PrintSummary(std::ostream &out)
+{
+	double seconds = (GetHostTime() - m_startTime) / 1e9;
+
+	out << std::left << std::setw(24) << "Stage" << std::right << "   count      fps  mean us   p50 us   p99 us p99.9 us   max us" << std::endl;
+	HistogramSnapshot snapshot;
+	for (size_t i = 0; i < m_entries.size(); i++)
+	{
+		m_entries[i].pHistogram->GetSnapshot(snapshot);
+		out << std::left << std::setw(24) << m_entries[i].name << std::right << std::fixed << std::setprecision(1)
+			<< std::setw(8) << snapshot.count
+			<< std::setw(9) << ((seconds > 0) ? (double)snapshot.count / seconds : 0.0)
+			<< std::setw(9) << snapshot.GetMean() / 1000.0
+			<< std::setw(9) << snapshot.GetPercentile(50) / 1000.0
+			<< std::setw(9) << snapshot.GetPercentile(99) / 1000.0
+			<< std::setw(9) << snapshot.GetPercentile(99.9) / 1000.0
+			<< std::setw(9) << snapshot.max / 1000.0 << std::endl;
+		out.unsetf(std::ios::floatfield);
+	}
+}
+
+// *********************************************************************************************************
+
+#endif
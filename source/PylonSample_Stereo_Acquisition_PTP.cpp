@@ -4,8 +4,8 @@ in the pylon C++ API documentation that gets installed with pylon.
 If you are upgrading to a higher major version of pylon, Basler also
 strongly recommends reading the Migration topic in the pylon C++ API documentation.
 
-This Sample will demostrate freerunning synchronized acquisition from dual cameras.
-It will also stitch the images side by side and save them to a .mp4 or .avi movie.
+This Sample will demostrate freerunning synchronized acquisition from multiple cameras (two by default, see c_cameras).
+It will also stitch the images side by side (or in a grid) and save them to a .mp4 or .avi movie.
 
 Author: mbreit
 
@@ -26,7 +26,24 @@ Author: mbreit
 
 // Additional Libraries
 #include <thread> // for sleeping
-#include <StitchImage.h> // for stitching the Left Camera image and the Right Camera image side-by-side
+#include <StitchImage.h> // for stitching the images of the cameras side-by-side (or in a grid)
+#include <Pipeline.h> // for running the Grab, Stitch, Convert, and Write stages on their own threads
+#include <FrameMatcher.h> // for grouping the images of the cameras by their timestamps
+#include <AsyncVideoWriter.h> // for encoding and writing the video on its own thread
+#include <RawStereoFile.h> // for recording the unprocessed images of both cameras
+#include <FrameSource.h> // for getting the images from the cameras, from a synthetic image generator, or from a raw recording
+#include <Telemetry.h> // for timing each stage of each frame and reporting where the frame budget goes
+#include <PtpCamera.h> // for waiting until the camera clocks have synchronized (PtpMonitor.h) and scheduling a common start time
+#include <BandwidthPlanner.h> // for working out the GigE transmission settings of the cameras
+#include <MjpegAviWriter.h> // for encoding the .avi video on all cores
+#include <PreviewDisplay.h> // for showing the latest stitched image on its own thread
+#include <MetadataJournal.h> // for recording the framecounter and timestamp of every image
+#include <GrabHealthCamera.h> // for watching the Grab Engines' buffers and the stream grabber statistics on their own thread
+#include <BufferPlanner.h> // for working out how many buffers the Grab Engines need
+#include <SyncAnalytics.h> // for checking that the cameras stay synchronized during the run
+#include <memory> // for unique_ptr
+#include <vector> // for the list of cameras
+#include <algorithm> // for min_element and max_element
 
 // Namespace for using pylon objects.
 using namespace Pylon;
@@ -60,38 +77,151 @@ using namespace Basler_UsbCameraParams;
 using namespace std;
 
 // ******************************* Program settings **********************************
-// CAMERAS TO USE
-const String_t c_leftCameraSN = "22167541";
-const String_t c_rightCameraSN = "22226680";
+// FRAME SOURCE SETTINGS
+const FrameSource::ESourceType c_frameSource = FrameSource::SourceType_Pylon; // Pylon: the cameras below. Synthetic: generated images (no cameras needed, eg: to profile the processing on any PC). Replay: the raw recording c_rawFileName.
+const bool c_sourceRealTime = true; // Synthetic and Replay sources deliver the images at the frame rate (or the recorded timestamps). false = as fast as the processing takes them.
+const int64_t c_syntheticJitter = 100000; // Synthetic timestamps vary by up to +/- this many ns...
+const int64_t c_syntheticSkew = 50000; // ...and each camera's are this many ns later than the previous camera's.
+const double c_syntheticDropRate = 0.001; // Fraction of the synthetic images that are "lost on the way" (to exercise the stereo pairing).
+// CAMERAS TO USE: one line per camera, in the order their images are stitched (left to right, then top to bottom, see c_stitchColumns).
+// The GigE transmission settings are planned from the image size, frame rate and links of the cameras (see c_usingBandwidthPlanner) to prevent packet collisions and dropped frames (buffers incompletely grabbed).
+// Cameras with the same link number share a link to the host (eg: the same NIC, or the same switch port). The packet size is the largest the network takes (eg: 9000 with jumbo frames).
+// Without the planner, the interpacket and frame transmission delays below are used as they are. Cameras sharing a link should then get different frame transmission delays, so they don't all send their images at the same time.
+struct CameraSettings
+{
+	const char *name;
+	const char *serialNumber;
+	int link;
+	int packetSize;
+	int interpacketDelay;
+	int frameTransmissionDelay;
+};
+const CameraSettings c_cameras[] =
+{
+	// name            serial number  link  packet size  interpacket delay  frame transmission delay
+	{ "Left Camera",   "22167541",    0,    1500,        0,                 0 },
+	{ "Right Camera",  "22226680",    0,    1500,        0,                 0 },
+};
+const int c_numCameras = sizeof(c_cameras) / sizeof(c_cameras[0]);
+const bool c_usingBandwidthPlanner = true; // Work out the interpacket and frame transmission delays from the image size, frame rate and link speeds. false = use the values in c_cameras.
+const double c_targetLinkUtilization = 0.9; // The fraction of each link the cameras may use. The rest is headroom for resends and other traffic.
+const bool c_parallelCameraSetup = true; // Open and configure all cameras at the same time (each on its own thread), so startup doesn't grow with the number of cameras.
 // INSTANT CAMERA: PHYSICAL CAMERA ACQUISITION SETTINGS
 const int c_frameRate = 30;
 const int c_width = 640;
 const int c_height = 480;
 const int c_exposureTime = 30000;
-const String_t c_pixelFormat = "Mono8";
-// INSTANT CAMERA: PHYSICAL CAMERA GIGE TRANSMISSION SETTINGS (note: these will probably need to be adjusted based on actual use case to prevent packet collisions and dropped frames (buffers incompletely grabbed))
-const int c_packetSize_LeftCamera = 1500;
-const int c_interpacketDelay_LeftCamera = 0;
-const int c_frameTransmissionDelay_LeftCamera = 0;
-const int c_packetSize_RightCamera = 1500;
-const int c_interpacketDelay_RightCamera = 0;
-const int c_frameTransmissionDelay_RightCamera = 0;
+const String_t c_pixelFormat = "Mono8"; // Packed formats like "Mono12p" need 25% less GigE bandwidth than "Mono16" and can be stitched as well.
 // INSTANT CAMERA: PYLON GRAB ENGINE SETTINGS
 const int c_imagesToGrab = 1000;
 const int c_maxNumBuffer = 200; // If writing a video, the more buffers the better, as writing could cause a bottleneck in the Grab Loop, leading to a Buffer Undderrun condition in the Grab Engine
 const int c_maxNumQueuedBuffer = c_maxNumBuffer; // Queue up all the allocated buffers to make as many as possible ready to receive images.
+const bool c_usingAutoBufferSizing = true; // Time the processing on synthetic images before the cameras start, and size MaxNumBuffer (and MaxNumQueuedBuffer) from it instead of using c_maxNumBuffer.
+const uint64_t c_bufferMemoryBudget = 1024ull * 1024 * 1024; // bytes the buffers of all of the Grab Engines together may use
+const double c_bufferTargetStall = 0.5; // seconds the processing may fall behind (eg: an encoder or disk hiccup) without losing images
+const int c_bufferWarmupFrames = 100; // How many frame sets the warm-up times.
+const bool c_usingHealthMonitor = true; // Watch the Grab Engines' buffer queues and the stream grabber statistics (failed buffers, buffer underruns, lost and resent packets) on their own thread, and warn when they change.
+const double c_healthPollInterval = 1.0; // seconds between samples. The Grab Loop itself never reads a camera parameter.
+const int c_healthWindow = 10; // The rolling counters cover this many samples.
 // PTP SETTINGS 
 const bool c_usingPTP = true;
-const int c_timeToSyncPTP = 60; // PTP requires some setup time to find the synchronization between the clocks.
+const int c_ptpTimeout = 60; // PTP requires some setup time to find the synchronization between the clocks. Give up waiting after this many seconds.
+const int64_t c_ptpOffsetThreshold = 1000; // The clocks count as synchronized when every camera is Master or Slave, with an offset from master of no more than this (ns)...
+const int c_ptpRequiredSamples = 5; // ...for this many samples in a row.
+const double c_ptpPollInterval = 1.0; // seconds between samples
+const bool c_ptpRequireConvergence = false; // Stop if the clocks have not converged by the timeout. Otherwise, continue with a warning (the images may not be matched correctly).
+const bool c_usingScheduledStart = true; // With PTP, program every camera to begin exposing at the same instant of the synchronized clocks, instead of releasing them one after the other from trigger mode.
+const double c_scheduledStartDelay = 1.0; // How far in the future the cameras start (seconds). Must cover starting all of the Grab Engines.
 // VIDEO RECORDING SETTINGS
 const bool c_recordingToMp4 = false;
 const bool c_recordingToAvi = true;
 const String_t c_mp4FileName = "Video.mp4";
 const String_t c_aviFileName = "Video.avi";
+const bool c_recordingToRaw = false; // Also record the unprocessed images of both cameras (only with two cameras) and their chunk data (lossless, limited by the disk rather than the CPU). Read them back with RawStereoFile::Reader. The Grab Engines' buffers are held until they are written, so MaxNumBuffer must cover the queues.
+const String_t c_rawFileName = "Video.stereoraw"; // the index goes next to it, in Video.stereoraw.idx
+const uint64_t c_rawPreallocationSize = 1024ull * 1024 * 1024; // The raw file is allocated on disk in steps of this many bytes.
 const uint32_t c_imageQuality = 100;
+const bool c_usingParallelMjpeg = true; // Linux .avi: JPEG-encode the frames on a pool of threads and write the .avi directly, instead of encoding one frame at a time with cv::VideoWriter.
+const int c_mjpegEncodingThreads = 0; // 0 = one per core
+const int c_mjpegQueueSize = 16; // How many frames can be encoding, or waiting for an earlier frame to finish, before recording has to wait.
+const bool c_recordingMonoAsGray = true; // Linux .avi: record Mono images as single channel gray frames, instead of converting them to BGR (3x the bytes to convert and encode, for the same picture).
+const bool c_recording16BitMono = false; // Linux .avi: record Mono formats with more than 8 bits as lossless 16 bit PNG frames (MPNG, needs c_usingParallelMjpeg). Otherwise they are reduced to 8 bit JPEG frames.
 const int c_playBackFrameRate = c_frameRate;
+const bool c_usingAsyncRecording = true; // Encode and write the video on its own thread, so encoder hiccups or a slow disk don't hold up grabbing.
+const int c_recordingQueueSize = 32; // How many stitched images can wait to be encoded.
+const AsyncVideoWriter::EDropPolicy c_recordingDropPolicy = AsyncVideoWriter::DropPolicy_DropOldest; // What to do when the recording queue is full: wait (Block), or skip a frame in the video (DropOldest/DropNewest).
+// STEREO PAIRING SETTINGS
+const int64_t c_pairingTolerance = 1000000; // Images whose ChunkTimestamps differ by no more than this belong together (in timestamp ticks, 1 tick = 1 ns when using PTP). Without PTP, the ChunkFramecounters are compared instead, for the whole run (MatchMode_FrameCounter is a global mode, not a fallback for single images).
+const int c_pairingMaxPending = 8; // How many images of one camera may wait for their partners before the oldest is discarded as an orphan.
+// PROCESSING SETTINGS
+const int c_stitchColumns = 0; // How many camera images are stitched side by side before a new row is started (0 = all in one row, eg: 2 for a 2x2 grid of 4 cameras).
+const bool c_usingFusedStitchConvert = true; // On Linux, stitch Mono8 images and convert them to BGR for OpenCV in a single pass (SIMD accelerated), instead of stitching first and then converting.
+const bool c_validatePackedStitching = true; // When using a packed Mono format, check the first stitched image against pylon's image format converter.
+// PIPELINE SETTINGS
+const bool c_usingPipeline = true; // Run Grab, Stitch, Convert, and Write (record/display) on their own threads so a slow stage doesn't stall the Grab Loop.
+const int c_pipelineQueueSize = 16; // How many frame sets can wait between two stages. Each set waiting before the Stitch stage holds one buffer of each Grab Engine.
+const int c_pipelineReportInterval = 100; // Print the occupancy of the queues every this many frames (0 = never).
+const bool c_usingRetrievalThreads = true; // Retrieve the images of each camera on its own thread, so waiting for one camera's image never holds up the others' (and a timeout of one camera doesn't stall all of them).
+const int c_retrievalQueueSize = 8; // How many images of each camera can wait to be paired. Each one holds a buffer of its Grab Engine.
+// PREVIEW SETTINGS
+const bool c_usingPreview = true; // Show the stitched images while grabbing. The preview runs on its own thread and only ever shows the latest image, so grabbing and recording never wait for the display.
+const double c_previewFrameRate = 15; // The preview is refreshed at most this often (0 = as often as it can).
+const int c_previewDownscale = 2; // Average blocks of 2x2 (or 4x4) pixels before displaying them (1 = full size).
+// METADATA JOURNAL SETTINGS
+const String_t c_journalFileName = "Journal.bin"; // The camera, framecounter, timestamp, arrival time, and grab status of every image are written to this binary file (convert it with 'make tools' and ./bin_linux/JournalToCsv). "" = print them instead (slow).
+const int c_journalQueueSize = 4096; // How many records can wait to be written before they are dropped.
+const uint64_t c_journalPreallocation = 65536; // The journal grows in steps of this many records.
+// TELEMETRY SETTINGS
+const String_t c_telemetryFileName = "Telemetry.csv"; // Every stage of every frame is timed. The p50/p99/p99.9/max times and the fps of each stage are appended to this file every report interval ("" = only print a summary at the end).
+const double c_telemetryReportInterval = 5.0; // seconds
+// SYNCHRONIZATION ANALYTICS SETTINGS
+const bool c_usingSyncAnalytics = true; // Follow the skew between the cameras' timestamps in every image set (mean, jitter, max), how fast it drifts, steps in it (eg: a new PTP master), and each camera's frame period. Reported with the telemetry.
+const double c_syncSkewAlarm = 10000; // ns. Warn when the images of a set were taken further apart than this (0 = never). Only meaningful with PTP.
+const double c_syncDriftAlarm = 1000; // ns/s. Warn when the skew drifts faster than this (0 = never).
+const double c_syncStepThreshold = 5000; // ns. A jump in the skew bigger than this that lasts for a few sets is reported as a step (0 = don't look for steps).
+const double c_syncPeriodTolerance = 0.001; // Warn when the measured frame period is off from 1 / c_frameRate by more than this fraction (0 = never).
 // ***********************************************************************************
 
+// The unit of work that is passed from stage to stage (Grab -> Stitch -> Convert -> Write): one image of each camera, taken at the same time.
+// The images share their buffers with the frame source (eg: a Grab Result from the Grab Engine), which get them back once the images are released.
+struct FrameSet
+{
+	std::vector<FrameMatcher::MatchedFrame<CPylonImage>> cameraFrames; // the image, ChunkTimestamp, and ChunkFramecounter of each camera, in the order of c_cameras
+	CPylonImage stitchedImage;
+	CPylonImage convertedImage; // the stitched image in the format needed by the recorder (eg: BGR for OpenCV)
+};
+
+// One image as it was retrieved from a frame source, on its way to the pairing (eg: from a camera's retrieval thread).
+struct RetrievedFrame
+{
+	FrameSource::SourceFrame sourceFrame;
+	int result = 0; // what RetrieveFrame() returned
+	int64_t retrieveTime = 0; // host time (ns) the image was retrieved
+	std::string errorMessage;
+};
+
+// Counts the parameter writes while a camera is configured (see SetIfDifferent()).
+struct ConfigurationStatistics
+{
+	int writes = 0;
+	int writesSkipped = 0;
+};
+
+// Writes a camera parameter only if it doesn't have the value already (eg: because it is the default after UserSetLoad).
+// The current value is read first, and the write is skipped (and counted) when it already matches.
+template <typename Parameter_t, typename Value_t>
+void SetIfDifferent(Parameter_t &parameter, Value_t value, ConfigurationStatistics &statistics)
+{
+	if (parameter.GetValue() == value)
+	{
+		statistics.writesSkipped++;
+		return;
+	}
+
+	parameter.SetValue(value);
+	statistics.writes++;
+}
+
 int main(int argc, char* argv[])
 {
 	// The exit code of the sample application.
@@ -102,134 +232,277 @@ int main(int argc, char* argv[])
 
 	try
 	{
-		// Our Pylon Instant Camera Objects (these contain the phyiscal camera and the pylon Grab Engine)
-		Camera_t LeftCamera;
-		Camera_t RightCamera;
-
-		// We will use specific devices defined by their serial numbers.
-		CDeviceInfo LeftCameraInfo;
-		CDeviceInfo RightCameraInfo;
-		LeftCameraInfo.SetSerialNumber(c_leftCameraSN);
-		RightCameraInfo.SetSerialNumber(c_rightCameraSN);
-
-		// Attach the instant camera objects to the appropriate hardware devices.
-		LeftCamera.Attach(CTlFactory::GetInstance().CreateFirstDevice(LeftCameraInfo));
-		RightCamera.Attach(CTlFactory::GetInstance().CreateFirstDevice(RightCameraInfo));
-
-		// Print the model name of the camera.
-		cout << "Left Camera  : " << LeftCamera.GetDeviceInfo().GetModelName() << " : " << LeftCamera.GetDeviceInfo().GetSerialNumber() << endl;
-		cout << "Right Camera : " << RightCamera.GetDeviceInfo().GetModelName() << " : " << RightCamera.GetDeviceInfo().GetSerialNumber() << endl;
-
-
-		// *********************** SETUP THE PHYSICAL CAMERAS ***********************
-		// Open the camera so we can configure the hardware
-		LeftCamera.Open();
-		RightCamera.Open();
-
-		// Reset cameras to defaults
-		cout << "Resetting Cameras to Defaults..." << endl;
-		LeftCamera.UserSetSelector.SetValue(UserSetSelectorEnums::UserSetSelector_Default);
-		LeftCamera.UserSetLoad.Execute();
-		RightCamera.UserSetSelector.SetValue(UserSetSelectorEnums::UserSetSelector_Default);
-		RightCamera.UserSetLoad.Execute();
-
-		// configure the cameras
-		cout << "Configuring the Left Camera's hardware..." << endl;
-		// image acquisition settings
-		LeftCamera.ExposureTimeAbs.SetValue(c_exposureTime);
-		LeftCamera.Width.SetValue(c_width);
-		LeftCamera.Height.SetValue(c_height);
-		LeftCamera.CenterX.SetValue(true);
-		LeftCamera.CenterY.SetValue(true);
-		LeftCamera.PixelFormat.FromString(c_pixelFormat);
-		// Optional: Chunk features for timestamp and framecounter image metadata can be used to keep track of images
-		LeftCamera.ChunkModeActive.SetValue(true);
-		LeftCamera.ChunkSelector.SetValue(ChunkSelectorEnums::ChunkSelector_Timestamp);
-		LeftCamera.ChunkEnable.SetValue(true);
-		LeftCamera.ChunkSelector.SetValue(ChunkSelectorEnums::ChunkSelector_Framecounter);
-		LeftCamera.ChunkEnable.SetValue(true);
-		LeftCamera.CounterSelector.SetValue(CounterSelector_Counter2);
-		LeftCamera.CounterResetSource.SetValue(Basler_GigECamera::CounterResetSourceEnums::CounterResetSource_Software);
-		LeftCamera.CounterReset.Execute(); // reset the framecounter
-		// Optional: If using PTP, configure those settings
-		LeftCamera.SyncFreeRunTimerTriggerRateAbs.SetValue(c_frameRate);
-		LeftCamera.SyncFreeRunTimerStartTimeHigh.SetValue(0);
-		LeftCamera.SyncFreeRunTimerStartTimeLow.SetValue(0);
-		LeftCamera.SyncFreeRunTimerUpdate.Execute();
-		LeftCamera.SyncFreeRunTimerEnable.SetValue(true);
-		// RECOMMENDED: If using GigE, configure the packet size, interpacket delay, and frame transmission delays to avoid packet collisions.
-		LeftCamera.GevSCPSPacketSize.SetValue(c_packetSize_LeftCamera); // Packet Size
-		LeftCamera.GevSCPD.SetValue(c_interpacketDelay_LeftCamera); // Interpacket Delay 
-		LeftCamera.GevSCFTD.SetValue(c_frameTransmissionDelay_LeftCamera); // Frame Transmission Delay.
-
-		cout << "Configuring the Right Camera's hardware..." << endl;
-		// image acquisition settings
-		RightCamera.ExposureTimeAbs.SetValue(c_exposureTime);
-		RightCamera.Width.SetValue(c_width);
-		RightCamera.Height.SetValue(c_height);
-		RightCamera.CenterX.SetValue(true);
-		RightCamera.CenterY.SetValue(true);
-		RightCamera.PixelFormat.FromString(c_pixelFormat);
-		// Optional: Chunk features for timestamp and framecounter image metadata can be used to keep track of images
-		RightCamera.ChunkModeActive.SetValue(true);
-		RightCamera.ChunkSelector.SetValue(ChunkSelectorEnums::ChunkSelector_Timestamp);
-		RightCamera.ChunkEnable.SetValue(true);
-		RightCamera.ChunkSelector.SetValue(ChunkSelectorEnums::ChunkSelector_Framecounter);
-		RightCamera.ChunkEnable.SetValue(true);
-		RightCamera.CounterSelector.SetValue(CounterSelector_Counter2);
-		RightCamera.CounterResetSource.SetValue(Basler_GigECamera::CounterResetSourceEnums::CounterResetSource_Software);
-		RightCamera.CounterReset.Execute(); // reset the framecounter
-		// Optional: If using PTP, configure those settings
-		RightCamera.SyncFreeRunTimerTriggerRateAbs.SetValue(c_frameRate);
-		RightCamera.SyncFreeRunTimerStartTimeHigh.SetValue(0);
-		RightCamera.SyncFreeRunTimerStartTimeLow.SetValue(0);
-		RightCamera.SyncFreeRunTimerUpdate.Execute();
-		RightCamera.SyncFreeRunTimerEnable.SetValue(true);
-		// RECOMMENDED: If using GigE, configure the packet size, interpacket delay, and frame transmission delays to avoid packet collisions.
-		RightCamera.GevSCPSPacketSize.SetValue(c_packetSize_LeftCamera); // Packet Size
-		RightCamera.GevSCPD.SetValue(c_interpacketDelay_LeftCamera); // Interpacket Delay 
-		RightCamera.GevSCFTD.SetValue(c_frameTransmissionDelay_LeftCamera); // Frame Transmission Delay.
-
-		// Synchronize the camera clocks using PTP if desired
-		if (c_usingPTP == true)
-		{
-			// configure IEEE1588 (PTP)
-			cout << endl << "Enabling the IEEE1588 PTP Feature on both cameras..." << endl;
-
-			// enable IEEE1588 (PTP)
-			LeftCamera.GevIEEE1588.SetValue(true);
-			RightCamera.GevIEEE1588.SetValue(true);
-
-			// We need to wait some time to let the PTP mechanism synchronize the clocks.
-			cout << "Allowing time for clock synchronization..." << endl;
-			for (int i = 0; i < c_timeToSyncPTP; i++) // give them a little time to sync
-			{
-				cout << "Time Left: " << c_timeToSyncPTP - i << " seconds." << endl;
-				LeftCamera.GevIEEE1588DataSetLatch.Execute();
-				RightCamera.GevIEEE1588DataSetLatch.Execute();
-				cout << "Left Camera Status  : " << std::setw(8) << LeftCamera.GevIEEE1588Status.ToString() << ". Offset from Master: " << LeftCamera.GevIEEE1588OffsetFromMaster.GetValue() << endl;
-				cout << "Right Camera Status : " << std::setw(8) << RightCamera.GevIEEE1588Status.ToString() << ". Offset from Master: " << RightCamera.GevIEEE1588OffsetFromMaster.GetValue() << endl;
-				std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+		// Our Pylon Instant Camera Objects (these contain the phyiscal camera and the pylon Grab Engine), one for each entry of c_cameras
+		std::vector<std::unique_ptr<Camera_t>> cameras;
+
+		// Configures one camera's hardware and its Grab Engine. Only talks to its own camera, so it can run for all cameras at the same time.
+		auto ConfigureCamera = [&](Camera_t &camera, const CameraSettings &settings, ConfigurationStatistics &statistics)
+		{
+			// Open the camera so we can configure the hardware
+			camera.Open();
+
+			// Reset camera to defaults
+			SetIfDifferent(camera.UserSetSelector, UserSetSelectorEnums::UserSetSelector_Default, statistics);
+			camera.UserSetLoad.Execute();
+
+			// configure the camera
+			// image acquisition settings
+			SetIfDifferent(camera.ExposureTimeAbs, c_exposureTime, statistics);
+			SetIfDifferent(camera.Width, c_width, statistics);
+			SetIfDifferent(camera.Height, c_height, statistics);
+			SetIfDifferent(camera.CenterX, true, statistics);
+			SetIfDifferent(camera.CenterY, true, statistics);
+			if (camera.PixelFormat.ToString() != c_pixelFormat)
+			{
+				camera.PixelFormat.FromString(c_pixelFormat);
+				statistics.writes++;
+			}
+			else
+				statistics.writesSkipped++;
+			// Optional: Chunk features for timestamp and framecounter image metadata can be used to keep track of images
+			SetIfDifferent(camera.ChunkModeActive, true, statistics);
+			SetIfDifferent(camera.ChunkSelector, ChunkSelectorEnums::ChunkSelector_Timestamp, statistics);
+			SetIfDifferent(camera.ChunkEnable, true, statistics);
+			SetIfDifferent(camera.ChunkSelector, ChunkSelectorEnums::ChunkSelector_Framecounter, statistics);
+			SetIfDifferent(camera.ChunkEnable, true, statistics);
+			SetIfDifferent(camera.CounterSelector, CounterSelector_Counter2, statistics);
+			SetIfDifferent(camera.CounterResetSource, Basler_GigECamera::CounterResetSourceEnums::CounterResetSource_Software, statistics);
+			camera.CounterReset.Execute(); // reset the framecounter
+			// Optional: If using PTP, configure those settings
+			SetIfDifferent(camera.SyncFreeRunTimerTriggerRateAbs, c_frameRate, statistics);
+			SetIfDifferent(camera.SyncFreeRunTimerStartTimeHigh, 0, statistics);
+			SetIfDifferent(camera.SyncFreeRunTimerStartTimeLow, 0, statistics);
+			camera.SyncFreeRunTimerUpdate.Execute();
+			SetIfDifferent(camera.SyncFreeRunTimerEnable, true, statistics);
+			// RECOMMENDED: If using GigE, configure the packet size, interpacket delay, and frame transmission delays to avoid packet collisions.
+			// (with the bandwidth planner, they are set once all cameras are configured, see below)
+			if (c_usingBandwidthPlanner == false)
+			{
+				SetIfDifferent(camera.GevSCPSPacketSize, settings.packetSize, statistics); // Packet Size
+				SetIfDifferent(camera.GevSCPD, settings.interpacketDelay, statistics); // Interpacket Delay
+				SetIfDifferent(camera.GevSCFTD, settings.frameTransmissionDelay, statistics); // Frame Transmission Delay.
+			}
+
+			// The Grab Engine receives data from the camera and fills buffers with it. It then provides Grab Results that are retrieved by the Grab Loop
+			// how many buffers should we use? Any image processing in the grab loop will take time, so use enough such that no images are dropped between RetrieveResult() calls
+			SetIfDifferent(camera.MaxNumBuffer, c_maxNumBuffer, statistics);
+			// allow pylon to queue up all the buffers if possible to enhance grabbing performance
+			SetIfDifferent(camera.MaxNumQueuedBuffer, c_maxNumQueuedBuffer, statistics);
+		};
+
+		// Runs ConfigureCamera() for one camera, and notes how long it took and what went wrong (if anything). Never throws, so it can run on its own thread.
+		std::vector<ConfigurationStatistics> configurationStatistics(c_numCameras);
+		std::vector<double> configurationTimes(c_numCameras, 0.0);
+		std::vector<std::string> configurationErrors(c_numCameras);
+		auto BringUpCamera = [&](int cameraIndex)
+		{
+			std::string &errorMessage = configurationErrors[cameraIndex];
+			std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+			try
+			{
+				ConfigureCamera(*cameras[cameraIndex], c_cameras[cameraIndex], configurationStatistics[cameraIndex]);
+			}
+			catch (const GenericException &e)
+			{
+				errorMessage = e.GetDescription();
+			}
+			catch (std::exception &e)
+			{
+				errorMessage = e.what();
+			}
+			catch (...)
+			{
+				errorMessage = "UNKNOWN.";
+			}
+
+			configurationTimes[cameraIndex] = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+		};
+
+		// The cameras are only set up if they are the source of the images (see c_frameSource).
+		if (c_frameSource == FrameSource::SourceType_Pylon)
+		{
+			// We will use specific devices defined by their serial numbers.
+			// The devices are only looked for once (on GigE, each search waits for the cameras on the network to answer).
+			DeviceInfoList_t devices;
+			CTlFactory::GetInstance().EnumerateDevices(devices);
+			for (int i = 0; i < c_numCameras; i++)
+			{
+				size_t deviceIndex = 0;
+				while (deviceIndex < devices.size() && devices[deviceIndex].GetSerialNumber() != c_cameras[i].serialNumber)
+					deviceIndex++;
+				if (deviceIndex == devices.size())
+					throw std::runtime_error(std::string("No camera found with serial number ") + c_cameras[i].serialNumber + " (" + c_cameras[i].name + ")");
+
+				// Attach the instant camera object to the appropriate hardware device.
+				cameras.push_back(std::unique_ptr<Camera_t>(new Camera_t()));
+				cameras[i]->Attach(CTlFactory::GetInstance().CreateDevice(devices[deviceIndex]));
+
+				// Print the model name of the camera.
+				cout << c_cameras[i].name << " : " << cameras[i]->GetDeviceInfo().GetModelName() << " : " << cameras[i]->GetDeviceInfo().GetSerialNumber() << endl;
+			}
+
+
+			// *********************** SETUP THE PHYSICAL CAMERAS AND THEIR GRAB ENGINES ***********************
+			// Each camera is opened, reset to defaults, and configured. Most of that time is spent waiting for the camera to answer, so the cameras are set up in parallel.
+			cout << "Configuring the cameras and their Pylon Grab Engines" << (c_parallelCameraSetup ? " (in parallel)..." : "...") << endl;
+			std::chrono::steady_clock::time_point setupStartTime = std::chrono::steady_clock::now();
+			if (c_parallelCameraSetup == true)
+			{
+				std::vector<std::thread> setupThreads;
+				for (int i = 0; i < c_numCameras; i++)
+					setupThreads.push_back(std::thread(BringUpCamera, i));
+				for (size_t i = 0; i < setupThreads.size(); i++)
+					setupThreads[i].join();
+			}
+			else
+			{
+				for (int i = 0; i < c_numCameras; i++)
+					BringUpCamera(i);
+			}
+			double setupTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - setupStartTime).count();
+
+			std::string setupErrorMessage = "";
+			for (int i = 0; i < c_numCameras; i++)
+			{
+				cout << c_cameras[i].name << " configured in " << configurationTimes[i] << " s (" << configurationStatistics[i].writes << " parameters written, " << configurationStatistics[i].writesSkipped << " already had the value)" << endl;
+				if (configurationErrors[i] != "")
+					setupErrorMessage.append(std::string("Configuring the ") + c_cameras[i].name + " failed: " + configurationErrors[i] + "\n");
+			}
+			cout << "All cameras configured in " << setupTime << " s" << endl;
+			if (setupErrorMessage != "")
+				throw std::runtime_error(setupErrorMessage);
+
+			// Synchronize the camera clocks using PTP if desired
+			if (c_usingPTP == true)
+			{
+				// configure IEEE1588 (PTP)
+				cout << endl << "Enabling the IEEE1588 PTP Feature on all cameras..." << endl;
+
+				// enable IEEE1588 (PTP)
+				for (int i = 0; i < c_numCameras; i++)
+					cameras[i]->GevIEEE1588.SetValue(true);
+
+				// We need to wait some time to let the PTP mechanism synchronize the clocks, but only until their offsets have settled.
+				cout << "Waiting for clock synchronization (at most " << c_ptpTimeout << " seconds)..." << endl;
+				PtpMonitor::CameraClockSource<Camera_t> clockSource;
+				for (int i = 0; i < c_numCameras; i++)
+					clockSource.AddCamera(*cameras[i], c_cameras[i].name);
+
+				PtpMonitor::ConvergenceMonitor ptpMonitor;
+				ptpMonitor.SetOffsetThreshold(c_ptpOffsetThreshold);
+				ptpMonitor.SetRequiredSamples(c_ptpRequiredSamples);
+				ptpMonitor.SetPollInterval(c_ptpPollInterval);
+				ptpMonitor.SetTimeout(c_ptpTimeout);
+				ptpMonitor.SetSampleCallback([&](int sampleIndex, const std::vector<PtpMonitor::ClockSample> &samples)
+				{
+					cout << "Sample " << sampleIndex + 1 << ":" << endl;
+					for (size_t i = 0; i < samples.size(); i++)
+						cout << c_cameras[i].name << " Status : " << std::setw(8) << samples[i].status << ". Offset from Master: " << samples[i].offsetFromMaster << endl;
+				});
+
+				PtpMonitor::ConvergenceResult ptpResult;
+				std::string ptpErrorMessage = "";
+				if (ptpMonitor.WaitForConvergence(clockSource, ptpResult, ptpErrorMessage) != 0)
+					throw std::runtime_error(ptpErrorMessage);
+
+				if (ptpResult.converged == true)
+					cout << "Clocks synchronized after " << ptpResult.seconds << " s (" << ptpResult.numSamples << " samples, max offset " << ptpResult.maxOffset << " ns)." << endl;
+				else
+				{
+					std::string ptpWarning = "Clocks did not synchronize within " + std::to_string(c_ptpTimeout) + " s (max offset " + std::to_string(ptpResult.maxOffset) + " ns).";
+					if (c_ptpRequireConvergence == true)
+						throw std::runtime_error(ptpWarning);
+					cout << "WARNING: " << ptpWarning << " Continuing anyway." << endl;
+				}
+			}
+
+			// Plan the GigE transmission settings of all cameras together, since cameras sharing a link have to share its bandwidth.
+			// (after enabling PTP, because that changes the timestamp tick frequency, the unit of the delays)
+			if (c_usingBandwidthPlanner == true)
+			{
+				std::vector<BandwidthPlanner::CameraStream> streams(c_numCameras);
+				for (int i = 0; i < c_numCameras; i++)
+				{
+					streams[i].name = c_cameras[i].name;
+					streams[i].width = (int)cameras[i]->Width.GetValue();
+					streams[i].height = (int)cameras[i]->Height.GetValue();
+					streams[i].bitsPerPixel = BitPerPixel(CPixelTypeMapper::GetPylonPixelTypeByName(cameras[i]->PixelFormat.ToString()));
+					streams[i].frameRate = c_frameRate;
+					streams[i].linkSpeed = cameras[i]->GevLinkSpeed.GetValue();
+					streams[i].link = c_cameras[i].link;
+					streams[i].maxPacketSize = c_cameras[i].packetSize;
+					streams[i].tickFrequency = cameras[i]->GevTimestampTickFrequency.GetValue();
+				}
+
+				BandwidthPlanner::PlannerOptions plannerOptions;
+				plannerOptions.targetUtilization = c_targetLinkUtilization;
+				plannerOptions.synchronizedCameras = c_usingPTP; // only with synchronized clocks do the cameras expose on the same tick
+
+				BandwidthPlanner::BandwidthPlan bandwidthPlan;
+				std::string plannerErrorMessage = "";
+				int plannerResult = BandwidthPlanner::PlanBandwidth(streams, plannerOptions, bandwidthPlan, plannerErrorMessage);
+				if (bandwidthPlan.links.empty() == false)
+					BandwidthPlanner::PrintBandwidthPlan(bandwidthPlan, cout);
+				if (plannerResult != 0)
+					throw std::runtime_error(plannerErrorMessage);
+
+				for (int i = 0; i < c_numCameras; i++)
+				{
+					cameras[i]->GevSCPSPacketSize.SetValue(bandwidthPlan.settings[i].packetSize); // Packet Size
+					cameras[i]->GevSCPD.SetValue(bandwidthPlan.settings[i].interpacketDelay); // Interpacket Delay
+					cameras[i]->GevSCFTD.SetValue(bandwidthPlan.settings[i].frameTransmissionDelay); // Frame Transmission Delay
+				}
+			}
+			// *************************************************************************************************
+		}
+
+		// *********************** SETUP THE FRAME SOURCES ***********************
+		// Everything after this only sees images with timestamps and framecounters, no matter where they come from.
+		cout << "Frame source: " << FrameSource::GetSourceTypeName(c_frameSource) << endl;
+		std::vector<std::unique_ptr<FrameSource::IFrameSource>> sources;
+		if (c_frameSource == FrameSource::SourceType_Pylon)
+		{
+			for (int i = 0; i < c_numCameras; i++)
+				sources.push_back(std::unique_ptr<FrameSource::IFrameSource>(new FrameSource::PylonSource<Camera_t, GrabResultPtr_t>(*cameras[i], c_cameras[i].name)));
+		}
+		else if (c_frameSource == FrameSource::SourceType_Synthetic)
+		{
+			EPixelType pixelType = CPixelTypeMapper::GetPylonPixelTypeByName(c_pixelFormat);
+			for (int i = 0; i < c_numCameras; i++)
+			{
+				FrameSource::SyntheticSource *pSource = new FrameSource::SyntheticSource(c_cameras[i].name, pixelType, c_width, c_height, c_frameRate, c_maxNumBuffer, i + 1);
+				sources.push_back(std::unique_ptr<FrameSource::IFrameSource>(pSource));
+				pSource->SetJitter(c_syntheticJitter);
+				pSource->SetOffset(c_syntheticSkew * i);
+				pSource->SetDropRate(c_syntheticDropRate);
+				pSource->SetRealTime(c_sourceRealTime);
+			}
+		}
+		else
+		{
+			// A raw recording holds the images of two cameras.
+			if (c_numCameras != 2)
+				throw std::runtime_error("Replaying a raw recording needs exactly two cameras in c_cameras");
+
+			for (int i = 0; i < c_numCameras; i++)
+			{
+				FrameSource::ReplaySource *pSource = new FrameSource::ReplaySource(c_cameras[i].name, c_rawFileName.c_str(), i);
+				sources.push_back(std::unique_ptr<FrameSource::IFrameSource>(pSource));
+				std::string errorMessage = "";
+				if (pSource->Open(errorMessage) != 0)
+					throw std::runtime_error(errorMessage);
+				pSource->SetRealTime(c_sourceRealTime);
 			}
 		}
-		// **************************************************************************
-
-		// *********************** SETUP THE HOST-SIDE GRAB ENGINE AND GRAB LOOP ***********************
-		// The Grab Engine receives data from the camera and fills buffers with it. It then provides Grab Results that are retrieved by the Grab Loop
-		cout << "Configuring the Left Camera's Pylon Grab Engine..." << endl;
-		// how many buffers should we use? Any image processing in the grab loop will take time, so use enough such that no images are dropped between RetrieveResult() calls
-		LeftCamera.MaxNumBuffer.SetValue(c_maxNumBuffer);
-		// allow pylon to queue up all the buffers if possible to enhance grabbing performance
-		LeftCamera.MaxNumQueuedBuffer.SetValue(c_maxNumQueuedBuffer);
-		cout << "Configuring the Right Camera's Pylon Grab Engine..." << endl;
-		RightCamera.MaxNumBuffer.SetValue(c_maxNumBuffer);
-		RightCamera.MaxNumQueuedBuffer.SetValue(c_maxNumQueuedBuffer);
-
-		// The Grab Loop will retrieve Grab Results and uses smart pointers to access the image and information inside them.
-		// The smart pointer holds information about the result (pass/fail), about the image (width/height), and is used to access the memory buffer containing the image.
-		GrabResultPtr_t ptrGrabResult_Left;
-		GrabResultPtr_t ptrGrabResult_Right;
-		// *********************************************************************************************
+
+		// The recorders need to know what the stitched images will look like: the cameras' images in one row, or in a grid c_stitchColumns wide.
+		const int stitchColumns = (c_stitchColumns > 0 && c_stitchColumns < c_numCameras) ? c_stitchColumns : c_numCameras;
+		const int stitchRows = (c_numCameras + stitchColumns - 1) / stitchColumns;
+		const uint32_t stitchedWidth = sources[0]->GetWidth() * stitchColumns;
+		const uint32_t stitchedHeight = sources[0]->GetHeight() * stitchRows;
+		const EPixelType sourcePixelType = sources[0]->GetPixelType();
+		// ***********************************************************************
 		
 		// *********************** SETUP THE VIDEO RECORDERS ***********************
 		// MP4 RECORDING SETUP
@@ -240,8 +513,8 @@ int main(int argc, char* argv[])
 			if (!CVideoWriter::IsSupported())
 			{
 				std::cout << "VideoWriter is not supported at the moment. Please install the pylon Supplementary Package for MPEG-4 which is available on the Basler website." << endl;
-				LeftCamera.Close();
-				RightCamera.Close();
+				for (size_t i = 0; i < cameras.size(); i++)
+					cameras[i]->Close();
 				// Releases all pylon resources. 
 				PylonTerminate();
 				// Return with error code 1.
@@ -250,16 +523,11 @@ int main(int argc, char* argv[])
 
 			cout << "We will record the images on-the-fly to an .mp4 video (Display is disabled to increase performance)" << endl;
 
-			// Map the pixelType
-			CEnumParameter pixelFormat(LeftCamera.GetNodeMap(), "PixelFormat");
-			CPixelTypeMapper pixelTypeMapper(&pixelFormat);
-			EPixelType videoPixelType = pixelTypeMapper.GetPylonPixelTypeFromNodeValue(pixelFormat.GetIntValue());
-
 			// Set parameters before opening the video writer.
 			videoWriter.SetParameter(
-				(uint32_t)c_width * 2,
-				(uint32_t)c_height,
-				videoPixelType,
+				stitchedWidth,
+				stitchedHeight,
+				sourcePixelType,
 				c_playBackFrameRate,
 				c_imageQuality);
 
@@ -273,11 +541,6 @@ int main(int argc, char* argv[])
 		CAviWriter aviWriter;
 		if (c_recordingToAvi == true)
 		{
-			// Map the pixelType
-			CEnumParameter pixelFormat(LeftCamera.GetNodeMap(), "PixelFormat");
-			CPixelTypeMapper pixelTypeMapper(&pixelFormat);
-			EPixelType videoPixelType = pixelTypeMapper.GetPylonPixelTypeFromNodeValue(pixelFormat.GetIntValue());
-
 			// Optionally set up compression options.
 			SAviCompressionOptions* pCompressionOptions = NULL;
 			// Uncomment the two code lines below to enable AVI compression.
@@ -289,9 +552,9 @@ int main(int argc, char* argv[])
 			aviWriter.Open(
 				c_aviFileName,
 				c_playBackFrameRate,
-				videoPixelType,
-				(uint32_t)c_width * 2,
-				(uint32_t)c_height,
+				sourcePixelType,
+				stitchedWidth,
+				stitchedHeight,
 				ImageOrientation_BottomUp, // Some compression codecs will not work with top down oriented images.
 				pCompressionOptions);
 		}
@@ -301,155 +564,1065 @@ int main(int argc, char* argv[])
 		// we will need to convert the image from the camera to BGR format for use in OpenCV
 		CImageFormatConverter FormatConverter;
 		cv::VideoWriter cvVideoCreator;
+
+		// OpenCV uses BGR format for color. Mono images can stay gray (JPEG and the .avi hold single channel frames just as well), which leaves a third of the bytes to convert and encode.
+		// Only PNG frames can hold more than 8 bits, and only our own .avi writer writes them.
+		EPixelType recordingPixelType = PixelType_BGR8packed;
+		if (c_recordingMonoAsGray == true && IsMono(sourcePixelType) == true)
+			recordingPixelType = (c_recording16BitMono == true && c_usingParallelMjpeg == true && BitPerPixel(sourcePixelType) > 8) ? PixelType_Mono16 : PixelType_Mono8;
+
+		// An OpenCV Mat around a converted image (no copy)
+		auto ToMat = [](CPylonImage &image) -> cv::Mat
+		{
+			int type = CV_8UC3;
+			if (image.GetPixelType() == PixelType_Mono8)
+				type = CV_8UC1;
+			else if (image.GetPixelType() == PixelType_Mono16)
+				type = CV_16UC1;
+			return cv::Mat(image.GetHeight(), image.GetWidth(), type, (uint8_t*)image.GetBuffer());
+		};
+
+		// MJPEG frames don't depend on each other, so they can be encoded on all cores at once. The stitched images are encoded with OpenCV and written in order.
+		MjpegAviWriter::ParallelWriter<CPylonImage> mjpegWriter([&](CPylonImage &image, std::vector<uint8_t> &jpeg)
+		{
+			bool encoded = false;
+			if (image.GetPixelType() == PixelType_Mono16)
+				encoded = cv::imencode(".png", ToMat(image), jpeg); // lossless, and JPEG can't hold 16 bits
+			else
+			{
+				std::vector<int> parameters = { cv::IMWRITE_JPEG_QUALITY, (int)c_imageQuality };
+				encoded = cv::imencode(".jpg", ToMat(image), jpeg, parameters);
+			}
+			if (encoded == false)
+				throw std::runtime_error("cv::imencode() failed");
+		});
 		if (c_recordingToAvi == true)
 		{
+			if (c_usingParallelMjpeg == true)
+			{
+				MjpegAviWriter::FrameFormat format;
+				format.width = stitchedWidth;
+				format.height = stitchedHeight;
+				format.bitsPerPixel = (uint16_t)BitPerPixel(recordingPixelType);
+				format.codec = (recordingPixelType == PixelType_Mono16) ? "MPNG" : "MJPG";
+				format.frameRate = c_playBackFrameRate;
+
+				std::string errorMessage = "";
+				if (mjpegWriter.Open(c_aviFileName.c_str(), format, c_mjpegEncodingThreads, c_mjpegQueueSize, errorMessage) != 0)
+					throw std::runtime_error(errorMessage);
+				cout << "Encoding the .avi video (" << format.codec << ", " << CPixelTypeMapper::GetNameByPixelType(recordingPixelType) << ") on " << mjpegWriter.GetNumWorkers() << " threads" << endl;
+			}
+			else
+			{
+				// we need to know the width and height of the image we will write 
+				cv::Size frameSize = cv::Size(stitchedWidth, stitchedHeight);
 
-			// we need to know the width and height of the image we will write 
-			int stitchedWidth = c_width * 2;
-			cv::Size frameSize = cv::Size(stitchedWidth, c_height);
+				// there are various compression options defined by the FourCC code. Consult OpenCV docs for more info
+				cvVideoCreator.open(c_aviFileName.c_str(), CV_FOURCC('M', 'J', 'P', 'G'), c_frameRate, frameSize, recordingPixelType == PixelType_BGR8packed); // MJPG
+			}
 
-			// there are various compression options defined by the FourCC code. Consult OpenCV docs for more info
-			cvVideoCreator.open(c_aviFileName.c_str(), CV_FOURCC('M', 'J', 'P', 'G'), c_frameRate, frameSize, true); // MJPG
-			
-			// OpenCV uses BGR format
-			FormatConverter.OutputPixelFormat = PixelType_BGR8packed;
+			FormatConverter.OutputPixelFormat = recordingPixelType;
+			FormatConverter.OutputBitAlignment = OutputBitAlignment_MsbAligned; // 12 bit images fill the 16 bit range, so they aren't nearly black when viewed
 		}
 #endif
+
+		// RAW RECORDING SETUP
+		RawStereoFile::Writer rawWriter;
+		if (c_recordingToRaw == true && c_frameSource == FrameSource::SourceType_Replay)
+			cout << "Not recording raw images, as they are being replayed from " << c_rawFileName << endl;
+		else if (c_recordingToRaw == true && c_numCameras != 2)
+			cout << "Not recording raw images, as a raw recording holds the images of exactly two cameras" << endl;
+		else if (c_recordingToRaw == true)
+		{
+			std::string errorMessage = "";
+			if (rawWriter.Open(c_rawFileName.c_str(), c_rawPreallocationSize, errorMessage) != 0)
+				cout << errorMessage << endl;
+			else
+				cout << "We will also record the raw images to " << c_rawFileName << endl;
+		}
 		// *************************************************************************
 		
 		
-		// *********************** START THE GRAB ENGINE AND PHYSICAL CAMERA IMAGE ACQUISITION ***********************
-		// TIP: At this point, we turn on the camera's trigger mode to prevent image acquisition while we call StartGrabbing();
-		//      This is because StartGrabbing() allocates the memory buffers, configures the grab engine, and then calls AcquisitionStart() on the camera hardware.
-		//      The allocation & setup can take a moment, so in some cases the cameras start Acquiring images at slightly different times (even if using PTP for clock sync).
-		//      Even though the subsequent calls to turn off the trigger modes and "release" the cameras are also sequential, they are closer in time than sequential calls to StartGrabbing(). 
-		LeftCamera.TriggerMode.SetValue(TriggerMode_On);
-		RightCamera.TriggerMode.SetValue(TriggerMode_On);
+		// *********************** SETUP THE TELEMETRY ***********************
+		// How long each stage takes for each frame, and how late the images arrive, is recorded in histograms (in ns).
+		// The camera-to-host latency compares each image's ChunkTimestamp with the time it was retrieved.
+		std::vector<Telemetry::LatencyHistogram> retrieveTimes(c_numCameras); // waiting in RetrieveResult(), per camera
+		std::vector<Telemetry::CameraLatency> cameraLatencies(c_numCameras);
+		Telemetry::LatencyHistogram stitchTimes;
+		Telemetry::LatencyHistogram convertTimes;
+		Telemetry::LatencyHistogram recordTimes; // encoding and writing
+		Telemetry::LatencyHistogram displayTimes; // handing the image to the preview (or printing its framecounters and timestamps)
+		Telemetry::LatencyHistogram previewTimes; // downscaling and showing it, on the preview thread
+		if (c_frameSource == FrameSource::SourceType_Pylon && c_usingPTP == false)
+		{
+			// without PTP, the timestamps count ticks of the camera's own clock
+			for (int i = 0; i < c_numCameras; i++)
+				cameraLatencies[i].SetTickFrequency(cameras[i]->GevTimestampTickFrequency.GetValue());
+		}
 
-		cout << "Starting the Pylon Grab Engines..." << endl;
-		LeftCamera.StartGrabbing(c_imagesToGrab);
-		RightCamera.StartGrabbing(c_imagesToGrab);
+		// The skew of every camera's timestamps from the first camera's, and every camera's frame period, are followed set by set.
+		std::vector<std::string> cameraNames;
+		for (int i = 0; i < c_numCameras; i++)
+			cameraNames.push_back(c_cameras[i].name);
+		SyncAnalytics::SyncMonitor syncMonitor(cameraNames);
+		syncMonitor.SetSynchronizedClocks(c_usingPTP);
+		if (c_frameSource == FrameSource::SourceType_Pylon && c_usingPTP == false)
+			syncMonitor.SetTickFrequency(cameras[0]->GevTimestampTickFrequency.GetValue());
+		syncMonitor.SetExpectedFrameRate(c_frameRate);
+		syncMonitor.SetSkewThreshold(c_usingPTP ? c_syncSkewAlarm : 0);
+		syncMonitor.SetDriftThreshold(c_syncDriftAlarm);
+		syncMonitor.SetStepThreshold(c_syncStepThreshold);
+		syncMonitor.SetPeriodTolerance(c_syncPeriodTolerance);
+		syncMonitor.SetAlarmCallback([&](const SyncAnalytics::Alarm &alarm)
+		{
+			cout << "Warning! Sync " << SyncAnalytics::GetAlarmTypeName(alarm.type) << ": " << alarm.message << endl;
+		});
+		std::vector<int64_t> syncTimestamps(c_numCameras);
+		std::vector<int64_t> syncFrameCounters(c_numCameras);
 
-		// Pylon's Grab Engine is now ready to receive incoming images...
+		Telemetry::Reporter telemetry;
+		for (int i = 0; i < c_numCameras; i++)
+			telemetry.Add(std::string("Retrieve ") + c_cameras[i].name, retrieveTimes[i]);
+		for (int i = 0; i < c_numCameras; i++)
+			telemetry.Add(std::string("Latency ") + c_cameras[i].name, cameraLatencies[i]);
+		telemetry.Add("Stitch", stitchTimes);
+		telemetry.Add("Convert", convertTimes);
+		telemetry.Add("Record", recordTimes);
+		telemetry.Add("Display", displayTimes);
+		telemetry.Add("Preview", previewTimes);
+		if (c_usingSyncAnalytics == true)
+		{
+			for (int i = 1; i < c_numCameras; i++)
+				telemetry.Add(std::string("Skew ") + c_cameras[i].name, syncMonitor.GetSkewHistogram(i));
+			for (int i = 0; i < c_numCameras; i++)
+				telemetry.Add(std::string("Period ") + c_cameras[i].name, syncMonitor.GetPeriodHistogram(i));
+		}
+		if (c_telemetryFileName != "")
+		{
+			std::string errorMessage = "";
+			if (telemetry.Open(c_telemetryFileName.c_str(), c_telemetryReportInterval, errorMessage) != 0)
+				cout << errorMessage << endl;
+			else
+				cout << "Writing the stage timings to " << c_telemetryFileName << " every " << c_telemetryReportInterval << " seconds" << endl;
+		}
+
+		// The metadata of every image goes to the journal, where writing it costs a copy into a queue instead of a (flushed) line on the console.
+		MetadataJournal::Writer journal(c_journalQueueSize);
+		if (c_journalFileName != "")
+		{
+			std::string errorMessage = "";
+			if (journal.Open(c_journalFileName.c_str(), c_journalPreallocation, errorMessage) != 0)
+				cout << errorMessage << endl;
+			else
+				cout << "Writing the metadata of every image to " << c_journalFileName << endl;
+		}
 
-		cout << "Releasing the Cameras to start Free-Running Acquisition..." << endl;
-		LeftCamera.TriggerMode.SetValue(TriggerMode_Off);
-		RightCamera.TriggerMode.SetValue(TriggerMode_Off);
+		// Called from the Grab Loop. The histograms are written to by the stage threads, but reading them from here is safe.
+		auto ReportTelemetry = [&]()
+		{
+			if (telemetry.IsReportDue() == false)
+				return;
+			if (c_usingSyncAnalytics == true)
+				syncMonitor.Report(cout);
+			std::string errorMessage = "";
+			if (telemetry.Report(errorMessage) != 0)
+				cout << errorMessage << endl;
+		};
+		// *******************************************************************
 
-		cout << "Cameras are now Acquiring and Transmitting images to the Pylon Grab Engines..." << endl;
-		// ***********************************************************************************************************
+		// *********************** DEFINE THE PROCESSING STAGES ***********************
+		// Each stereo frame goes through the same stages: Grab -> Stitch -> Convert -> Write (record and/or display).
+		// Without the pipeline, the Grab Loop calls them one after the other. With the pipeline, each stage runs on its own thread.
 
-		// *********************** RUN A GRAB LOOP TO RETRIEVE GRAB RESULTS FROM GRAB ENGINE ***********************
-		// Here we retrieve grabbed images and process them.
-		cout << "Running the \"Grab Loop\" to Retrieve and process images from the Grab Engines..." << endl;
-		cout << "We will grab " << c_imagesToGrab << " images..." << endl;
+		// The images of the cameras are grouped by their ChunkTimestamps (or ChunkFramecounters without PTP) rather than by the order they were retrieved in.
+		// That way, a frame dropped or incompletely grabbed by one camera only costs that one set, instead of shifting all of the following sets.
+		FrameMatcher::SetMatcher<CPylonImage> frameMatcher(c_numCameras);
+		frameMatcher.SetMatchMode(c_usingPTP ? FrameMatcher::MatchMode_Timestamp : FrameMatcher::MatchMode_FrameCounter);
+		frameMatcher.SetTolerance(c_usingPTP ? c_pairingTolerance : 0);
+		frameMatcher.SetMaxPending(c_pairingMaxPending);
+
+		// Wait for an image from one camera and then retrieve it. A timeout of 5000 ms is used.
+		// The ChunkTimestamps of the first image of each camera show how closely the cameras started together (only comparable when the clocks are synchronized).
+		const bool usingScheduledStart = (c_frameSource == FrameSource::SourceType_Pylon && c_usingPTP == true && c_usingScheduledStart == true);
+		int64_t scheduledStartTime = 0; // set when the start is scheduled
+		std::vector<int64_t> firstTimestamps(c_numCameras, 0);
+		std::vector<bool> haveFirstTimestamp(c_numCameras, false);
+		int numFirstTimestamps = 0;
+		auto RecordFirstTimestamp = [&](int cameraIndex, int64_t timestamp)
+		{
+			firstTimestamps[cameraIndex] = timestamp;
+			haveFirstTimestamp[cameraIndex] = true;
+			numFirstTimestamps++;
+			if (numFirstTimestamps < c_numCameras || frameMatcher.GetMatchMode() != FrameMatcher::MatchMode_Timestamp)
+				return;
+
+			int64_t earliest = *std::min_element(firstTimestamps.begin(), firstTimestamps.end());
+			int64_t latest = *std::max_element(firstTimestamps.begin(), firstTimestamps.end());
+			cout << "Start skew between the cameras' first images: " << latest - earliest << " ticks";
+			if (usingScheduledStart == true)
+				cout << " (first exposure " << earliest - scheduledStartTime << " ns after the scheduled start)";
+			cout << endl;
+			if (latest - earliest > c_pairingTolerance)
+				cout << "WARNING: The cameras started further apart than the pairing tolerance. Their first images will not be matched." << endl;
+		};
+
+		// Retrieve the next image of one camera. Only touches that camera's histogram and the (thread safe) journal, so the cameras can be retrieved on threads of their own.
+		auto RetrieveFrame = [&](FrameSource::IFrameSource &source, int cameraIndex, RetrievedFrame &retrieved)
+		{
+			int64_t startTime = Telemetry::GetHostTime();
+			retrieved.result = source.RetrieveFrame(5000, retrieved.sourceFrame, retrieved.errorMessage);
+			retrieved.retrieveTime = Telemetry::GetHostTime();
+			retrieveTimes[cameraIndex].Record(retrieved.retrieveTime - startTime);
+
+			if (journal.IsOpen() == true)
+			{
+				MetadataJournal::Record record;
+				record.cameraIndex = (uint32_t)cameraIndex;
+				record.frameCounter = retrieved.sourceFrame.frameCounter;
+				record.timestamp = retrieved.sourceFrame.timestamp;
+				record.hostTime = retrieved.retrieveTime;
+				record.status = (retrieved.result == 0) ? MetadataJournal::GrabStatus_Grabbed : MetadataJournal::GrabStatus_Failed;
+				record.errorCode = retrieved.sourceFrame.errorCode;
+				journal.Add(record); // a dropped record is counted by the journal
+			}
+		};
+
+		// Hand a retrieved image to the pairing. Called from the Grab Loop only.
+		auto AcceptFrame = [&](int cameraIndex, RetrievedFrame &retrieved)
+		{
+			if (retrieved.result == 0)
+			{
+				cameraLatencies[cameraIndex].Record(retrieved.retrieveTime, retrieved.sourceFrame.timestamp);
+				if (haveFirstTimestamp[cameraIndex] == false)
+					RecordFirstTimestamp(cameraIndex, retrieved.sourceFrame.timestamp);
+				frameMatcher.Push(cameraIndex, retrieved.sourceFrame.image, retrieved.sourceFrame.timestamp, retrieved.sourceFrame.frameCounter);
+			}
+			else
+				cout << retrieved.errorMessage << endl;
+		};
+
+		auto RetrieveFromSource = [&](FrameSource::IFrameSource &source, int cameraIndex)
+		{
+			RetrievedFrame retrieved;
+			RetrieveFrame(source, cameraIndex, retrieved);
+			AcceptFrame(cameraIndex, retrieved);
+		};
+
+		// With c_usingRetrievalThreads, each camera's images are retrieved on a thread of its own and wait in that camera's queue until the Grab Loop pairs them.
+		// A camera that is slow to deliver (or times out) only holds up its own thread: the images of the other cameras are retrieved as they arrive.
+		const bool usingRetrievalThreads = c_usingRetrievalThreads;
+		std::vector<std::unique_ptr<Pipeline::SpscQueue<RetrievedFrame>>> retrievalQueues;
+		std::vector<std::thread> retrievalThreads;
+		std::vector<std::string> retrievalErrors(c_numCameras);
+		int retrievalBackoff = 0; // how long the Grab Loop has been waiting for images (see Pipeline::Backoff())
+
+		// Runs on a camera's retrieval thread until the camera has delivered all of its images, or the queue is closed by the Grab Loop.
+		// An exception (eg: a RetrieveResult() timeout) ends the thread, and is thrown again in the Grab Loop.
+		auto RetrievalLoop = [&](int cameraIndex)
+		{
+			Pipeline::SpscQueue<RetrievedFrame> &queue = *retrievalQueues[cameraIndex];
+			try
+			{
+				while (queue.IsClosed() == false && sources[cameraIndex]->IsGrabbing() == true)
+				{
+					RetrievedFrame retrieved;
+					RetrieveFrame(*sources[cameraIndex], cameraIndex, retrieved);
+					if (queue.Push(retrieved) == false)
+						break; // the Grab Loop has stopped
+				}
+			}
+			catch (const GenericException &e)
+			{
+				retrievalErrors[cameraIndex] = std::string(c_cameras[cameraIndex].name) + ": " + e.GetDescription();
+			}
+			catch (std::exception &e)
+			{
+				retrievalErrors[cameraIndex] = std::string(c_cameras[cameraIndex].name) + ": " + e.what();
+			}
+			catch (...)
+			{
+				retrievalErrors[cameraIndex] = std::string(c_cameras[cameraIndex].name) + ": UNKNOWN exception";
+			}
+			queue.Close(); // no more images from this camera
+		};
+
+		auto StartRetrievalThreads = [&]()
+		{
+			for (int i = 0; i < c_numCameras; i++)
+				retrievalQueues.push_back(std::unique_ptr<Pipeline::SpscQueue<RetrievedFrame>>(new Pipeline::SpscQueue<RetrievedFrame>(c_retrievalQueueSize)));
+			for (int i = 0; i < c_numCameras; i++)
+				retrievalThreads.push_back(std::thread(RetrievalLoop, i));
+		};
+
+		// A thread waiting for an image finishes its RetrieveFrame() call (up to the timeout) before it notices.
+		auto StopRetrievalThreads = [&]()
+		{
+			for (size_t i = 0; i < retrievalQueues.size(); i++)
+				retrievalQueues[i]->Close();
+			for (size_t i = 0; i < retrievalThreads.size(); i++)
+				retrievalThreads[i].join();
+			retrievalThreads.clear();
+		};
+
+		// A camera's thread has ended once its queue is closed, and the Grab Loop has taken everything in it.
+		auto RetrievalThreadsRunning = [&]() -> bool
+		{
+			for (size_t i = 0; i < retrievalQueues.size(); i++)
+			{
+				if (retrievalQueues[i]->IsClosed() == true && retrievalQueues[i]->GetSize() == 0)
+				{
+					if (retrievalErrors[i] != "")
+						throw std::runtime_error(retrievalErrors[i]);
+					return false;
+				}
+			}
+			return true;
+		};
+
+		// Grab: put the next set of images (one per camera) in frame. Returns false if there is no complete set yet.
+		auto GrabStage = [&](FrameSet &frame) -> bool
+		{
+			uint64_t orphans = frameMatcher.GetTotalOrphanCount();
+
+			bool haveSet = frameMatcher.TryGetSet(frame.cameraFrames);
+			if (haveSet == false && usingRetrievalThreads == true)
+			{
+				// take whatever the retrieval threads have delivered so far, without waiting for any one camera
+				bool gotFrame = false;
+				for (int i = 0; i < c_numCameras; i++)
+				{
+					RetrievedFrame retrieved;
+					while (retrievalQueues[i]->TryPop(retrieved) == true)
+					{
+						AcceptFrame(i, retrieved);
+						gotFrame = true;
+					}
+				}
+				haveSet = frameMatcher.TryGetSet(frame.cameraFrames);
+
+				if (gotFrame == true)
+					retrievalBackoff = 0;
+				else
+					Pipeline::Backoff(retrievalBackoff);
+			}
+			else if (haveSet == false)
+			{
+				for (int i = 0; i < c_numCameras; i++)
+					RetrieveFromSource(*sources[i], i);
+				haveSet = frameMatcher.TryGetSet(frame.cameraFrames);
+			}
+
+			if (haveSet == true && c_usingSyncAnalytics == true)
+			{
+				for (int i = 0; i < c_numCameras; i++)
+				{
+					syncTimestamps[i] = frame.cameraFrames[i].timestamp;
+					syncFrameCounters[i] = frame.cameraFrames[i].frameCounter;
+				}
+				syncMonitor.AddSet(syncTimestamps, syncFrameCounters);
+			}
+
+			if (frameMatcher.GetTotalOrphanCount() != orphans)
+			{
+				cout << "Warning! Discarded frame(s) without a partner. Orphaned frames so far:";
+				for (int i = 0; i < c_numCameras; i++)
+					cout << " " << c_cameras[i].name << ": " << frameMatcher.GetOrphanCount(i);
+				cout << endl;
+			}
+
+			// If we have a set, we have a good image from each camera, and they belong together
+			return haveSet;
+		};
+
+		// Since image processing takes time, we could build up a backlog of images in the Grab Engines if processing framerate is slower than camera framerate.
+		// The health monitor samples the Grab Engines (and the stream grabber statistics) on its own thread and warns when buffers run out or images and packets get lost,
+		// so the Grab Loop doesn't have to read any camera parameters.
+		GrabHealth::CameraStatisticsSource<Camera_t> healthSource;
+		for (size_t i = 0; i < cameras.size(); i++)
+			healthSource.AddCamera(*cameras[i], c_cameras[i].name);
+		GrabHealth::HealthMonitor healthMonitor;
+		healthMonitor.SetPollInterval(c_healthPollInterval);
+		healthMonitor.SetWindowSize(c_healthWindow);
+		healthMonitor.SetAlertCallback([&](const GrabHealth::Alert &alert)
+		{
+			cout << "Warning! " << GrabHealth::GetAlertTypeName(alert.type) << ": " << alert.message << endl;
+		});
+
+		// The stitched and converted images are passed on to the next stages while the next frames are being stitched and converted.
+		// Taking them from pools means their buffers get reused once the later stages are done with them, instead of allocating new ones for every frame.
+		// Each pool is only taken from by one stage: the fused Stitch + Convert has its own, as it runs on the Stitch thread while the Convert stage runs on another.
+		// (every stage can hold one frame, plus the frames waiting in the queues between the stages and in the recording queue)
+		const int imagesInFlight = (c_usingPipeline ? 2 * c_pipelineQueueSize + 4 : 2) + (c_usingAsyncRecording ? c_recordingQueueSize + 1 : 0) + (c_usingParallelMjpeg ? c_mjpegQueueSize : 0) + (c_usingPreview ? 2 : 0);
+		StitchImage::ImagePool stitchedImagePool(imagesInFlight);
+		StitchImage::ImagePool convertedImagePool(imagesInFlight);
+		StitchImage::ImagePool fusedImagePool(imagesInFlight);
+		std::string stitchErrorMessage = "";
+
+		// Checks once that stitching a packed pixel format (eg: Mono12p) gives the same pixel values as pylon's own image format converter:
+		// two images stitched side by side in the packed format are converted by pylon, and compared to the same images stitched and unpacked by our own kernels.
+		bool packedStitchingValidated = false;
+		auto ValidatePackedStitching = [&](CPylonImage &leftImage, CPylonImage &rightImage)
+		{
+			packedStitchingValidated = true;
+
+			CPylonImage stitchedImage;
+			CPylonImage unpackedImage;
+			std::string errorMessage = "";
+			if (StitchImage::StitchToRight(leftImage, rightImage, &stitchedImage, errorMessage) != 0 || StitchImage::StitchToRightUnpacked(leftImage, rightImage, &unpackedImage, errorMessage) != 0)
+			{
+				cout << errorMessage << endl;
+				return;
+			}
+
+			CImageFormatConverter validationConverter;
+			validationConverter.OutputPixelFormat = PixelType_Mono16;
+			validationConverter.OutputBitAlignment = OutputBitAlignment_LsbAligned;
+			CPylonImage convertedImage;
+			validationConverter.Convert(convertedImage, stitchedImage);
 
-		while (LeftCamera.IsGrabbing() && RightCamera.IsGrabbing())
+			bool identical = (convertedImage.GetImageSize() == unpackedImage.GetImageSize()) && (memcmp(convertedImage.GetBuffer(), unpackedImage.GetBuffer(), unpackedImage.GetImageSize()) == 0);
+			if (identical == true)
+				cout << "Packed pixel format stitching matches pylon's image format converter." << endl;
+			else
+				cout << "Warning! Packed pixel format stitching does NOT match pylon's image format converter." << endl;
+		};
+
+		// Stitch: put the images side by side (or in a grid). The images are released afterwards to give their buffers back to the Grab Engines as early as possible
+		// (unless they are still needed for the raw recording).
+		std::vector<CPylonImage*> stitchInputs(c_numCameras); // only used by the Stitch stage
+		auto StitchStage = [&](FrameSet &frame) -> bool
 		{
-			// Wait for an image and then retrieve it. A timeout of 5000 ms is used.
-			// RetrieveResult calls the image event handler's OnImageGrabbed method.
-			LeftCamera.RetrieveResult(5000, ptrGrabResult_Left, TimeoutHandling_ThrowException);
-			RightCamera.RetrieveResult(5000, ptrGrabResult_Right, TimeoutHandling_ThrowException);
+			int64_t startTime = Telemetry::GetHostTime();
+			for (int i = 0; i < c_numCameras; i++)
+				stitchInputs[i] = &frame.cameraFrames[i].payload;
+
+			bool stitched = false;
+#ifdef PYLON_LINUX_BUILD
+			if (c_usingFusedStitchConvert == true && c_recordingToMp4 == false && c_recordingToAvi == true && recordingPixelType == PixelType_BGR8packed && stitchInputs[0]->GetPixelType() == PixelType_Mono8)
+			{
+				// Stitch and convert to BGR for OpenCV in one pass, which leaves nothing for the Convert stage to do.
+				CPylonImage &convertedImage = fusedImagePool.GetImage();
+				stitched = (StitchImage::StitchToGridAsBGR8(stitchInputs, stitchColumns, &convertedImage, stitchErrorMessage) == 0);
+				if (stitched == true)
+					frame.convertedImage = convertedImage;
+			}
+			else
+#endif
+			{
+				CPylonImage &stitchedImage = stitchedImagePool.GetImage();
+				stitched = (StitchImage::StitchToGrid(stitchInputs, stitchColumns, &stitchedImage, stitchErrorMessage) == 0);
+				if (stitched == true)
+					frame.stitchedImage = stitchedImage;
 
-			if (ptrGrabResult_Left->GrabSucceeded() && ptrGrabResult_Right->GrabSucceeded())
+				if (stitched == true && c_validatePackedStitching == true && packedStitchingValidated == false && c_numCameras >= 2 && IsPacked(stitchedImage.GetPixelType()) && IsMono(stitchedImage.GetPixelType()))
+					ValidatePackedStitching(*stitchInputs[0], *stitchInputs[1]);
+			}
+
+			if (stitched == false)
+				cout << stitchErrorMessage << endl;
+
+			if (rawWriter.IsOpen() == false)
+			{
+				for (int i = 0; i < c_numCameras; i++)
+					frame.cameraFrames[i].payload.Release();
+			}
+
+			stitchTimes.Record(Telemetry::GetHostTime() - startTime);
+			return stitched;
+		};
+
+		// Convert: only needed for OpenCV, which uses BGR format (or gray, see c_recordingMonoAsGray).
+		auto ConvertStage = [&](FrameSet &frame) -> bool
+		{
+#ifdef PYLON_LINUX_BUILD
+			if (c_recordingToMp4 == false && c_recordingToAvi == true && frame.convertedImage.IsValid() == false && frame.stitchedImage.GetPixelType() == recordingPixelType)
 			{
-				// We have a good image from each camera
+				// already in the recording format (eg: Mono8 recorded as gray), so there is nothing to convert
+				frame.convertedImage = frame.stitchedImage;
+			}
+			else if (c_recordingToMp4 == false && c_recordingToAvi == true && frame.convertedImage.IsValid() == false)
+			{
+				int64_t startTime = Telemetry::GetHostTime();
+				CPylonImage &convertedImage = convertedImagePool.GetImage();
+				FormatConverter.Convert(convertedImage, frame.stitchedImage);
+				frame.convertedImage = convertedImage;
+				convertTimes.Record(Telemetry::GetHostTime() - startTime);
+			}
+#endif
+			return true;
+		};
+
+		// The metadata of one camera's image in the raw file
+		auto GetRawFrameInfo = [](FrameMatcher::MatchedFrame<CPylonImage> &cameraFrame) -> RawStereoFile::FrameInfo
+		{
+			RawStereoFile::FrameInfo info;
+			info.size = cameraFrame.payload.GetImageSize();
+			info.timestamp = cameraFrame.timestamp;
+			info.frameCounter = cameraFrame.frameCounter;
+			info.pixelType = (uint32_t)cameraFrame.payload.GetPixelType();
+			info.width = cameraFrame.payload.GetWidth();
+			info.height = cameraFrame.payload.GetHeight();
+			info.paddingX = (uint32_t)cameraFrame.payload.GetPaddingX();
+			return info;
+		};
 
-				// Stitch the images side by side
-				CPylonImage leftImage;
-				CPylonImage rightImage;
-				CPylonImage stitchedImage;
+		// Record: add the raw images to the raw file (two cameras only), and add the stitched image to the .mp4 video or to the .avi video
+		auto RecordFrame = [&](FrameSet &frame)
+		{
+			int64_t startTime = Telemetry::GetHostTime();
+
+			if (rawWriter.IsOpen() == true && frame.cameraFrames.size() == 2 && frame.cameraFrames[0].payload.IsValid() && frame.cameraFrames[1].payload.IsValid())
+			{
+				FrameMatcher::MatchedFrame<CPylonImage> &leftFrame = frame.cameraFrames[0];
+				FrameMatcher::MatchedFrame<CPylonImage> &rightFrame = frame.cameraFrames[1];
 
-				leftImage.AttachGrabResultBuffer(ptrGrabResult_Left);
-				rightImage.AttachGrabResultBuffer(ptrGrabResult_Right);
-							
 				std::string errorMessage = "";
-				if (StitchImage::StitchToRight(leftImage, rightImage, &stitchedImage, errorMessage) != 0)
+				if (rawWriter.Add(leftFrame.payload.GetBuffer(), GetRawFrameInfo(leftFrame), rightFrame.payload.GetBuffer(), GetRawFrameInfo(rightFrame), errorMessage) != 0)
 					cout << errorMessage << endl;
 
-				// Either add them to the .mp4 video, add to a .avi video, or just display them
-				if (c_recordingToMp4 == true)
-				{
-					// Write the image to the mp4
-					videoWriter.Add(stitchedImage);
+				// Done with the Grab Engines' buffers.
+				leftFrame.payload.Release();
+				rightFrame.payload.Release();
+			}
+
+			if (c_recordingToMp4 == true)
+			{
+				// Write the image to the mp4
+				videoWriter.Add(frame.stitchedImage);
+			}
+			else if (c_recordingToAvi == true)
+			{
 #ifdef PYLON_WIN_BUILD
-					Pylon::DisplayImage(0, stitchedImage); // comment out to improve performance
+				// Write the image to the AVI
+				aviWriter.Add(frame.stitchedImage);
 #endif
 #ifdef PYLON_LINUX_BUILD
-					// There is no pylon image display in linux, so just cout the framecounters and timestamps of the images
-					// (or use opencv to display them, as below)
-					int64_t frameCounter_left = ptrGrabResult_Left->ChunkFramecounter.GetValue();
-					int64_t frameCounter_right = ptrGrabResult_Right->ChunkFramecounter.GetValue();
-					int64_t timestamp_left = ptrGrabResult_Left->ChunkTimestamp.GetValue();
-					int64_t timestamp_right = ptrGrabResult_Right->ChunkTimestamp.GetValue();
-
-					cout << "Left Camera  : FrameCounter: " << frameCounter_left << " TimeStamp: " << timestamp_left << endl;
-					cout << "Right Camera : FrameCounter: " << frameCounter_right << " TimeStamp: " << timestamp_right << endl;
-#endif
+				if (c_usingParallelMjpeg == true)
+				{
+					// Hand the image to the encoding threads (waits if they are all busy and the queue is full)
+					mjpegWriter.Add(frame.convertedImage);
 				}
-				else if (c_recordingToAvi == true)
+				else
 				{
-#ifdef PYLON_WIN_BUILD
+					// create an OpenCV Mat from the converted Pylon Image
+					cv::Mat cv_img = ToMat(frame.convertedImage);
 					// Write the image to the AVI
-					aviWriter.Add(stitchedImage);
-					// Display the image (comment out to improve performance)
-					Pylon::DisplayImage(0, stitchedImage);
+					cvVideoCreator.write(cv_img);
+				}
+#endif
+			}
+
+			recordTimes.Record(Telemetry::GetHostTime() - startTime);
+		};
+
+		// Encoding can take longer than a frame period every now and then (or the disk stalls), so the recording can run on its own thread behind a queue.
+		// When the queue is full, the drop policy decides whether to wait for the recorder or to skip frames in the video. Grabbing keeps up either way.
+		AsyncVideoWriter::FrameWriter<FrameSet> asyncRecorder(c_recordingQueueSize, c_recordingDropPolicy, RecordFrame);
+		if (c_usingAsyncRecording == true && (c_recordingToMp4 == true || c_recordingToAvi == true || rawWriter.IsOpen() == true))
+		{
+			std::string errorMessage = "";
+			if (asyncRecorder.Start(errorMessage) != 0)
+				cout << errorMessage << endl;
+			else
+				cout << "Recording on its own thread. Queue size: " << asyncRecorder.GetCapacity() << " Drop policy: " << AsyncVideoWriter::GetDropPolicyName(asyncRecorder.GetDropPolicy()) << endl;
+		}
+
+		// The preview gets the latest image from the Write stage, and downscales and shows it on its own thread (never more often than c_previewFrameRate).
+		// Images that arrive while it is busy replace each other, so a slow display only costs preview frames, never grabbed or recorded ones.
+		// Everything here runs on the preview thread, including the OpenCV window and its event loop.
+		CImageFormatConverter previewConverter;
+		CPylonImage previewConvertedImage;
+		CPylonImage previewImage;
+		PreviewDisplay::PreviewThread<CPylonImage> preview(c_previewFrameRate, [&](CPylonImage &image)
+		{
+			int64_t startTime = Telemetry::GetHostTime();
+
+			// The box filter works on 8 bit images, so anything else (eg: Mono12p on Windows, Mono16 when recording 16 bit) is converted first.
+			CPylonImage *pImage = &image;
+			if (image.GetPixelType() != PixelType_Mono8 && image.GetPixelType() != PixelType_BGR8packed)
+			{
+				previewConverter.OutputPixelFormat = IsMono(image.GetPixelType()) ? PixelType_Mono8 : PixelType_BGR8packed;
+				previewConverter.Convert(previewConvertedImage, image);
+				pImage = &previewConvertedImage;
+			}
+			if (c_previewDownscale > 1)
+			{
+				std::string errorMessage = "";
+				if (StitchImage::Downscale(*pImage, c_previewDownscale, &previewImage, errorMessage) != 0)
+					throw std::runtime_error(errorMessage);
+				pImage = &previewImage;
+			}
+
+#ifdef PYLON_WIN_BUILD
+			Pylon::DisplayImage(0, *pImage);
 #endif
 #ifdef PYLON_LINUX_BUILD
-					// OpenCV needs BGR format, so use pylon to convert the image.
-					CPylonImage ocvImage;
-					FormatConverter.Convert(ocvImage, stitchedImage);
-					// create an OpenCV Mat from the Pylon Image
-					cv::Mat cv_img = cv::Mat(ocvImage.GetHeight(), ocvImage.GetWidth(), CV_8UC3, (uint8_t*)ocvImage.GetBuffer());
-					// Write the image to the AVI
-					cvVideoCreator.write(cv_img); 
-					// Display the image (comment out to improve performance)
-					cv::imshow("window", cv_img);
-					cv::waitKey(1); // opencv needs this for display
+			cv::Mat cv_img = ToMat(*pImage);
+			cv::imshow("window", cv_img);
+			cv::waitKey(1); // opencv needs this for display
 #endif
-				}
-				else
-				{
+			previewTimes.Record(Telemetry::GetHostTime() - startTime);
+		});
+		if (c_usingPreview == true)
+		{
+			std::string errorMessage = "";
+			if (preview.Start(errorMessage) != 0)
+				cout << errorMessage << endl;
+			else
+				cout << "Previewing on its own thread at up to " << c_previewFrameRate << " fps" << (c_previewDownscale > 1 ? " (downscaled " + std::to_string(c_previewDownscale) + "x)" : std::string("")) << endl;
+		}
+
+		// There is no pylon image display in linux, so the framecounters and timestamps of the images can be printed instead (unless they are in the journal already)
+		auto PrintFrameSet = [&](FrameSet &frame)
+		{
+			if (journal.IsOpen() == true)
+				return;
+			for (size_t i = 0; i < frame.cameraFrames.size(); i++)
+				cout << c_cameras[i].name << " : FrameCounter: " << frame.cameraFrames[i].frameCounter << " TimeStamp: " << frame.cameraFrames[i].timestamp << endl;
+		};
+
+		// Hands the image to the preview thread. The preview gets its own reference to the image, so the frame keeps its images for recording.
+		auto OfferToPreview = [&](CPylonImage &image)
+		{
+			if (preview.IsRunning() == false || image.IsValid() == false)
+				return;
+			CPylonImage previewFrame = image;
+			preview.Offer(previewFrame);
+		};
+
+		// Write: display the image (or its framecounters and timestamps), and either record it right away or hand it to the recording thread
+		auto WriteStage = [&](FrameSet &frame) -> bool
+		{
+			int64_t startTime = Telemetry::GetHostTime();
+
+			if (c_recordingToMp4 == true)
+			{
+#ifdef PYLON_WIN_BUILD
+				OfferToPreview(frame.stitchedImage);
+#endif
+#ifdef PYLON_LINUX_BUILD
+				// There is no pylon image display in linux, so just cout the framecounters and timestamps of the images
+				// (or use opencv to display them, as below)
+				PrintFrameSet(frame);
+#endif
+			}
+			else if (c_recordingToAvi == true)
+			{
+#ifdef PYLON_WIN_BUILD
+				OfferToPreview(frame.stitchedImage);
+#endif
+#ifdef PYLON_LINUX_BUILD
+				// The converted image is already in a format OpenCV can show
+				OfferToPreview(frame.convertedImage);
+#endif
+			}
+			else
+			{
 #ifdef PYLON_WIN_BUILD
-					// Display the image
-					Pylon::DisplayImage(0, stitchedImage);
+				OfferToPreview(frame.stitchedImage);
+#endif
+#ifdef PYLON_LINUX_BUILD
+				// There is no pylon image display in linux, so just cout the framecounters and timestamps of the images
+				// (or use something like opencv to display them, as above)
+				PrintFrameSet(frame);
 #endif
+			}
+
+			displayTimes.Record(Telemetry::GetHostTime() - startTime);
+
+			if (c_recordingToMp4 == false && c_recordingToAvi == false && rawWriter.IsOpen() == false)
+				return true; // nothing to record
+
+			// The frame is moved into the recording queue, so this comes last.
+			if (asyncRecorder.IsRunning() == true)
+				asyncRecorder.Add(frame); // a dropped frame is counted by the recorder
+			else
+				RecordFrame(frame);
+			return true;
+		};
+		// *****************************************************************************
+
+		// *********************** SIZE THE GRAB ENGINE BUFFERS ***********************
+		// Every buffer is as large as an image, so a fixed number of them is either more memory than needed (large images) or too few to bridge a slow frame (small images).
+		// Instead, a warm-up stitches (and converts) synthetic images of the same size and format as fast as it can, before the cameras start,
+		// and the buffer planner works out how many buffers bridge c_bufferTargetStall (or the slowest warm-up frame) within c_bufferMemoryBudget.
+		// (recording isn't part of the warm-up: the recording queue bridges the encoder, and only holds stitched images)
+		if (c_usingAutoBufferSizing == true && c_frameSource == FrameSource::SourceType_Pylon)
+		{
+			cout << "Warming up: timing the processing of " << c_bufferWarmupFrames << " synthetic frame sets..." << endl;
+			std::vector<std::unique_ptr<FrameSource::SyntheticSource>> warmupSources;
+			for (int i = 0; i < c_numCameras; i++)
+			{
+				warmupSources.push_back(std::unique_ptr<FrameSource::SyntheticSource>(new FrameSource::SyntheticSource(c_cameras[i].name, sources[i]->GetPixelType(), sources[i]->GetWidth(), sources[i]->GetHeight(), c_frameRate, 2, i + 1)));
+				warmupSources[i]->SetRealTime(false);
+				std::string errorMessage = "";
+				if (warmupSources[i]->Start(c_bufferWarmupFrames, errorMessage) != 0)
+					throw std::runtime_error(errorMessage);
+			}
+
+			std::vector<CPylonImage> warmupImages(c_numCameras);
+			std::vector<CPylonImage*> warmupInputs(c_numCameras);
+			CPylonImage warmupStitchedImage;
+			CPylonImage warmupConvertedImage;
+			BufferPlanner::ServiceTimeEstimator serviceTimes;
+			for (int n = 0; n < c_bufferWarmupFrames; n++)
+			{
+				for (int i = 0; i < c_numCameras; i++)
+				{
+					FrameSource::SourceFrame sourceFrame;
+					std::string errorMessage = "";
+					if (warmupSources[i]->RetrieveFrame(5000, sourceFrame, errorMessage) != 0)
+						throw std::runtime_error(errorMessage);
+					warmupImages[i] = sourceFrame.image;
+					warmupInputs[i] = &warmupImages[i];
+				}
+
+				// the same work as the Stitch and Convert stages
+				std::string errorMessage = "";
+				int64_t startTime = Telemetry::GetHostTime();
+				bool converted = false;
 #ifdef PYLON_LINUX_BUILD
-					// There is no pylon image display in linux, so just cout the framecounters and timestamps of the images
-					// (or use something like opencv to display them, as above)
-					int64_t frameCounter_left = ptrGrabResult_Left->ChunkFramecounter.GetValue();
-					int64_t frameCounter_right = ptrGrabResult_Right->ChunkFramecounter.GetValue();
-					int64_t timestamp_left = ptrGrabResult_Left->ChunkTimestamp.GetValue();
-					int64_t timestamp_right = ptrGrabResult_Right->ChunkTimestamp.GetValue();
-
-					cout << "Left Camera  : FrameCounter: " << frameCounter_left << " TimeStamp: " << timestamp_left << endl;
-					cout << "Right Camera : FrameCounter: " << frameCounter_right << " TimeStamp: " << timestamp_right << endl;
+				if (c_usingFusedStitchConvert == true && c_recordingToMp4 == false && c_recordingToAvi == true && recordingPixelType == PixelType_BGR8packed && warmupInputs[0]->GetPixelType() == PixelType_Mono8)
+				{
+					if (StitchImage::StitchToGridAsBGR8(warmupInputs, stitchColumns, &warmupConvertedImage, errorMessage) != 0)
+						throw std::runtime_error(errorMessage);
+					converted = true;
+				}
+				else
 #endif
+				{
+					if (StitchImage::StitchToGrid(warmupInputs, stitchColumns, &warmupStitchedImage, errorMessage) != 0)
+						throw std::runtime_error(errorMessage);
 				}
+				int64_t stitchTime = Telemetry::GetHostTime();
+#ifdef PYLON_LINUX_BUILD
+				if (converted == false && c_recordingToMp4 == false && c_recordingToAvi == true && warmupStitchedImage.GetPixelType() != recordingPixelType)
+					FormatConverter.Convert(warmupConvertedImage, warmupStitchedImage);
+#endif
+				int64_t convertTime = Telemetry::GetHostTime();
+
+				// With the pipeline, Stitch and Convert work on different frames at the same time, so the slower of the two sets the pace.
+				int64_t serviceTime = c_usingPipeline ? std::max(stitchTime - startTime, convertTime - stitchTime) : convertTime - startTime;
+				serviceTimes.AddSample(serviceTime / 1e9);
+
+				for (int i = 0; i < c_numCameras; i++)
+					warmupImages[i].Release();
+			}
+
+			// The buffers of each camera that can't receive images anyway: the sets waiting in the pipeline queue (or being stitched), the images waiting to be paired (and for their partners),
+			// and with the raw recording, every set until it has been written.
+			int heldBuffers = (c_usingPipeline ? c_pipelineQueueSize + 2 : 1) + c_pairingMaxPending;
+			if (usingRetrievalThreads == true)
+				heldBuffers += c_retrievalQueueSize + 1;
+			if (rawWriter.IsOpen() == true)
+				heldBuffers += (c_usingPipeline ? 2 * c_pipelineQueueSize + 2 : 0) + (c_usingAsyncRecording ? c_recordingQueueSize + 1 : 0);
+
+			BufferPlanner::BufferOptions bufferOptions;
+			bufferOptions.frameRate = c_frameRate;
+			bufferOptions.numCameras = c_numCameras;
+			bufferOptions.memoryBudget = c_bufferMemoryBudget;
+			bufferOptions.targetStall = c_bufferTargetStall;
+			bufferOptions.heldBuffers = heldBuffers;
+			for (int i = 0; i < c_numCameras; i++)
+				bufferOptions.bufferSize = std::max<int64_t>(bufferOptions.bufferSize, cameras[i]->PayloadSize.GetValue());
+
+			BufferPlanner::BufferPlan bufferPlan;
+			std::string errorMessage = "";
+			if (BufferPlanner::PlanBuffers(serviceTimes, bufferOptions, bufferPlan, errorMessage) != 0)
+				throw std::runtime_error(errorMessage);
+			BufferPlanner::PrintBufferPlan(bufferPlan, cout);
+			if (bufferPlan.keepsUp == false)
+				cout << "WARNING: The processing takes longer than a frame period on average, so the buffers will run out sooner or later. Lower the frame rate or the image size." << endl;
+			if (bufferPlan.coversWorstCase == false)
+				cout << "WARNING: The memory budget of " << c_bufferMemoryBudget / (1024 * 1024) << " MB can't cover the slowest frame of the warm-up (" << bufferPlan.worstCaseBuffers << " buffers per camera). Increase c_bufferMemoryBudget." << endl;
+			else if (bufferPlan.budgetLimited == true)
+				cout << "WARNING: The memory budget of " << c_bufferMemoryBudget / (1024 * 1024) << " MB only covers a stall of " << bufferPlan.coveredStall * 1000 << " ms, not " << bufferPlan.stall * 1000 << " ms." << endl;
+
+			// The Grab Engines allocate their buffers when they are started, so they can still be changed now.
+			for (int i = 0; i < c_numCameras; i++)
+			{
+				cameras[i]->MaxNumBuffer.SetValue(bufferPlan.maxNumBuffer);
+				cameras[i]->MaxNumQueuedBuffer.SetValue(bufferPlan.maxNumQueuedBuffer);
 			}
+		}
+		// *****************************************************************************
+
+		// *********************** START THE GRAB ENGINE AND PHYSICAL CAMERA IMAGE ACQUISITION ***********************
+		// TIP: StartGrabbing() allocates the memory buffers, configures the grab engine, and then calls AcquisitionStart() on the camera hardware.
+		//      The allocation & setup can take a moment, so sequential calls start the cameras at slightly different times (even if using PTP for clock sync).
+		//      With PTP, we schedule the start instead: every camera's synchronous free run timer is set to begin at the same future instant of the synchronized clocks,
+		//      so all of the sensors expose on the same tick, no matter how long each StartGrabbing() takes.
+		//      Without PTP, we turn on the camera's trigger mode to prevent image acquisition while we call StartGrabbing(), and release the cameras afterwards.
+		//      Even though the calls to turn off the trigger modes are also sequential, they are closer in time than sequential calls to StartGrabbing().
+		if (usingScheduledStart == true)
+		{
+			std::string errorMessage = "";
+			std::vector<Camera_t*> cameraPointers;
+			for (size_t i = 0; i < cameras.size(); i++)
+				cameraPointers.push_back(cameras[i].get());
+
+			int64_t clockTime = 0;
+			if (PtpMonitor::ReadClockTime(*cameras[0], clockTime, errorMessage) != 0)
+				throw std::runtime_error(errorMessage);
+			scheduledStartTime = clockTime + (int64_t)(c_scheduledStartDelay * 1e9);
+			if (PtpMonitor::ScheduleFreeRunStart(cameraPointers, scheduledStartTime, errorMessage) != 0)
+				throw std::runtime_error(errorMessage);
+			cout << "Scheduled the cameras to start at PTP time " << scheduledStartTime << " (in " << c_scheduledStartDelay << " s)." << endl;
+		}
+		else
+		{
+			for (size_t i = 0; i < cameras.size(); i++)
+				cameras[i]->TriggerMode.SetValue(TriggerMode_On);
+		}
+
+		cout << "Starting the Frame Sources (the Pylon Grab Engines, when using the cameras)..." << endl;
+		for (int i = 0; i < c_numCameras; i++)
+		{
+			std::string errorMessage = "";
+			if (sources[i]->Start(c_imagesToGrab, errorMessage) != 0)
+				throw std::runtime_error(errorMessage);
+		}
+
+		// Pylon's Grab Engine is now ready to receive incoming images...
+
+		if (usingScheduledStart == true)
+		{
+			// If the start time passed while the Grab Engines were being started, the cameras that were started late begin on a later tick of the timer.
+			std::string errorMessage = "";
+			int64_t clockTime = 0;
+			if (PtpMonitor::ReadClockTime(*cameras[0], clockTime, errorMessage) != 0)
+				throw std::runtime_error(errorMessage);
+			if (clockTime >= scheduledStartTime)
+				cout << "WARNING: Starting the Grab Engines took longer than the scheduled start delay of " << c_scheduledStartDelay << " s. The cameras may not start together. Increase c_scheduledStartDelay." << endl;
 			else
+				cout << "The cameras will start acquiring in " << (scheduledStartTime - clockTime) / 1e9 << " s..." << endl;
+		}
+		else if (c_frameSource == FrameSource::SourceType_Pylon)
+		{
+			cout << "Releasing the Cameras to start Free-Running Acquisition..." << endl;
+			for (size_t i = 0; i < cameras.size(); i++)
+				cameras[i]->TriggerMode.SetValue(TriggerMode_Off);
+		}
+
+		if (c_frameSource == FrameSource::SourceType_Pylon)
+			cout << "Cameras are now Acquiring and Transmitting images to the Pylon Grab Engines..." << endl;
+
+		if (c_frameSource == FrameSource::SourceType_Pylon && c_usingHealthMonitor == true)
+		{
+			std::string errorMessage = "";
+			if (healthMonitor.Start(healthSource, errorMessage) != 0)
+				throw std::runtime_error(errorMessage);
+			cout << "Monitoring the Grab Engines every " << c_healthPollInterval << " s on their own thread." << endl;
+		}
+		// ***********************************************************************************************************
+
+		// *********************** RUN A GRAB LOOP TO RETRIEVE GRAB RESULTS FROM GRAB ENGINE ***********************
+		// Here we retrieve grabbed images and process them.
+		cout << "Running the \"Grab Loop\" to Retrieve and process images from the Grab Engines..." << endl;
+		cout << "Image processing kernels use: " << StitchKernels::GetInstructionSetName(StitchKernels::GetInstructionSet()) << endl;
+		cout << "We will grab " << c_imagesToGrab << " images..." << endl;
+
+		// Grabbing ends when any of the sources has delivered all of its images.
+		auto AllSourcesGrabbing = [&]() -> bool
+		{
+			if (usingRetrievalThreads == true)
+				return RetrievalThreadsRunning();
+
+			for (int i = 0; i < c_numCameras; i++)
+			{
+				if (sources[i]->IsGrabbing() == false)
+					return false;
+			}
+			return true;
+		};
+
+		if (usingRetrievalThreads == true)
+		{
+			StartRetrievalThreads();
+			cout << "Retrieving the images of each camera on its own thread." << endl;
+		}
+
+		// The retrieval threads must be joined before leaving this scope, even if grabbing throws.
+		try
+		{
+			if (c_usingPipeline == true)
 			{
-				cout << "Grab Failed: " << endl;
-				if (ptrGrabResult_Left->GrabSucceeded() == false)
+				// Each stage runs on its own thread. The queues between them are bounded, so a slow stage eventually holds up the Grab Loop
+				// (and the Grab Engines start to use up their buffers) instead of using up all the memory.
+				cout << "Using the pipeline: Grab -> Stitch -> Convert -> Write each run on their own thread." << endl;
+
+				Pipeline::SpscQueue<FrameSet> grabToStitchQueue(c_pipelineQueueSize);
+				Pipeline::SpscQueue<FrameSet> stitchToConvertQueue(c_pipelineQueueSize);
+				Pipeline::SpscQueue<FrameSet> convertToWriteQueue(c_pipelineQueueSize);
+
+				std::string stitchStageErrorMessage = "";
+				std::string convertStageErrorMessage = "";
+				std::string writeStageErrorMessage = "";
+				int stitchResult = 0;
+				int convertResult = 0;
+				int writeResult = 0;
+
+				// Pipeline.h doesn't know about pylon, so the stages pass on pylon exceptions as std::runtime_error to keep their descriptions.
+				auto KeepPylonExceptions = [](std::function<bool(FrameSet &frame)> process) -> std::function<bool(FrameSet &frame)>
+				{
+					return [process](FrameSet &frame) -> bool
+					{
+						try
+						{
+							return process(frame);
+						}
+						catch (const GenericException &e)
+						{
+							throw std::runtime_error(e.GetDescription());
+						}
+					};
+				};
+
+				std::thread stitchThread([&]() { stitchResult = Pipeline::RunStage<FrameSet>("Stitch", grabToStitchQueue, &stitchToConvertQueue, KeepPylonExceptions(StitchStage), stitchStageErrorMessage); });
+				std::thread convertThread([&]() { convertResult = Pipeline::RunStage<FrameSet>("Convert", stitchToConvertQueue, &convertToWriteQueue, KeepPylonExceptions(ConvertStage), convertStageErrorMessage); });
+				std::thread writeThread([&]() { writeResult = Pipeline::RunStage<FrameSet>("Write", convertToWriteQueue, NULL, KeepPylonExceptions(WriteStage), writeStageErrorMessage); });
+
+				// The stage threads must be joined before leaving this scope, even if grabbing throws (eg: a RetrieveResult() timeout).
+				auto StopPipeline = [&]()
 				{
-					cout << "Left Camera: " << "(" << ptrGrabResult_Left->GetErrorCode() << ") " << ptrGrabResult_Left->GetErrorDescription() << endl;
+					grabToStitchQueue.Close();
+					stitchThread.join();
+					convertThread.join();
+					writeThread.join();
+				};
+
+				try
+				{
+					int framesGrabbed = 0;
+					while (AllSourcesGrabbing())
+					{
+						FrameSet frame;
+						if (GrabStage(frame) == true)
+						{
+							if (grabToStitchQueue.Push(frame) == false)
+								break; // a stage has stopped, so there is no point in grabbing more
+
+							// Only count the frames actually grabbed: with the retrieval threads, GrabStage() returns false every time it has to wait.
+							framesGrabbed++;
+							if (c_pipelineReportInterval > 0 && framesGrabbed % c_pipelineReportInterval == 0)
+							{
+								cout << "Pipeline queue occupancy (current/peak/capacity): "
+									<< "Grab->Stitch " << grabToStitchQueue.GetSize() << "/" << grabToStitchQueue.GetHighWaterMark() << "/" << grabToStitchQueue.GetCapacity() << "  "
+									<< "Stitch->Convert " << stitchToConvertQueue.GetSize() << "/" << stitchToConvertQueue.GetHighWaterMark() << "/" << stitchToConvertQueue.GetCapacity() << "  "
+									<< "Convert->Write " << convertToWriteQueue.GetSize() << "/" << convertToWriteQueue.GetHighWaterMark() << "/" << convertToWriteQueue.GetCapacity() << endl;
+							}
+						}
+
+						ReportTelemetry();
+					}
 				}
-				if (ptrGrabResult_Right->GrabSucceeded() == false)
+				catch (...)
 				{
-					cout << "Right Camera: " << "(" << ptrGrabResult_Right->GetErrorCode() << ") " << ptrGrabResult_Right->GetErrorDescription() << endl;
+					StopPipeline();
+					throw;
 				}
+
+				// Let the stages finish the frames still in the queues.
+				StopPipeline();
+
+				if (stitchResult != 0)
+					cout << stitchStageErrorMessage << endl;
+				if (convertResult != 0)
+					cout << convertStageErrorMessage << endl;
+				if (writeResult != 0)
+					cout << writeStageErrorMessage << endl;
 			}
+			else
+			{
+				while (AllSourcesGrabbing())
+				{
+					FrameSet frame;
+					if (GrabStage(frame) == true)
+					{
+						if (StitchStage(frame) == true && ConvertStage(frame) == true)
+							WriteStage(frame);
+					}
 
-			// Since image processing takes time, we could build up a backlog of images in the Grab Engines if processing framerate is slower than camera framerate.
-			// This is one way to check if we've run out of buffers in the Grab Engines.
-			// (if the input queue is empty and the output queue is empty, then grabbing is complete. If the input queue is empty and the output queue has images, we have an underrun)
-			if ((LeftCamera.NumQueuedBuffers.GetValue() == 0 || RightCamera.NumQueuedBuffers.GetValue() == 0) && (LeftCamera.NumReadyBuffers.GetValue() != 0 && RightCamera.NumReadyBuffers.GetValue() != 0))
-					cout << "Warning! Buffer underrun detected. Increase MaxNumBuffer or make the image processing run faster." << endl;
+					ReportTelemetry();
+				}
+			}
+		}
+		catch (...)
+		{
+			StopRetrievalThreads();
+			throw;
 		}
+		StopRetrievalThreads();
 		cout << "Grabbing Complete." << endl;
+		if (healthMonitor.IsRunning() == true)
+		{
+			std::string errorMessage = "";
+			if (healthMonitor.Stop(errorMessage) != 0)
+				cout << errorMessage << endl;
+			cout << "Grab Engine health (" << healthMonitor.GetNumSamples() << " samples):" << endl;
+			healthMonitor.PrintSummary(cout);
+		}
+		if (c_usingPreview == true)
+		{
+			std::string errorMessage = "";
+			if (preview.Stop(errorMessage) != 0)
+				cout << errorMessage << endl;
+			cout << "Preview frames shown: " << preview.GetFramesShown() << " of " << preview.GetFramesOffered() << " (" << preview.GetFramesSkipped() << " skipped to keep up)" << endl;
+		}
+		cout << "Image sets: " << frameMatcher.GetSetCount() << ". Orphaned frames:";
+		for (int i = 0; i < c_numCameras; i++)
+			cout << " " << c_cameras[i].name << ": " << frameMatcher.GetOrphanCount(i);
+		cout << endl;
+
+		// Let the recorder finish the frames still in its queue before the video files are closed.
+		if (c_usingAsyncRecording == true && (c_recordingToMp4 == true || c_recordingToAvi == true || rawWriter.IsOpen() == true))
+		{
+			std::string errorMessage = "";
+			if (asyncRecorder.Stop(errorMessage) != 0)
+				cout << errorMessage << endl;
+			cout << "Recorded frames: " << asyncRecorder.GetFramesWritten() << ". Dropped frames: " << asyncRecorder.GetFramesDropped() << ". Recording queue peak: " << asyncRecorder.GetHighWaterMark() << "/" << asyncRecorder.GetCapacity() << endl;
+		}
+		if (rawWriter.IsOpen() == true)
+		{
+			cout << "Raw frames recorded: " << rawWriter.GetFrameCount() << " (" << rawWriter.GetDataSize() / (1024 * 1024) << " MB)" << endl;
+			std::string errorMessage = "";
+			if (rawWriter.Close(errorMessage) != 0)
+				cout << errorMessage << endl;
+		}
 #ifdef PYLON_LINUX_BUILD
+		if (c_recordingToAvi == true && c_usingParallelMjpeg == true)
+		{
+			std::string errorMessage = "";
+			if (mjpegWriter.Close(errorMessage) != 0)
+				cout << errorMessage << endl;
+			cout << "MJPEG frames encoded: " << mjpegWriter.GetFramesWritten() << " at " << mjpegWriter.GetEncodedFrameRate() << " fps. Reorder buffer peak: " << mjpegWriter.GetReorderHighWaterMark() << "/" << mjpegWriter.GetCapacity() << ". Thread utilization:";
+			std::vector<double> utilization = mjpegWriter.GetWorkerUtilization();
+			for (size_t i = 0; i < utilization.size(); i++)
+				cout << " " << (int)(utilization[i] * 100 + 0.5) << "%";
+			cout << endl;
+		}
 		cvVideoCreator.release();
 #endif
+
+		if (c_journalFileName != "")
+		{
+			std::string errorMessage = "";
+			if (journal.Close(errorMessage) != 0)
+				cout << errorMessage << endl;
+			cout << "Journal records written: " << journal.GetRecordsWritten() << ". Dropped: " << journal.GetRecordsDropped() << endl;
+		}
+
+		// Where the frame budget went, over the whole run.
+		std::string telemetryErrorMessage = "";
+		if (telemetry.Close(telemetryErrorMessage) != 0)
+			cout << telemetryErrorMessage << endl;
+		cout << endl << "Stage timings:" << endl;
+		telemetry.PrintSummary(cout);
+		if (c_usingSyncAnalytics == true)
+		{
+			cout << endl;
+			syncMonitor.PrintSummary(cout);
+		}
 		// *********************************************************************************************************
 	}
 	catch (const GenericException &e)
@@ -0,0 +1,94 @@
+/*
+Checks BandwidthPlanner::PlanBandwidth() without cameras: staggered frame transmission delays on a shared link, the target utilization,
+and an over-subscribed link.
+
+Usage: BandwidthPlannerCheck
+  Prints each check (and the plans) and returns 0 if all of them passed.
+
+Author: mbreit
+
+*/
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <BandwidthPlanner.h>
+
+// Namespace for using cout.
+using namespace std;
+
+static int failures = 0;
+
+static void Check(bool passed, const std::string &description)
+{
+	cout << (passed ? "PASS: " : "FAIL: ") << description << endl;
+	if (passed == false)
+		failures++;
+}
+
+// Two Mono8 cameras of the given size and frame rate, on the given links.
+static std::vector<BandwidthPlanner::CameraStream> MakeStreams(int width, int height, double frameRate, int leftLink, int rightLink)
+{
+	std::vector<BandwidthPlanner::CameraStream> streams(2);
+	streams[0].name = "Left";
+	streams[0].link = leftLink;
+	streams[1].name = "Right";
+	streams[1].link = rightLink;
+	for (size_t i = 0; i < streams.size(); i++)
+	{
+		streams[i].width = width;
+		streams[i].height = height;
+		streams[i].frameRate = frameRate;
+	}
+	return streams;
+}
+
+int main(int /*argc*/, char* /*argv*/[])
+{
+	BandwidthPlanner::PlannerOptions options;
+	options.targetUtilization = 0.9;
+	options.synchronizedCameras = true;
+	std::string errorMessage = "";
+
+	// Two synchronized 1920x1200 cameras at 20 fps share a GigE link: about 97 MB/s on the wire, of the 112.5 MB/s the target allows.
+	{
+		BandwidthPlanner::BandwidthPlan plan;
+		int status = BandwidthPlanner::PlanBandwidth(MakeStreams(1920, 1200, 20, 0, 0), options, plan, errorMessage);
+		BandwidthPlanner::PrintBandwidthPlan(plan, cout);
+
+		Check(status == 0 && plan.fits == true, "Two cameras fit on a shared link.");
+		Check(plan.links.size() == 1 && plan.links[0].numCameras == 2, "Both cameras are on the same link.");
+		Check(plan.links.size() == 1 && plan.links[0].utilization <= options.targetUtilization, "The link stays under the target utilization.");
+
+		const BandwidthPlanner::StreamSettings &left = plan.settings[0];
+		const BandwidthPlanner::StreamSettings &right = plan.settings[1];
+		Check(left.frameTransmissionDelay != right.frameTransmissionDelay, "The cameras get different GevSCFTD values.");
+		const BandwidthPlanner::StreamSettings &first = (left.transmissionStart <= right.transmissionStart) ? left : right;
+		const BandwidthPlanner::StreamSettings &second = (left.transmissionStart <= right.transmissionStart) ? right : left;
+		Check(second.transmissionStart >= first.transmissionStart + first.transmissionTime, "The second camera starts sending after the first one has finished.");
+		Check(second.transmissionStart + second.transmissionTime <= plan.links[0].framePeriod, "Both images are sent within one frame period.");
+	}
+
+	// The same cameras on links of their own don't have to take turns.
+	{
+		BandwidthPlanner::BandwidthPlan plan;
+		int status = BandwidthPlanner::PlanBandwidth(MakeStreams(1920, 1200, 20, 0, 1), options, plan, errorMessage);
+
+		Check(status == 0 && plan.fits == true && plan.links.size() == 2, "Two cameras fit on links of their own.");
+		Check(plan.settings[0].frameTransmissionDelay == 0 && plan.settings[1].frameTransmissionDelay == 0, "Cameras on links of their own send right away.");
+	}
+
+	// At 30 fps the two cameras would need about 145 MB/s of the 125 MB/s link.
+	{
+		BandwidthPlanner::BandwidthPlan plan;
+		int status = BandwidthPlanner::PlanBandwidth(MakeStreams(1920, 1200, 30, 0, 0), options, plan, errorMessage);
+		BandwidthPlanner::PrintBandwidthPlan(plan, cout);
+
+		Check(status == 1 && plan.fits == false, "An over-subscribed link is reported (" + errorMessage + ").");
+		Check(plan.links.size() == 1 && plan.links[0].fits == false && plan.links[0].utilization > options.targetUtilization, "The link is marked as over budget.");
+	}
+
+	cout << ((failures == 0) ? "All checks passed." : std::to_string(failures) + " check(s) failed.") << endl;
+	return (failures == 0) ? 0 : 1;
+}
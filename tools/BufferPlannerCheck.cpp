@@ -0,0 +1,107 @@
+/*
+Checks BufferPlanner::PlanBuffers() without cameras: a plan within the memory budget, a plan limited by the budget,
+processing that doesn't keep up with the frame rate, and a slowest frame that takes longer than the target stall.
+
+Usage: BufferPlannerCheck
+  Prints each check (and the plans) and returns 0 if all of them passed.
+
+Author: mbreit
+
+*/
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+#include <BufferPlanner.h>
+
+// Namespace for using cout.
+using namespace std;
+
+static int failures = 0;
+
+static void Check(bool passed, const std::string &description)
+{
+	cout << (passed ? "PASS: " : "FAIL: ") << description << endl;
+	if (passed == false)
+		failures++;
+}
+
+// A warm-up of 100 frames that each took serviceTime seconds, except for one that took slowestTime.
+static BufferPlanner::ServiceTimeEstimator MakeServiceTimes(double serviceTime, double slowestTime)
+{
+	BufferPlanner::ServiceTimeEstimator serviceTimes;
+	for (int i = 0; i < 100; i++)
+		serviceTimes.AddSample((i == 50) ? slowestTime : serviceTime);
+	return serviceTimes;
+}
+
+int main(int /*argc*/, char* /*argv*/[])
+{
+	// Two 1920x1200 Mono8 cameras at 30 fps, with a target stall of 0.5 s: 15 frames pile up, plus the one being filled.
+	BufferPlanner::BufferOptions options;
+	options.frameRate = 30;
+	options.bufferSize = 1920 * 1200;
+	options.numCameras = 2;
+	options.memoryBudget = 1024ull * 1024 * 1024;
+	options.targetStall = 0.5;
+	options.heldBuffers = 4;
+	std::string errorMessage = "";
+
+	// Fast processing with plenty of memory: the target stall sets the number of buffers.
+	{
+		BufferPlanner::BufferPlan plan;
+		int status = BufferPlanner::PlanBuffers(MakeServiceTimes(0.010, 0.020), options, plan, errorMessage);
+		BufferPlanner::PrintBufferPlan(plan, cout);
+
+		Check(status == 0 && plan.keepsUp == true && plan.budgetLimited == false, "Plans within the budget for processing that keeps up.");
+		Check(plan.maxNumBuffer == 4 + 15 + 1 && plan.maxNumQueuedBuffer == plan.maxNumBuffer, "The held buffers plus the target stall's frames plus one (" + std::to_string(plan.maxNumBuffer) + ").");
+		Check(plan.coveredStall >= options.targetStall && plan.coversWorstCase == true, "Covers the target stall and the slowest frame.");
+	}
+
+	// Only room for 10 buffers per camera in the budget.
+	{
+		BufferPlanner::BufferOptions smallBudget = options;
+		smallBudget.memoryBudget = 10ull * options.bufferSize * options.numCameras;
+		BufferPlanner::BufferPlan plan;
+		int status = BufferPlanner::PlanBuffers(MakeServiceTimes(0.010, 0.020), smallBudget, plan, errorMessage);
+		BufferPlanner::PrintBufferPlan(plan, cout);
+
+		Check(status == 0 && plan.budgetLimited == true && plan.maxNumBuffer == 10, "A budget too small for the target stall limits the buffers (" + std::to_string(plan.maxNumBuffer) + ").");
+		Check(plan.memory <= smallBudget.memoryBudget && plan.coveredStall < smallBudget.targetStall, "Stays within the budget, and reports the shorter stall it covers.");
+	}
+
+	// Processing takes 40 ms per frame, longer than the 33 ms frame period.
+	{
+		BufferPlanner::BufferPlan plan;
+		int status = BufferPlanner::PlanBuffers(MakeServiceTimes(0.040, 0.050), options, plan, errorMessage);
+
+		Check(status == 0 && plan.keepsUp == false, "Processing slower than the frame rate is reported (keepsUp is false), but still planned.");
+	}
+
+	// One frame of the warm-up took 2 s (eg: a disk hiccup), far longer than the 0.5 s target stall.
+	{
+		BufferPlanner::BufferPlan plan;
+		int status = BufferPlanner::PlanBuffers(MakeServiceTimes(0.010, 2.0), options, plan, errorMessage);
+		BufferPlanner::PrintBufferPlan(plan, cout);
+
+		Check(status == 0 && plan.stall >= 2.0 && plan.maxNumBuffer >= plan.worstCaseBuffers && plan.coversWorstCase == true, "A slowest frame beyond the target stall sets the number of buffers (" + std::to_string(plan.maxNumBuffer) + ").");
+
+		BufferPlanner::BufferOptions smallBudget = options;
+		smallBudget.memoryBudget = 30ull * options.bufferSize * options.numCameras;
+		status = BufferPlanner::PlanBuffers(MakeServiceTimes(0.010, 2.0), smallBudget, plan, errorMessage);
+		Check(status == 0 && plan.budgetLimited == true && plan.coversWorstCase == false, "Reports when the budget can't cover the slowest frame (coversWorstCase is false).");
+	}
+
+	// Invalid options and a missing warm-up.
+	{
+		BufferPlanner::BufferOptions noFrameRate = options;
+		noFrameRate.frameRate = 0;
+		BufferPlanner::BufferPlan plan;
+		Check(BufferPlanner::PlanBuffers(MakeServiceTimes(0.010, 0.020), noFrameRate, plan, errorMessage) == 1, "Returns 1 without a frame rate.");
+		Check(BufferPlanner::PlanBuffers(BufferPlanner::ServiceTimeEstimator(), options, plan, errorMessage) == 1, "Returns 1 without service times.");
+	}
+
+	cout << ((failures == 0) ? "All checks passed." : std::to_string(failures) + " check(s) failed.") << endl;
+	return (failures == 0) ? 0 : 1;
+}
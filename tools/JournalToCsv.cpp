@@ -0,0 +1,56 @@
+/*
+Converts a metadata journal (see MetadataJournal.h) written by the sample program to .csv: one line per image of each camera,
+with its framecounter, timestamp, when the host retrieved it, and whether it was grabbed.
+
+Usage: JournalToCsv journal.bin [journal.csv]
+  Without a .csv file name, the .csv is written to the console.
+
+Author: mbreit
+
+*/
+
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include <MetadataJournal.h>
+
+// Namespace for using cout.
+using namespace std;
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2 || argc > 3)
+	{
+		cerr << "Usage: JournalToCsv journal.bin [journal.csv]" << endl;
+		return 1;
+	}
+
+	MetadataJournal::Reader reader;
+	std::string errorMessage = "";
+	if (reader.Open(argv[1], errorMessage) != 0)
+	{
+		cerr << errorMessage << endl;
+		return 1;
+	}
+
+	int result = 0;
+	if (argc == 3)
+	{
+		std::ofstream file(argv[2]);
+		if (file.is_open() == false)
+		{
+			cerr << "ERROR: Could not create " << argv[2] << endl;
+			return 1;
+		}
+		result = MetadataJournal::WriteCsv(reader, file, errorMessage);
+		if (result == 0)
+			cerr << reader.GetRecordCount() << " records written to " << argv[2] << endl;
+	}
+	else
+		result = MetadataJournal::WriteCsv(reader, cout, errorMessage);
+
+	if (result != 0)
+		cerr << errorMessage << endl;
+	return result;
+}
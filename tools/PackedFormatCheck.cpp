@@ -0,0 +1,184 @@
+/*
+Checks the packed pixel format kernels of StitchKernels.h without cameras or pylon: UnpackRow() (and each of its scalar and SIMD versions)
+against a reference unpacker that reads the pixels bit by bit, and CopyBitsLsbFirst() against a reference bit copy.
+Covers Mono10p/Mono12p (least significant bits first) and the GigE Mono10Packed/Mono12Packed layouts, at odd and even widths.
+
+Usage: PackedFormatCheck
+  Prints each check and returns 0 if all of them passed.
+
+Author: mbreit
+
+*/
+
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <StitchKernels.h>
+
+// Namespace for using cout.
+using namespace std;
+
+static int failures = 0;
+
+static void Check(bool passed, const std::string &description)
+{
+	cout << (passed ? "PASS: " : "FAIL: ") << description << endl;
+	if (passed == false)
+		failures++;
+}
+
+// Bit n of a row, counting the least significant bit of the first byte as bit 0.
+static int GetBit(const std::vector<uint8_t> &row, size_t n)
+{
+	return (row[n / 8] >> (n % 8)) & 1;
+}
+
+// The bytes one row of width pixels takes up.
+static size_t GetPackedRowBytes(StitchKernels::EPacking packing, int width)
+{
+	if (packing == StitchKernels::Packing_10p)
+		return (10 * (size_t)width + 7) / 8;
+	if (packing == StitchKernels::Packing_12p)
+		return (12 * (size_t)width + 7) / 8;
+	return 3 * (((size_t)width + 1) / 2); // the GigE formats always use whole groups of 2 pixels
+}
+
+// Reads pixel x straight from the layout of the format, one bit at a time.
+static uint16_t ReferenceUnpack(StitchKernels::EPacking packing, const std::vector<uint8_t> &row, int x)
+{
+	uint16_t value = 0;
+	switch (packing)
+	{
+	case StitchKernels::Packing_10p:
+	case StitchKernels::Packing_12p:
+	{
+		// the pixels follow each other without gaps, least significant bit first
+		int bits = (packing == StitchKernels::Packing_10p) ? 10 : 12;
+		for (int b = 0; b < bits; b++)
+			value |= (uint16_t)(GetBit(row, (size_t)x * bits + b) << b);
+		return value;
+	}
+	case StitchKernels::Packing_10Packed:
+	case StitchKernels::Packing_12Packed:
+	{
+		// groups of 3 bytes: the upper 8 bits of the first pixel, the lower bits of both pixels, the upper 8 bits of the second pixel
+		int lowBits = (packing == StitchKernels::Packing_10Packed) ? 2 : 4;
+		size_t group = 3 * ((size_t)x / 2);
+		uint8_t upper = (x % 2 == 0) ? row[group] : row[group + 2];
+		int lowShift = (x % 2 == 0) ? 0 : 4;
+		for (int b = 0; b < lowBits; b++)
+			value |= (uint16_t)(((row[group + 1] >> (lowShift + b)) & 1) << b);
+		return (uint16_t)(value | (upper << lowBits));
+	}
+	default:
+		return 0;
+	}
+}
+
+static std::string GetPackingName(StitchKernels::EPacking packing)
+{
+	switch (packing)
+	{
+	case StitchKernels::Packing_10p: return "10p";
+	case StitchKernels::Packing_12p: return "12p";
+	case StitchKernels::Packing_10Packed: return "10Packed";
+	case StitchKernels::Packing_12Packed: return "12Packed";
+	default: return "None";
+	}
+}
+
+int main(int /*argc*/, char* /*argv*/[])
+{
+	std::mt19937 random(1234);
+	std::uniform_int_distribution<int> randomByte(0, 255);
+
+	// odd and even widths, below and above the 8 pixels the SIMD versions take at a time, and a typical sensor width
+	const int widths[] = { 1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 32, 33, 63, 64, 65, 641, 1920, 1921 };
+	const StitchKernels::EPacking packings[] = { StitchKernels::Packing_10p, StitchKernels::Packing_12p, StitchKernels::Packing_10Packed, StitchKernels::Packing_12Packed };
+
+	// UnpackRow() picks the best version for this CPU. The versions for the other instruction sets are checked on their own as well.
+	typedef std::function<void(const uint8_t*, uint16_t*, int)> Unpacker;
+	for (StitchKernels::EPacking packing : packings)
+	{
+		std::vector<std::pair<std::string, Unpacker>> unpackers;
+		unpackers.push_back(std::make_pair(std::string("UnpackRow"), [packing](const uint8_t *pSource, uint16_t *pDestination, int width) { StitchKernels::UnpackRow(packing, pSource, pDestination, width); }));
+		if (packing == StitchKernels::Packing_10p)
+			unpackers.push_back(std::make_pair(std::string("Unpack10pRow_Scalar"), Unpacker(StitchKernels::Unpack10pRow_Scalar)));
+		if (packing == StitchKernels::Packing_12p)
+			unpackers.push_back(std::make_pair(std::string("Unpack12pRow_Scalar"), Unpacker(StitchKernels::Unpack12pRow_Scalar)));
+#ifdef STITCHKERNELS_X86
+		if (packing == StitchKernels::Packing_10p && StitchKernels::GetInstructionSet() >= StitchKernels::InstructionSet_SSSE3)
+			unpackers.push_back(std::make_pair(std::string("Unpack10pRow_SSSE3"), Unpacker(StitchKernels::Unpack10pRow_SSSE3)));
+		if (packing == StitchKernels::Packing_12p && StitchKernels::GetInstructionSet() >= StitchKernels::InstructionSet_SSSE3)
+			unpackers.push_back(std::make_pair(std::string("Unpack12pRow_SSSE3"), Unpacker(StitchKernels::Unpack12pRow_SSSE3)));
+#endif
+
+		for (size_t u = 0; u < unpackers.size(); u++)
+		{
+			int mismatchedWidths = 0;
+			std::string firstMismatch = "";
+			for (int width : widths)
+			{
+				// random bytes cover every bit pattern, and the row is exactly as long as the format needs (no padding to read into)
+				std::vector<uint8_t> row(GetPackedRowBytes(packing, width));
+				for (size_t i = 0; i < row.size(); i++)
+					row[i] = (uint8_t)randomByte(random);
+
+				std::vector<uint16_t> unpacked(width, 0xFFFF);
+				unpackers[u].second(row.data(), unpacked.data(), width);
+
+				for (int x = 0; x < width; x++)
+				{
+					if (unpacked[x] != ReferenceUnpack(packing, row, x))
+					{
+						if (mismatchedWidths == 0)
+							firstMismatch = " (first at width " + std::to_string(width) + ", pixel " + std::to_string(x) + ": " + std::to_string(unpacked[x]) + " instead of " + std::to_string(ReferenceUnpack(packing, row, x)) + ")";
+						mismatchedWidths++;
+						break;
+					}
+				}
+			}
+			Check(mismatchedWidths == 0, unpackers[u].first + " unpacks " + GetPackingName(packing) + " like the reference" + firstMismatch + ".");
+		}
+	}
+
+	// CopyBitsLsbFirst() appends the pixels of one image to a packed row at any bit offset (eg: the right image of a Mono10p pair of odd width).
+	{
+		int mismatches = 0;
+		for (int offset = 0; offset < 8; offset++)
+		{
+			for (size_t numBits = 1; numBits <= 200; numBits++)
+			{
+				std::vector<uint8_t> source((numBits + 7) / 8);
+				for (size_t i = 0; i < source.size(); i++)
+					source[i] = (uint8_t)randomByte(random);
+				std::vector<uint8_t> destination((offset + numBits + 7) / 8);
+				for (size_t i = 0; i < destination.size(); i++)
+					destination[i] = (uint8_t)randomByte(random);
+				std::vector<uint8_t> before = destination;
+
+				StitchKernels::CopyBitsLsbFirst(source.data(), destination.data(), offset, numBits);
+
+				// the bits below the offset are kept, and the copied bits follow them
+				for (int b = 0; b < offset; b++)
+				{
+					if (GetBit(destination, b) != GetBit(before, b))
+						mismatches++;
+				}
+				for (size_t b = 0; b < numBits; b++)
+				{
+					if (GetBit(destination, offset + b) != GetBit(source, b))
+						mismatches++;
+				}
+			}
+		}
+		Check(mismatches == 0, "CopyBitsLsbFirst copies the bits at every offset and keeps the bits below it (" + std::to_string(mismatches) + " wrong bits).");
+	}
+
+	cout << ((failures == 0) ? "All checks passed." : std::to_string(failures) + " check(s) failed.") << endl;
+	return (failures == 0) ? 0 : 1;
+}
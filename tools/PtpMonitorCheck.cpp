@@ -0,0 +1,160 @@
+/*
+Checks the convergence logic of PtpMonitor.h without cameras, by feeding PtpMonitor::ConvergenceMonitor scripted clock samples.
+
+Usage: PtpMonitorCheck
+  Prints each check and returns 0 if all of them passed.
+
+Author: mbreit
+
+*/
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <PtpMonitor.h>
+
+// Namespace for using cout.
+using namespace std;
+
+// Plays back one scripted sample of every clock per ReadSamples(). Keeps repeating the last one when the script runs out.
+class ScriptedClockSource : public PtpMonitor::IClockSource
+{
+private:
+	std::vector<std::vector<PtpMonitor::ClockSample>> m_script;
+	size_t m_next = 0;
+	int m_failAt = -1;
+
+public:
+	// offsets of each clock per sample, in ns. A status of "Listening" is used for offsets of INT64_MIN.
+	void AddSample(const std::vector<int64_t> &offsets)
+	{
+		std::vector<PtpMonitor::ClockSample> samples(offsets.size());
+		for (size_t i = 0; i < offsets.size(); i++)
+		{
+			samples[i].status = (offsets[i] == INT64_MIN) ? "Listening" : ((i == 0) ? "Master" : "Slave");
+			samples[i].synchronized = (offsets[i] != INT64_MIN);
+			samples[i].offsetFromMaster = (offsets[i] == INT64_MIN) ? 0 : offsets[i];
+		}
+		m_script.push_back(samples);
+	}
+
+	// ReadSamples() fails from this sample on (eg: a camera was unplugged)
+	void FailAt(int sampleIndex)
+	{
+		m_failAt = sampleIndex;
+	}
+
+	int GetNumClocks()
+	{
+		return m_script.empty() ? 0 : (int)m_script[0].size();
+	}
+
+	std::string GetName(int clockIndex)
+	{
+		return "Clock " + std::to_string(clockIndex);
+	}
+
+	int ReadSamples(std::vector<PtpMonitor::ClockSample> &samples, std::string &errorMessage)
+	{
+		if (m_failAt >= 0 && (int)m_next >= m_failAt)
+		{
+			errorMessage = "ERROR: ReadSamples(): scripted failure.";
+			return 1;
+		}
+		samples = m_script[(m_next < m_script.size()) ? m_next : m_script.size() - 1];
+		m_next++;
+		return 0;
+	}
+};
+
+static int failures = 0;
+
+static void Check(bool passed, const std::string &description)
+{
+	cout << (passed ? "PASS: " : "FAIL: ") << description << endl;
+	if (passed == false)
+		failures++;
+}
+
+int main(int /*argc*/, char* /*argv*/[])
+{
+	const int64_t listening = INT64_MIN;
+	std::string errorMessage = "";
+
+	PtpMonitor::ConvergenceMonitor monitor;
+	monitor.SetOffsetThreshold(1000);
+	monitor.SetRequiredSamples(3);
+	monitor.SetPollInterval(0.0);
+	monitor.SetTimeout(1.0);
+
+	// The slave is still listening, then settles, with one spike that must restart the count of samples in range.
+	{
+		ScriptedClockSource source;
+		source.AddSample({ 0, listening });
+		source.AddSample({ 0, listening });
+		source.AddSample({ 0, 250000 });
+		source.AddSample({ 0, -40000 });
+		source.AddSample({ 0, 800 });
+		source.AddSample({ 0, -600 });
+		source.AddSample({ 0, 5000 }); // spike
+		source.AddSample({ 0, 400 });
+		source.AddSample({ 0, -300 });
+		source.AddSample({ 0, 200 });
+		source.AddSample({ 0, 999999 }); // must never be read
+
+		PtpMonitor::ConvergenceResult result;
+		int callbacks = 0;
+		monitor.SetSampleCallback([&](int /*sampleIndex*/, const std::vector<PtpMonitor::ClockSample> & /*samples*/) { callbacks++; });
+		int status = monitor.WaitForConvergence(source, result, errorMessage);
+		monitor.SetSampleCallback(nullptr);
+
+		Check(status == 0 && result.converged == true, "Converges once the offsets stay in range.");
+		Check(result.numSamples == 10, "Needs 3 samples in a row in range, after the spike (took " + std::to_string(result.numSamples) + ").");
+		Check(result.maxOffset == 200, "Reports the largest offset of the last sample (" + std::to_string(result.maxOffset) + " ns).");
+		Check(callbacks == result.numSamples, "Calls the sample callback for every sample.");
+	}
+
+	// A clock that is listening has an offset of 0, which must not count as in range.
+	{
+		ScriptedClockSource source;
+		source.AddSample({ 0, listening });
+
+		PtpMonitor::ConvergenceResult result;
+		monitor.SetTimeout(0.05);
+		int status = monitor.WaitForConvergence(source, result, errorMessage);
+		monitor.SetTimeout(1.0);
+
+		Check(status == 0 && result.converged == false, "Times out while a clock is still listening.");
+		Check(result.seconds >= 0.05, "Waits until the timeout.");
+	}
+
+	// An offset just above the threshold never converges.
+	{
+		ScriptedClockSource source;
+		source.AddSample({ 0, 1001, -20 });
+
+		PtpMonitor::ConvergenceResult result;
+		monitor.SetTimeout(0.05);
+		int status = monitor.WaitForConvergence(source, result, errorMessage);
+		monitor.SetTimeout(1.0);
+
+		Check(status == 0 && result.converged == false && result.maxOffset == 1001, "Times out while one clock is just above the threshold.");
+	}
+
+	// The clocks can't be read.
+	{
+		ScriptedClockSource source;
+		source.AddSample({ 0, 100 });
+		source.FailAt(1);
+
+		PtpMonitor::ConvergenceResult result;
+		int status = monitor.WaitForConvergence(source, result, errorMessage);
+
+		Check(status == 1 && errorMessage.empty() == false, "Returns 1 when the clocks can't be read.");
+	}
+
+	cout << ((failures == 0) ? "All checks passed." : std::to_string(failures) + " check(s) failed.") << endl;
+	return (failures == 0) ? 0 : 1;
+}
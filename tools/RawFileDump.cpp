@@ -0,0 +1,86 @@
+/*
+Lists the stereo frames of a raw recording (see RawStereoFile.h) written by the sample program: the framecounter, timestamp and size
+of the left and right image of each frame, and how far apart the two timestamps are.
+Given a timestamp, it only lists the frame whose left image was taken closest to it (eg: to find the frame of an event logged elsewhere).
+
+Usage: RawFileDump Video.stereoraw [timestamp]
+  The timestamp is in camera ticks (ns with PTP), like the timestamps in the list.
+
+Author: mbreit
+
+*/
+
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include <RawStereoFile.h>
+
+// Namespace for using cout.
+using namespace std;
+
+static void PrintFrame(uint64_t frameNumber, const RawStereoFile::Frame &frame)
+{
+	cout << frameNumber << ","
+		<< frame.left.frameCounter << "," << frame.left.timestamp << "," << frame.left.width << "x" << frame.left.height << "," << frame.left.size << ","
+		<< frame.right.frameCounter << "," << frame.right.timestamp << "," << frame.right.width << "x" << frame.right.height << "," << frame.right.size << ","
+		<< frame.right.timestamp - frame.left.timestamp << endl;
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2 || argc > 3)
+	{
+		cerr << "Usage: RawFileDump Video.stereoraw [timestamp]" << endl;
+		return 1;
+	}
+
+	RawStereoFile::Reader reader;
+	std::string errorMessage = "";
+	if (reader.Open(argv[1], errorMessage) != 0)
+	{
+		cerr << errorMessage << endl;
+		return 1;
+	}
+
+	int64_t timestamp = 0;
+	if (argc == 3)
+	{
+		char *pEnd = NULL;
+		timestamp = strtoll(argv[2], &pEnd, 10);
+		if (pEnd == argv[2] || *pEnd != '\0')
+		{
+			cerr << "ERROR: " << argv[2] << " is not a timestamp" << endl;
+			return 1;
+		}
+	}
+
+	cout << "Frame,LeftFramecounter,LeftTimestamp,LeftSize,LeftBytes,RightFramecounter,RightTimestamp,RightSize,RightBytes,TimestampDifference" << endl;
+
+	RawStereoFile::Frame frame;
+	if (argc == 3)
+	{
+		uint64_t frameNumber = 0;
+		if (reader.FindFrame(timestamp, frameNumber) == false || reader.GetFrame(frameNumber, frame) == false)
+		{
+			cerr << "ERROR: " << argv[1] << " has no frames" << endl;
+			return 1;
+		}
+		PrintFrame(frameNumber, frame);
+		cerr << "Closest frame to " << timestamp << ": " << frameNumber << " (" << frame.left.timestamp - timestamp << " ticks away)" << endl;
+		return 0;
+	}
+
+	for (uint64_t frameNumber = 0; frameNumber < reader.GetFrameCount(); frameNumber++)
+	{
+		if (reader.GetFrame(frameNumber, frame) == false)
+		{
+			cerr << "ERROR: Could not read frame " << frameNumber << " of " << argv[1] << endl;
+			return 1;
+		}
+		PrintFrame(frameNumber, frame);
+	}
+	cerr << reader.GetFrameCount() << " frames in " << argv[1] << endl;
+	return 0;
+}